@@ -0,0 +1,59 @@
+# Compiles two copies of a map two different ways and checks with bspdiff that
+# both wrote the same lumps. Exits with 0 if they match, 1 if they don't.
+#
+# usage: perl comparecompile.pl [-lump <n>]... [-skiplump <n>]... <map.bsp> "<command 1>" "<command 2>"
+#
+# Each command is run with the name of its copy of the map appended. The map's
+# .prt file is copied along with it so vvis can be run on the copies.
+#
+# vvis, SIMD vs. scalar portal clipping:
+#	perl comparecompile.pl -lump 4 maps\foo.bsp "vvis" "vvis -nosimdclip"
+# vvis, threaded vs. -distribute:
+#	perl comparecompile.pl -lump 4 maps\foo.bsp "vvis" "vvis -distribute 4"
+# vrad, threaded vs. -distribute (lighting, HDR lighting, leaf ambient and pakfile):
+#	perl comparecompile.pl -lump 8 -lump 53 -lump 51 -lump 52 -lump 55 -lump 56 -lump 40 maps\foo.bsp "vrad" "vrad -distribute 4"
+# vrad, old build vs. new build:
+#	perl comparecompile.pl -lump 8 -lump 53 -lump 51 -lump 52 -lump 55 -lump 56 maps\foo.bsp "\old\bin\vrad" "vrad"
+
+use File::Copy;
+
+@lumpargs = ();
+while( scalar( @ARGV ) && ( $ARGV[0] eq "-lump" || $ARGV[0] eq "-skiplump" ) )
+{
+	push @lumpargs, shift, shift;
+}
+
+if( scalar( @ARGV ) != 3 )
+{
+	die "usage: perl comparecompile.pl [-lump <n>]... [-skiplump <n>]... <map.bsp> \"<command 1>\" \"<command 2>\"\n";
+}
+
+$bspname = shift;
+@commands = ( shift, shift );
+
+$bspname =~ s/\.bsp$//i;
+-e "$bspname.bsp" || die "$bspname.bsp not found\n";
+
+for( $i = 0; $i < 2; $i++ )
+{
+	$copyname = $bspname . "_compare" . ( $i + 1 );
+	copy( "$bspname.bsp", "$copyname.bsp" ) || die "can't copy $bspname.bsp to $copyname.bsp: $!\n";
+	if( -e "$bspname.prt" )
+	{
+		copy( "$bspname.prt", "$copyname.prt" ) || die "can't copy $bspname.prt to $copyname.prt: $!\n";
+	}
+
+	print "$commands[$i] $copyname\n";
+	if( system( "$commands[$i] $copyname" ) != 0 )
+	{
+		die "\"$commands[$i] $copyname\" failed\n";
+	}
+}
+
+$result = system( "bspdiff", @lumpargs, "${bspname}_compare1.bsp", "${bspname}_compare2.bsp" );
+if( $result == -1 )
+{
+	die "can't run bspdiff: $!\n";
+}
+
+exit( ( $result >> 8 ) == 0 ? 0 : 1 );
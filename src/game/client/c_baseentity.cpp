@@ -76,6 +76,7 @@ void cc_cl_interp_all_changed( IConVar *pConVar, const char *pOldString, float f
 static ConVar  cl_extrapolate( "cl_extrapolate", "1", FCVAR_CHEAT, "Enable/disable extrapolation if interpolation history runs out." );
 static ConVar  cl_interp_npcs( "cl_interp_npcs", "0.0", FCVAR_USERINFO, "Interpolate NPC positions starting this many seconds in past (or cl_interp, if greater)" );  
 static ConVar  cl_interp_all( "cl_interp_all", "0", 0, "Disable interpolation list optimizations.", 0, 0, 0, 0, cc_cl_interp_all_changed );
+static ConVar  cl_interp_batch( "cl_interp_batch", "1", 0, "Blend the float and Vector interpolated vars of all entities in one SIMD pass." );
 ConVar  r_drawmodeldecals( "r_drawmodeldecals", "1" );
 extern ConVar	cl_showerror;
 int C_BaseEntity::m_nPredictionRandomSeed = -1;
@@ -887,6 +888,26 @@ inline int C_BaseEntity::Interp_Interpolate( VarMapping_t *map, float currentTim
 	return bNoMoreChanges;
 }
 
+void C_BaseEntity::Interp_QueueBatchedInterpolate( VarMapping_t *map, float currentTime )
+{
+	// Only entities that will interpolate at exactly this time. Anything else
+	// just won't find its results and interpolates the regular way.
+	if ( IsFollowingEntity() || !IsInterpolationEnabled() || GetPredictable() || IsClientCreated() )
+		return;
+
+	if ( currentTime < map->m_lastInterpolationTime )
+		return;
+
+	for ( int i = 0; i < map->m_nInterpolatedEntries; i++ )
+	{
+		VarMapEntry_t *e = &map->m_Entries[ i ];
+		if ( e->m_bNeedsToInterpolate )
+		{
+			e->watcher->QueueBatchedInterpolate( currentTime );
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Functions.
 //-----------------------------------------------------------------------------
@@ -3090,6 +3111,21 @@ void C_BaseEntity::ProcessInterpolatedList()
 {
 	CheckInterpolatedVarParanoidMeasurement();
 
+#ifndef INTERPOLATEDVAR_PARANOID_MEASUREMENT
+	// Blend everything the batch can handle up front, the Interpolate() calls below pick up the results.
+	bool bBatch = cl_interp_batch.GetBool();
+	if ( bBatch )
+	{
+		g_InterpolationBatch.Begin();
+		for ( int iCur=g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur=g_InterpolationList.Next( iCur ) )
+		{
+			C_BaseEntity *pCur = g_InterpolationList[iCur];
+			pCur->Interp_QueueBatchedInterpolate( pCur->GetVarMapping(), gpGlobals->curtime );
+		}
+		g_InterpolationBatch.Run();
+	}
+#endif
+
 	// Interpolate the minimal set of entities that need it.
 	int iNext;
 	for ( int iCur=g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur=iNext )
@@ -3099,6 +3135,13 @@ void C_BaseEntity::ProcessInterpolatedList()
 		
 		pCur->m_bReadyToDraw = pCur->Interpolate( gpGlobals->curtime );
 	}
+
+#ifndef INTERPOLATEDVAR_PARANOID_MEASUREMENT
+	if ( bBatch )
+	{
+		g_InterpolationBatch.End();
+	}
+#endif
 }
 
 
@@ -231,6 +231,9 @@ public:
 	
 	// Returns 1 if there are no more changes (ie: we could call RemoveFromInterpolationList).
 	int								Interp_Interpolate( VarMapping_t *map, float currentTime );
+
+	// Queues the plain float and Vector blends for the batched pass in ProcessInterpolatedList().
+	void							Interp_QueueBatchedInterpolate( VarMapping_t *map, float currentTime );
 	
 	void							Interp_RestoreToLastNetworked( VarMapping_t *map );
 	void							Interp_UpdateInterpolationAmounts( VarMapping_t *map );
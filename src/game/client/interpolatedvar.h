@@ -15,6 +15,7 @@
 #include "lerp_functions.h"
 #include "animationlayer.h"
 #include "convar.h"
+#include "interpolationbatch.h"
 
 
 #include "tier0/memdbgon.h"
@@ -164,6 +165,11 @@ public:
 	
 	// Returns 1 if the value will always be the same if currentTime is always increasing.
 	virtual int Interpolate( float currentTime ) = 0;
+
+	// Hands this frame's blend to g_InterpolationBatch so the Interpolate() call
+	// that follows can pick up the result. Returns false if the var has to be
+	// interpolated the regular way.
+	virtual bool QueueBatchedInterpolate( float currentTime ) = 0;
 	
 	virtual int	 GetType() const = 0;
 	virtual void RestoreToLastNetworked() = 0;
@@ -451,6 +457,7 @@ public:
 	virtual bool NoteChanged( float changetime, bool bUpdateLastNetworkedValue );
 	virtual void Reset();
 	virtual int Interpolate( float currentTime );
+	virtual bool QueueBatchedInterpolate( float currentTime );
 	virtual int GetType() const;
 	virtual void RestoreToLastNetworked();
 	virtual void Copy( IInterpolatedVar *pInSrc );
@@ -559,6 +566,8 @@ protected:
 	
 	bool ValidOrder();
 
+	bool HasLoopingEntries() const;
+
 protected:
 	// The underlying data element
 	Type								*m_pValue;
@@ -571,6 +580,8 @@ protected:
 	byte *								m_bLooping;
 	float								m_InterpolationAmount;
 	const char *						m_pDebugName;
+	// Entry in g_InterpolationBatch queued for this var, -1 if none
+	int									m_iBatchEntry;
 	bool								m_bDebug : 1;
 };
 
@@ -586,6 +597,7 @@ inline CInterpolatedVarArrayBase<Type, IS_ARRAY>::CInterpolatedVarArrayBase( con
 	m_LastNetworkedTime = 0;
 	m_LastNetworkedValue = NULL;
 	m_bLooping = NULL;
+	m_iBatchEntry = -1;
 	m_bDebug = false;
 }
 
@@ -968,6 +980,28 @@ template< typename Type, bool IS_ARRAY >
 inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float currentTime, float interpolation_amount )
 {
 	int noMoreChanges = 0;
+
+#ifndef INTERPOLATEDVAR_PARANOID_MEASUREMENT
+	if ( m_iBatchEntry != -1 )
+	{
+		// Looping can get switched on between queueing and here (see C_BaseAnimating::Interpolate)
+		const float *pResult = NULL;
+		if ( !m_bDebug && !HasLoopingEntries() )
+		{
+			float flHeadTime = m_VarHistory.Count() ? m_VarHistory[0].changetime : 0.0f;
+			pResult = g_InterpolationBatch.GetResult( m_iBatchEntry, this, currentTime, interpolation_amount, m_VarHistory.Count(), flHeadTime, &noMoreChanges );
+		}
+		m_iBatchEntry = -1;
+
+		if ( pResult )
+		{
+			memcpy( m_pValue, pResult, sizeof( Type ) * m_nMaxCount );
+			RemoveEntriesPreviousTo( currentTime - interpolation_amount - EXTRA_INTERPOLATION_HISTORY_STORED );
+			return noMoreChanges;
+		}
+		noMoreChanges = 0;
+	}
+#endif
 	
 	CInterpolationInfo info;
 	if (!GetInterpolationInfo( &info, currentTime, interpolation_amount, &noMoreChanges ))
@@ -1153,6 +1187,62 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 	return Interpolate( currentTime, m_InterpolationAmount );
 }
 
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::QueueBatchedInterpolate( float currentTime )
+{
+	m_iBatchEntry = -1;
+
+	// Only plain linear and hermite blends of float lanes go through the batch,
+	// everything else (extrapolation, holding the last value) stays in Interpolate().
+	int nLanes = InterpolationBatchLanes<Type>::LANES * m_nMaxCount;
+	if ( !nLanes || m_bDebug || !g_InterpolationBatch.IsCollecting() || HasLoopingEntries() )
+		return false;
+
+	int noMoreChanges = 0;
+	CInterpolationInfo info;
+	if ( !GetInterpolationInfo( &info, currentTime, m_InterpolationAmount, &noMoreChanges ) )
+		return false;
+
+	CVarHistory &history = m_VarHistory;
+	float flHeadTime = history[0].changetime;
+
+	if ( info.m_bHermite )
+	{
+		CInterpolatedVarEntry fixup;
+		fixup.Init( m_nMaxCount );
+
+		CInterpolatedVarEntry *prev = &history[info.oldest];
+		CInterpolatedVarEntry *start = &history[info.older];
+		CInterpolatedVarEntry *end = &history[info.newer];
+		TimeFixup_Hermite( fixup, prev, start, end );
+
+		m_iBatchEntry = g_InterpolationBatch.AddHermite( this, currentTime, m_InterpolationAmount, history.Count(), flHeadTime, noMoreChanges,
+			info.frac, (const float *)prev->GetValue(), (const float *)start->GetValue(), (const float *)end->GetValue(), nLanes );
+	}
+	else if ( info.newer != info.older )
+	{
+		m_iBatchEntry = g_InterpolationBatch.AddLinear( this, currentTime, m_InterpolationAmount, history.Count(), flHeadTime, noMoreChanges,
+			info.frac, (const float *)history[info.older].GetValue(), (const float *)history[info.newer].GetValue(), nLanes );
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::HasLoopingEntries() const
+{
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[i] )
+			return true;
+	}
+	return false;
+}
+
 template< typename Type, bool IS_ARRAY >
 inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::Copy( IInterpolatedVar *pInSrc )
 {
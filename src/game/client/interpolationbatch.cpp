@@ -0,0 +1,210 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Central store that blends the float and Vector interpolated vars
+//			of every entity in the interpolation list in one SIMD pass.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "interpolationbatch.h"
+#include "mathlib/ssemath.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CInterpolationBatch g_InterpolationBatch;
+
+
+int CInterpolationBatch::CLaneStream::AddLanes( int nLanes )
+{
+	int iFirst = m_Frac.AddMultipleToTail( nLanes );
+	m_Prev.AddMultipleToTail( nLanes );
+	m_Start.AddMultipleToTail( nLanes );
+	m_End.AddMultipleToTail( nLanes );
+	return iFirst;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fill the stream out to a multiple of four lanes with zeros so the
+//			SIMD loop never reads past the end.
+//-----------------------------------------------------------------------------
+void CInterpolationBatch::CLaneStream::Pad()
+{
+	while ( Count() & 3 )
+	{
+		int i = AddLanes( 1 );
+		m_Frac[i] = m_Prev[i] = m_Start[i] = m_End[i] = 0.0f;
+	}
+	m_Out.SetCount( Count() );
+}
+
+void CInterpolationBatch::CLaneStream::RemoveAll()
+{
+	m_Frac.RemoveAll();
+	m_Prev.RemoveAll();
+	m_Start.RemoveAll();
+	m_End.RemoveAll();
+	m_Out.RemoveAll();
+}
+
+
+CInterpolationBatch::CInterpolationBatch()
+{
+	m_bCollecting = false;
+	m_bReady = false;
+}
+
+void CInterpolationBatch::Begin()
+{
+	m_Entries.RemoveAll();
+	m_Linear.RemoveAll();
+	m_Hermite.RemoveAll();
+	m_bCollecting = true;
+	m_bReady = false;
+}
+
+void CInterpolationBatch::Run()
+{
+	VPROF_BUDGET( "CInterpolationBatch::Run", VPROF_BUDGETGROUP_INTERPOLATION );
+
+	m_bCollecting = false;
+
+	m_Linear.Pad();
+	m_Hermite.Pad();
+	RunLinear();
+	RunHermite();
+
+	m_bReady = true;
+}
+
+void CInterpolationBatch::End()
+{
+	m_bCollecting = false;
+	m_bReady = false;
+}
+
+int CInterpolationBatch::AddEntry( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges, bool bHermite, int iFirstLane )
+{
+	int iEntry = m_Entries.AddToTail();
+	Entry_t &entry = m_Entries[iEntry];
+	entry.m_pVar = pVar;
+	entry.m_flTime = flTime;
+	entry.m_flAmount = flAmount;
+	entry.m_flHeadTime = flHeadTime;
+	entry.m_nHistoryCount = nHistoryCount;
+	entry.m_nNoMoreChanges = nNoMoreChanges;
+	entry.m_bHermite = bHermite;
+	entry.m_iFirstLane = iFirstLane;
+	return iEntry;
+}
+
+int CInterpolationBatch::AddLinear( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges,
+	float flFrac, const float *pStart, const float *pEnd, int nLanes )
+{
+	Assert( m_bCollecting );
+
+	int iFirst = m_Linear.AddLanes( nLanes );
+	for ( int i = 0; i < nLanes; i++ )
+	{
+		m_Linear.m_Frac[iFirst + i] = flFrac;
+		m_Linear.m_Prev[iFirst + i] = 0.0f;
+		m_Linear.m_Start[iFirst + i] = pStart[i];
+		m_Linear.m_End[iFirst + i] = pEnd[i];
+	}
+
+	return AddEntry( pVar, flTime, flAmount, nHistoryCount, flHeadTime, nNoMoreChanges, false, iFirst );
+}
+
+int CInterpolationBatch::AddHermite( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges,
+	float flFrac, const float *pPrev, const float *pStart, const float *pEnd, int nLanes )
+{
+	Assert( m_bCollecting );
+
+	int iFirst = m_Hermite.AddLanes( nLanes );
+	for ( int i = 0; i < nLanes; i++ )
+	{
+		m_Hermite.m_Frac[iFirst + i] = flFrac;
+		m_Hermite.m_Prev[iFirst + i] = pPrev[i];
+		m_Hermite.m_Start[iFirst + i] = pStart[i];
+		m_Hermite.m_End[iFirst + i] = pEnd[i];
+	}
+
+	return AddEntry( pVar, flTime, flAmount, nHistoryCount, flHeadTime, nNoMoreChanges, true, iFirst );
+}
+
+const float *CInterpolationBatch::GetResult( int iEntry, const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int *pNoMoreChanges ) const
+{
+	if ( !m_bReady || !m_Entries.IsValidIndex( iEntry ) )
+		return NULL;
+
+	const Entry_t &entry = m_Entries[iEntry];
+	if ( entry.m_pVar != pVar || entry.m_flTime != flTime || entry.m_flAmount != flAmount ||
+		entry.m_nHistoryCount != nHistoryCount || entry.m_flHeadTime != flHeadTime )
+	{
+		return NULL;
+	}
+
+	*pNoMoreChanges = entry.m_nNoMoreChanges;
+	const CLaneStream &stream = entry.m_bHermite ? m_Hermite : m_Linear;
+	return &stream.m_Out[entry.m_iFirstLane];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: start + ( end - start ) * frac, same operation order as Lerp() so
+//			the results match the per var path exactly.
+//-----------------------------------------------------------------------------
+void CInterpolationBatch::RunLinear()
+{
+	int nCount = m_Linear.Count();
+	const float *pFrac = m_Linear.m_Frac.Base();
+	const float *pStart = m_Linear.m_Start.Base();
+	const float *pEnd = m_Linear.m_End.Base();
+	float *pOut = m_Linear.m_Out.Base();
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		fltx4 frac = LoadAlignedSIMD( pFrac + i );
+		fltx4 start = LoadAlignedSIMD( pStart + i );
+		fltx4 end = LoadAlignedSIMD( pEnd + i );
+		StoreAlignedSIMD( pOut + i, AddSIMD( start, MulSIMD( SubSIMD( end, start ), frac ) ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Four lane version of Lerp_Hermite(), again keeping its operation
+//			order.
+//-----------------------------------------------------------------------------
+void CInterpolationBatch::RunHermite()
+{
+	int nCount = m_Hermite.Count();
+	const float *pFrac = m_Hermite.m_Frac.Base();
+	const float *pPrev = m_Hermite.m_Prev.Base();
+	const float *pStart = m_Hermite.m_Start.Base();
+	const float *pEnd = m_Hermite.m_End.Base();
+	float *pOut = m_Hermite.m_Out.Base();
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		fltx4 t = LoadAlignedSIMD( pFrac + i );
+		fltx4 p0 = LoadAlignedSIMD( pPrev + i );
+		fltx4 p1 = LoadAlignedSIMD( pStart + i );
+		fltx4 p2 = LoadAlignedSIMD( pEnd + i );
+
+		fltx4 d1 = SubSIMD( p1, p0 );
+		fltx4 d2 = SubSIMD( p2, p1 );
+
+		fltx4 tSqr = MulSIMD( t, t );
+		fltx4 tCube = MulSIMD( t, tSqr );
+
+		fltx4 twoCube = MulSIMD( Four_Twos, tCube );
+		fltx4 threeSqr = MulSIMD( Four_Threes, tSqr );
+
+		fltx4 out = MulSIMD( p1, AddSIMD( SubSIMD( twoCube, threeSqr ), Four_Ones ) );
+		out = AddSIMD( out, MulSIMD( p2, SubSIMD( threeSqr, twoCube ) ) );
+		out = AddSIMD( out, MulSIMD( d1, AddSIMD( SubSIMD( tCube, MulSIMD( Four_Twos, tSqr ) ), t ) ) );
+		out = AddSIMD( out, MulSIMD( d2, SubSIMD( tCube, tSqr ) ) );
+
+		StoreAlignedSIMD( pOut + i, out );
+	}
+}
@@ -0,0 +1,102 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Central store that blends the float and Vector interpolated vars
+//			of every entity in the interpolation list in one SIMD pass.
+//
+//			C_BaseEntity::ProcessInterpolatedList() first asks each var to work
+//			out its samples for the frame (QueueBatchedInterpolate), the batch
+//			then blends all of them at once into contiguous SoA lanes, and
+//			the regular Interpolate() calls that follow just copy the results
+//			out. Vars that need anything else (QAngles, looping values,
+//			extrapolation, debugging) take the normal path.
+//
+//=============================================================================//
+
+#ifndef INTERPOLATIONBATCH_H
+#define INTERPOLATIONBATCH_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+#include "mathlib/vector.h"
+
+//-----------------------------------------------------------------------------
+// Number of float lanes a value of the given type takes in the batch, zero
+// for types the batch can't blend.
+//-----------------------------------------------------------------------------
+template< class T > struct InterpolationBatchLanes { enum { LANES = 0 }; };
+template<> struct InterpolationBatchLanes< float > { enum { LANES = 1 }; };
+template<> struct InterpolationBatchLanes< Vector > { enum { LANES = 3 }; };
+
+
+class CInterpolationBatch
+{
+public:
+	CInterpolationBatch();
+
+	// Between Begin() and Run() vars can be queued, between Run() and End()
+	// the results can be fetched.
+	void Begin();
+	void Run();
+	void End();
+
+	bool IsCollecting() const { return m_bCollecting; }
+
+	// Queue a blend for a var. Returns the entry index to hand back to GetResult().
+	int AddLinear( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges,
+		float flFrac, const float *pStart, const float *pEnd, int nLanes );
+	int AddHermite( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges,
+		float flFrac, const float *pPrev, const float *pStart, const float *pEnd, int nLanes );
+
+	// Returns the blended lanes for the entry, or NULL if the entry is stale
+	// (wrong var, different time or the history changed since it was queued).
+	const float *GetResult( int iEntry, const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int *pNoMoreChanges ) const;
+
+	int GetEntryCount() const { return m_Entries.Count(); }
+	int GetLaneCount() const { return m_Linear.Count() + m_Hermite.Count(); }
+
+private:
+	struct Entry_t
+	{
+		const void	*m_pVar;
+		float		m_flTime;
+		float		m_flAmount;
+		float		m_flHeadTime;
+		int			m_nHistoryCount;
+		int			m_nNoMoreChanges;
+		bool		m_bHermite;
+		int			m_iFirstLane;
+	};
+
+	// SoA lanes, one float per lane in each array.
+	class CLaneStream
+	{
+	public:
+		int Count() const { return m_Frac.Count(); }
+		int AddLanes( int nLanes );
+		void Pad();
+		void RemoveAll();
+
+		CUtlVector< float, CUtlMemoryAligned< float, 16 > > m_Frac;
+		CUtlVector< float, CUtlMemoryAligned< float, 16 > > m_Prev;
+		CUtlVector< float, CUtlMemoryAligned< float, 16 > > m_Start;
+		CUtlVector< float, CUtlMemoryAligned< float, 16 > > m_End;
+		CUtlVector< float, CUtlMemoryAligned< float, 16 > > m_Out;
+	};
+
+	int AddEntry( const void *pVar, float flTime, float flAmount, int nHistoryCount, float flHeadTime, int nNoMoreChanges, bool bHermite, int iFirstLane );
+
+	void RunLinear();
+	void RunHermite();
+
+	CUtlVector< Entry_t > m_Entries;
+	CLaneStream m_Linear;
+	CLaneStream m_Hermite;
+	bool m_bCollecting;
+	bool m_bReady;
+};
+
+extern CInterpolationBatch g_InterpolationBatch;
+
+#endif // INTERPOLATIONBATCH_H
@@ -154,6 +154,10 @@ CParticleEffectBinding::CParticleEffectBinding()
 
 	m_UpdateBBoxCounter = 0;
 
+	m_bFullBBoxUpdate = false;
+	m_bSimBBoxSet = false;
+	m_bDeferParticleRemoval = false;
+
 	memset( m_EffectMaterialHash, 0, sizeof( m_EffectMaterialHash ) );
 }
 
@@ -652,38 +656,59 @@ void CParticleEffectBinding::GrowBBoxFromParticlePositions( CEffectMaterial *pMa
 //-----------------------------------------------------------------------------
 void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 {
-	if ( !m_pSim->ShouldSimulate() )
+	if ( !StartSimulateParticles() )
 		return;
 
-	if ( GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) )
-	{
-		CParticleSimulateIterator simulateIterator;
-		simulateIterator.m_pEffectBinding = this;
-		simulateIterator.m_pMaterial = NULL; //pMaterial;
-		simulateIterator.m_flTimeDelta = flTimeDelta;
-		m_pSim->SimulateParticles( &simulateIterator );
-	}
-	else
-	{
-		Vector bbMin(0,0,0), bbMax(0,0,0);
-		bool bboxSet = false;
+	RunSimulateParticles( flTimeDelta );
+	FinishSimulateParticles();
+}
+
+
+//-----------------------------------------------------------------------------
+// Decides whether this frame does a full bbox update. Returns false if the
+// effect doesn't want to be simulated.
+//-----------------------------------------------------------------------------
+bool CParticleEffectBinding::StartSimulateParticles()
+{
+	if ( !m_pSim->ShouldSimulate() )
+		return false;
 
+	m_bFullBBoxUpdate = false;
+	if ( !GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) )
+	{
 		// slow the expensive update operation for particle systems that use auto-update-bbox
 		// auto update the bbox after N frames then randomly 1/N or after 2*N frames 
-		bool bFullBBoxUpdate = false;
 		++m_UpdateBBoxCounter;
 		if ( ( m_UpdateBBoxCounter >= BBOX_UPDATE_EVERY_N && random->RandomInt( 0, BBOX_UPDATE_EVERY_N ) == 0 ) ||
 			 ( m_UpdateBBoxCounter >= 2*BBOX_UPDATE_EVERY_N ) )
 		{
-			bFullBBoxUpdate = true;
+			m_bFullBBoxUpdate = true;
 
 			// reset watchdog
 			m_UpdateBBoxCounter = 0;
 		}
+	}
+
+	return true;
+}
+
 
-		if ( bFullBBoxUpdate )
+void CParticleEffectBinding::RunSimulateParticles( float flTimeDelta )
+{
+	if ( GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) )
+	{
+		CParticleSimulateIterator simulateIterator;
+		simulateIterator.m_pEffectBinding = this;
+		simulateIterator.m_pMaterial = NULL; //pMaterial;
+		simulateIterator.m_flTimeDelta = flTimeDelta;
+		m_pSim->SimulateParticles( &simulateIterator );
+	}
+	else
+	{
+		m_bSimBBoxSet = false;
+		if ( m_bFullBBoxUpdate )
 		{
-			BBoxCalcStart( bbMin, bbMax );
+			BBoxCalcStart( m_SimBBoxMin, m_SimBBoxMax );
 		}
 		FOR_EACH_LL( m_Materials, i )
 		{
@@ -698,15 +723,42 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 			m_pSim->SimulateParticles( &simulateIterator );
 
 			// Update the bbox.
-			if ( bFullBBoxUpdate )
+			if ( m_bFullBBoxUpdate )
 			{
-				GrowBBoxFromParticlePositions( pMaterial, bboxSet, bbMin, bbMax );
+				GrowBBoxFromParticlePositions( pMaterial, m_bSimBBoxSet, m_SimBBoxMin, m_SimBBoxMax );
 			}
 		}
-		if ( bFullBBoxUpdate )
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Hands the particles RunSimulateParticles killed back to the effect and the
+// pool, then puts the new bbox into world space. BBoxCalcEnd can ask the effect
+// for its sort origin, which is often an entity's GetAbsOrigin().
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::FinishSimulateParticles()
+{
+	m_bDeferParticleRemoval = false;
+
+	int nRemoved = m_DeferredRemovals.Count();
+	if ( nRemoved )
+	{
+		// Replay the count the way RemoveParticle would have, so the effect still
+		// sees GetNumActiveParticles() hit 0 on the last particle only.
+		m_nActiveParticles += nRemoved;
+		for ( int i = 0; i < nRemoved; i++ )
 		{
-			BBoxCalcEnd( bboxSet, bbMin, bbMax );
+			--m_nActiveParticles;
+			m_pSim->NotifyDestroyParticle( m_DeferredRemovals[i] );
+			m_pParticleMgr->FreeParticle( m_DeferredRemovals[i] );
 		}
+		m_DeferredRemovals.RemoveAll();
+	}
+
+	if ( m_bFullBBoxUpdate )
+	{
+		BBoxCalcEnd( m_bSimBBoxSet, m_SimBBoxMin, m_SimBBoxMax );
 	}
 }
 
@@ -966,6 +1018,13 @@ void CParticleEffectBinding::RemoveParticle( Particle *pParticle )
 	--m_nActiveParticles;
 	Assert( m_nActiveParticles >= 0 );
 
+	// On a job thread, see CParticleMgr::SimulateLegacyEffects
+	if ( m_bDeferParticleRemoval )
+	{
+		m_DeferredRemovals.AddToTail( pParticle );
+		return;
+	}
+
 	// Let the effect do any necessary cleanup
 	m_pSim->NotifyDestroyParticle(pParticle);
 
@@ -1052,6 +1111,10 @@ CParticleMgr::CParticleMgr()
 	m_DefaultInvalidSubTexture.m_tCoordMaxs[0] = m_DefaultInvalidSubTexture.m_tCoordMaxs[1] = 1;
 	
 	m_nCurrentParticlesAllocated = 0;
+	m_pParticlePool = NULL;
+	m_nParticleAllocsThisFrame = m_nParticleFreesThisFrame = 0;
+	m_nParticleAllocsLastFrame = m_nParticleFreesLastFrame = 0;
+	m_nParticleAllocsPeakFrame = 0;
 
 	SetDefLessFunc( m_effectFactories );
 }
@@ -1157,12 +1220,19 @@ void CParticleMgr::Term()
 	}
 
 	Assert( m_nCurrentParticlesAllocated == 0 );
+	if ( m_pParticlePool && m_nCurrentParticlesAllocated == 0 )
+	{
+		delete m_pParticlePool;
+		m_pParticlePool = NULL;
+	}
 }
 
 
 void CParticleMgr::LevelInit()
 {
 	g_pParticleSystemMgr->SetLastSimulationTime( gpGlobals->curtime );
+
+	m_nParticleAllocsPeakFrame = 0;
 }
 
 
@@ -1172,9 +1242,19 @@ Particle *CParticleMgr::AllocParticle( int size )
 	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
 		return NULL;
 		
-	Particle *pRet = (Particle *)malloc( size );
+	Assert( size == PARTICLE_SIZE );
+	if ( !m_pParticlePool )
+	{
+		// MAX_TOTAL_PARTICLES is small enough to just take it all in one slab
+		m_pParticlePool = new CUtlMemoryPool( PARTICLE_SIZE, MAX_TOTAL_PARTICLES, CUtlMemoryPool::GROW_NONE, "CParticleMgr::m_pParticlePool", 16 );
+	}
+
+	Particle *pRet = (Particle *)m_pParticlePool->Alloc();
 	if ( pRet )
+	{
 		++m_nCurrentParticlesAllocated;
+		++m_nParticleAllocsThisFrame;
+	}
 
 	return pRet;
 }
@@ -1182,10 +1262,82 @@ Particle *CParticleMgr::AllocParticle( int size )
 void CParticleMgr::FreeParticle( Particle *pParticle )
 {
 	Assert( m_nCurrentParticlesAllocated > 0 );
-	if ( pParticle )
-		--m_nCurrentParticlesAllocated;
-	
-	free( pParticle );
+	if ( !pParticle )
+		return;
+
+	--m_nCurrentParticlesAllocated;
+	++m_nParticleFreesThisFrame;
+	m_pParticlePool->Free( pParticle );
+}
+
+void CParticleMgr::SpewParticlePoolStats()
+{
+	Msg( "Legacy particles: %d allocated, pool peak %d (%d bytes each)\n",
+		m_nCurrentParticlesAllocated, m_pParticlePool ? m_pParticlePool->PeakCount() : 0, PARTICLE_SIZE );
+	Msg( "Last frame: %d allocs, %d frees. Worst frame this map: %d allocs\n",
+		m_nParticleAllocsLastFrame, m_nParticleFreesLastFrame, m_nParticleAllocsPeakFrame );
+}
+
+CON_COMMAND( cl_particle_pool_stats, "Show legacy particle pool usage and allocations per frame." )
+{
+	ParticleMgr()->SpewParticlePoolStats();
+}
+
+//-----------------------------------------------------------------------------
+// Churns particles through the pool the way a busy fight does: every frame a
+// random slice of the live particles dies and is replaced. Compares against
+// the heap so the difference shows up on the box it's run on.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( cl_particle_pool_benchmark, "cl_particle_pool_benchmark [live particles] [frames] - time particle alloc/free churn, pooled vs heap.", FCVAR_CHEAT )
+{
+	int nLive = ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, MAX_TOTAL_PARTICLES ) : MAX_TOTAL_PARTICLES;
+	int nFrames = ( args.ArgC() > 2 ) ? Max( atoi( args[2] ), 1 ) : 300;
+	int nChurn = Max( nLive / 4, 1 );
+
+	CUtlVector<void *> live;
+	live.SetCount( nLive );
+
+	CUtlMemoryPool pool( PARTICLE_SIZE, MAX_TOTAL_PARTICLES, CUtlMemoryPool::GROW_NONE, "cl_particle_pool_benchmark", 16 );
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		bool bPool = ( nPass == 0 );
+		RandomSeed( 1 );
+
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nLive; i++ )
+		{
+			live[i] = bPool ? pool.Alloc() : malloc( PARTICLE_SIZE );
+		}
+		for ( int nFrame = 0; nFrame < nFrames; nFrame++ )
+		{
+			for ( int i = 0; i < nChurn; i++ )
+			{
+				int j = RandomInt( 0, nLive - 1 );
+				if ( bPool )
+				{
+					pool.Free( live[j] );
+					live[j] = pool.Alloc();
+				}
+				else
+				{
+					free( live[j] );
+					live[j] = malloc( PARTICLE_SIZE );
+				}
+			}
+		}
+		for ( int i = 0; i < nLive; i++ )
+		{
+			if ( bPool )
+				pool.Free( live[i] );
+			else
+				free( live[i] );
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		int nAllocs = nLive + nChurn * nFrames;
+		Msg( "%s: %d allocs/frame, %.2f ms total, %.1f ns per alloc+free\n", bPool ? "pool" : "heap",
+			nChurn, flElapsed * 1000.0, flElapsed * 1e9 / nAllocs );
+	}
 }
 
 
@@ -1427,6 +1579,11 @@ void CParticleMgr::IncrementFrameCode()
 {
 	VPROF( "CParticleMgr::IncrementFrameCode()" );
 
+	m_nParticleAllocsLastFrame = m_nParticleAllocsThisFrame;
+	m_nParticleFreesLastFrame = m_nParticleFreesThisFrame;
+	m_nParticleAllocsPeakFrame = Max( m_nParticleAllocsPeakFrame, m_nParticleAllocsThisFrame );
+	m_nParticleAllocsThisFrame = m_nParticleFreesThisFrame = 0;
+
 	++m_FrameCode;
 	if ( m_FrameCode == 0 )
 	{
@@ -1447,6 +1604,8 @@ void CParticleMgr::IncrementFrameCode()
 //-----------------------------------------------------------------------------
 void CParticleMgr::Simulate( float flTimeDelta )
 {
+	VPROF_BUDGET( "CParticleMgr::Simulate", VPROF_BUDGETGROUP_PARTICLE_SIMULATION );
+
 	g_nParticlesDrawn = 0;
 
 	if(!m_pMaterialSystem)
@@ -1931,6 +2090,113 @@ void CParticleMgr::UpdateNewEffects( float flTimeDelta )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Legacy effect simulation. Update() and the leaf system bookkeeping call into
+// entity code and stay on the main thread. Only effects that say
+// IsSimulationThreadSafe() are simulated on the job threads; the bbox random
+// numbers are drawn before they go and the particles they kill are released
+// after, both on the main thread.
+//-----------------------------------------------------------------------------
+static ConVar cl_particle_legacy_sim_threaded( "cl_particle_legacy_sim_threaded", "0", 0, "Simulate legacy particle effects on the job threads. 0 simulates them in order on the main thread." );
+
+static float s_flLegacySimTimeDelta;
+
+void CParticleMgr::ProcessLegacyEffect( CParticleEffectBinding *&pEffect )
+{
+	FPExceptionEnabler enableExceptions;
+	pEffect->RunSimulateParticles( s_flLegacySimTimeDelta );
+}
+
+void CParticleMgr::SimulateLegacyEffects( CUtlVector<CParticleEffectBinding *> &effects, float flTimeDelta )
+{
+	VPROF_BUDGET( "CParticleMgr::SimulateLegacyEffects", "Particle Simulation" );
+
+	int nCount = effects.Count();
+	if ( !cl_particle_legacy_sim_threaded.GetBool() || nCount <= 1 )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			effects[i]->SimulateParticles( flTimeDelta );
+		}
+		return;
+	}
+
+	// Everything that isn't thread safe is simulated here first, in order.
+	CUtlVector<CParticleEffectBinding *> threaded( 0, nCount );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		CParticleEffectBinding *pEffect = effects[i];
+		if ( !pEffect->StartSimulateParticles() )
+			continue;
+
+		if ( pEffect->m_pSim->IsSimulationThreadSafe() )
+		{
+			pEffect->m_bDeferParticleRemoval = true;
+			threaded.AddToTail( pEffect );
+		}
+		else
+		{
+			pEffect->RunSimulateParticles( flTimeDelta );
+			pEffect->FinishSimulateParticles();
+		}
+	}
+
+	if ( threaded.Count() )
+	{
+		s_flLegacySimTimeDelta = flTimeDelta;
+		ParallelProcess( "CParticleMgr::SimulateLegacyEffects", threaded.Base(), threaded.Count(), ProcessLegacyEffect );
+	}
+
+	for ( int i = 0; i < threaded.Count(); i++ )
+	{
+		threaded[i]->FinishSimulateParticles();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Times the legacy simulation pass over whatever effects are alive right now,
+// serial and threaded. A zero time step does all the per particle work without
+// aging anything, so both modes see the same particles.
+//-----------------------------------------------------------------------------
+void CParticleMgr::BenchmarkLegacySimulation( int nIterations )
+{
+	CUtlVector<CParticleEffectBinding *> effects;
+	int nParticles = 0;
+	FOR_EACH_LL( m_Effects, i )
+	{
+		CParticleEffectBinding *pEffect = m_Effects[i];
+		if ( !pEffect->GetRemoveFlag() && !pEffect->GetFirstFrameFlag() )
+		{
+			effects.AddToTail( pEffect );
+			nParticles += pEffect->m_nActiveParticles;
+		}
+	}
+
+	Msg( "%d legacy effects, %d particles, %d iterations\n", effects.Count(), nParticles, nIterations );
+
+	bool bThreaded = cl_particle_legacy_sim_threaded.GetBool();
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		cl_particle_legacy_sim_threaded.SetValue( nPass );
+
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			SimulateLegacyEffects( effects, 0.0f );
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		Msg( "%s: %.3f ms per pass\n", nPass ? "threaded" : "serial", flElapsed * 1000.0 / nIterations );
+	}
+	cl_particle_legacy_sim_threaded.SetValue( bThreaded );
+}
+
+CON_COMMAND_F( cl_particle_legacy_sim_benchmark, "cl_particle_legacy_sim_benchmark [iterations] - time legacy particle simulation serial vs threaded on the current effects.", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? Max( atoi( args[1] ), 1 ) : 100;
+	ParticleMgr()->BenchmarkLegacySimulation( nIterations );
+}
+
 void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 {
 	// These reflect the convars so we don't parse the strings every particle.
@@ -1943,6 +2209,8 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 	if( flTimeDelta > 0.1f )
 		flTimeDelta = 0.1f;
 
+	CUtlVector<CParticleEffectBinding *> simulate( 0, m_Effects.Count() );
+
 	FOR_EACH_LL( m_Effects, iEffect )
 	{
 		CParticleEffectBinding *pEffect = m_Effects[iEffect];
@@ -1973,7 +2241,16 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 		if ( pEffect->GetFirstFrameFlag() )
 			pEffect->SetFirstFrameFlag( false );
 		else
-			pEffect->SimulateParticles( flTimeDelta );
+			simulate.AddToTail( pEffect );
+	}
+
+	SimulateLegacyEffects( simulate, flTimeDelta );
+
+	FOR_EACH_LL( m_Effects, iEffect )
+	{
+		CParticleEffectBinding *pEffect = m_Effects[iEffect];
+		if( pEffect->GetRemoveFlag() )
+			continue;
 
 		// Update its position in the leaf system if its bbox changed.
 		pEffect->DetectChanges();
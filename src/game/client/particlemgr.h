@@ -303,6 +303,12 @@ public:
 	virtual const Vector *GetParticlePosition( Particle *pParticle ) { return &pParticle->m_Pos; }
 
 	virtual const char *GetEffectName() { return "???"; } 
+
+	// Return true if SimulateParticles() only reads and writes this effect's own particles
+	// and members, so cl_particle_legacy_sim_threaded can run it on a job thread. It must not
+	// add particles, draw random numbers or touch entities (GetAbsOrigin, attachments, bones).
+	// NotifyDestroyParticle() and GetSortOrigin() are still called on the main thread.
+	virtual bool	IsSimulationThreadSafe() const { return false; }
 };
 
 #define REGISTER_EFFECT( effect )														\
@@ -469,6 +475,12 @@ private:
 	// Get rid of the specified particle.
 	void			RemoveParticle( Particle *pParticle );
 
+	// SimulateParticles() split up for CParticleMgr::SimulateLegacyEffects. Start and Finish
+	// run on the main thread, Run may be on a job thread when the effect is thread safe.
+	bool			StartSimulateParticles();
+	void			RunSimulateParticles( float flTimeDelta );
+	void			FinishSimulateParticles();
+
 	void			StartDrawMaterialParticles(
 						CEffectMaterial *pMaterial,
 						float flTimeDelta,
@@ -594,6 +606,16 @@ private:
 
 	// auto updates the bbox after N frames
 	unsigned short					m_UpdateBBoxCounter;
+
+	// Carried from RunSimulateParticles to FinishSimulateParticles.
+	bool							m_bFullBBoxUpdate;
+	bool							m_bSimBBoxSet;
+	Vector							m_SimBBoxMin;
+	Vector							m_SimBBoxMax;
+
+	// While set, RemoveParticle leaves NotifyDestroyParticle and the free to FinishSimulateParticles.
+	bool							m_bDeferParticleRemoval;
+	CUtlVector<Particle*>			m_DeferredRemovals;
 };
 
 
@@ -668,6 +690,12 @@ public:
 	Particle		*AllocParticle( int size );
 	void			FreeParticle( Particle * );
 
+	// Particle pool stats, see cl_particle_pool_stats
+	void			SpewParticlePoolStats();
+
+	// See cl_particle_legacy_sim_benchmark
+	void			BenchmarkLegacySimulation( int nIterations );
+
 	PMaterialHandle	GetPMaterial( const char *pMaterialName );
 	IMaterial*		PMaterialToIMaterial( PMaterialHandle hMaterial );
 
@@ -714,6 +742,10 @@ private:
 	// Call Update() on all the effects.
 	void UpdateAllEffects( float flTimeDelta );
 
+	// Runs SimulateParticles() on the legacy effects, see cl_particle_legacy_sim_threaded
+	void SimulateLegacyEffects( CUtlVector<CParticleEffectBinding *> &effects, float flTimeDelta );
+	static void ProcessLegacyEffect( CParticleEffectBinding *&pEffect );
+
 	void UpdateNewEffects( float flTimeDelta );				// update new particle effects
 
 	CParticleSubTextureGroup* FindOrAddSubTextureGroup( IMaterial *pPageMaterial );
@@ -731,6 +763,15 @@ private:
 
 	int m_nCurrentParticlesAllocated;
 
+	// Legacy particles are all PARTICLE_SIZE, so they come out of one fixed
+	// size pool of MAX_TOTAL_PARTICLES instead of the heap.
+	CUtlMemoryPool *m_pParticlePool;
+	int m_nParticleAllocsThisFrame;
+	int m_nParticleFreesThisFrame;
+	int m_nParticleAllocsLastFrame;
+	int m_nParticleFreesLastFrame;
+	int m_nParticleAllocsPeakFrame;
+
 	// Directional lighting info.
 	CParticleLightInfo m_DirectionalLight;
 
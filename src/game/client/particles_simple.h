@@ -171,6 +171,7 @@ public:
 
 	virtual void	SimulateParticles( CParticleSimulateIterator *pIterator );
 	virtual void	RenderParticles( CParticleRenderIterator *pIterator );
+	virtual bool	IsSimulationThreadSafe() const	{ return m_bThreadSafeSimulation; }
 
 	void			SetNearClip( float nearClipMin, float nearClipMax );
 
@@ -193,6 +194,9 @@ protected:
 	float			m_flNearClipMax;
 
 private:
+	// Only set by Create(). Variants override the Update functions and stay on the main thread.
+	bool			m_bThreadSafeSimulation;
+
 	CSimpleEmitter( const CSimpleEmitter & ); // not defined, not accessible
 };
 
@@ -490,6 +490,32 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 	boneSetup.CalcBoneAdj( pos, q, GetEncodedControllerArray() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: layers feed GetSkeleton too, so they're part of the bone setup key
+//-----------------------------------------------------------------------------
+void CBaseAnimatingOverlay::HashBoneSetupInputs( CRC32_t *pCRC )
+{
+	BaseClass::HashBoneSetupInputs( pCRC );
+
+	for ( int i = 0; i < m_AnimOverlay.Count(); i++ )
+	{
+		CAnimationLayer &pLayer = m_AnimOverlay[i];
+		if ( !pLayer.IsActive() || pLayer.m_flWeight <= 0 )
+			continue;
+
+		int nSequence = pLayer.m_nSequence;
+		int nOrder = pLayer.m_nOrder;
+		float flCycle = pLayer.m_flCycle;
+		float flWeight = pLayer.m_flWeight;
+
+		CRC32_ProcessBuffer( pCRC, &i, sizeof( i ) );
+		CRC32_ProcessBuffer( pCRC, &nSequence, sizeof( nSequence ) );
+		CRC32_ProcessBuffer( pCRC, &nOrder, sizeof( nOrder ) );
+		CRC32_ProcessBuffer( pCRC, &flCycle, sizeof( flCycle ) );
+		CRC32_ProcessBuffer( pCRC, &flWeight, sizeof( flWeight ) );
+	}
+}
+
 
 
 //-----------------------------------------------------------------------------
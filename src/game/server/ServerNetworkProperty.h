@@ -15,6 +15,7 @@
 #include "server_class.h"
 #include "edict.h"
 #include "timedeventmgr.h"
+#include "networkstatetracker.h"
 
 //
 // Lightweight base class for networkable data on the server.
@@ -184,6 +185,11 @@ inline void CServerNetworkProperty::NetworkStateForceUpdate()
 
 inline void CServerNetworkProperty::NetworkStateChanged()
 { 
+	if ( g_bNetworkStateTrackerActive )
+	{
+		NetworkStateTracker_FullChange( m_pOuter, m_pServerClass );
+	}
+
 	// If we're using the timer, then ignore this call.
 	if ( m_TimerEvent.IsRegistered() )
 	{
@@ -200,6 +206,10 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 
 inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffset )
 { 
+	// Changes to vars this class doesn't send don't need to reach the engine
+	if ( g_bNetworkStateTrackerActive && !NetworkStateTracker_PropChanged( m_pOuter, m_pServerClass, varOffset ) )
+		return;
+
 	// If we're using the timer, then ignore this call.
 	if ( m_TimerEvent.IsRegistered() )
 	{
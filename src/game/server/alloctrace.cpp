@@ -0,0 +1,535 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Opt-in tracer for heap churn on the main thread. While it's on,
+//			g_pMemAlloc is swapped for a forwarding allocator that counts
+//			every allocation, charged to the VProf scope it was made in and
+//			to its file and line where the caller passed them (debug builds
+//			with memdbgon). The counts are rolled up once per tick for
+//			sv_alloc_trace_dump, and sv_alloc_trace_zero flags every tick
+//			that allocates at all once the game has warmed up.
+//
+//			Only allocations routed through g_pMemAlloc are seen. Other
+//			threads are counted but not broken down, so the bookkeeping
+//			never needs a lock.
+//
+//			g_pMemAlloc is tier0's, so the swap covers the whole process:
+//			the engine and the client allocate through the tracer too, not
+//			just this module. It has to be undone before server.dll unloads.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier0/vprof.h"
+
+#if !defined(STEAM) && !defined(NO_MALLOC_OVERRIDE)
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static void AllocTraceChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_alloc_trace( "sv_alloc_trace", "0", 0, "Count the heap allocations made on the main thread every tick. See sv_alloc_trace_dump.", AllocTraceChanged );
+ConVar sv_alloc_trace_zero( "sv_alloc_trace_zero", "0", 0, "With sv_alloc_trace on, warn about every tick that allocates once sv_alloc_trace_zero_warmup ticks have gone by." );
+ConVar sv_alloc_trace_zero_warmup( "sv_alloc_trace_zero_warmup", "300", 0, "Ticks to let the game settle after sv_alloc_trace is turned on before sv_alloc_trace_zero starts warning." );
+
+
+class CAllocTrace : public IMemAlloc, public CAutoGameSystemPerFrame
+{
+public:
+	CAllocTrace();
+
+	virtual void Shutdown();
+	virtual void FrameUpdatePostEntityThink();
+
+	void Install();
+	void Uninstall();
+	bool IsInstalled() const { return m_bInstalled; }
+	int GetTickAllocs() const { return m_nTickAllocs; }
+
+	void Dump();
+	void Reset();
+
+	// IMemAlloc. Everything is passed on to the allocator we replaced.
+	virtual void *Alloc( size_t nSize );
+	virtual void *Realloc( void *pMem, size_t nSize );
+	virtual void Free( void *pMem );
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize ) { return m_pActual->Expand_NoLongerSupported( pMem, nSize ); }
+
+	virtual void *Alloc( size_t nSize, const char *pFileName, int nLine );
+	virtual void *Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine );
+	virtual void Free( void *pMem, const char *pFileName, int nLine );
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize, const char *pFileName, int nLine ) { return m_pActual->Expand_NoLongerSupported( pMem, nSize, pFileName, nLine ); }
+
+	virtual size_t GetSize( void *pMem ) { return m_pActual->GetSize( pMem ); }
+
+	virtual void PushAllocDbgInfo( const char *pFileName, int nLine ) { m_pActual->PushAllocDbgInfo( pFileName, nLine ); }
+	virtual void PopAllocDbgInfo() { m_pActual->PopAllocDbgInfo(); }
+
+	virtual long CrtSetBreakAlloc( long lNewBreakAlloc ) { return m_pActual->CrtSetBreakAlloc( lNewBreakAlloc ); }
+	virtual	int CrtSetReportMode( int nReportType, int nReportMode ) { return m_pActual->CrtSetReportMode( nReportType, nReportMode ); }
+	virtual int CrtIsValidHeapPointer( const void *pMem ) { return m_pActual->CrtIsValidHeapPointer( pMem ); }
+	virtual int CrtIsValidPointer( const void *pMem, unsigned int size, int access ) { return m_pActual->CrtIsValidPointer( pMem, size, access ); }
+	virtual int CrtCheckMemory( void ) { return m_pActual->CrtCheckMemory(); }
+	virtual int CrtSetDbgFlag( int nNewFlag ) { return m_pActual->CrtSetDbgFlag( nNewFlag ); }
+	virtual void CrtMemCheckpoint( _CrtMemState *pState ) { m_pActual->CrtMemCheckpoint( pState ); }
+
+	virtual void DumpStats() { m_pActual->DumpStats(); }
+	virtual void DumpStatsFileBase( char const *pchFileBase ) { m_pActual->DumpStatsFileBase( pchFileBase ); }
+
+	virtual void* CrtSetReportFile( int nRptType, void* hFile ) { return m_pActual->CrtSetReportFile( nRptType, hFile ); }
+	virtual void* CrtSetReportHook( void* pfnNewHook ) { return m_pActual->CrtSetReportHook( pfnNewHook ); }
+	virtual int CrtDbgReport( int nRptType, const char * szFile, int nLine, const char * szModule, const char * pMsg ) { return m_pActual->CrtDbgReport( nRptType, szFile, nLine, szModule, pMsg ); }
+
+	virtual int heapchk() { return m_pActual->heapchk(); }
+
+	virtual bool IsDebugHeap() { return m_pActual->IsDebugHeap(); }
+
+	virtual void GetActualDbgInfo( const char *&pFileName, int &nLine ) { m_pActual->GetActualDbgInfo( pFileName, nLine ); }
+	virtual void RegisterAllocation( const char *pFileName, int nLine, int nLogicalSize, int nActualSize, unsigned nTime ) { m_pActual->RegisterAllocation( pFileName, nLine, nLogicalSize, nActualSize, nTime ); }
+	virtual void RegisterDeallocation( const char *pFileName, int nLine, int nLogicalSize, int nActualSize, unsigned nTime ) { m_pActual->RegisterDeallocation( pFileName, nLine, nLogicalSize, nActualSize, nTime ); }
+
+	virtual int GetVersion() { return m_pActual->GetVersion(); }
+
+	virtual void CompactHeap() { m_pActual->CompactHeap(); }
+
+	virtual MemAllocFailHandler_t SetAllocFailHandler( MemAllocFailHandler_t pfnMemAllocFailHandler ) { return m_pActual->SetAllocFailHandler( pfnMemAllocFailHandler ); }
+
+	virtual void DumpBlockStats( void *p ) { m_pActual->DumpBlockStats( p ); }
+
+#if defined( _MEMTEST )
+	virtual void SetStatsExtraInfo( const char *pMapName, const char *pComment ) { m_pActual->SetStatsExtraInfo( pMapName, pComment ); }
+#endif
+
+	virtual size_t MemoryAllocFailed() { return m_pActual->MemoryAllocFailed(); }
+
+	virtual uint32 GetDebugInfoSize() { return m_pActual->GetDebugInfoSize(); }
+	virtual void SaveDebugInfo( void *pvDebugInfo ) { m_pActual->SaveDebugInfo( pvDebugInfo ); }
+	virtual void RestoreDebugInfo( const void *pvDebugInfo ) { m_pActual->RestoreDebugInfo( pvDebugInfo ); }
+	virtual void InitDebugInfo( void *pvDebugInfo, const char *pchRootFileName, int nLine ) { m_pActual->InitDebugInfo( pvDebugInfo, pchRootFileName, nLine ); }
+
+	virtual void GlobalMemoryStatus( size_t *pUsedMemory, size_t *pFreeMemory ) { m_pActual->GlobalMemoryStatus( pUsedMemory, pFreeMemory ); }
+
+private:
+	enum
+	{
+		// Open addressing, so the table itself never allocates. Sites that
+		// don't fit are charged to the overflow slot.
+		MAX_SITES = 2048,
+		SITE_OVERFLOW = MAX_SITES,
+	};
+
+	struct Site_t
+	{
+		const char	*m_pszScope;
+		const char	*m_pszFile;
+		int			m_nLine;
+
+		// This tick.
+		int			m_nTickAllocs;
+		int64		m_nTickBytes;
+
+		// Since the last reset.
+		uint64		m_nAllocs;
+		uint64		m_nBytes;
+		int			m_nMaxTickAllocs;
+	};
+
+	void Record( size_t nSize, const char *pFileName, int nLine );
+	int FindOrAddSite( const char *pszScope, const char *pszFile, int nLine );
+	static int SortByAllocs( const int *pLeft, const int *pRight );
+
+	IMemAlloc		*m_pActual;
+	bool			m_bInstalled;
+
+	// Set while we print, so our own output isn't charged to the game.
+	bool			m_bReporting;
+
+	Site_t			m_Sites[MAX_SITES + 1];
+	int				m_nSites;
+	int				m_nTickSites;
+
+	int				m_nTickAllocs;
+	int64			m_nTickBytes;
+	int				m_nTickFrees;
+
+	int				m_nTicks;
+	uint64			m_nAllocs;
+	uint64			m_nBytes;
+	uint64			m_nFrees;
+	int				m_nMaxTickAllocs;
+	int64			m_nMaxTickBytes;
+	int				m_nNonZeroTicks;
+
+	volatile int	m_nOtherThreadAllocs;
+};
+
+static CAllocTrace g_AllocTrace;
+
+static void AllocTraceChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	if ( sv_alloc_trace.GetBool() )
+	{
+		g_AllocTrace.Install();
+	}
+	else
+	{
+		g_AllocTrace.Uninstall();
+	}
+}
+
+
+CAllocTrace::CAllocTrace() : CAutoGameSystemPerFrame( "CAllocTrace" )
+{
+	m_pActual = NULL;
+	m_bInstalled = false;
+	m_bReporting = false;
+	Reset();
+}
+
+void CAllocTrace::Shutdown()
+{
+	// Leaving the tracer installed past this point would send every allocation
+	// in the process into an unloaded module. If something wrapped us, it
+	// still forwards here, so there's nothing safe to put back either.
+	if ( IsInstalled() && g_pMemAlloc != this )
+	{
+		Error( "sv_alloc_trace: g_pMemAlloc was replaced after the tracer was installed, so it can't be removed before the server unloads.\n" );
+	}
+
+	Uninstall();
+}
+
+void CAllocTrace::Install()
+{
+	if ( IsInstalled() )
+		return;
+
+	Reset();
+
+	// Blocks handed out before this are freed through us as well, which is
+	// fine since nothing is added to the blocks themselves.
+	m_pActual = g_pMemAlloc;
+	g_pMemAlloc = this;
+	m_bInstalled = true;
+
+#ifdef VPROF_ENABLED
+	g_VProfCurrentProfile.Start();
+#endif
+
+	Msg( "Tracing heap allocations\n" );
+}
+
+void CAllocTrace::Uninstall()
+{
+	if ( !IsInstalled() )
+		return;
+
+	// Someone else may have wrapped the allocator after us; they still call
+	// into us, so stay in place rather than cut them off.
+	if ( g_pMemAlloc != this )
+	{
+		Warning( "g_pMemAlloc was replaced after sv_alloc_trace was turned on; leaving the tracer installed.\n" );
+		return;
+	}
+
+	// m_pActual stays set; another thread may still be inside one of our
+	// forwarding calls.
+	g_pMemAlloc = m_pActual;
+	m_bInstalled = false;
+
+#ifdef VPROF_ENABLED
+	g_VProfCurrentProfile.Stop();
+#endif
+}
+
+int CAllocTrace::FindOrAddSite( const char *pszScope, const char *pszFile, int nLine )
+{
+	// Scope and file names are literals, so the pointers identify them.
+	uintp nHash = ( (uintp)pszScope * 31 ) ^ ( (uintp)pszFile * 17 ) ^ (uintp)nLine;
+	nHash ^= nHash >> 13;
+
+	for ( int nProbe = 0; nProbe < MAX_SITES; nProbe++ )
+	{
+		int iSite = ( nHash + nProbe ) & ( MAX_SITES - 1 );
+		Site_t &site = m_Sites[iSite];
+		if ( site.m_pszScope == pszScope && site.m_pszFile == pszFile && site.m_nLine == nLine )
+			return iSite;
+
+		if ( !site.m_pszScope )
+		{
+			if ( m_nSites >= MAX_SITES / 2 )
+				break;
+
+			site.m_pszScope = pszScope;
+			site.m_pszFile = pszFile;
+			site.m_nLine = nLine;
+			m_nSites++;
+			return iSite;
+		}
+	}
+
+	return SITE_OVERFLOW;
+}
+
+void CAllocTrace::Record( size_t nSize, const char *pFileName, int nLine )
+{
+	if ( !m_bInstalled )
+		return;
+
+	if ( !ThreadInMainThread() )
+	{
+		ThreadInterlockedIncrement( &m_nOtherThreadAllocs );
+		return;
+	}
+
+	if ( m_bReporting )
+		return;
+
+	const char *pszScope = "(no scope)";
+#ifdef VPROF_ENABLED
+	CVProfNode *pNode = g_VProfCurrentProfile.GetCurrentNode();
+	if ( pNode && pNode != g_VProfCurrentProfile.GetRoot() )
+	{
+		pszScope = pNode->GetName();
+	}
+#endif
+
+	Site_t &site = m_Sites[ FindOrAddSite( pszScope, pFileName, pFileName ? nLine : 0 ) ];
+	if ( !site.m_nTickAllocs )
+	{
+		m_nTickSites++;
+	}
+	site.m_nTickAllocs++;
+	site.m_nTickBytes += nSize;
+
+	m_nTickAllocs++;
+	m_nTickBytes += nSize;
+}
+
+void *CAllocTrace::Alloc( size_t nSize )
+{
+	Record( nSize, NULL, 0 );
+	return m_pActual->Alloc( nSize );
+}
+
+void *CAllocTrace::Alloc( size_t nSize, const char *pFileName, int nLine )
+{
+	Record( nSize, pFileName, nLine );
+	return m_pActual->Alloc( nSize, pFileName, nLine );
+}
+
+void *CAllocTrace::Realloc( void *pMem, size_t nSize )
+{
+	Record( nSize, NULL, 0 );
+	return m_pActual->Realloc( pMem, nSize );
+}
+
+void *CAllocTrace::Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine )
+{
+	Record( nSize, pFileName, nLine );
+	return m_pActual->Realloc( pMem, nSize, pFileName, nLine );
+}
+
+void CAllocTrace::Free( void *pMem )
+{
+	if ( pMem && m_bInstalled && !m_bReporting && ThreadInMainThread() )
+	{
+		m_nTickFrees++;
+	}
+	m_pActual->Free( pMem );
+}
+
+void CAllocTrace::Free( void *pMem, const char *pFileName, int nLine )
+{
+	if ( pMem && m_bInstalled && !m_bReporting && ThreadInMainThread() )
+	{
+		m_nTickFrees++;
+	}
+	m_pActual->Free( pMem, pFileName, nLine );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rolls the tick that just ran into the totals.
+//-----------------------------------------------------------------------------
+void CAllocTrace::FrameUpdatePostEntityThink()
+{
+	if ( !IsInstalled() )
+		return;
+
+	m_nTicks++;
+	m_nAllocs += m_nTickAllocs;
+	m_nBytes += m_nTickBytes;
+	m_nFrees += m_nTickFrees;
+	m_nMaxTickAllocs = MAX( m_nMaxTickAllocs, m_nTickAllocs );
+	m_nMaxTickBytes = MAX( m_nMaxTickBytes, m_nTickBytes );
+
+	bool bFlag = m_nTickAllocs && sv_alloc_trace_zero.GetBool() && m_nTicks > sv_alloc_trace_zero_warmup.GetInt();
+	if ( bFlag )
+	{
+		m_nNonZeroTicks++;
+	}
+
+	int nTickAllocs = m_nTickAllocs;
+	int64 nTickBytes = m_nTickBytes;
+	int iWorstSite = -1;
+
+	for ( int i = 0; i <= MAX_SITES && m_nTickSites; i++ )
+	{
+		Site_t &site = m_Sites[i];
+		if ( !site.m_nTickAllocs )
+			continue;
+
+		if ( iWorstSite == -1 || site.m_nTickAllocs > m_Sites[iWorstSite].m_nTickAllocs )
+		{
+			iWorstSite = i;
+		}
+
+		site.m_nAllocs += site.m_nTickAllocs;
+		site.m_nBytes += site.m_nTickBytes;
+		site.m_nMaxTickAllocs = MAX( site.m_nMaxTickAllocs, site.m_nTickAllocs );
+		site.m_nTickAllocs = 0;
+		site.m_nTickBytes = 0;
+		m_nTickSites--;
+	}
+
+	m_nTickAllocs = 0;
+	m_nTickBytes = 0;
+	m_nTickFrees = 0;
+
+	if ( bFlag )
+	{
+		m_bReporting = true;
+
+		const Site_t &worst = m_Sites[iWorstSite];
+		Warning( "Tick %d made %d allocations (%lld bytes); most from %s %s:%d\n", gpGlobals->tickcount, nTickAllocs, (long long)nTickBytes,
+			worst.m_pszScope ? worst.m_pszScope : "(overflow)", worst.m_pszFile ? worst.m_pszFile : "?", worst.m_nLine );
+		AssertMsg( false, "sv_alloc_trace_zero: allocation in steady state" );
+
+		m_bReporting = false;
+	}
+}
+
+int CAllocTrace::SortByAllocs( const int *pLeft, const int *pRight )
+{
+	uint64 nLeft = g_AllocTrace.m_Sites[*pLeft].m_nAllocs;
+	uint64 nRight = g_AllocTrace.m_Sites[*pRight].m_nAllocs;
+	if ( nLeft == nRight )
+		return 0;
+
+	return ( nLeft > nRight ) ? -1 : 1;
+}
+
+void CAllocTrace::Dump()
+{
+	if ( !m_nTicks )
+	{
+		Msg( "No allocations counted yet. Set sv_alloc_trace 1 first.\n" );
+		return;
+	}
+
+	m_bReporting = true;
+
+	CUtlVector<int> sorted;
+	sorted.EnsureCapacity( m_nSites + 1 );
+	for ( int i = 0; i <= MAX_SITES; i++ )
+	{
+		if ( m_Sites[i].m_nAllocs )
+		{
+			sorted.AddToTail( i );
+		}
+	}
+	sorted.Sort( SortByAllocs );
+
+	Msg( "Main thread allocations over %d ticks:\n", m_nTicks );
+	Msg( "  %.1f allocs/tick (max %d), %.0f bytes/tick (max %lld), %.1f frees/tick\n",
+		(double)m_nAllocs / m_nTicks, m_nMaxTickAllocs,
+		(double)m_nBytes / m_nTicks, (long long)m_nMaxTickBytes,
+		(double)m_nFrees / m_nTicks );
+	Msg( "  %d allocations made on other threads\n", (int)m_nOtherThreadAllocs );
+	if ( sv_alloc_trace_zero.GetBool() )
+	{
+		Msg( "  %d ticks allocated after the warmup\n", m_nNonZeroTicks );
+	}
+
+	Msg( "%-40s %-32s %10s %9s %9s %12s\n", "scope", "file:line", "allocs", "avg/tick", "max/tick", "bytes" );
+
+	int nShown = MIN( sorted.Count(), 32 );
+	for ( int i = 0; i < nShown; i++ )
+	{
+		const Site_t &site = m_Sites[ sorted[i] ];
+
+		char szFileLine[64];
+		if ( site.m_pszFile )
+		{
+			Q_snprintf( szFileLine, sizeof( szFileLine ), "%s:%d", V_UnqualifiedFileName( site.m_pszFile ), site.m_nLine );
+		}
+		else
+		{
+			Q_strncpy( szFileLine, "-", sizeof( szFileLine ) );
+		}
+
+		Msg( "%-40s %-32s %10llu %9.2f %9d %12llu\n",
+			site.m_pszScope ? site.m_pszScope : "(overflow)",
+			szFileLine,
+			(unsigned long long)site.m_nAllocs,
+			(double)site.m_nAllocs / m_nTicks,
+			site.m_nMaxTickAllocs,
+			(unsigned long long)site.m_nBytes );
+	}
+
+	m_bReporting = false;
+}
+
+void CAllocTrace::Reset()
+{
+	memset( m_Sites, 0, sizeof( m_Sites ) );
+	m_nSites = 0;
+	m_nTickSites = 0;
+
+	m_nTickAllocs = 0;
+	m_nTickBytes = 0;
+	m_nTickFrees = 0;
+
+	m_nTicks = 0;
+	m_nAllocs = 0;
+	m_nBytes = 0;
+	m_nFrees = 0;
+	m_nMaxTickAllocs = 0;
+	m_nMaxTickBytes = 0;
+	m_nNonZeroTicks = 0;
+
+	m_nOtherThreadAllocs = 0;
+}
+
+
+
+int AllocTrace_GetTickAllocs()
+{
+	return g_AllocTrace.IsInstalled() ? g_AllocTrace.GetTickAllocs() : -1;
+}
+
+
+CON_COMMAND( sv_alloc_trace_dump, "Show the heap allocations made on the main thread since sv_alloc_trace was turned on, by VProf scope and call site." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_AllocTrace.Dump();
+}
+
+CON_COMMAND( sv_alloc_trace_reset, "Reset the allocation trace counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_AllocTrace.Reset();
+}
+
+#else
+
+int AllocTrace_GetTickAllocs()
+{
+	return -1;
+}
+
+#endif // !STEAM && !NO_MALLOC_OVERRIDE
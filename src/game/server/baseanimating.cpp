@@ -288,6 +288,9 @@ CBaseAnimating::CBaseAnimating()
 	m_fadeMaxDist = 0;
 	m_flFadeScale = 0.0f;
 	m_fBoneCacheFlags = 0;
+	m_nBoneSetupKey = 0;
+	m_iLastBoneCacheRequestTick = -1;
+	m_iQueuedBoneSetupTick = -1;
 }
 
 CBaseAnimating::~CBaseAnimating()
@@ -2582,6 +2585,20 @@ void CBaseAnimating::UnlockStudioHdr()
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: bones kept in the shared bone cache
+//-----------------------------------------------------------------------------
+static int GetBoneCacheMask( void )
+{
+	int boneMask = BONE_USED_BY_HITBOX | BONE_USED_BY_ATTACHMENT;
+
+	// TF queries these bones to position weapons when players are killed
+#if defined( TF_DLL ) || defined( TF_VINTAGE )
+	boneMask |= BONE_USED_BY_BONE_MERGE;
+#endif
+	return boneMask;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: return the index to the shared bone cache
 // Output :
@@ -2591,13 +2608,14 @@ CBoneCache *CBaseAnimating::GetBoneCache( void )
 	CStudioHdr *pStudioHdr = GetModelPtr( );
 	Assert(pStudioHdr);
 
-	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
-	int boneMask = BONE_USED_BY_HITBOX | BONE_USED_BY_ATTACHMENT;
+	// Remember who asks for bones so the next frame can set them up ahead of time
+	if ( ThreadInMainThread() )
+	{
+		m_iLastBoneCacheRequestTick = gpGlobals->tickcount;
+	}
 
-	// TF queries these bones to position weapons when players are killed
-#if defined( TF_DLL ) || defined( TF_VINTAGE )
-	boneMask |= BONE_USED_BY_BONE_MERGE;
-#endif
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+	int boneMask = GetBoneCacheMask();
 	if ( pcache )
 	{
 		if ( pcache->IsValid( gpGlobals->curtime ) && (pcache->m_boneMask & boneMask) == boneMask && pcache->m_timeValid <= gpGlobals->curtime)
@@ -2615,8 +2633,17 @@ CBoneCache *CBaseAnimating::GetBoneCache( void )
 		}
 	}
 
+	// Nothing that feeds the skeleton has changed since the bones were built, just revalidate them
+	CRC32_t nBoneSetupKey = ComputeBoneSetupKey( boneMask );
+	if ( pcache && nBoneSetupKey != 0 && nBoneSetupKey == m_nBoneSetupKey )
+	{
+		pcache->m_timeValid = gpGlobals->curtime;
+		return pcache;
+	}
+
 	matrix3x4_t bonetoworld[MAXSTUDIOBONES];
 	SetupBones( bonetoworld, boneMask );
+	m_nBoneSetupKey = nBoneSetupKey;
 
 	if ( pcache )
 	{
@@ -2642,6 +2669,153 @@ CBoneCache *CBaseAnimating::GetBoneCache( void )
 void CBaseAnimating::InvalidateBoneCache( void )
 {
 	Studio_InvalidateBoneCache( m_boneCacheHandle );
+	m_nBoneSetupKey = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hash everything that SetupBones reads so unchanged skeletons can
+//			reuse their cached bones. Returns 0 if the result can't be reused.
+//-----------------------------------------------------------------------------
+CRC32_t CBaseAnimating::ComputeBoneSetupKey( int boneMask )
+{
+	// IK and bone merging depend on state outside of this entity
+	if ( m_pIk || CanSkipAnimation() || dynamic_cast< CBaseAnimating* >( GetMoveParent() ) )
+		return 0;
+
+	// Autoplay sequences are driven by curtime
+	CStudioHdr *pStudioHdr = GetModelPtr();
+	if ( !pStudioHdr || pStudioHdr->GetAutoplayList( NULL ) > 0 )
+		return 0;
+
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, &boneMask, sizeof( boneMask ) );
+	HashBoneSetupInputs( &crc );
+	CRC32_Final( &crc );
+
+	// Reserve 0 for "not cacheable"
+	return crc ? crc : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Feed the inputs of the skeleton into the bone setup key
+//-----------------------------------------------------------------------------
+void CBaseAnimating::HashBoneSetupInputs( CRC32_t *pCRC )
+{
+	int nModelIndex = GetModelIndex();
+	int nSequence = GetSequence();
+	float flCycle = GetCycle();
+	float flScale = GetModelScale();
+	const Vector &vecOrigin = GetAbsOrigin();
+	const QAngle &angAngles = GetAbsAngles();
+
+	CRC32_ProcessBuffer( pCRC, &nModelIndex, sizeof( nModelIndex ) );
+	CRC32_ProcessBuffer( pCRC, &nSequence, sizeof( nSequence ) );
+	CRC32_ProcessBuffer( pCRC, &flCycle, sizeof( flCycle ) );
+	CRC32_ProcessBuffer( pCRC, &flScale, sizeof( flScale ) );
+	CRC32_ProcessBuffer( pCRC, &m_flEstIkOffset, sizeof( m_flEstIkOffset ) );
+	CRC32_ProcessBuffer( pCRC, &vecOrigin, sizeof( vecOrigin ) );
+	CRC32_ProcessBuffer( pCRC, &angAngles, sizeof( angAngles ) );
+	CRC32_ProcessBuffer( pCRC, GetPoseParameterArray(), sizeof( float ) * NUM_POSEPAREMETERS );
+	CRC32_ProcessBuffer( pCRC, GetEncodedControllerArray(), sizeof( float ) * NUM_BONECTRLS );
+}
+
+//-----------------------------------------------------------------------------
+// Threaded bone setup
+//
+// Entities that expect to need their bone cache next frame (they fired, or
+// asked for attachments/hitboxes recently) queue themselves, and have their
+// bones built in parallel at the start of the next frame before thinks and
+// usercmds start pulling attachments and hitboxes on the main thread.
+//-----------------------------------------------------------------------------
+ConVar sv_threaded_bone_setup( "sv_threaded_bone_setup", "0", 0, "Enable parallel processing of CBaseAnimating::SetupBones() for entities that will need bones this frame" );
+ConVar sv_threaded_bone_setup_window( "sv_threaded_bone_setup_window", "2", 0, "Number of ticks a bone cache request keeps an entity queued for threaded bone setup" );
+
+static CUtlVector<EHANDLE> g_QueuedBoneSetups;
+static CUtlVector<CBaseAnimating *> g_ThreadedBoneSetups;
+
+static void SetupBonesOnBaseAnimating( CBaseAnimating *&pBaseAnimating )
+{
+	pBaseAnimating->GetBoneCache();
+}
+
+static void PreThreadedBoneSetup()
+{
+	mdlcache->BeginLock();
+}
+
+static void PostThreadedBoneSetup()
+{
+	mdlcache->EndLock();
+}
+
+bool CBaseAnimating::HasRecentBoneCacheRequest( void ) const
+{
+	if ( m_iLastBoneCacheRequestTick < 0 )
+		return false;
+
+	return ( gpGlobals->tickcount - m_iLastBoneCacheRequestTick ) <= sv_threaded_bone_setup_window.GetInt();
+}
+
+void CBaseAnimating::QueueThreadedBoneSetup( void )
+{
+	Assert( ThreadInMainThread() );
+
+	if ( m_iQueuedBoneSetupTick == gpGlobals->tickcount )
+		return;
+
+	m_iQueuedBoneSetupTick = gpGlobals->tickcount;
+	g_QueuedBoneSetups.AddToTail( this );
+}
+
+void CBaseAnimating::ThreadedBoneSetup( void )
+{
+	VPROF_BUDGET( "CBaseAnimating::ThreadedBoneSetup", VPROF_BUDGETGROUP_SERVER_ANIM );
+
+	if ( !sv_threaded_bone_setup.GetBool() )
+	{
+		g_QueuedBoneSetups.RemoveAll();
+		return;
+	}
+
+	g_ThreadedBoneSetups.RemoveAll();
+
+	int boneMask = GetBoneCacheMask();
+	for ( int i = 0; i < g_QueuedBoneSetups.Count(); ++i )
+	{
+		CBaseAnimating *pAnimating = g_QueuedBoneSetups[i] ? g_QueuedBoneSetups[i]->GetBaseAnimating() : NULL;
+		if ( !pAnimating || pAnimating->IsMarkedForDeletion() || !pAnimating->GetModelPtr() )
+			continue;
+
+		// Bone merged children read their parent's cache, leave them to the main thread
+		if ( !pAnimating->WantsThreadedBoneSetup() || dynamic_cast< CBaseAnimating* >( pAnimating->GetMoveParent() ) )
+			continue;
+
+		// Still good from an earlier request, GetBoneCache would return it as-is
+		CBoneCache *pcache = Studio_GetBoneCache( pAnimating->m_boneCacheHandle );
+		if ( pcache && pcache->IsValid( gpGlobals->curtime ) && ( pcache->m_boneMask & boneMask ) == boneMask && pcache->m_timeValid <= gpGlobals->curtime )
+			continue;
+
+		g_ThreadedBoneSetups.AddToTail( pAnimating );
+	}
+
+	g_QueuedBoneSetups.RemoveAll();
+
+	CUtlVector<CBaseAnimating *> &requests = g_ThreadedBoneSetups;
+	if ( requests.Count() > 1 )
+	{
+		ParallelProcess( "CBaseAnimating::ThreadedBoneSetup", requests.Base(), requests.Count(), &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+	}
+	else if ( requests.Count() == 1 )
+	{
+		requests[0]->GetBoneCache();
+	}
+}
+
+void CBaseAnimating::ShutdownThreadedBoneSetup( void )
+{
+	g_QueuedBoneSetups.Purge();
+	g_ThreadedBoneSetups.Purge();
 }
 
 bool CBaseAnimating::TestCollision( const Ray_t &ray, unsigned int fContentsMask, trace_t& tr )
@@ -15,6 +15,7 @@
 #include "studio.h"
 #include "datacache/idatacache.h"
 #include "tier0/threadtools.h"
+#include "checksum_crc.h"
 
 
 struct animevent_t;
@@ -135,6 +136,7 @@ public:
 
 	virtual void GetBoneTransform( int iBone, matrix3x4_t &pBoneToWorld );
 	virtual void SetupBones( matrix3x4_t *pBoneToWorld, int boneMask );
+	virtual void HashBoneSetupInputs( CRC32_t *pCRC );
 	virtual void CalculateIKLocks( float currentTime );
 	virtual void Teleport( const Vector *newPosition, const QAngle *newAngles, const Vector *newVelocity );
 
@@ -259,6 +261,13 @@ public:
 	class CBoneCache *GetBoneCache( void );
 	void InvalidateBoneCache();
 	void InvalidateBoneCacheIfOlderThan( float deltaTime );
+
+	// Threaded bone setup, run once per frame before entities think
+	static void ThreadedBoneSetup( void );
+	static void ShutdownThreadedBoneSetup( void );
+	void QueueThreadedBoneSetup( void );
+	virtual bool WantsThreadedBoneSetup( void ) { return false; }
+	bool HasRecentBoneCacheRequest( void ) const;
 	virtual int DrawDebugTextOverlays( void );
 	
 	// See note in code re: bandwidth usage!!!
@@ -409,6 +418,11 @@ private:
 	memhandle_t		m_boneCacheHandle;
 	unsigned short	m_fBoneCacheFlags;		// Used for bone cache state on model
 
+	CRC32_t			ComputeBoneSetupKey( int boneMask );
+	CRC32_t			m_nBoneSetupKey;		// Hash of the inputs the cached bones were built from, 0 if not reusable
+	int				m_iLastBoneCacheRequestTick;
+	int				m_iQueuedBoneSetupTick;
+
 protected:
 	CNetworkVar( float, m_fadeMinDist );	// Point at which fading is absolute
 	CNetworkVar( float, m_fadeMaxDist );	// Point at which fading is inactive
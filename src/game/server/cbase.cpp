@@ -644,8 +644,9 @@ CEventQueue g_EventQueue;
 
 CEventQueue::CEventQueue()
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_nNextSequence = 0;
+	memset( m_pEventsByCaller, 0, sizeof( m_pEventsByCaller ) );
+	memset( m_pEventsByTarget, 0, sizeof( m_pEventsByTarget ) );
 
 	Init();
 }
@@ -759,21 +760,21 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		delete m_Events[i];
 	}
 
-	m_Events.m_pNext = NULL;
+	m_Events.RemoveAll();
+
+	memset( m_pEventsByCaller, 0, sizeof( m_pEventsByCaller ) );
+	memset( m_pEventsByTarget, 0, sizeof( m_pEventsByTarget ) );
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetEventsInFireOrder( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #if defined( TF_DLL ) || defined(TF_VINTAGE)
@@ -783,9 +784,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -794,8 +795,6 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
@@ -857,41 +856,171 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
+// Purpose: private function, adds an event into the queue
 // Input  : *newEvent - the (already built) event to add
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	newEvent->m_nSequence = m_nNextSequence++;
+
+	// link it into the lists of its caller and target
+	newEvent->m_iCallerSlot = -1;
+	newEvent->m_pNextByCaller = newEvent->m_pPrevByCaller = NULL;
+	if ( newEvent->m_pCaller.IsValid() )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+		int iSlot = newEvent->m_pCaller.GetEntryIndex();
+		newEvent->m_iCallerSlot = iSlot;
+		newEvent->m_pNextByCaller = m_pEventsByCaller[iSlot];
+		if ( newEvent->m_pNextByCaller )
 		{
-			break;
+			newEvent->m_pNextByCaller->m_pPrevByCaller = newEvent;
 		}
+		m_pEventsByCaller[iSlot] = newEvent;
 	}
 
-	Assert( pe );
-
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	newEvent->m_iTargetSlot = -1;
+	newEvent->m_pNextByTarget = newEvent->m_pPrevByTarget = NULL;
+	if ( newEvent->m_pEntTarget.IsValid() )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		int iSlot = newEvent->m_pEntTarget.GetEntryIndex();
+		newEvent->m_iTargetSlot = iSlot;
+		newEvent->m_pNextByTarget = m_pEventsByTarget[iSlot];
+		if ( newEvent->m_pNextByTarget )
+		{
+			newEvent->m_pNextByTarget->m_pPrevByTarget = newEvent;
+		}
+		m_pEventsByTarget[iSlot] = newEvent;
 	}
+
+	SetHeapElement( m_Events.AddToTail(), newEvent );
+	SiftUp( newEvent->m_iHeapIndex );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: private function, takes an event out of the queue without deleting it
+//-----------------------------------------------------------------------------
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	if ( pe->m_iCallerSlot != -1 )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		if ( pe->m_pPrevByCaller )
+			pe->m_pPrevByCaller->m_pNextByCaller = pe->m_pNextByCaller;
+		else
+			m_pEventsByCaller[pe->m_iCallerSlot] = pe->m_pNextByCaller;
+
+		if ( pe->m_pNextByCaller )
+			pe->m_pNextByCaller->m_pPrevByCaller = pe->m_pPrevByCaller;
+
+		pe->m_iCallerSlot = -1;
 	}
+
+	if ( pe->m_iTargetSlot != -1 )
+	{
+		if ( pe->m_pPrevByTarget )
+			pe->m_pPrevByTarget->m_pNextByTarget = pe->m_pNextByTarget;
+		else
+			m_pEventsByTarget[pe->m_iTargetSlot] = pe->m_pNextByTarget;
+
+		if ( pe->m_pNextByTarget )
+			pe->m_pNextByTarget->m_pPrevByTarget = pe->m_pPrevByTarget;
+
+		pe->m_iTargetSlot = -1;
+	}
+
+	// move the last event into the hole and let it find its place
+	int iIndex = pe->m_iHeapIndex;
+	Assert( m_Events.IsValidIndex( iIndex ) && m_Events[iIndex] == pe );
+
+	int iLast = m_Events.Count() - 1;
+	if ( iIndex != iLast )
+	{
+		SetHeapElement( iIndex, m_Events[iLast] );
+		m_Events.RemoveMultipleFromTail( 1 );
+
+		if ( iIndex > 0 && FiresBefore( m_Events[iIndex], m_Events[( iIndex - 1 ) / 2] ) )
+		{
+			SiftUp( iIndex );
+		}
+		else
+		{
+			SiftDown( iIndex );
+		}
+	}
+	else
+	{
+		m_Events.RemoveMultipleFromTail( 1 );
+	}
+
+	pe->m_iHeapIndex = -1;
+}
+
+bool CEventQueue::FiresBefore( const EventQueuePrioritizedEvent_t *pLeft, const EventQueuePrioritizedEvent_t *pRight )
+{
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return pLeft->m_flFireTime < pRight->m_flFireTime;
+
+	return (int)( pLeft->m_nSequence - pRight->m_nSequence ) < 0;
+}
+
+int CEventQueue::SortByFireOrder( EventQueuePrioritizedEvent_t * const *ppLeft, EventQueuePrioritizedEvent_t * const *ppRight )
+{
+	if ( FiresBefore( *ppLeft, *ppRight ) )
+		return -1;
+
+	return FiresBefore( *ppRight, *ppLeft ) ? 1 : 0;
+}
+
+void CEventQueue::SetHeapElement( int iIndex, EventQueuePrioritizedEvent_t *pe )
+{
+	m_Events[iIndex] = pe;
+	pe->m_iHeapIndex = iIndex;
+}
+
+void CEventQueue::SiftUp( int iIndex )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Events[iIndex];
+	while ( iIndex > 0 )
+	{
+		int iParent = ( iIndex - 1 ) / 2;
+		if ( !FiresBefore( pe, m_Events[iParent] ) )
+			break;
+
+		SetHeapElement( iIndex, m_Events[iParent] );
+		iIndex = iParent;
+	}
+
+	SetHeapElement( iIndex, pe );
+}
+
+void CEventQueue::SiftDown( int iIndex )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Events[iIndex];
+	int nCount = m_Events.Count();
+	while ( 1 )
+	{
+		int iChild = iIndex * 2 + 1;
+		if ( iChild >= nCount )
+			break;
+
+		if ( iChild + 1 < nCount && FiresBefore( m_Events[iChild + 1], m_Events[iChild] ) )
+		{
+			iChild++;
+		}
+
+		if ( !FiresBefore( m_Events[iChild], pe ) )
+			break;
+
+		SetHeapElement( iIndex, m_Events[iChild] );
+		iIndex = iChild;
+	}
+
+	SetHeapElement( iIndex, pe );
+}
+
+void CEventQueue::GetEventsInFireOrder( CUtlVector<EventQueuePrioritizedEvent_t *> &events )
+{
+	events.CopyArray( m_Events.Base(), m_Events.Count() );
+	events.Sort( SortByFireOrder );
 }
 
 
@@ -905,16 +1034,19 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-
 #if defined( TF_DLL ) || defined(TF_VINTAGE)
-	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
+	while ( m_Events.Count() && m_Events[0]->m_flFireTime <= engine->GetServerTime() )
 #else
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	while ( m_Events.Count() && m_Events[0]->m_flFireTime <= gpGlobals->curtime )
 #endif
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// take the event out of the queue before firing it, so inputs that
+		// cancel events or clear the queue can't delete it under us
+		EventQueuePrioritizedEvent_t *pe = m_Events[0];
+		RemoveEvent( pe );
+
 		bool targetFound = false;
 
 		// find the targets
@@ -978,8 +1110,6 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
-		RemoveEvent( pe );
 		delete pe;
 
 		//
@@ -992,9 +1122,6 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
 }
 
@@ -1019,10 +1146,10 @@ static ConCommand dumpeventqueue( "dumpeventqueue", CC_DumpEventQueue, "Dump the
 //-----------------------------------------------------------------------------
 void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 {
-	if (!pCaller)
+	if (!pCaller || !pCaller->GetRefEHandle().IsValid())
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = m_pEventsByCaller[pCaller->GetRefEHandle().GetEntryIndex()];
 
 	while (pCur != NULL)
 	{
@@ -1039,7 +1166,7 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 		}
 
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByCaller;
 
 		if (bDelete)
 		{
@@ -1057,10 +1184,10 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 //-----------------------------------------------------------------------------
 void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 {
-	if (!pTarget)
+	if (!pTarget || !pTarget->GetRefEHandle().IsValid())
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = m_pEventsByTarget[pTarget->GetRefEHandle().GetEntryIndex()];
 
 	while (pCur != NULL)
 	{
@@ -1075,7 +1202,7 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 		}
 
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByTarget;
 
 		if (bDelete)
 		{
@@ -1092,10 +1219,10 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 //-----------------------------------------------------------------------------
 bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName )
 {
-	if (!pTarget)
+	if (!pTarget || !pTarget->GetRefEHandle().IsValid())
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = m_pEventsByTarget[pTarget->GetRefEHandle().GetEntryIndex()];
 
 	while (pCur != NULL)
 	{
@@ -1108,7 +1235,7 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 				return true;
 		}
 
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByTarget;
 	}
 
 	return false;
@@ -1143,29 +1270,27 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+//	DEFINE_FIELD( m_nSequence, FIELD_INTEGER ),	// the queue is saved in fire order
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
 	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetEventsInFireOrder( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
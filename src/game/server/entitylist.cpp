@@ -33,6 +33,8 @@ static CUtlVector<IServerNetworkable*> g_DeleteList;
 CGlobalEntityList gEntList;
 CBaseEntityList *g_pEntityList = &gEntList;
 
+ConVar ent_name_index( "ent_name_index", "1", FCVAR_CHEAT, "Answer exact classname and targetname finds from the per name entity lists instead of walking every entity." );
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -294,6 +296,8 @@ CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_nNextEntitySerial = 0;
+	ClearNameIndex();
 }
 
 
@@ -382,6 +386,9 @@ void CGlobalEntityList::Clear( void )
 	m_iHighestEnt = 0;
 	m_iNumEnts = 0;
 
+	// Everything unlinked itself on the way out, this just drops the buckets.
+	ClearNameIndex();
+
 	m_bClearingEntities = false;
 }
 
@@ -481,6 +488,12 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 {
+	int iFirst;
+	if ( FindFirstInNameIndex( NAME_INDEX_CLASSNAME, pStartEntity, szName, iFirst ) )
+	{
+		return ( iFirst != -1 ) ? (CBaseEntity *)GetEntInfoPtrByIndex( iFirst )->m_pEntity : NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -590,6 +603,21 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	int iFirst;
+	if ( FindFirstInNameIndex( NAME_INDEX_TARGETNAME, pStartEntity, szName, iFirst ) )
+	{
+		for ( int i = iFirst; i != -1; i = m_NameLinks[NAME_INDEX_TARGETNAME][i].m_iNext )
+		{
+			CBaseEntity *ent = (CBaseEntity *)GetEntInfoPtrByIndex( i )->m_pEntity;
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -1100,6 +1128,11 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	{
 		m_entityListeners[i]->OnEntityCreated( pBaseEnt );
 	}
+
+	int iSlot = handle.GetEntryIndex();
+	m_nEntitySerial[iSlot] = m_nNextEntitySerial++;
+	LinkEntityName( NAME_INDEX_CLASSNAME, iSlot, pBaseEnt->m_iClassname );
+	LinkEntityName( NAME_INDEX_TARGETNAME, iSlot, pBaseEnt->GetEntityName() );
 }
 
 
@@ -1126,6 +1159,151 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 		m_iNumEdicts--;
 
 	m_iNumEnts--;
+
+	UnlinkEntityName( NAME_INDEX_CLASSNAME, handle.GetEntryIndex() );
+	UnlinkEntityName( NAME_INDEX_TARGETNAME, handle.GetEntryIndex() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves an entity to the lists for its current classname and
+//			targetname. Does nothing for entities that aren't in the list yet,
+//			OnAddEntity picks up their names.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::UpdateEntityNameIndex( CBaseEntity *pEntity )
+{
+	const CBaseHandle &handle = pEntity->GetRefEHandle();
+	if ( !handle.IsValid() || LookupEntity( handle ) != pEntity )
+		return;
+
+	LinkEntityName( NAME_INDEX_CLASSNAME, handle.GetEntryIndex(), pEntity->m_iClassname );
+	LinkEntityName( NAME_INDEX_TARGETNAME, handle.GetEntryIndex(), pEntity->GetEntityName() );
+}
+
+void CGlobalEntityList::LinkEntityName( int iIndex, int iSlot, string_t name )
+{
+	NameLink_t &link = m_NameLinks[iIndex][iSlot];
+	if ( name == NULL_STRING )
+	{
+		UnlinkEntityName( iIndex, iSlot );
+		return;
+	}
+
+	if ( link.m_pszKey && !Q_stricmp( link.m_pszKey, STRING( name ) ) )
+		return;
+
+	UnlinkEntityName( iIndex, iSlot );
+
+	// Names set with MAKE_STRING aren't pooled, and the bucket may outlive
+	// this entity's name, so key on the pooled copy.
+	const char *pszKey = STRING( AllocPooledString( STRING( name ) ) );
+
+	NameBucketTable_t &buckets = m_NameBuckets[iIndex];
+	UtlHashHandle_t h = buckets.Find( pszKey );
+	if ( h == buckets.InvalidHandle() )
+	{
+		NameBucket_t empty = { -1, -1 };
+		h = buckets.Insert( pszKey, empty );
+	}
+	NameBucket_t &bucket = buckets[h];
+
+	// Keep the list order. New entities go on the end; only renames walk back.
+	int iPrev = bucket.m_iTail;
+	while ( iPrev != -1 && m_nEntitySerial[iPrev] > m_nEntitySerial[iSlot] )
+	{
+		iPrev = m_NameLinks[iIndex][iPrev].m_iPrev;
+	}
+
+	int iNext = ( iPrev != -1 ) ? m_NameLinks[iIndex][iPrev].m_iNext : bucket.m_iHead;
+
+	link.m_pszKey = pszKey;
+	link.m_iPrev = iPrev;
+	link.m_iNext = iNext;
+
+	if ( iPrev != -1 )
+		m_NameLinks[iIndex][iPrev].m_iNext = iSlot;
+	else
+		bucket.m_iHead = iSlot;
+
+	if ( iNext != -1 )
+		m_NameLinks[iIndex][iNext].m_iPrev = iSlot;
+	else
+		bucket.m_iTail = iSlot;
+}
+
+void CGlobalEntityList::UnlinkEntityName( int iIndex, int iSlot )
+{
+	NameLink_t &link = m_NameLinks[iIndex][iSlot];
+	if ( !link.m_pszKey )
+		return;
+
+	NameBucketTable_t &buckets = m_NameBuckets[iIndex];
+	UtlHashHandle_t h = buckets.Find( link.m_pszKey );
+	Assert( h != buckets.InvalidHandle() );
+	if ( h != buckets.InvalidHandle() )
+	{
+		NameBucket_t &bucket = buckets[h];
+
+		if ( link.m_iPrev != -1 )
+			m_NameLinks[iIndex][link.m_iPrev].m_iNext = link.m_iNext;
+		else
+			bucket.m_iHead = link.m_iNext;
+
+		if ( link.m_iNext != -1 )
+			m_NameLinks[iIndex][link.m_iNext].m_iPrev = link.m_iPrev;
+		else
+			bucket.m_iTail = link.m_iPrev;
+
+		if ( bucket.m_iHead == -1 )
+		{
+			buckets.Remove( link.m_pszKey );
+		}
+	}
+
+	link.m_pszKey = NULL;
+	link.m_iPrev = link.m_iNext = -1;
+}
+
+void CGlobalEntityList::ClearNameIndex()
+{
+	for ( int i = 0; i < NAME_INDEX_COUNT; i++ )
+	{
+		m_NameBuckets[i].Purge();
+
+		for ( int j = 0; j < NUM_ENT_ENTRIES; j++ )
+		{
+			m_NameLinks[i][j].m_pszKey = NULL;
+			m_NameLinks[i][j].m_iPrev = m_NameLinks[i][j].m_iNext = -1;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds where an exact name search starts in the name lists.
+// Output : iFirst - Slot of the first match after pStartEntity, -1 if none.
+//			Returns false for wildcards, or when pStartEntity isn't in the list
+//			for szName, in which case the caller walks the entity list.
+//-----------------------------------------------------------------------------
+bool CGlobalEntityList::FindFirstInNameIndex( int iIndex, CBaseEntity *pStartEntity, const char *szName, int &iFirst )
+{
+	if ( !ent_name_index.GetBool() || !szName || !szName[0] || strchr( szName, '*' ) )
+		return false;
+
+	if ( pStartEntity )
+	{
+		if ( !pStartEntity->GetRefEHandle().IsValid() )
+			return false;
+
+		const NameLink_t &link = m_NameLinks[iIndex][ pStartEntity->GetRefEHandle().GetEntryIndex() ];
+		if ( !link.m_pszKey || Q_stricmp( link.m_pszKey, szName ) )
+			return false;
+
+		iFirst = link.m_iNext;
+		return true;
+	}
+
+	const NameBucket_t *pBucket = m_NameBuckets[iIndex].GetPtr( szName );
+	iFirst = pBucket ? pBucket->m_iHead : -1;
+	return true;
 }
 
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
@@ -14,6 +14,7 @@
 #endif
 
 #include "baseentity.h"
+#include "utlhashtable.h"
 
 class IEntityListener;
 
@@ -157,6 +158,9 @@ public:
 	CBaseEntity *FindEntityClassNearestFacing( const Vector &origin, const Vector &facing, float threshold, char *classname);
 
 	CBaseEntity *FindEntityProcedural( const char *szName, CBaseEntity *pSearchingEntity = NULL, CBaseEntity *pActivator = NULL, CBaseEntity *pCaller = NULL );
+
+	// Call when the classname or targetname of an entity changes.
+	void UpdateEntityNameIndex( CBaseEntity *pEntity );
 	
 	CGlobalEntityList();
 
@@ -166,6 +170,45 @@ protected:
 	virtual void OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle );
 	virtual void OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle );
 
+private:
+	// The entities sharing a classname or a targetname are linked together,
+	// in the same order as the entity list, so exact finds only visit the
+	// entities that match. Names are matched without case, like NamesMatch.
+	// Wildcard finds still walk the whole list.
+	enum
+	{
+		NAME_INDEX_CLASSNAME = 0,
+		NAME_INDEX_TARGETNAME,
+
+		NAME_INDEX_COUNT
+	};
+
+	struct NameBucket_t
+	{
+		int m_iHead;
+		int m_iTail;
+	};
+
+	struct NameLink_t
+	{
+		const char	*m_pszKey;	// Pooled name of the bucket, NULL if not linked
+		int			m_iPrev;
+		int			m_iNext;
+	};
+
+	void LinkEntityName( int iIndex, int iSlot, string_t name );
+	void UnlinkEntityName( int iIndex, int iSlot );
+	void ClearNameIndex();
+
+	// Returns false if the query has to be answered by walking the whole list.
+	bool FindFirstInNameIndex( int iIndex, CBaseEntity *pStartEntity, const char *szName, int &iFirst );
+
+	typedef CUtlHashtable<const char *, NameBucket_t, CaselessStringHashFunctor, CaselessStringEqualFunctor> NameBucketTable_t;
+
+	NameBucketTable_t	m_NameBuckets[NAME_INDEX_COUNT];
+	NameLink_t			m_NameLinks[NAME_INDEX_COUNT][NUM_ENT_ENTRIES];
+	unsigned int		m_nEntitySerial[NUM_ENT_ENTRIES];
+	unsigned int		m_nNextEntitySerial;
 };
 
 extern CGlobalEntityList gEntList;
@@ -6,6 +6,11 @@
 //
 //			The queue is serviced once per server frame.
 //
+//			Events are kept in a binary heap ordered by fire time, then by
+//			the order they were added in. Each event is also linked into
+//			per entity lists for its caller and its target, so cancelling
+//			or looking up the events of one entity doesn't walk the queue.
+//
 //=============================================================================//
 
 #ifndef EVENTQUEUE_H
@@ -15,6 +20,7 @@
 #endif
 
 #include "mempool.h"
+#include "utlvector.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +34,17 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	unsigned int m_nSequence;	// breaks fire time ties in the order the events were added
+	int m_iHeapIndex;
+
+	// Links in the per entity lists, by entity list slot. -1 if not linked.
+	int m_iCallerSlot;
+	EventQueuePrioritizedEvent_t *m_pNextByCaller;
+	EventQueuePrioritizedEvent_t *m_pPrevByCaller;
+
+	int m_iTargetSlot;
+	EventQueuePrioritizedEvent_t *m_pNextByTarget;
+	EventQueuePrioritizedEvent_t *m_pPrevByTarget;
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -71,9 +86,23 @@ private:
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
 
+	// heap maintenance
+	static bool FiresBefore( const EventQueuePrioritizedEvent_t *pLeft, const EventQueuePrioritizedEvent_t *pRight );
+	static int SortByFireOrder( EventQueuePrioritizedEvent_t * const *ppLeft, EventQueuePrioritizedEvent_t * const *ppRight );
+	void SiftUp( int iIndex );
+	void SiftDown( int iIndex );
+	void SetHeapElement( int iIndex, EventQueuePrioritizedEvent_t *pe );
+
+	// all the events in the order they will fire, for dumping and saving
+	void GetEventsInFireOrder( CUtlVector<EventQueuePrioritizedEvent_t *> &events );
+
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector<EventQueuePrioritizedEvent_t *> m_Events;
+	unsigned int m_nNextSequence;
 	int m_iListCount;
+
+	EventQueuePrioritizedEvent_t *m_pEventsByCaller[NUM_ENT_ENTRIES];
+	EventQueuePrioritizedEvent_t *m_pEventsByTarget[NUM_ENT_ENTRIES];
 };
 
 extern CEventQueue g_EventQueue;
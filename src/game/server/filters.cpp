@@ -9,6 +9,9 @@
 #include "entitylist.h"
 #include "ai_squad.h"
 #include "ai_basenpc.h"
+#ifdef TF_DLL
+#include "tf_player.h"
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -31,8 +34,58 @@ BEGIN_DATADESC( CBaseFilter )
 
 END_DATADESC()
 
+ConVar ent_filter_compile( "ent_filter_compile", "1", FCVAR_CHEAT, "Test team and class filters from their compiled bitmasks instead of running the filter code." );
+
+// Starts above the zero a new filter has, so each compiles on first use.
+int CBaseFilter::s_nCompileGeneration = 1;
+
 //-----------------------------------------------------------------------------
 
+void CBaseFilter::Activate( void )
+{
+	BaseClass::Activate();
+
+	CompileFilter();
+}
+
+
+bool CBaseFilter::KeyValue( const char *szKeyName, const char *szValue )
+{
+	// AddOutput can change what the filter tests at any time.
+	InvalidateCompiledFilter();
+
+	return BaseClass::KeyValue( szKeyName, szValue );
+}
+
+
+void CBaseFilter::ChangeTeam( int iTeamNum )
+{
+	BaseClass::ChangeTeam( iTeamNum );
+
+	InvalidateCompiledFilter();
+}
+
+
+void CBaseFilter::CompileFilter( void )
+{
+	m_nCompiledGeneration = s_nCompileGeneration;
+
+	m_Compiled.Clear();
+	m_bCompiled = CompileFilterImpl( m_Compiled );
+
+	if ( m_bCompiled && m_bNegated )
+	{
+		for ( int i = 0; i < FILTER_ENTITY_TYPE_COUNT; i++ )
+		{
+			for ( int j = 0; j < MAX_TEAMS; j++ )
+			{
+				m_Compiled.m_nPassClasses[i][j] = ~m_Compiled.m_nPassClasses[i][j];
+			}
+		}
+	}
+}
+
+
 bool CBaseFilter::PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity )
 {
 	return true;
@@ -41,6 +94,38 @@ bool CBaseFilter::PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity )
 
 bool CBaseFilter::PassesFilter( CBaseEntity *pCaller, CBaseEntity *pEntity )
 {
+	if ( ent_filter_compile.GetBool() && pEntity )
+	{
+		if ( m_nCompiledGeneration != s_nCompileGeneration )
+		{
+			CompileFilter();
+		}
+
+		int iTeam = pEntity->GetTeamNumber();
+		if ( m_bCompiled && iTeam >= 0 && iTeam < MAX_TEAMS )
+		{
+			int iType = FILTER_ENTITY_OTHER;
+			int iClass = 0;
+			if ( pEntity->IsPlayer() )
+			{
+				iType = FILTER_ENTITY_PLAYER;
+#ifdef TF_DLL
+				COMPILE_TIME_ASSERT( TF_CLASS_COUNT_ALL <= 32 );
+				iClass = ToTFPlayer( pEntity )->GetPlayerClass()->GetClassIndex();
+#endif
+			}
+			else if ( pEntity->GetFlags() & FL_NPC )
+			{
+				iType = FILTER_ENTITY_NPC;
+			}
+
+			if ( m_Compiled.m_nAlwaysPassTeams[iType] & ( 1u << iTeam ) )
+				return true;
+
+			return ( m_Compiled.m_nPassClasses[iType][iTeam] & ( 1u << iClass ) ) != 0;
+		}
+	}
+
 	bool baseResult = PassesFilterImpl( pCaller, pEntity );
 	return (m_bNegated) ? !baseResult : baseResult;
 }
@@ -312,6 +397,12 @@ public:
 	{
 	 	return ( pEntity->GetTeamNumber() == m_iFilterTeam );
 	}
+
+	bool CompileFilterImpl( CompiledFilter_t &compiled )
+	{
+		compiled.SetTeam( m_iFilterTeam );
+		return true;
+	}
 };
 
 LINK_ENTITY_TO_CLASS( filter_activator_team, FilterTeam );
@@ -17,6 +17,10 @@
 //			More than one filter can be combined to create a more complex boolean
 //			expression by using filter_multi.
 //
+//			Filters that only look at the team, player class and type of the
+//			activator are compiled into bitmasks when they activate, and
+//			tested from those until something they depend on changes.
+//
 //=============================================================================//
 
 #ifndef FILTERS_H
@@ -28,6 +32,47 @@
 #include "baseentity.h"
 #include "entityoutput.h"
 
+// Kinds of activator a compiled filter tells apart.
+enum FilterEntityType_t
+{
+	FILTER_ENTITY_PLAYER = 0,
+	FILTER_ENTITY_NPC,
+	FILTER_ENTITY_OTHER,
+
+	FILTER_ENTITY_TYPE_COUNT
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A filter reduced to bitmasks. For each activator type and team,
+//			bit n of m_nPassClasses is set if the activator passes with player
+//			class n; activators without a class use bit 0.
+//-----------------------------------------------------------------------------
+struct CompiledFilter_t
+{
+	void Clear()
+	{
+		memset( m_nPassClasses, 0, sizeof( m_nPassClasses ) );
+		memset( m_nAlwaysPassTeams, 0, sizeof( m_nAlwaysPassTeams ) );
+	}
+
+	void SetTeam( int iTeam, uint32 nClasses = 0xFFFFFFFF )
+	{
+		if ( iTeam >= 0 && iTeam < MAX_TEAMS )
+		{
+			for ( int i = 0; i < FILTER_ENTITY_TYPE_COUNT; i++ )
+			{
+				m_nPassClasses[i][iTeam] |= nClasses;
+			}
+		}
+	}
+
+	uint32	m_nPassClasses[FILTER_ENTITY_TYPE_COUNT][MAX_TEAMS];
+
+	// Teams that pass whatever the rest says, even when the filter is
+	// negated. One bit per team, for each activator type.
+	uint32	m_nAlwaysPassTeams[FILTER_ENTITY_TYPE_COUNT];
+};
+
 // ###################################################################
 //	> BaseFilter
 // ###################################################################
@@ -39,9 +84,18 @@ public:
 
 	DECLARE_DATADESC();
 
+	virtual void Activate( void );
+	virtual bool KeyValue( const char *szKeyName, const char *szValue );
+	virtual void ChangeTeam( int iTeamNum );
+
 	bool PassesFilter( CBaseEntity *pCaller, CBaseEntity *pEntity );
 	bool PassesDamageFilter( const CTakeDamageInfo &info );
 
+	// Makes every filter compile itself again before its next test. Call it
+	// when game state that CompileFilterImpl reads changes.
+	static void InvalidateCompiledFilters( void ) { s_nCompileGeneration++; }
+	void InvalidateCompiledFilter( void ) { m_nCompiledGeneration = 0; }
+
 	bool m_bNegated;
 
 	// Inputs
@@ -55,6 +109,19 @@ protected:
 
 	virtual bool PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity );
 	virtual bool PassesDamageFilterImpl(const CTakeDamageInfo &info);
+
+	// Fills in what PassesFilterImpl would answer, before negation. Returns
+	// false if the filter can't be put as bitmasks.
+	virtual bool CompileFilterImpl( CompiledFilter_t &compiled ) { return false; }
+
+private:
+	void CompileFilter( void );
+
+	bool				m_bCompiled;
+	int					m_nCompiledGeneration;
+	CompiledFilter_t	m_Compiled;
+
+	static int			s_nCompileGeneration;
 };
 
 #endif // FILTERS_H
@@ -0,0 +1,195 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Typed construction of the game events fired many times a tick.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "gameeventbuilder.h"
+#include "igameevents.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CGameEventDesc *CGameEventDesc::s_pFirst = NULL;
+
+// Main thread allocations counted this tick by sv_alloc_trace, or -1.
+extern int AllocTrace_GetTickAllocs();
+
+
+CGameEventDesc::CGameEventDesc( const char *pszName, const GameEventField_t *pFields, int nFields )
+{
+	Assert( nFields <= MAX_GAMEEVENT_BUILDER_FIELDS );
+
+	m_pszName = pszName;
+	m_pFields = pFields;
+	m_nFields = MIN( nFields, MAX_GAMEEVENT_BUILDER_FIELDS );
+	memset( m_LastValues, 0, sizeof( m_LastValues ) );
+
+	m_pNext = s_pFirst;
+	s_pFirst = this;
+}
+
+
+CGameEventBuilder::CGameEventBuilder( CGameEventDesc &desc ) : m_Desc( desc )
+{
+	memset( m_Values, 0, sizeof( m_Values ) );
+}
+
+static void WriteField( IGameEvent *event, const GameEventField_t &field, const GameEventValue_t &value )
+{
+	switch ( field.m_eType )
+	{
+	case GAMEEVENT_FIELD_INT:
+		event->SetInt( field.m_pszName, value.m_nValue );
+		break;
+	case GAMEEVENT_FIELD_BOOL:
+		event->SetBool( field.m_pszName, value.m_nValue != 0 );
+		break;
+	case GAMEEVENT_FIELD_FLOAT:
+		event->SetFloat( field.m_pszName, value.m_flValue );
+		break;
+	case GAMEEVENT_FIELD_STRING:
+		event->SetString( field.m_pszName, value.m_pszValue ? value.m_pszValue : "" );
+		break;
+	}
+}
+
+static bool IsZero( const GameEventField_t &field, const GameEventValue_t &value )
+{
+	switch ( field.m_eType )
+	{
+	case GAMEEVENT_FIELD_FLOAT:
+		return value.m_flValue == 0.0f;
+	case GAMEEVENT_FIELD_STRING:
+		return !value.m_pszValue || !value.m_pszValue[0];
+	default:
+		return value.m_nValue == 0;
+	}
+}
+
+IGameEvent *CGameEventBuilder::Create( bool bForce ) const
+{
+	IGameEvent *event = gameeventmanager->CreateEvent( m_Desc.GetName(), bForce );
+	if ( !event )
+		return NULL;
+
+	for ( int i = 0; i < m_Desc.GetFieldCount(); i++ )
+	{
+		const GameEventField_t &field = m_Desc.GetField( i );
+		if ( !field.m_bAlways && IsZero( field, m_Values[i] ) )
+			continue;
+
+		WriteField( event, field, m_Values[i] );
+	}
+
+	return event;
+}
+
+bool CGameEventBuilder::Fire( bool bDontBroadcast )
+{
+	IGameEvent *event = Create();
+	if ( !event )
+		return false;
+
+	// Strings may not outlive the caller, so the benchmark doesn't get them.
+	for ( int i = 0; i < m_Desc.GetFieldCount(); i++ )
+	{
+		m_Desc.m_LastValues[i] = m_Values[i];
+		if ( m_Desc.GetField( i ).m_eType == GAMEEVENT_FIELD_STRING )
+		{
+			m_Desc.m_LastValues[i].m_pszValue = NULL;
+		}
+	}
+
+	return gameeventmanager->FireEvent( event, bDontBroadcast );
+}
+
+IGameEvent *CGameEventBuilder::CreateUnbuilt( const CGameEventDesc &desc, const GameEventValue_t *pValues, bool bForce )
+{
+	IGameEvent *event = gameeventmanager->CreateEvent( desc.GetName(), bForce );
+	if ( !event )
+		return NULL;
+
+	for ( int i = 0; i < desc.GetFieldCount(); i++ )
+	{
+		WriteField( event, desc.GetField( i ), pValues[i] );
+	}
+
+	return event;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Times building and freeing each described event both ways, with
+//			the values it was last fired with. Events are never fired, so
+//			no listener or client sees them.
+//-----------------------------------------------------------------------------
+CON_COMMAND( sv_gameevent_bench, "Compare building the hot game events with and without CGameEventBuilder. Usage: sv_gameevent_bench [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 10000;
+	nIterations = MAX( nIterations, 1 );
+
+	if ( AllocTrace_GetTickAllocs() < 0 )
+	{
+		Msg( "Turn on sv_alloc_trace to count allocations as well.\n" );
+	}
+
+	Msg( "%-24s %12s %12s %10s %10s\n", "event", "plain ev/s", "built ev/s", "plain alc", "built alc" );
+
+	for ( CGameEventDesc *pDesc = CGameEventDesc::GetFirst(); pDesc; pDesc = pDesc->GetNext() )
+	{
+		CGameEventBuilder builder( *pDesc );
+		GameEventValue_t values[MAX_GAMEEVENT_BUILDER_FIELDS];
+		for ( int i = 0; i < pDesc->GetFieldCount(); i++ )
+		{
+			const GameEventField_t &field = pDesc->GetField( i );
+			const GameEventValue_t &value = pDesc->GetLastValues()[i];
+			values[i] = value;
+
+			switch ( field.m_eType )
+			{
+			case GAMEEVENT_FIELD_INT:		builder.SetInt( i, value.m_nValue ); break;
+			case GAMEEVENT_FIELD_BOOL:		builder.SetBool( i, value.m_nValue != 0 ); break;
+			case GAMEEVENT_FIELD_FLOAT:		builder.SetFloat( i, value.m_flValue ); break;
+			case GAMEEVENT_FIELD_STRING:	builder.SetString( i, value.m_pszValue ); break;
+			}
+		}
+
+		double flRate[2];
+		int nAllocs[2];
+		for ( int nPass = 0; nPass < 2; nPass++ )
+		{
+			int nAllocsBefore = AllocTrace_GetTickAllocs();
+
+			CFastTimer timer;
+			timer.Start();
+			for ( int i = 0; i < nIterations; i++ )
+			{
+				IGameEvent *event = nPass ? builder.Create( true ) : CGameEventBuilder::CreateUnbuilt( *pDesc, values, true );
+				if ( event )
+				{
+					gameeventmanager->FreeEvent( event );
+				}
+			}
+			timer.End();
+
+			flRate[nPass] = nIterations / MAX( timer.GetDuration().GetSeconds(), 0.000001 );
+			nAllocs[nPass] = ( nAllocsBefore >= 0 ) ? ( AllocTrace_GetTickAllocs() - nAllocsBefore ) : -1;
+		}
+
+		if ( nAllocs[0] >= 0 )
+		{
+			Msg( "%-24s %12.0f %12.0f %10.2f %10.2f\n", pDesc->GetName(), flRate[0], flRate[1],
+				(float)nAllocs[0] / nIterations, (float)nAllocs[1] / nIterations );
+		}
+		else
+		{
+			Msg( "%-24s %12.0f %12.0f %10s %10s\n", pDesc->GetName(), flRate[0], flRate[1], "-", "-" );
+		}
+	}
+}
@@ -0,0 +1,134 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Typed construction of the game events fired many times a tick.
+//			Each event gets a static table of its fields, and call sites
+//			fill a builder on the stack by field index instead of handing
+//			key strings to the IGameEvent one at a time. Fields left at
+//			zero are not written at all, since listeners and the network
+//			serializer read a missing key as zero; each key written costs
+//			the engine a KeyValues allocation and a symbol lookup.
+//
+//=============================================================================//
+
+#ifndef GAMEEVENTBUILDER_H
+#define GAMEEVENTBUILDER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class IGameEvent;
+
+#define MAX_GAMEEVENT_BUILDER_FIELDS	16
+
+enum GameEventFieldType_t
+{
+	GAMEEVENT_FIELD_INT = 0,
+	GAMEEVENT_FIELD_BOOL,
+	GAMEEVENT_FIELD_FLOAT,
+	GAMEEVENT_FIELD_STRING,
+};
+
+struct GameEventField_t
+{
+	const char				*m_pszName;
+	GameEventFieldType_t	m_eType;
+	bool					m_bAlways;	// Written even when it's zero, for listeners that read it with another default
+};
+
+union GameEventValue_t
+{
+	int			m_nValue;
+	float		m_flValue;
+	const char	*m_pszValue;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: The fields of one event. Declared statically next to the code
+//			that fires the event; they link themselves into a list so
+//			sv_gameevent_bench can find them.
+//-----------------------------------------------------------------------------
+class CGameEventDesc
+{
+public:
+	CGameEventDesc( const char *pszName, const GameEventField_t *pFields, int nFields );
+
+	const char *GetName() const { return m_pszName; }
+	int GetFieldCount() const { return m_nFields; }
+	const GameEventField_t &GetField( int iField ) const { return m_pFields[iField]; }
+
+	// The values of the last event fired through a builder, for the benchmark.
+	const GameEventValue_t *GetLastValues() const { return m_LastValues; }
+
+	static CGameEventDesc *GetFirst() { return s_pFirst; }
+	CGameEventDesc *GetNext() const { return m_pNext; }
+
+private:
+	friend class CGameEventBuilder;
+
+	const char				*m_pszName;
+	const GameEventField_t	*m_pFields;
+	int						m_nFields;
+
+	GameEventValue_t		m_LastValues[MAX_GAMEEVENT_BUILDER_FIELDS];
+
+	CGameEventDesc			*m_pNext;
+	static CGameEventDesc	*s_pFirst;
+};
+
+#define DEFINE_GAMEEVENT_DESC( varName, eventName, fields, fieldCount )	\
+	COMPILE_TIME_ASSERT( ARRAYSIZE( fields ) == fieldCount );			\
+	static CGameEventDesc varName( eventName, fields, fieldCount )
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills in one event. Every field starts at zero. String values are
+//			not copied, so they must outlive the call to Fire.
+//-----------------------------------------------------------------------------
+class CGameEventBuilder
+{
+public:
+	CGameEventBuilder( CGameEventDesc &desc );
+
+	void SetInt( int iField, int nValue );
+	void SetBool( int iField, bool bValue );
+	void SetFloat( int iField, float flValue );
+	void SetString( int iField, const char *pszValue );
+
+	// Returns NULL if nobody listens to the event and bForce isn't set.
+	IGameEvent *Create( bool bForce = false ) const;
+
+	bool Fire( bool bDontBroadcast = false );
+
+	// Creates the event with the values given, the way it would be done with
+	// no builder. Only here so the benchmark has something to compare with.
+	static IGameEvent *CreateUnbuilt( const CGameEventDesc &desc, const GameEventValue_t *pValues, bool bForce );
+
+private:
+	CGameEventDesc		&m_Desc;
+	GameEventValue_t	m_Values[MAX_GAMEEVENT_BUILDER_FIELDS];
+};
+
+inline void CGameEventBuilder::SetInt( int iField, int nValue )
+{
+	Assert( m_Desc.GetField( iField ).m_eType == GAMEEVENT_FIELD_INT );
+	m_Values[iField].m_nValue = nValue;
+}
+
+inline void CGameEventBuilder::SetBool( int iField, bool bValue )
+{
+	Assert( m_Desc.GetField( iField ).m_eType == GAMEEVENT_FIELD_BOOL );
+	m_Values[iField].m_nValue = bValue ? 1 : 0;
+}
+
+inline void CGameEventBuilder::SetFloat( int iField, float flValue )
+{
+	Assert( m_Desc.GetField( iField ).m_eType == GAMEEVENT_FIELD_FLOAT );
+	m_Values[iField].m_flValue = flValue;
+}
+
+inline void CGameEventBuilder::SetString( int iField, const char *pszValue )
+{
+	Assert( m_Desc.GetField( iField ).m_eType == GAMEEVENT_FIELD_STRING );
+	m_Values[iField].m_pszValue = pszValue;
+}
+
+#endif // GAMEEVENTBUILDER_H
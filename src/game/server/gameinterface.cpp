@@ -1238,6 +1238,9 @@ void CServerGameDLL::GameFrame( bool simulating )
 	UpdateQueryCache();
 	g_pServerBenchmark->UpdateBenchmark();
 
+	// Build bones for everyone who will be queried for hitboxes and attachments this frame
+	CBaseAnimating::ThreadedBoneSetup();
+
 	Physics_RunThinkFunctions( simulating );
 	
 	IGameSystem::FrameUpdatePostEntityThinkAllSystems();
@@ -1385,6 +1388,7 @@ void CServerGameDLL::LevelShutdown( void )
 	gEntList.Clear();
 
 	InvalidateQueryCache();
+	CBaseAnimating::ShutdownThreadedBoneSetup();
 
 	IGameSystem::LevelShutdownPostEntityAllSystems();
 
@@ -2454,6 +2458,8 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 	// is consecutive in memory. If either of these things change, then this routine needs to change, but
 	// ideally we won't be calling any virtual from this routine. This speedy routine was added as an
 	// optimization which would be nice to keep.
+	VPROF_BUDGET( "CServerGameEnts::CheckTransmit", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+
 	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
 
 	// get recipient player's skybox:
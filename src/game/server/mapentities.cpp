@@ -32,6 +32,161 @@ struct HierarchicalSpawnMapData_t
 static CStringRegistry *g_pClassnameSpawnPriority = NULL;
 extern edict_t *g_pForceAttachEdict;
 
+ConVar sv_map_entity_cache( "sv_map_entity_cache", "1", 0, "Keep the map's entities parsed from level load, so round restarts recreate them without parsing the entity lump again." );
+
+
+//-----------------------------------------------------------------------------
+// Purpose: The map's entity lump, tokenized once per level into interned
+//			classnames and key/value pairs (outputs are keys like any other).
+//			The text is kept as well, for the entities that are handed their
+//			map data: templates, point_template targets and nodes. The strings
+//			live in the game string pool, which is also cleared per level.
+//-----------------------------------------------------------------------------
+class CMapEntityCache : public CAutoGameSystem
+{
+public:
+	CMapEntityCache() : CAutoGameSystem( "CMapEntityCache" ) {}
+
+	virtual void LevelInitPostEntity();
+	virtual void LevelShutdownPostEntity();
+
+	void Build( const char *pMapData );
+	void Purge();
+	bool IsBuilt() const { return m_MapData.Count() > 0; }
+
+	int GetEntityCount() const { return m_Entities.Count(); }
+	const char *GetEntityMapData( int iEntity ) const { return m_MapData.Base() + m_Entities[iEntity].m_nDataStart; }
+	const char *GetEntityMapDataEnd( int iEntity ) const { return m_MapData.Base() + m_Entities[iEntity].m_nDataEnd; }
+
+	// The cached equivalent of MapEntity_ParseEntity.
+	CBaseEntity *CreateEntity( int iEntity, IMapEntityFilter *pFilter ) const;
+
+private:
+	struct CachedEntity_t
+	{
+		const char	*m_pszClassname;
+		int			m_iFirstKey;		// into m_KeyValues, which holds each key followed by its value
+		int			m_nKeys;
+		int			m_nDataStart;		// where MapEntity_ParseEntity would start and stop
+		int			m_nDataEnd;			// parsing the entity's text in m_MapData
+	};
+
+	CUtlVector< char >			m_MapData;
+	CUtlVector< const char * >	m_KeyValues;
+	CUtlVector< CachedEntity_t >	m_Entities;
+};
+
+static CMapEntityCache g_MapEntityCache;
+
+void CMapEntityCache::LevelInitPostEntity()
+{
+	if ( sv_map_entity_cache.GetBool() )
+	{
+		Build( engine->GetMapEntitiesString() );
+	}
+}
+
+void CMapEntityCache::LevelShutdownPostEntity()
+{
+	Purge();
+}
+
+void CMapEntityCache::Purge()
+{
+	m_MapData.Purge();
+	m_KeyValues.Purge();
+	m_Entities.Purge();
+}
+
+void CMapEntityCache::Build( const char *pMapData )
+{
+	VPROF( "CMapEntityCache::Build" );
+
+	Purge();
+
+	// Cache what MapEntity_ParseAllEntities would parse
+	if ( serverenginetools )
+	{
+		pMapData = serverenginetools->GetEntityData( pMapData );
+	}
+
+	if ( !pMapData )
+		return;
+
+	m_MapData.CopyArray( pMapData, V_strlen( pMapData ) + 1 );
+
+	char szTokenBuffer[MAPKEY_MAXLENGTH];
+	const char *pData = m_MapData.Base();
+	for ( ; true; pData = MapEntity_SkipToNextEntity( pData, szTokenBuffer ) )
+	{
+		char token[MAPKEY_MAXLENGTH];
+		pData = MapEntity_ParseToken( pData, token );
+		if ( !pData )
+			break;
+
+		CEntityMapData entData( (char*)pData );
+		char className[MAPKEY_MAXLENGTH];
+
+		// Leave broken lumps to the regular parser, which reports them
+		if ( token[0] != '{' || !entData.ExtractValue( "classname", className ) )
+		{
+			Warning( "Not caching the map entities, the entity lump failed to parse\n" );
+			Purge();
+			return;
+		}
+
+		CachedEntity_t &entity = m_Entities[ m_Entities.AddToTail() ];
+		entity.m_pszClassname = STRING( AllocPooledString( className ) );
+		entity.m_iFirstKey = m_KeyValues.Count();
+		entity.m_nKeys = 0;
+		entity.m_nDataStart = pData - m_MapData.Base();
+
+		char keyName[MAPKEY_MAXLENGTH];
+		char value[MAPKEY_MAXLENGTH];
+		if ( entData.GetFirstKey( keyName, value ) )
+		{
+			do
+			{
+				m_KeyValues.AddToTail( STRING( AllocPooledString( keyName ) ) );
+				m_KeyValues.AddToTail( STRING( AllocPooledString( value ) ) );
+				++entity.m_nKeys;
+			}
+			while ( entData.GetNextKey( keyName, value ) );
+		}
+
+		pData = entData.CurrentBufferPosition();
+		entity.m_nDataEnd = pData - m_MapData.Base();
+	}
+
+	DevMsg( "Cached %d map entities (%d keys)\n", m_Entities.Count(), m_KeyValues.Count() / 2 );
+}
+
+CBaseEntity *CMapEntityCache::CreateEntity( int iEntity, IMapEntityFilter *pFilter ) const
+{
+	const CachedEntity_t &entity = m_Entities[iEntity];
+
+	if ( pFilter && !pFilter->ShouldCreateEntity( entity.m_pszClassname ) )
+		return NULL;
+
+	CBaseEntity *pEntity = pFilter ? pFilter->CreateNextEntity( entity.m_pszClassname ) : CreateEntityByName( entity.m_pszClassname );
+	if ( !pEntity )
+	{
+		Warning( "Can't init %s\n", entity.m_pszClassname );
+		return NULL;
+	}
+
+	// KeyValue() may write to the key name, so it gets a copy.
+	char keyName[MAPKEY_MAXLENGTH];
+	for ( int i = 0; i < entity.m_nKeys; i++ )
+	{
+		const char * const *ppKeyValue = &m_KeyValues[ entity.m_iFirstKey + i * 2 ];
+		Q_strncpy( keyName, ppKeyValue[0], sizeof( keyName ) );
+		pEntity->KeyValue( keyName, ppKeyValue[1] );
+	}
+
+	return pEntity;
+}
+
 // creates an entity by string name, but does not spawn it
 CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 {
@@ -304,13 +459,11 @@ void SpawnAllEntities( int nEntities, HierarchicalSpawn_t *pSpawnList, bool bAct
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Only called on BSP load. Parses and spawns all the entities in the BSP.
-// Input  : pMapData - Pointer to the entity data block to parse.
+// Purpose: Creates and spawns all the entities in the BSP, either parsing
+//			them from pMapData or taking them from pCache.
 //-----------------------------------------------------------------------------
-void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter, bool bActivateEntities)
+static void MapEntity_SpawnAllEntities( const char *pMapData, const CMapEntityCache *pCache, IMapEntityFilter *pFilter, bool bActivateEntities )
 {
-	VPROF("MapEntity_ParseAllEntities");
-
 	HierarchicalSpawnMapData_t *pSpawnMapData = new HierarchicalSpawnMapData_t[NUM_ENT_ENTRIES];
 	HierarchicalSpawn_t *pSpawnList = new HierarchicalSpawn_t[NUM_ENT_ENTRIES];
 
@@ -320,38 +473,58 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 	char szTokenBuffer[MAPKEY_MAXLENGTH];
 
 	// Allow the tools to spawn different things
-	if ( serverenginetools )
+	if ( serverenginetools && !pCache )
 	{
 		pMapData = serverenginetools->GetEntityData( pMapData );
 	}
 
 	//  Loop through all entities in the map data, creating each.
-	for ( ; true; pMapData = MapEntity_SkipToNextEntity(pMapData, szTokenBuffer) )
+	for ( int iEntity = 0; true; ++iEntity )
 	{
-		//
-		// Parse the opening brace.
-		//
-		char token[MAPKEY_MAXLENGTH];
-		pMapData = MapEntity_ParseToken( pMapData, token );
+		CBaseEntity *pEntity;
+		const char *pCurMapData;
 
-		//
-		// Check to see if we've finished or not.
-		//
-		if (!pMapData)
-			break;
+		if ( pCache )
+		{
+			if ( iEntity == pCache->GetEntityCount() )
+				break;
 
-		if (token[0] != '{')
+			pCurMapData = pCache->GetEntityMapData( iEntity );
+			pMapData = pCache->GetEntityMapDataEnd( iEntity );
+			pEntity = pCache->CreateEntity( iEntity, pFilter );
+		}
+		else
 		{
-			Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
-			continue;
+			if ( iEntity > 0 )
+			{
+				pMapData = MapEntity_SkipToNextEntity( pMapData, szTokenBuffer );
+			}
+
+			//
+			// Parse the opening brace.
+			//
+			char token[MAPKEY_MAXLENGTH];
+			pMapData = MapEntity_ParseToken( pMapData, token );
+
+			//
+			// Check to see if we've finished or not.
+			//
+			if (!pMapData)
+				break;
+
+			if (token[0] != '{')
+			{
+				Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
+				continue;
+			}
+
+			//
+			// Parse the entity and add it to the spawn list.
+			//
+			pCurMapData = pMapData;
+			pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
 		}
 
-		//
-		// Parse the entity and add it to the spawn list.
-		//
-		CBaseEntity *pEntity;
-		const char *pCurMapData = pMapData;
-		pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
 		if (pEntity == NULL)
 			continue;
 
@@ -487,6 +660,46 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 	delete [] pSpawnList;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Only called on BSP load. Parses and spawns all the entities in the BSP.
+// Input  : pMapData - Pointer to the entity data block to parse.
+//-----------------------------------------------------------------------------
+void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter, bool bActivateEntities)
+{
+	VPROF("MapEntity_ParseAllEntities");
+
+	MapEntity_SpawnAllEntities( pMapData, NULL, pFilter, bActivateEntities );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Recreates the map's entities, as MapEntity_ParseAllEntities would
+//			from engine->GetMapEntitiesString(), from the entities cached at
+//			level load when sv_map_entity_cache is on.
+// Output : Returns true if the cache was used.
+//-----------------------------------------------------------------------------
+bool MapEntity_RespawnAllEntities( IMapEntityFilter *pFilter, bool bActivateEntities )
+{
+	VPROF("MapEntity_RespawnAllEntities");
+
+	if ( sv_map_entity_cache.GetBool() )
+	{
+		// Turned on since the level loaded
+		if ( !g_MapEntityCache.IsBuilt() )
+		{
+			g_MapEntityCache.Build( engine->GetMapEntitiesString() );
+		}
+
+		if ( g_MapEntityCache.IsBuilt() )
+		{
+			MapEntity_SpawnAllEntities( NULL, &g_MapEntityCache, pFilter, bActivateEntities );
+			return true;
+		}
+	}
+
+	MapEntity_SpawnAllEntities( engine->GetMapEntitiesString(), NULL, pFilter, bActivateEntities );
+	return false;
+}
+
 void SpawnHierarchicalList( int nEntities, HierarchicalSpawn_t *pSpawnList, bool bActivateEntities )
 {
 	// Compute the hierarchical depth of all entities hierarchically attached
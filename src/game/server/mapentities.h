@@ -27,6 +27,10 @@ public:
 // entities like the world entity need to be left intact.
 void MapEntity_ParseAllEntities( const char *pMapData, IMapEntityFilter *pFilter=NULL, bool bActivateEntities=false );
 
+// Same as MapEntity_ParseAllEntities( engine->GetMapEntitiesString(), ... ), but takes the entities from the
+// copy parsed at level load when sv_map_entity_cache is on. Returns true if it did.
+bool MapEntity_RespawnAllEntities( IMapEntityFilter *pFilter, bool bActivateEntities );
+
 const char *MapEntity_ParseEntity( CBaseEntity *&pEntity, const char *pEntData, IMapEntityFilter *pFilter );
 void MapEntity_PrecacheEntity( const char *pEntData, int &nStringSize );
 
@@ -0,0 +1,167 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per player cache of the hull traces made by player movement.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "movementtracecache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_movement_trace_cache( "sv_movement_trace_cache", "1", FCVAR_CHEAT, "Reuse identical player movement traces made in the same tick." );
+
+CMovementTraceCache g_MovementTraceCache;
+
+
+CMovementTraceCache::CMovementTraceCache() : CAutoGameSystem( "CMovementTraceCache" )
+{
+	m_nSerial = 0;
+	Clear();
+	ResetStats();
+}
+
+void CMovementTraceCache::LevelInitPreEntity()
+{
+	Clear();
+}
+
+void CMovementTraceCache::Clear()
+{
+	for ( int i = 0; i < MAX_PLAYERS; i++ )
+	{
+		for ( int j = 0; j < ENTRIES_PER_PLAYER; j++ )
+		{
+			m_Entries[i][j].m_nTick = -1;
+		}
+		m_iNextEntry[i] = 0;
+	}
+
+	m_nResetSerial = ++m_nSerial;
+	m_iLastMover = -1;
+	m_nLastMoveSerial = 0;
+	m_nOtherMoveSerial = 0;
+}
+
+void CMovementTraceCache::ResetStats()
+{
+	m_nIssued = 0;
+	m_nServed = 0;
+	m_nUsercmds = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Serial of the last change that the entries of this player can't
+//			ignore. The player's own movement doesn't count since its traces
+//			never hit the player.
+//-----------------------------------------------------------------------------
+int CMovementTraceCache::ChangeSerialForPlayer( int iPlayer ) const
+{
+	int nMoveSerial = ( m_iLastMover == iPlayer ) ? m_nOtherMoveSerial : m_nLastMoveSerial;
+	return MAX( nMoveSerial, m_nResetSerial );
+}
+
+void CMovementTraceCache::EntityChanged( CBaseEntity *pEntity )
+{
+	int iEntity = pEntity->entindex();
+	int nSerial = ++m_nSerial;
+
+	if ( iEntity != m_iLastMover )
+	{
+		// Everything up to the last mover's latest change was by someone else.
+		m_nOtherMoveSerial = m_nLastMoveSerial;
+		m_iLastMover = iEntity;
+	}
+	m_nLastMoveSerial = nSerial;
+}
+
+bool CMovementTraceCache::Lookup( CBasePlayer *pPlayer, const Ray_t &ray, unsigned int fMask, int collisionGroup, int nFilter, trace_t &tr )
+{
+	if ( !sv_movement_trace_cache.GetBool() )
+		return false;
+
+	int iPlayer = pPlayer->entindex();
+	if ( iPlayer < 1 || iPlayer > MAX_PLAYERS )
+		return false;
+
+	int nChangeSerial = ChangeSerialForPlayer( iPlayer );
+
+	for ( int i = 0; i < ENTRIES_PER_PLAYER; i++ )
+	{
+		const Entry_t &entry = m_Entries[iPlayer - 1][i];
+		if ( entry.m_nTick != gpGlobals->tickcount || entry.m_nSerial < nChangeSerial )
+			continue;
+
+		if ( entry.m_fMask != fMask || entry.m_nCollisionGroup != collisionGroup || entry.m_nFilter != nFilter )
+			continue;
+
+		if ( entry.m_vecStart != ray.m_Start || entry.m_vecDelta != ray.m_Delta ||
+			entry.m_vecExtents != ray.m_Extents || entry.m_vecStartOffset != ray.m_StartOffset )
+		{
+			continue;
+		}
+
+		tr = entry.m_Trace;
+		++m_nServed;
+		return true;
+	}
+
+	return false;
+}
+
+void CMovementTraceCache::Store( CBasePlayer *pPlayer, const Ray_t &ray, unsigned int fMask, int collisionGroup, int nFilter, const trace_t &tr )
+{
+	++m_nIssued;
+
+	if ( !sv_movement_trace_cache.GetBool() )
+		return;
+
+	int iPlayer = pPlayer->entindex();
+	if ( iPlayer < 1 || iPlayer > MAX_PLAYERS )
+		return;
+
+	int &iNext = m_iNextEntry[iPlayer - 1];
+	Entry_t &entry = m_Entries[iPlayer - 1][iNext];
+	iNext = ( iNext + 1 ) % ENTRIES_PER_PLAYER;
+
+	entry.m_vecStart = ray.m_Start;
+	entry.m_vecDelta = ray.m_Delta;
+	entry.m_vecStartOffset = ray.m_StartOffset;
+	entry.m_vecExtents = ray.m_Extents;
+	entry.m_fMask = fMask;
+	entry.m_nCollisionGroup = collisionGroup;
+	entry.m_nFilter = nFilter;
+	entry.m_nTick = gpGlobals->tickcount;
+	entry.m_nSerial = m_nSerial;
+	entry.m_Trace = tr;
+}
+
+void CMovementTraceCache::PrintStats()
+{
+	unsigned int nTotal = m_nIssued + m_nServed;
+	Msg( "Movement traces: %u issued, %u served from cache (%.1f%%)\n", m_nIssued, m_nServed,
+		nTotal ? 100.0f * m_nServed / nTotal : 0.0f );
+
+	if ( m_nUsercmds )
+	{
+		Msg( "%u usercmds, %.2f traces issued per usercmd\n", m_nUsercmds, (float)m_nIssued / m_nUsercmds );
+	}
+}
+
+
+CON_COMMAND( sv_movement_trace_cache_stats, "Show how many player movement traces were issued and how many came from the cache." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_MovementTraceCache.PrintStats();
+}
+
+CON_COMMAND( sv_movement_trace_cache_reset, "Reset the player movement trace counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_MovementTraceCache.ResetStats();
+}
@@ -0,0 +1,91 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per player cache of the hull traces made by player movement.
+//			Many of them repeat within a usercmd (standing still, walking on
+//			flat ground) and between the usercmds a player runs in the same
+//			tick after a lag spike. Entries only live for the tick they were
+//			made in. Any solid entity other than the player moving, or any
+//			change in collision rules, throws the player's entries away.
+//
+//=============================================================================//
+
+#ifndef MOVEMENTTRACECACHE_H
+#define MOVEMENTTRACECACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+#include "cmodel.h"
+#include "gametrace.h"
+
+class CBaseEntity;
+class CBasePlayer;
+
+
+class CMovementTraceCache : public CAutoGameSystem
+{
+public:
+	CMovementTraceCache();
+
+	virtual void LevelInitPreEntity();
+
+	// nFilter tells apart the trace filters the caller uses, so traces
+	// through different filters never share an entry.
+	bool Lookup( CBasePlayer *pPlayer, const Ray_t &ray, unsigned int fMask, int collisionGroup, int nFilter, trace_t &tr );
+	void Store( CBasePlayer *pPlayer, const Ray_t &ray, unsigned int fMask, int collisionGroup, int nFilter, const trace_t &tr );
+
+	void UsercmdProcessed() { ++m_nUsercmds; }
+
+	// A solid entity moved, changed its bounds or solidity, or was removed.
+	void EntityChanged( CBaseEntity *pEntity );
+
+	// Anything the trace filters look at changed.
+	void CollisionRulesChanged() { m_nResetSerial = ++m_nSerial; }
+
+	void PrintStats();
+	void ResetStats();
+
+private:
+	enum
+	{
+		ENTRIES_PER_PLAYER = 8,
+	};
+
+	struct Entry_t
+	{
+		Vector			m_vecStart;
+		Vector			m_vecDelta;
+		Vector			m_vecStartOffset;
+		Vector			m_vecExtents;
+		unsigned int	m_fMask;
+		int				m_nCollisionGroup;
+		int				m_nFilter;
+		int				m_nTick;
+		int				m_nSerial;
+		trace_t			m_Trace;
+	};
+
+	int ChangeSerialForPlayer( int iPlayer ) const;
+	void Clear();
+
+	Entry_t	m_Entries[ MAX_PLAYERS ][ ENTRIES_PER_PLAYER ];
+	int		m_iNextEntry[ MAX_PLAYERS ];
+
+	// Every change gets the next serial. The serial of the last change by
+	// the last entity to move, and of the last change by anything else, let
+	// a player skip its own movement when checking its entries.
+	int		m_nSerial;
+	int		m_nResetSerial;
+	int		m_iLastMover;
+	int		m_nLastMoveSerial;
+	int		m_nOtherMoveSerial;
+
+	unsigned int	m_nIssued;
+	unsigned int	m_nServed;
+	unsigned int	m_nUsercmds;
+};
+
+extern CMovementTraceCache g_MovementTraceCache;
+
+#endif // MOVEMENTTRACECACHE_H
@@ -34,6 +34,8 @@
 #include "functorutils.h"
 #include "team.h"
 #include "nav_entities.h"
+#include "raytrace.h"
+#include "mathlib/polyhedron.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -63,6 +65,7 @@ const float DEF_NAV_VIEW_DISTANCE = 1500.0;
 ConVar nav_max_view_distance( "nav_max_view_distance", "6000", FCVAR_CHEAT, "Maximum range for precomputed nav mesh visibility (0 = default 1500 units)" );
 ConVar nav_update_visibility_on_edit( "nav_update_visibility_on_edit", "0", FCVAR_CHEAT, "If nonzero editing the mesh will incrementally recompue visibility" );
 ConVar nav_potentially_visible_dot_tolerance( "nav_potentially_visible_dot_tolerance", "0.98", FCVAR_CHEAT );
+ConVar nav_vis_ray_tracer( "nav_vis_ray_tracer", "1", FCVAR_CHEAT, "If nonzero, computing nav mesh visibility rules out lines of sight blocked by world brushes in batches before tracing the rest" );
 ConVar nav_show_potentially_visible( "nav_show_potentially_visible", "0", FCVAR_CHEAT, "Show areas that are potentially visible from the current nav area" );
 
 Color s_selectedSetColor( 255, 255, 200, 96 );
@@ -4816,6 +4819,7 @@ void CNavArea::UnblockArea( int teamID )
 void CNavArea::UpdateBlocked( bool force, int teamID )
 {
 	VPROF( "CNavArea::UpdateBlocked" );
+	TRACE_BUDGET_SCOPE( "Nav blocked areas" );
 	if ( !force && !m_blockedTimer.IsElapsed() )
 	{
 		return;
@@ -5244,6 +5248,298 @@ CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs > *g_pNavVisPairHas
 
 #define MASK_NAV_VISION				(MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE)
 
+// World brushes that block MASK_NAV_VISION, for ruling out lines of sight while computing visibility
+static RayTracingEnvironment *s_pNavVisWorld;
+static CInterlockedInt s_navVisRayCount;
+static CInterlockedInt s_navVisRaysBlocked;
+
+// rays must end this far past a brush face before the ray tracer calls them blocked
+#define NAV_VIS_RAY_TRACER_MARGIN	1.0f
+
+// brush sides are pulled in this far, so a ray that only clips an edge is left to the engine trace
+#define NAV_VIS_BRUSH_INSET			0.1f
+
+#include "tier0/memdbgoff.h"
+
+// RayTracingEnvironment holds SIMD members, so it needs 16 byte alignment
+static RayTracingEnvironment *AllocNavVisibilityWorld( void )
+{
+	void *mem = MemAlloc_AllocAligned( sizeof( RayTracingEnvironment ), 16 );
+	return new( mem ) RayTracingEnvironment;
+}
+
+static void FreeNavVisibilityWorld( RayTracingEnvironment *world )
+{
+	world->~RayTracingEnvironment();
+	MemAlloc_FreeAligned( world );
+}
+
+#include "tier0/memdbgon.h"
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Free the world built by BuildNavVisibilityWorld()
+ */
+void DestroyNavVisibilityWorld( void )
+{
+	if ( !s_pNavVisWorld )
+		return;
+
+	if ( s_navVisRayCount > 0 )
+	{
+		Msg( "Nav visibility: world brushes ruled out %d of %d lines of sight\n", (int)s_navVisRaysBlocked, (int)s_navVisRayCount );
+	}
+
+	FreeNavVisibilityWorld( s_pNavVisWorld );
+	s_pNavVisWorld = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Build a ray tracer of the world brushes that block nav vision, for ComputeVisibility().
+ * It can only prove a line of sight is blocked. Displacements, props, and entities
+ * are left to the engine traces.
+ */
+void BuildNavVisibilityWorld( void )
+{
+	DestroyNavVisibilityWorld();
+
+	if ( !nav_vis_ray_tracer.GetBool() || TheNavAreas.Count() == 0 )
+		return;
+
+	double startTime = Plat_FloatTime();
+
+	// every line of sight runs between eye points over the mesh, which can be twice the eye height
+	// up (see IsPartiallyVisible), so only brushes near the mesh can block one
+	Extent meshExtent, areaExtent;
+	TheNavAreas[0]->GetExtent( &meshExtent );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[it]->GetExtent( &areaExtent );
+		meshExtent.Encompass( areaExtent );
+	}
+	meshExtent.lo -= Vector( 1, 1, 1 );
+	meshExtent.hi += Vector( 1, 1, 1.5f * HumanHeight + 1 );
+
+	CUtlVector< int > brushes;
+	enginetrace->GetBrushesInAABB( meshExtent.lo, meshExtent.hi, &brushes, MASK_BLOCKLOS );
+
+	s_pNavVisWorld = AllocNavVisibilityWorld();
+	s_navVisRayCount = 0;
+	s_navVisRaysBlocked = 0;
+
+	int triangleCount = 0;
+	CUtlVector< Vector4D > planes;
+	FOR_EACH_VEC( brushes, it )
+	{
+		int contents;
+		planes.RemoveAll();
+		if ( !enginetrace->GetBrushInfo( brushes[it], &planes, &contents ) || !( contents & MASK_BLOCKLOS ) )
+			continue;
+
+		FOR_EACH_VEC( planes, p )
+		{
+			planes[p].w -= NAV_VIS_BRUSH_INSET;
+		}
+
+		CPolyhedron *polyhedron = GeneratePolyhedronFromPlanes( planes.Base()->Base(), planes.Count(), 0.01f, true );
+		if ( !polyhedron )
+			continue;
+
+		for( int p=0; p<polyhedron->iPolygonCount; ++p )
+		{
+			const Polyhedron_IndexedPolygon_t &polygon = polyhedron->pPolygons[p];
+			Vector vert[ 2 ];
+			for( int i=0; i<polygon.iIndexCount; ++i )
+			{
+				const Polyhedron_IndexedLineReference_t &ref = polyhedron->pIndices[ polygon.iFirstIndex + i ];
+				const Vector &pos = polyhedron->pVertices[ polyhedron->pLines[ ref.iLineIndex ].iPointIndices[ ref.iEndPointIndex ] ];
+				if ( i < 2 )
+				{
+					vert[i] = pos;
+					continue;
+				}
+
+				// fan out from the first vertex, wound so the ray tracer's normal faces out of the brush
+				if ( CrossProduct( vert[1] - vert[0], pos - vert[0] ).Dot( polygon.polyNormal ) >= 0.0f )
+				{
+					s_pNavVisWorld->AddTriangle( triangleCount, vert[0], vert[1], pos, vec3_origin );
+				}
+				else
+				{
+					s_pNavVisWorld->AddTriangle( triangleCount, vert[0], pos, vert[1], vec3_origin );
+				}
+				++triangleCount;
+				vert[1] = pos;
+			}
+		}
+
+		polyhedron->Release();
+	}
+
+	if ( triangleCount == 0 )
+	{
+		DestroyNavVisibilityWorld();
+		return;
+	}
+
+	s_pNavVisWorld->SetupAccelerationStructure();
+
+	Msg( "Nav visibility: %d world brushes, %d triangles, set up in %2.2f seconds\n", brushes.Count(), triangleCount, (float)( Plat_FloatTime() - startTime ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * The lines of sight IsPartiallyVisible() checks from a few eye points to an area.
+ * The world brushes rule out blocked rays in packets of four, and only the rest
+ * are traced by the engine.
+ */
+class CNavVisRayBatch
+{
+public:
+	enum { MAX_EYES = 4, MAX_RAYS = MAX_EYES * ( 1 + NUM_CORNERS ) };
+
+	CNavVisRayBatch( const CNavArea *area ) : m_area( area ), m_traceFilter( NULL, COLLISION_GROUP_NONE ) { }
+
+	void Trace( const Vector *eyes, int eyeCount );		// rule out the blocked rays from these eyes
+	bool IsPartiallyVisible( int eye );					// engine trace the rest of the rays from eyes[eye] until one is clear
+
+private:
+	void AddRays( const Vector &eye );
+
+	const CNavArea *m_area;
+	CTraceFilterNoNPCsOrPlayer m_traceFilter;
+
+	Vector m_start[ MAX_RAYS ];
+	Vector m_end[ MAX_RAYS ];
+	bool m_isBlocked[ MAX_RAYS ];
+	int m_rayCount;
+	int m_firstRay[ MAX_EYES + 1 ];
+};
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Add the rays IsPartiallyVisible() traces from the given eye, in the same order
+ */
+void CNavVisRayBatch::AddRays( const Vector &eye )
+{
+	const float offset = 0.75f * HumanHeight;
+
+	Vector center( m_area->GetCenter() + Vector( 0, 0, offset ) );
+	m_start[ m_rayCount ] = eye;
+	m_end[ m_rayCount ] = center;
+	++m_rayCount;
+
+	Vector eyeToCenter( center - eye );
+	eyeToCenter.NormalizeInPlace();
+	float angleTolerance = nav_potentially_visible_dot_tolerance.GetFloat();
+
+	for( int c=0; c<NUM_CORNERS; ++c )
+	{
+		Vector corner( m_area->GetCorner( (NavCornerType)c ) + Vector( 0, 0, offset ) );
+
+		Vector eyeToCorner( corner - eye );
+		eyeToCorner.NormalizeInPlace();
+		if ( eyeToCorner.Dot( eyeToCenter ) >= angleTolerance )
+		{
+			continue;
+		}
+
+		// IsPartiallyVisible() adds the offset to the corners twice
+		m_start[ m_rayCount ] = eye;
+		m_end[ m_rayCount ] = corner + Vector( 0, 0, offset );
+		++m_rayCount;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+void CNavVisRayBatch::Trace( const Vector *eyes, int eyeCount )
+{
+	Assert( eyeCount <= MAX_EYES );
+
+	m_rayCount = 0;
+	for( int i=0; i<eyeCount; ++i )
+	{
+		m_firstRay[i] = m_rayCount;
+		AddRays( eyes[i] );
+	}
+	m_firstRay[ eyeCount ] = m_rayCount;
+
+	int blockedCount = 0;
+	for( int r=0; r<m_rayCount; r += 4 )
+	{
+		FourRays rays;
+		fltx4 length = Four_Zeros;
+		for( int i=0; i<4; ++i )
+		{
+			// pad the last packet with copies of its first ray
+			int ray = ( r + i < m_rayCount ) ? r + i : r;
+
+			Vector dir( m_end[ ray ] - m_start[ ray ] );
+			float len = dir.NormalizeInPlace();
+			if ( len < NAV_VIS_RAY_TRACER_MARGIN )
+			{
+				dir.Init( 0, 0, 1 );
+				len = 0.0f;
+			}
+
+			rays.origin.X( i ) = m_start[ ray ].x;
+			rays.origin.Y( i ) = m_start[ ray ].y;
+			rays.origin.Z( i ) = m_start[ ray ].z;
+			rays.direction.X( i ) = dir.x;
+			rays.direction.Y( i ) = dir.y;
+			rays.direction.Z( i ) = dir.z;
+			SubFloat( length, i ) = len;
+		}
+
+		RayTracingResult result;
+		s_pNavVisWorld->Trace4Rays( rays, Four_Zeros, length, &result );
+
+		// Only a ray that enters a brush through its front face well short of its end is surely
+		// blocked. Rays starting inside a brush are left to the engine.
+		fltx4 entering = CmpLtSIMD( rays.direction * result.surface_normal, Four_Zeros );
+		fltx4 short_of_end = CmpLtSIMD( result.HitDistance, SubSIMD( length, ReplicateX4( NAV_VIS_RAY_TRACER_MARGIN ) ) );
+		int blocked = TestSignSIMD( AndSIMD( entering, short_of_end ) );
+
+		for( int i=0; i<4 && r + i < m_rayCount; ++i )
+		{
+			m_isBlocked[ r + i ] = ( result.HitIds[i] != -1 && ( blocked & ( 1 << i ) ) );
+			if ( m_isBlocked[ r + i ] )
+			{
+				++blockedCount;
+			}
+		}
+	}
+
+	s_navVisRayCount += m_rayCount;
+	s_navVisRaysBlocked += blockedCount;
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+bool CNavVisRayBatch::IsPartiallyVisible( int eye )
+{
+	trace_t result;
+	for( int r=m_firstRay[ eye ]; r<m_firstRay[ eye+1 ]; ++r )
+	{
+		if ( m_isBlocked[ r ] )
+			continue;
+
+		UTIL_TraceLine( m_start[ r ], m_end[ r ], MASK_NAV_VISION, &m_traceFilter, &result );
+		if ( result.fraction >= 1.0f )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 
 //--------------------------------------------------------------------------------------------------------
 /**
@@ -5377,21 +5673,13 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 
 	//------------------------------------
 	// check line of sight between areas
-	unsigned char vis = COMPLETELY_VISIBLE;
-
 	const float margin = GenerationStepSize/2.0f;
 
 	Vector shift( 0, 0, 0.75f * HumanHeight );
 
 	// always check center to catch very small areas
-	if ( area->IsPartiallyVisible( GetCenter() + eye ) )
-	{
-		vis |= POTENTIALLY_VISIBLE;
-	}
-	else
-	{
-		vis &= ~COMPLETELY_VISIBLE;
-	}
+	CUtlVectorFixedGrowable< Vector, 64 > eyes;
+	eyes.AddToTail( GetCenter() + eye );
 
 	Vector eyeToCenter( GetCenter() - area->GetCenter() );
 	eyeToCenter.NormalizeInPlace();
@@ -5402,12 +5690,6 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 	{
 		for( shift.x = margin; shift.x <= GetSizeX() - margin; shift.x += GenerationStepSize )
 		{
-			// Optimization:
-			// If we are already POTENTIALLY_VISIBLE, and no longer COMPLETELY_VISIBLE, there's
-			// no way for vis to change again.
-			if ( vis == POTENTIALLY_VISIBLE )
-				return POTENTIALLY_VISIBLE;
-
 			Vector testPos( GetCorner( NORTH_WEST ) + shift );
 			testPos.z = GetZ( testPos ) + eye.z;
 
@@ -5422,14 +5704,43 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 				}
 			}
 
-			if ( area->IsPartiallyVisible( testPos ) )
-			{
-				vis |= POTENTIALLY_VISIBLE;
-			}
-			else
+			eyes.AddToTail( testPos );
+		}
+	}
+
+	// while the mesh visibility is computed, world brushes rule out rays a few eyes at a time
+	CNavVisRayBatch batch( area );
+
+	unsigned char vis = COMPLETELY_VISIBLE;
+	for( int i=0; i<eyes.Count(); ++i )
+	{
+		// Optimization:
+		// If we are already POTENTIALLY_VISIBLE, and no longer COMPLETELY_VISIBLE, there's
+		// no way for vis to change again.
+		if ( vis == POTENTIALLY_VISIBLE )
+			return POTENTIALLY_VISIBLE;
+
+		bool isVisible;
+		if ( s_pNavVisWorld )
+		{
+			if ( i % CNavVisRayBatch::MAX_EYES == 0 )
 			{
-				vis &= ~COMPLETELY_VISIBLE;
+				batch.Trace( &eyes[i], MIN( eyes.Count() - i, (int)CNavVisRayBatch::MAX_EYES ) );
 			}
+			isVisible = batch.IsPartiallyVisible( i % CNavVisRayBatch::MAX_EYES );
+		}
+		else
+		{
+			isVisible = area->IsPartiallyVisible( eyes[i] );
+		}
+
+		if ( isVisible )
+		{
+			vis |= POTENTIALLY_VISIBLE;
+		}
+		else
+		{
+			vis &= ~COMPLETELY_VISIBLE;
 		}
 	}
 
@@ -5437,77 +5748,107 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 }
 
 
+//--------------------------------------------------------------------------------------------------------
+static int AreaBindInfoIDCompare( const CNavArea::AreaBindInfo *left, const CNavArea::AreaBindInfo *right )
+{
+	unsigned int leftID = left->area ? left->area->GetID() : 0;
+	unsigned int rightID = right->area ? right->area->GetID() : 0;
+
+	if ( leftID < rightID )
+		return -1;
+
+	return ( leftID > rightID ) ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+void CNavArea::SortPotentiallyVisibleAreas( CNavArea *&area )
+{
+	area->m_potentiallyVisibleAreas.Sort( AreaBindInfoIDCompare );
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 /**
- * Return a list of the delta between our visibility list and the given adjacent area
+ * Compute the delta between our visibility list and the given adjacent area, and return its length.
+ * Both lists must have been sorted by SortPotentiallyVisibleAreas(), so they can be walked together
+ * instead of searching one for each entry of the other.
+ * Stops early and returns maxLength+1 once the delta grows longer than maxLength.
+ * If 'delta' is NULL, only the length is computed.
  */
-const CNavArea::CAreaBindInfoArray &CNavArea::ComputeVisibilityDelta( const CNavArea *other ) const
+int CNavArea::ComputeVisibilityDelta( const CNavArea *other, CAreaBindInfoArray *delta, int maxLength ) const
 {
-	static CAreaBindInfoArray delta;
+	if ( delta )
+	{
+		delta->RemoveAll();
+	}
+
+	const CAreaBindInfoArray &mine = m_potentiallyVisibleAreas;
+	const CAreaBindInfoArray &theirs = other->m_potentiallyVisibleAreas;
 
-	delta.RemoveAll();
-	
 	// do not delta from a delta - if 'other' is already inheriting, use its inherited source directly
 	if ( other->m_inheritVisibilityFrom.area != NULL )
 	{
 		Assert( false && "Visibility inheriting from inherited area" );
 
-		delta = m_potentiallyVisibleAreas;
-		return delta;
+		if ( delta )
+		{
+			*delta = mine;
+		}
+		return MIN( mine.Count(), maxLength + 1 );
 	}
 
-	// add any visible areas in my list that are not in 'others' list into the delta
-	int i, j;
-	for( i=0; i<m_potentiallyVisibleAreas.Count(); ++i )
+	int length = 0;
+	int i = 0, j = 0;
+	while( i < mine.Count() || j < theirs.Count() )
 	{
-		if ( m_potentiallyVisibleAreas[i].area )
+		if ( i < mine.Count() && !mine[i].area )
 		{
-			// is my visible area also in adjacent area's vis list
-			for( j=0; j<other->m_potentiallyVisibleAreas.Count(); ++j )
-			{
-				if ( m_potentiallyVisibleAreas[i].area == other->m_potentiallyVisibleAreas[j].area &&
-					 m_potentiallyVisibleAreas[i].attributes == other->m_potentiallyVisibleAreas[j].attributes )
-				{
-					// mutually identically visible
-					break;
-				}
-			}
+			++i;
+			continue;
+		}
 
-			if ( j == other->m_potentiallyVisibleAreas.Count() )
-			{
-				// my vis area not in adjacent area's vis list or has different visibility attributes - add to delta
-				delta.AddToTail( m_potentiallyVisibleAreas[i] );
-			}
+		if ( j < theirs.Count() && !theirs[j].area )
+		{
+			++j;
+			continue;
 		}
-	}
 
-	// add explicit NOT_VISIBLE references to areas in 'others' list that are NOT in mine
-	for( j=0; j<other->m_potentiallyVisibleAreas.Count(); ++j )
-	{
-		if ( other->m_potentiallyVisibleAreas[j].area )
+		AreaBindInfo info;
+
+		if ( j == theirs.Count() || ( i < mine.Count() && mine[i].area->GetID() < theirs[j].area->GetID() ) )
 		{
-			for( i=0; i<m_potentiallyVisibleAreas.Count(); ++i )
-			{
-				if ( m_potentiallyVisibleAreas[i].area == other->m_potentiallyVisibleAreas[j].area )
-				{
-					// area in both lists - already handled in delta above
-					break;
-				}
-			}
+			// my vis area not in adjacent area's vis list - add to delta
+			info = mine[i++];
+		}
+		else if ( i == mine.Count() || theirs[j].area->GetID() < mine[i].area->GetID() )
+		{
+			// 'other' has area in their list that we don't - mark it explicitly NOT_VISIBLE
+			info.area = theirs[j++].area;
+			info.attributes = NOT_VISIBLE;
+		}
+		else
+		{
+			// area in both lists - only a change in visibility attributes goes into the delta
+			bool isSame = ( mine[i].attributes == theirs[j].attributes );
+			info = mine[i];
+			++i;
+			++j;
 
-			if ( i == m_potentiallyVisibleAreas.Count() )
-			{
-				// 'other' has area in their list that we don't - mark it explicitly NOT_VISIBLE
-				AreaBindInfo info;
-				info.area = other->m_potentiallyVisibleAreas[j].area;
-				info.attributes = NOT_VISIBLE;
+			if ( isSame )
+				continue;
+		}
 
-				delta.AddToTail( info );
-			}
+		if ( ++length > maxLength )
+			return length;
+
+		if ( delta )
+		{
+			delta->AddToTail( info );
 		}
 	}
 
-	return delta;
+	return length;
 }
 
 
@@ -748,6 +748,7 @@ private:
 	void ComputeVisibilityToMesh( void );						// compute visibility to surrounding mesh
 	void ResetPotentiallyVisibleAreas();
 	static void ComputeVisToArea( CNavArea *&pOtherArea );
+	static void SortPotentiallyVisibleAreas( CNavArea *&area );	// sort an area's visibility list by area ID, for ComputeVisibilityDelta()
 
 #ifndef _X360
 	typedef CUtlVectorConservative<AreaBindInfo> CAreaBindInfoArray; // shaves 8 bytes off structure caused by need to support editing
@@ -759,7 +760,7 @@ private:
 	CAreaBindInfoArray m_potentiallyVisibleAreas;				// list of areas potentially visible from inside this area (after PostLoad(), use area portion of union)
 	bool m_isInheritedFrom;										// latch used during visibility inheritance computation
 
-	const CAreaBindInfoArray &ComputeVisibilityDelta( const CNavArea *other ) const;	// return a list of the delta between our visibility list and the given adjacent area
+	int ComputeVisibilityDelta( const CNavArea *other, CAreaBindInfoArray *delta, int maxLength ) const;	// compute the delta between our visibility list and the given adjacent area, return its length
 
 	uint32 m_nVisTestCounter;
 	static uint32 s_nCurrVisTestCounter;
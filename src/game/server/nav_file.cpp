@@ -19,6 +19,7 @@
 #endif
 
 #include "tier1/lzmaDecoder.h"
+#include "checksum_crc.h"
 
 #ifdef CSTRIKE_DLL
 #include "cs_shareddefs.h"
@@ -176,11 +177,22 @@ PlaceDirectory placeDirectory;
 #if defined( _X360 )
 	#define FORMAT_BSPFILE "maps\\%s.360.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.360.nav"
+	#define FORMAT_NAVCACHEFILE "maps\\%s.360.navcache"
 #else
 	#define FORMAT_BSPFILE "maps\\%s.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.nav"
+	#define FORMAT_NAVCACHEFILE "maps\\%s.navcache"
 #endif
 
+extern ConVar nav_slope_limit;
+
+ConVar nav_derived_cache( "nav_derived_cache", "1", 0, "Keep the area data the nav mesh works out on load (stairs) in a cache file next to the .nav, so later loads of the same map skip the work." );
+
+#define NAV_DERIVED_MAGIC_NUMBER 0xFEEDCACE
+
+// 1 = Area attributes after stair marking
+const unsigned int NavDerivedVersion = 1;
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Replace extension with "bsp"
@@ -1559,7 +1571,17 @@ NavErrorType CNavMesh::Load( void )
 	}
 
 	// mark stairways (TODO: this can be removed once all maps are re-saved with this attribute in them)
-	MarkStairAreas();
+	// This traces across every large area, so the results are cached per map.
+	CRC32_t navCRC = CRC32_ProcessSingleBuffer( fileBuffer.Base(), fileBuffer.TellMaxPut() );
+	if ( !nav_derived_cache.GetBool() || !LoadDerivedData( navCRC ) )
+	{
+		MarkStairAreas();
+
+		if ( nav_derived_cache.GetBool() )
+		{
+			SaveDerivedData( navCRC );
+		}
+	}
 
 	//
 	// Load derived class mesh info
@@ -1577,6 +1599,103 @@ NavErrorType CNavMesh::Load( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write what the key of a derived data cache file must match: the nav file, the bsp file it
+ * was traced against, and the settings the tracing used.
+ */
+static void PutDerivedDataKey( CUtlBuffer &fileBuffer, unsigned int navCRC, unsigned int areaCount )
+{
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+	const char *bspFilename = GetBspFilename( navFilename );
+
+	fileBuffer.PutUnsignedInt( NAV_DERIVED_MAGIC_NUMBER );
+	fileBuffer.PutUnsignedInt( NavDerivedVersion );
+	fileBuffer.PutUnsignedInt( navCRC );
+	fileBuffer.PutUnsignedInt( bspFilename ? filesystem->Size( bspFilename ) : 0 );
+	fileBuffer.PutUnsignedInt( bspFilename ? (unsigned int)filesystem->GetFileTime( bspFilename ) : 0 );
+	fileBuffer.PutFloat( nav_slope_limit.GetFloat() );
+	fileBuffer.PutUnsignedInt( areaCount );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Restore the area data derived on load from the map's cache file.
+ * Return false, and change nothing, if there is no cache or it was made for something else.
+ */
+bool CNavMesh::LoadDerivedData( unsigned int navCRC )
+{
+	char filename[256];
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVCACHEFILE, STRING( gpGlobals->mapname ) );
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
+	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )
+		return false;
+
+	CUtlBuffer key;
+	PutDerivedDataKey( key, navCRC, TheNavAreas.Count() );
+
+	if ( fileBuffer.TellMaxPut() != key.TellMaxPut() + TheNavAreas.Count() * 2 * sizeof( unsigned int ) ||
+		 V_memcmp( fileBuffer.Base(), key.Base(), key.TellMaxPut() ) )
+	{
+		DevMsg( "Navigation cache '%s' is out of date.\n", filename );
+		return false;
+	}
+
+	fileBuffer.SeekGet( CUtlBuffer::SEEK_HEAD, key.TellMaxPut() );
+
+	// the areas come back in the order they were saved, check them all before touching any
+	int dataStart = fileBuffer.TellGet();
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		unsigned int id = fileBuffer.GetUnsignedInt();
+		fileBuffer.GetUnsignedInt();
+
+		if ( id != TheNavAreas[ it ]->GetID() )
+		{
+			DevMsg( "Navigation cache '%s' doesn't match the mesh.\n", filename );
+			return false;
+		}
+	}
+
+	fileBuffer.SeekGet( CUtlBuffer::SEEK_HEAD, dataStart );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		fileBuffer.GetUnsignedInt();
+		TheNavAreas[ it ]->SetAttributes( fileBuffer.GetUnsignedInt() );
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write the area data derived on load to the map's cache file.
+ */
+void CNavMesh::SaveDerivedData( unsigned int navCRC )
+{
+	char filename[256];
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVCACHEFILE, STRING( gpGlobals->mapname ) );
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024 );
+	PutDerivedDataKey( fileBuffer, navCRC, TheNavAreas.Count() );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		fileBuffer.PutUnsignedInt( TheNavAreas[ it ]->GetID() );
+		fileBuffer.PutUnsignedInt( TheNavAreas[ it ]->GetAttributes() );
+	}
+
+	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		DevMsg( "Unable to write navigation cache '%s'.\n", filename );
+	}
+}
+
+
 struct OneWayLink_t
 {
 	CNavArea *destArea;
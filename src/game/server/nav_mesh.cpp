@@ -16,6 +16,7 @@
 #include "fmtstr.h"
 #include "utlbuffer.h"
 #include "tier0/vprof.h"
+#include "vstdlib/jobthread.h"
 #ifdef TERROR
 #include "func_simpleladder.h"
 #endif
@@ -3200,6 +3201,8 @@ void CNavMesh::UpdateAvoidanceObstacleAreas( void )
 
 
 extern CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs > *g_pNavVisPairHash;
+extern void BuildNavVisibilityWorld( void );
+extern void DestroyNavVisibilityWorld( void );
 
 //--------------------------------------------------------------------------------------------------------
 void CNavMesh::BeginVisibilityComputations( void )
@@ -3218,6 +3221,8 @@ void CNavMesh::BeginVisibilityComputations( void )
 		CNavArea *area = TheNavAreas[ it ];
 		area->ResetPotentiallyVisibleAreas();
 	}
+
+	BuildNavVisibilityWorld();
 }
 
 
@@ -3229,6 +3234,13 @@ void CNavMesh::EndVisibilityComputations( void )
 {
 	g_pNavVisPairHash->RemoveAll();
 
+	DestroyNavVisibilityWorld();
+
+	// sort every list once up front, so each delta below is a single linear walk of two lists
+	ParallelProcess( "CNavMesh::EndVisibilityComputations", TheNavAreas.Base(), TheNavAreas.Count(), &CNavArea::SortPotentiallyVisibleAreas );
+
+	const int maxDeltaLength = nav_max_vis_delta_list_length.GetInt();
+
 	int avgVisLength = 0;
 	int maxVisLength = 0;
 	int minVisLength = 999999999;
@@ -3258,7 +3270,8 @@ void CNavMesh::EndVisibilityComputations( void )
 		}
 
 		// find adjacent area with the smallest change from our visibility list
-		CNavArea::CAreaBindInfoArray bestDelta;
+		// each delta is only counted as far as it could still be stored and beat the best so far
+		int bestDeltaLength = maxDeltaLength + 1;
 		CNavArea *anchor = NULL;
 
 		for( int dir = NORTH; dir < NUM_DIRECTIONS; ++dir )
@@ -3276,12 +3289,12 @@ void CNavMesh::EndVisibilityComputations( void )
 						continue;	// don't try to inherit visibility from ourselves
 				}
 
-				const CNavArea::CAreaBindInfoArray &delta = area->ComputeVisibilityDelta( adjArea );
+				int deltaLength = area->ComputeVisibilityDelta( adjArea, NULL, bestDeltaLength - 1 );
 
 				// keep the smallest delta
-				if ( !anchor || ( anchor && delta.Count() < bestDelta.Count() ) )
+				if ( deltaLength < bestDeltaLength )
 				{
-					bestDelta = delta;
+					bestDeltaLength = deltaLength;
 					anchor = adjArea;
 					Assert( anchor != area );
 				}
@@ -3289,11 +3302,14 @@ void CNavMesh::EndVisibilityComputations( void )
 		}
 
 		// if best delta is small enough, inherit our data from this anchor
-		if ( anchor && bestDelta.Count() <= nav_max_vis_delta_list_length.GetInt() && anchor != area )
+		if ( anchor && anchor != area )
 		{
+			CNavArea::CAreaBindInfoArray delta;
+			area->ComputeVisibilityDelta( anchor, &delta, maxDeltaLength );
+
 			// inherit from anchor area's visibility list
 			area->m_inheritVisibilityFrom.area = anchor;
-			area->m_potentiallyVisibleAreas = bestDelta;
+			area->m_potentiallyVisibleAreas = delta;
 
 			// mark inherited-from area so it doesn't later try to inherit
 			anchor->m_isInheritedFrom = true;
@@ -1092,6 +1092,9 @@ private:
 
 	void ComputeBattlefrontAreas( void );						// determine areas where rushing teams will first meet
 
+	bool LoadDerivedData( unsigned int navCRC );				// restore the area data derived on load from the map's cache file, if it matches
+	void SaveDerivedData( unsigned int navCRC );				// write the area data derived on load to the map's cache file
+
 	//----------------------------------------------------------------------------------
 	// Place directory
 	//
@@ -0,0 +1,482 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side bookkeeping for CNetworkVar changes.
+//
+// The engine only learns about changes through CBaseEdict::StateChanged(),
+// either for the whole edict or for a list of up to MAX_CHANGE_OFFSETS var
+// offsets. This maps those offsets back onto the flattened SendTable of the
+// entity's ServerClass, which lets us:
+//
+//	- keep per-SendProp dirty bits for each entity for the current tick
+//	- drop changes to CNetworkVars that the class doesn't actually send, so
+//	  they never flag the edict for the engine's delta pass
+//	- gather per-class statistics about which props dirty most often
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "networkstatetracker.h"
+#include "server_class.h"
+#include "dt_send.h"
+#include "utlvector.h"
+#include "utlbuffer.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+bool g_bNetworkStateTrackerActive = false;
+
+static void NetworkStateTrackerChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_netvar_track( "sv_netvar_track", "0", FCVAR_CHEAT, "Track per-SendProp network state changes. Use sv_netvar_dump to see the results.", NetworkStateTrackerChanged );
+ConVar sv_netvar_suppress_unsent( "sv_netvar_suppress_unsent", "0", 0, "Don't flag entities as changed when the modified network var isn't part of their SendTable.", NetworkStateTrackerChanged );
+
+//-----------------------------------------------------------------------------
+// A flattened SendProp
+//-----------------------------------------------------------------------------
+struct TrackedNetworkProp_t
+{
+	const char		*m_pszTableName;
+	const char		*m_pszPropName;
+	int				m_nOffset;
+	unsigned int	m_nDirtyCount;		// Times this prop was dirtied
+	unsigned int	m_nRedundantCount;	// Times it was dirtied again in a tick it was already dirty in
+};
+
+//-----------------------------------------------------------------------------
+// Offset range [m_nStart, m_nEnd) that dirties m_iProp. Plain props cover a
+// single offset, old style SendPropArray props cover the whole array.
+//-----------------------------------------------------------------------------
+struct TrackedPropOffset_t
+{
+	unsigned short	m_nStart;
+	unsigned short	m_nEnd;
+	int				m_iProp;
+};
+
+static int SortPropOffsets( const TrackedPropOffset_t *a, const TrackedPropOffset_t *b )
+{
+	return (int)a->m_nStart - (int)b->m_nStart;
+}
+
+//-----------------------------------------------------------------------------
+// Per ServerClass data
+//-----------------------------------------------------------------------------
+class CNetworkClassTracker
+{
+public:
+	CNetworkClassTracker( ServerClass *pServerClass );
+
+	// Fills pProps with the indices of every prop covering nOffset, returns the count
+	int FindProps( unsigned short nOffset, int *pProps, int nMaxProps ) const;
+
+	// Can offsets that don't map to a prop be dropped?
+	bool IsOffsetExact( void ) const { return m_bOffsetExact; }
+
+	int GetNumProps( void ) const { return m_Props.Count(); }
+
+	ServerClass							*m_pServerClass;
+	CUtlVector<TrackedNetworkProp_t>	m_Props;
+	CUtlVector<TrackedPropOffset_t>		m_Offsets;		// Single offset props, sorted by m_nStart
+	CUtlVector<TrackedPropOffset_t>		m_Ranges;		// Array props
+	bool								m_bOffsetExact;
+
+	unsigned int	m_nChanges;
+	unsigned int	m_nFullChanges;
+	unsigned int	m_nUnsentChanges;
+
+private:
+	void AddTable( SendTable *pTable, int nBaseOffset );
+	void AddOffset( int nStart, int nEnd, int iProp );
+	static bool IsTrackableDataTableProxy( SendTableProxyFn fn );
+};
+
+CNetworkClassTracker::CNetworkClassTracker( ServerClass *pServerClass )
+{
+	m_pServerClass = pServerClass;
+	m_bOffsetExact = true;
+	m_nChanges = 0;
+	m_nFullChanges = 0;
+	m_nUnsentChanges = 0;
+
+	AddTable( pServerClass->m_pTable, 0 );
+	m_Offsets.Sort( SortPropOffsets );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same rule the engine uses for change offsets: only datatables whose
+//			proxy passes the data pointer through unmodified keep offsets valid.
+//-----------------------------------------------------------------------------
+bool CNetworkClassTracker::IsTrackableDataTableProxy( SendTableProxyFn fn )
+{
+	if ( fn == SendProxy_DataTableToDataTable || fn == SendProxy_SendLocalDataTable )
+		return true;
+
+	for ( CNonModifiedPointerProxy *pProxy = *g_StandardSendProxies.m_ppNonModifiedPointerProxies; pProxy; pProxy = pProxy->m_pNext )
+	{
+		if ( pProxy->m_Fn == fn )
+			return true;
+	}
+
+	return false;
+}
+
+void CNetworkClassTracker::AddTable( SendTable *pTable, int nBaseOffset )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+
+		// Excluded props are ignored, keeping them only makes us more conservative.
+		if ( pProp->IsExcludeProp() || ( pProp->GetFlags() & SPROP_INSIDEARRAY ) )
+			continue;
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			if ( !IsTrackableDataTableProxy( pProp->GetDataTableProxyFn() ) )
+			{
+				// The data lives somewhere else, so offsets into this entity can't be matched against it.
+				m_bOffsetExact = false;
+				continue;
+			}
+
+			AddTable( pProp->GetDataTable(), nBaseOffset + pProp->GetOffset() );
+			continue;
+		}
+
+		int iProp = m_Props.AddToTail();
+		TrackedNetworkProp_t &prop = m_Props[iProp];
+		prop.m_pszTableName = pTable->GetName();
+		prop.m_pszPropName = pProp->GetName();
+		prop.m_nDirtyCount = 0;
+		prop.m_nRedundantCount = 0;
+
+		if ( pProp->GetType() == DPT_Array )
+		{
+			// Old style arrays: elements are described by the prop that precedes the array
+			SendProp *pElement = pProp->GetArrayProp();
+			if ( !pElement )
+			{
+				m_bOffsetExact = false;
+				continue;
+			}
+
+			prop.m_nOffset = nBaseOffset + pElement->GetOffset();
+			AddOffset( prop.m_nOffset, prop.m_nOffset + MAX( pProp->GetNumElements() * pProp->GetElementStride(), 1 ), iProp );
+		}
+		else
+		{
+			prop.m_nOffset = nBaseOffset + pProp->GetOffset();
+			AddOffset( prop.m_nOffset, prop.m_nOffset + 1, iProp );
+		}
+	}
+}
+
+void CNetworkClassTracker::AddOffset( int nStart, int nEnd, int iProp )
+{
+	// Outside of what a change offset can represent, so we can't reason about unsent changes anymore
+	if ( nStart < 0 || nEnd > 0xFFFF )
+	{
+		m_bOffsetExact = false;
+		return;
+	}
+
+	CUtlVector<TrackedPropOffset_t> &list = ( nEnd - nStart > 1 ) ? m_Ranges : m_Offsets;
+	TrackedPropOffset_t &offset = list[ list.AddToTail() ];
+	offset.m_nStart = nStart;
+	offset.m_nEnd = nEnd;
+	offset.m_iProp = iProp;
+}
+
+int CNetworkClassTracker::FindProps( unsigned short nOffset, int *pProps, int nMaxProps ) const
+{
+	// Lower bound on the sorted single offsets, several props can share a var
+	int nLow = 0, nHigh = m_Offsets.Count();
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) / 2;
+		if ( m_Offsets[nMid].m_nStart < nOffset )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	int nFound = 0;
+	for ( int i = nLow; i < m_Offsets.Count() && m_Offsets[i].m_nStart == nOffset && nFound < nMaxProps; i++ )
+	{
+		pProps[nFound++] = m_Offsets[i].m_iProp;
+	}
+
+	// Arrays are rare, just walk them
+	for ( int i = 0; i < m_Ranges.Count() && nFound < nMaxProps; i++ )
+	{
+		if ( m_Ranges[i].m_nStart <= nOffset && nOffset < m_Ranges[i].m_nEnd )
+		{
+			pProps[nFound++] = m_Ranges[i].m_iProp;
+		}
+	}
+
+	return nFound;
+}
+
+
+//-----------------------------------------------------------------------------
+// Tracks every class and the per-tick dirty bits of every edict
+//-----------------------------------------------------------------------------
+class CNetworkStateTracker : public CAutoGameSystemPerFrame
+{
+public:
+	CNetworkStateTracker() : CAutoGameSystemPerFrame( "CNetworkStateTracker" ) {}
+
+	virtual void LevelShutdownPostEntity( void );
+	virtual void PreClientUpdate( void );
+
+	bool PropChanged( CBaseEntity *pEntity, ServerClass *pServerClass, unsigned short nOffset );
+	void FullChange( CBaseEntity *pEntity, ServerClass *pServerClass );
+
+	void Dump( int nTopProps );
+	void WriteCSV( const char *pszFilename );
+	void Reset( void );
+
+private:
+	CNetworkClassTracker *GetClassTracker( ServerClass *pServerClass );
+	bool MarkDirty( int iEntity, int iProp, int nNumProps );
+
+	CUtlVector<CNetworkClassTracker *>	m_Classes;				// Indexed by ServerClass::m_ClassID
+	CUtlVector<uint32>					m_DirtyBits[MAX_EDICTS];
+	CUtlVector<int>						m_DirtyEntities;
+};
+
+static CNetworkStateTracker g_NetworkStateTracker;
+
+static void NetworkStateTrackerChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	g_bNetworkStateTrackerActive = sv_netvar_track.GetBool() || sv_netvar_suppress_unsent.GetBool();
+}
+
+CNetworkClassTracker *CNetworkStateTracker::GetClassTracker( ServerClass *pServerClass )
+{
+	int nClassID = pServerClass->m_ClassID;
+	if ( nClassID < 0 )
+		return NULL;
+
+	if ( nClassID >= m_Classes.Count() )
+	{
+		int nOldCount = m_Classes.Count();
+		m_Classes.AddMultipleToTail( nClassID + 1 - nOldCount );
+		for ( int i = nOldCount; i < m_Classes.Count(); i++ )
+		{
+			m_Classes[i] = NULL;
+		}
+	}
+
+	if ( !m_Classes[nClassID] )
+	{
+		m_Classes[nClassID] = new CNetworkClassTracker( pServerClass );
+	}
+
+	return m_Classes[nClassID];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets the dirty bit, returns true if it was already set this tick
+//-----------------------------------------------------------------------------
+bool CNetworkStateTracker::MarkDirty( int iEntity, int iProp, int nNumProps )
+{
+	CUtlVector<uint32> &bits = m_DirtyBits[iEntity];
+	if ( bits.Count() == 0 )
+	{
+		int nWords = ( nNumProps + 31 ) / 32;
+		bits.SetCount( MAX( nWords, 1 ) );
+		memset( bits.Base(), 0, bits.Count() * sizeof( uint32 ) );
+		m_DirtyEntities.AddToTail( iEntity );
+	}
+
+	int iWord = iProp / 32;
+	if ( iWord >= bits.Count() )
+		return false;
+
+	uint32 nMask = 1u << ( iProp & 31 );
+	bool bWasDirty = ( bits[iWord] & nMask ) != 0;
+	bits[iWord] |= nMask;
+	return bWasDirty;
+}
+
+bool CNetworkStateTracker::PropChanged( CBaseEntity *pEntity, ServerClass *pServerClass, unsigned short nOffset )
+{
+	CNetworkClassTracker *pClass = GetClassTracker( pServerClass );
+	if ( !pClass )
+		return true;
+
+	int props[8];
+	int nFound = pClass->FindProps( nOffset, props, ARRAYSIZE( props ) );
+	if ( nFound == 0 )
+	{
+		pClass->m_nUnsentChanges++;
+		return !( sv_netvar_suppress_unsent.GetBool() && pClass->IsOffsetExact() );
+	}
+
+	if ( sv_netvar_track.GetBool() )
+	{
+		pClass->m_nChanges++;
+
+		int iEntity = pEntity->entindex();
+		for ( int i = 0; i < nFound; i++ )
+		{
+			TrackedNetworkProp_t &prop = pClass->m_Props[ props[i] ];
+			prop.m_nDirtyCount++;
+
+			if ( iEntity >= 0 && iEntity < MAX_EDICTS && MarkDirty( iEntity, props[i], pClass->GetNumProps() ) )
+			{
+				prop.m_nRedundantCount++;
+			}
+		}
+	}
+
+	return true;
+}
+
+void CNetworkStateTracker::FullChange( CBaseEntity *pEntity, ServerClass *pServerClass )
+{
+	if ( !sv_netvar_track.GetBool() )
+		return;
+
+	CNetworkClassTracker *pClass = GetClassTracker( pServerClass );
+	if ( pClass )
+	{
+		pClass->m_nFullChanges++;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The engine packs entities right after this, so the tick is over
+//-----------------------------------------------------------------------------
+void CNetworkStateTracker::PreClientUpdate( void )
+{
+	for ( int i = 0; i < m_DirtyEntities.Count(); i++ )
+	{
+		m_DirtyBits[ m_DirtyEntities[i] ].RemoveAll();
+	}
+	m_DirtyEntities.RemoveAll();
+}
+
+void CNetworkStateTracker::LevelShutdownPostEntity( void )
+{
+	PreClientUpdate();
+}
+
+void CNetworkStateTracker::Reset( void )
+{
+	m_Classes.PurgeAndDeleteElements();
+	PreClientUpdate();
+}
+
+static int SortPropsByDirtyCount( const TrackedNetworkProp_t * const *a, const TrackedNetworkProp_t * const *b )
+{
+	return (int)(*b)->m_nDirtyCount - (int)(*a)->m_nDirtyCount;
+}
+
+void CNetworkStateTracker::Dump( int nTopProps )
+{
+	for ( int i = 0; i < m_Classes.Count(); i++ )
+	{
+		CNetworkClassTracker *pClass = m_Classes[i];
+		if ( !pClass || ( !pClass->m_nChanges && !pClass->m_nFullChanges && !pClass->m_nUnsentChanges ) )
+			continue;
+
+		Msg( "%s: %u prop changes, %u full changes, %u unsent changes%s\n", pClass->m_pServerClass->GetName(),
+			pClass->m_nChanges, pClass->m_nFullChanges, pClass->m_nUnsentChanges, pClass->IsOffsetExact() ? "" : " (not offset exact)" );
+
+		CUtlVector<TrackedNetworkProp_t *> sorted;
+		for ( int j = 0; j < pClass->m_Props.Count(); j++ )
+		{
+			if ( pClass->m_Props[j].m_nDirtyCount )
+			{
+				sorted.AddToTail( &pClass->m_Props[j] );
+			}
+		}
+		sorted.Sort( SortPropsByDirtyCount );
+
+		for ( int j = 0; j < sorted.Count() && j < nTopProps; j++ )
+		{
+			Msg( "    %-32s %-32s %8u dirty %8u redundant\n", sorted[j]->m_pszTableName, sorted[j]->m_pszPropName, sorted[j]->m_nDirtyCount, sorted[j]->m_nRedundantCount );
+		}
+	}
+}
+
+void CNetworkStateTracker::WriteCSV( const char *pszFilename )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	buf.PutString( "class,table,prop,offset,dirty,redundant\n" );
+
+	for ( int i = 0; i < m_Classes.Count(); i++ )
+	{
+		CNetworkClassTracker *pClass = m_Classes[i];
+		if ( !pClass )
+			continue;
+
+		for ( int j = 0; j < pClass->m_Props.Count(); j++ )
+		{
+			const TrackedNetworkProp_t &prop = pClass->m_Props[j];
+			if ( !prop.m_nDirtyCount )
+				continue;
+
+			buf.Printf( "%s,%s,%s,%d,%u,%u\n", pClass->m_pServerClass->GetName(), prop.m_pszTableName, prop.m_pszPropName, prop.m_nOffset, prop.m_nDirtyCount, prop.m_nRedundantCount );
+		}
+	}
+
+	if ( filesystem->WriteFile( pszFilename, "MOD", buf ) )
+	{
+		Msg( "Wrote network var stats to %s\n", pszFilename );
+	}
+	else
+	{
+		Warning( "Failed to write network var stats to %s\n", pszFilename );
+	}
+}
+
+bool NetworkStateTracker_PropChanged( CBaseEntity *pEntity, ServerClass *pServerClass, unsigned short nOffset )
+{
+	if ( !pServerClass )
+		return true;
+
+	return g_NetworkStateTracker.PropChanged( pEntity, pServerClass, nOffset );
+}
+
+void NetworkStateTracker_FullChange( CBaseEntity *pEntity, ServerClass *pServerClass )
+{
+	if ( !pServerClass )
+		return;
+
+	g_NetworkStateTracker.FullChange( pEntity, pServerClass );
+}
+
+CON_COMMAND( sv_netvar_dump, "Dump the most frequently changed network vars per class. Usage: sv_netvar_dump [props per class]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nTopProps = args.ArgC() > 1 ? atoi( args[1] ) : 10;
+	g_NetworkStateTracker.Dump( MAX( nTopProps, 1 ) );
+}
+
+CON_COMMAND( sv_netvar_csv, "Write network var change statistics to a csv file. Usage: sv_netvar_csv [filename]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_NetworkStateTracker.WriteCSV( args.ArgC() > 1 ? args[1] : "netvar_stats.csv" );
+}
+
+CON_COMMAND( sv_netvar_reset, "Reset network var change statistics" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_NetworkStateTracker.Reset();
+}
@@ -0,0 +1,35 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side bookkeeping for CNetworkVar changes. Maps the offsets
+//			passed to NetworkStateChanged() back to SendProps so we can keep
+//			per-prop dirty bits, drop changes to fields the class never sends
+//			and report which props dirty the most.
+//
+//=============================================================================//
+
+#ifndef NETWORKSTATETRACKER_H
+#define NETWORKSTATETRACKER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBaseEntity;
+class ServerClass;
+
+// Non-zero while either tracking or unsent suppression is enabled, so the
+// inline NetworkStateChanged() paths only pay for a bool test otherwise.
+extern bool g_bNetworkStateTrackerActive;
+
+//-----------------------------------------------------------------------------
+// Purpose: Called for every offset based state change.
+// Output : false if the change doesn't touch anything the class sends and
+//			the edict doesn't need to be flagged.
+//-----------------------------------------------------------------------------
+bool NetworkStateTracker_PropChanged( CBaseEntity *pEntity, ServerClass *pServerClass, unsigned short nOffset );
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when the whole entity is flagged changed.
+//-----------------------------------------------------------------------------
+void NetworkStateTracker_FullChange( CBaseEntity *pEntity, ServerClass *pServerClass );
+
+#endif // NETWORKSTATETRACKER_H
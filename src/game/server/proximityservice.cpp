@@ -0,0 +1,351 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Shared "who is near me" tracking for auras.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "proximityservice.h"
+#include "collisionutils.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CProximityService g_ProximityService;
+
+
+CProximityService::CProximityService() : CAutoGameSystemPerFrame( "CProximityService" )
+{
+	m_nNextSerial = 0;
+	memset( m_pPlayers, 0, sizeof( m_pPlayers ) );
+	memset( m_iGridBuckets, 0xff, sizeof( m_iGridBuckets ) );
+
+	m_nTicks = 0;
+	m_nCandidateTests = 0;
+	m_nEnters = 0;
+	m_nExits = 0;
+}
+
+void CProximityService::LevelShutdownPostEntity()
+{
+	m_Sources.Purge();
+	m_GridEntries.Purge();
+	m_Events.Purge();
+	memset( m_pPlayers, 0, sizeof( m_pPlayers ) );
+	memset( m_iGridBuckets, 0xff, sizeof( m_iGridBuckets ) );
+}
+
+ProximityHandle_t CProximityService::AddSource( CBaseEntity *pOwner, IProximityListener *pListener )
+{
+	ProximityHandle_t hSource = m_Sources.AddToTail();
+	Source_t &source = m_Sources[hSource];
+	source.m_hOwner = pOwner;
+	source.m_pListener = pListener;
+	source.m_nSerial = ++m_nNextSerial;
+	source.m_MemberBits.ClearAll();
+	source.m_Members.RemoveAll();
+	return hSource;
+}
+
+ProximityHandle_t CProximityService::AddSphere( CBaseEntity *pOwner, IProximityListener *pListener, const Vector &vecOffset, float flRadius )
+{
+	ProximityHandle_t hSource = AddSource( pOwner, pListener );
+	Source_t &source = m_Sources[hSource];
+	source.m_bSphere = true;
+	source.m_vecMins = vecOffset;
+	source.m_vecMaxs = vecOffset;
+	source.m_flRadius = flRadius;
+	return hSource;
+}
+
+ProximityHandle_t CProximityService::AddBox( CBaseEntity *pOwner, IProximityListener *pListener, const Vector &vecMins, const Vector &vecMaxs )
+{
+	ProximityHandle_t hSource = AddSource( pOwner, pListener );
+	Source_t &source = m_Sources[hSource];
+	source.m_bSphere = false;
+	source.m_vecMins = vecMins;
+	source.m_vecMaxs = vecMaxs;
+	source.m_flRadius = 0.0f;
+	return hSource;
+}
+
+void CProximityService::RemoveSource( ProximityHandle_t hSource )
+{
+	if ( IsValidSource( hSource ) )
+	{
+		m_Sources.Remove( hSource );
+	}
+}
+
+bool CProximityService::IsValidSource( ProximityHandle_t hSource ) const
+{
+	return ( hSource != PROXIMITY_INVALID_HANDLE ) && m_Sources.IsValidIndex( hSource );
+}
+
+int CProximityService::GetMemberCount( ProximityHandle_t hSource ) const
+{
+	return IsValidSource( hSource ) ? m_Sources[hSource].m_Members.Count() : 0;
+}
+
+CBasePlayer *CProximityService::GetMember( ProximityHandle_t hSource, int iMember ) const
+{
+	Assert( IsValidSource( hSource ) );
+	return UTIL_PlayerByIndex( m_Sources[hSource].m_Members[iMember] );
+}
+
+bool CProximityService::IsMember( ProximityHandle_t hSource, CBasePlayer *pPlayer ) const
+{
+	if ( !pPlayer || !IsValidSource( hSource ) )
+		return false;
+
+	int iPlayer = pPlayer->entindex();
+	if ( iPlayer < 1 || iPlayer > MAX_PLAYERS )
+		return false;
+
+	return m_Sources[hSource].m_MemberBits.IsBitSet( iPlayer - 1 );
+}
+
+int CProximityService::GridBucket( int x, int y )
+{
+	return ( ( x * 73856093 ) ^ ( y * 19349663 ) ) & ( GRID_BUCKETS - 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Bins the live players by the 2D grid cells their bounds touch.
+//-----------------------------------------------------------------------------
+void CProximityService::BuildGrid()
+{
+	m_GridEntries.RemoveAll();
+	memset( m_iGridBuckets, 0xff, sizeof( m_iGridBuckets ) );
+
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( !pPlayer || !pPlayer->IsAlive() )
+		{
+			m_pPlayers[i - 1] = NULL;
+			continue;
+		}
+
+		m_pPlayers[i - 1] = pPlayer;
+
+		Vector vecMins, vecMaxs;
+		pPlayer->CollisionProp()->WorldSpaceAABB( &vecMins, &vecMaxs );
+
+		int x0 = Floor2Int( vecMins.x / GRID_CELL_SIZE );
+		int x1 = Floor2Int( vecMaxs.x / GRID_CELL_SIZE );
+		int y0 = Floor2Int( vecMins.y / GRID_CELL_SIZE );
+		int y1 = Floor2Int( vecMaxs.y / GRID_CELL_SIZE );
+
+		for ( int x = x0; x <= x1; x++ )
+		{
+			for ( int y = y0; y <= y1; y++ )
+			{
+				int iBucket = GridBucket( x, y );
+
+				int iEntry = m_GridEntries.AddToTail();
+				GridEntry_t &entry = m_GridEntries[iEntry];
+				entry.m_x = x;
+				entry.m_y = y;
+				entry.m_iPlayer = i;
+				entry.m_iNext = m_iGridBuckets[iBucket];
+				m_iGridBuckets[iBucket] = iEntry;
+			}
+		}
+	}
+
+	for ( int i = gpGlobals->maxClients; i < MAX_PLAYERS; i++ )
+	{
+		m_pPlayers[i] = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Works out who is inside one source and queues the differences.
+//-----------------------------------------------------------------------------
+void CProximityService::UpdateSource( ProximityHandle_t hSource )
+{
+	Source_t &source = m_Sources[hSource];
+	CBaseEntity *pOwner = source.m_hOwner.Get();
+	Assert( pOwner );
+
+	const Vector &vecOrigin = pOwner->GetAbsOrigin();
+	Vector vecCenter, vecMins, vecMaxs;
+	if ( source.m_bSphere )
+	{
+		vecCenter = vecOrigin + source.m_vecMins;
+		vecMins = vecCenter - Vector( source.m_flRadius, source.m_flRadius, source.m_flRadius );
+		vecMaxs = vecCenter + Vector( source.m_flRadius, source.m_flRadius, source.m_flRadius );
+	}
+	else
+	{
+		vecMins = vecOrigin + source.m_vecMins;
+		vecMaxs = vecOrigin + source.m_vecMaxs;
+	}
+
+	CBitVec<MAX_PLAYERS> inside;
+	inside.ClearAll();
+
+	CBitVec<MAX_PLAYERS> tested;
+	tested.ClearAll();
+
+	int x0 = Floor2Int( vecMins.x / GRID_CELL_SIZE );
+	int x1 = Floor2Int( vecMaxs.x / GRID_CELL_SIZE );
+	int y0 = Floor2Int( vecMins.y / GRID_CELL_SIZE );
+	int y1 = Floor2Int( vecMaxs.y / GRID_CELL_SIZE );
+
+	for ( int x = x0; x <= x1; x++ )
+	{
+		for ( int y = y0; y <= y1; y++ )
+		{
+			for ( int iEntry = m_iGridBuckets[ GridBucket( x, y ) ]; iEntry != -1; iEntry = m_GridEntries[iEntry].m_iNext )
+			{
+				const GridEntry_t &entry = m_GridEntries[iEntry];
+				if ( entry.m_x != x || entry.m_y != y )
+					continue;
+
+				// Players that span cells show up once per cell.
+				int iBit = entry.m_iPlayer - 1;
+				if ( tested.IsBitSet( iBit ) )
+					continue;
+				tested.Set( iBit );
+
+				++m_nCandidateTests;
+
+				CBasePlayer *pPlayer = m_pPlayers[iBit];
+				Vector vecPlayerMins, vecPlayerMaxs;
+				pPlayer->CollisionProp()->WorldSpaceAABB( &vecPlayerMins, &vecPlayerMaxs );
+
+				bool bInside = source.m_bSphere ?
+					IsBoxIntersectingSphere( vecPlayerMins, vecPlayerMaxs, vecCenter, source.m_flRadius ) :
+					IsBoxIntersectingBox( vecPlayerMins, vecPlayerMaxs, vecMins, vecMaxs );
+
+				if ( bInside && ( !source.m_pListener || source.m_pListener->ProximityShouldInclude( hSource, pPlayer ) ) )
+				{
+					inside.Set( iBit );
+				}
+			}
+		}
+	}
+
+	// Players that left.
+	for ( int i = source.m_Members.Count() - 1; i >= 0; i-- )
+	{
+		int iPlayer = source.m_Members[i];
+		if ( inside.IsBitSet( iPlayer - 1 ) )
+			continue;
+
+		source.m_Members.Remove( i );
+		source.m_MemberBits.Clear( iPlayer - 1 );
+		++m_nExits;
+
+		if ( source.m_pListener )
+		{
+			Event_t &event = m_Events[ m_Events.AddToTail() ];
+			event.m_hSource = hSource;
+			event.m_nSerial = source.m_nSerial;
+			event.m_iPlayer = iPlayer;
+			event.m_bEnter = false;
+		}
+	}
+
+	// Players that came in.
+	for ( int iBit = inside.FindNextSetBit( 0 ); iBit != -1; iBit = inside.FindNextSetBit( iBit + 1 ) )
+	{
+		if ( source.m_MemberBits.IsBitSet( iBit ) )
+			continue;
+
+		source.m_Members.AddToTail( iBit + 1 );
+		source.m_MemberBits.Set( iBit );
+		++m_nEnters;
+
+		if ( source.m_pListener )
+		{
+			Event_t &event = m_Events[ m_Events.AddToTail() ];
+			event.m_hSource = hSource;
+			event.m_nSerial = source.m_nSerial;
+			event.m_iPlayer = iBit + 1;
+			event.m_bEnter = true;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes the callbacks once every source is up to date, so listeners
+//			are free to add and remove sources from them.
+//-----------------------------------------------------------------------------
+void CProximityService::DispatchEvents()
+{
+	for ( int i = 0; i < m_Events.Count(); i++ )
+	{
+		const Event_t &event = m_Events[i];
+		if ( !IsValidSource( event.m_hSource ) || m_Sources[event.m_hSource].m_nSerial != event.m_nSerial )
+			continue;
+
+		IProximityListener *pListener = m_Sources[event.m_hSource].m_pListener;
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( event.m_iPlayer );
+		if ( !pListener || !pPlayer )
+			continue;
+
+		if ( event.m_bEnter )
+		{
+			pListener->OnProximityEnter( event.m_hSource, pPlayer );
+		}
+		else
+		{
+			pListener->OnProximityExit( event.m_hSource, pPlayer );
+		}
+	}
+
+	m_Events.RemoveAll();
+}
+
+void CProximityService::FrameUpdatePostEntityThink()
+{
+	VPROF( "CProximityService::FrameUpdatePostEntityThink" );
+
+	if ( !m_Sources.Count() )
+		return;
+
+	BuildGrid();
+
+	int iNext;
+	for ( int i = m_Sources.Head(); i != m_Sources.InvalidIndex(); i = iNext )
+	{
+		iNext = m_Sources.Next( i );
+
+		// Sources die with their owners. The owner was the listener, if any.
+		if ( !m_Sources[i].m_hOwner.Get() )
+		{
+			m_Sources.Remove( i );
+			continue;
+		}
+
+		UpdateSource( i );
+	}
+
+	++m_nTicks;
+
+	DispatchEvents();
+}
+
+void CProximityService::PrintStats()
+{
+	Msg( "%d proximity sources\n", m_Sources.Count() );
+
+	if ( m_nTicks )
+	{
+		Msg( "%u ticks: %.1f player tests, %.2f enters, %.2f exits per tick\n", m_nTicks,
+			(float)m_nCandidateTests / m_nTicks, (float)m_nEnters / m_nTicks, (float)m_nExits / m_nTicks );
+	}
+}
+
+
+CON_COMMAND( sv_proximity_stats, "Show how much work the proximity service is doing for auras." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_ProximityService.PrintStats();
+}
@@ -0,0 +1,129 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Shared "who is near me" tracking for auras. Entities register a
+//			sphere or box around themselves and the service works out which
+//			live players are inside it once per tick, from a coarse grid of
+//			the players built once per tick. Sources read the membership
+//			instead of running their own sphere queries, and listeners are
+//			told when a player enters or leaves.
+//
+//=============================================================================//
+
+#ifndef PROXIMITYSERVICE_H
+#define PROXIMITYSERVICE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+#include "utllinkedlist.h"
+#include "bitvec.h"
+
+class CBaseEntity;
+class CBasePlayer;
+
+typedef int ProximityHandle_t;
+#define PROXIMITY_INVALID_HANDLE	-1
+
+//-----------------------------------------------------------------------------
+// Purpose: Filter and enter/exit callbacks for a proximity source.
+//-----------------------------------------------------------------------------
+abstract_class IProximityListener
+{
+public:
+	// Return false to keep a player out of the membership while it's inside
+	// the volume. Called every tick for every player inside, keep it cheap.
+	virtual bool ProximityShouldInclude( ProximityHandle_t hSource, CBasePlayer *pPlayer ) { return true; }
+
+	virtual void OnProximityEnter( ProximityHandle_t hSource, CBasePlayer *pPlayer ) {}
+	virtual void OnProximityExit( ProximityHandle_t hSource, CBasePlayer *pPlayer ) {}
+};
+
+
+class CProximityService : public CAutoGameSystemPerFrame
+{
+public:
+	CProximityService();
+
+	virtual void LevelShutdownPostEntity();
+	virtual void FrameUpdatePostEntityThink();
+
+	// The volume follows pOwner's origin and is dropped when pOwner goes away.
+	// pListener may be NULL if the owner only reads the membership.
+	ProximityHandle_t AddSphere( CBaseEntity *pOwner, IProximityListener *pListener, const Vector &vecOffset, float flRadius );
+	ProximityHandle_t AddBox( CBaseEntity *pOwner, IProximityListener *pListener, const Vector &vecMins, const Vector &vecMaxs );
+
+	// No exit callbacks are made for the members at the time.
+	void RemoveSource( ProximityHandle_t hSource );
+
+	// Players inside as of the end of the last tick.
+	int GetMemberCount( ProximityHandle_t hSource ) const;
+	CBasePlayer *GetMember( ProximityHandle_t hSource, int iMember ) const;
+	bool IsMember( ProximityHandle_t hSource, CBasePlayer *pPlayer ) const;
+
+	void PrintStats();
+
+private:
+	enum
+	{
+		GRID_CELL_SIZE = 512,
+		GRID_BUCKETS = 64,
+	};
+
+	struct Source_t
+	{
+		EHANDLE					m_hOwner;
+		IProximityListener		*m_pListener;
+		int						m_nSerial;
+
+		bool					m_bSphere;
+		Vector					m_vecMins;		// Offset of the center for spheres
+		Vector					m_vecMaxs;
+		float					m_flRadius;
+
+		CBitVec<MAX_PLAYERS>	m_MemberBits;	// By entindex - 1
+		CUtlVector<int>			m_Members;		// Entindexes, in the order they came in
+	};
+
+	struct GridEntry_t
+	{
+		int	m_x;
+		int	m_y;
+		int	m_iPlayer;
+		int	m_iNext;
+	};
+
+	struct Event_t
+	{
+		ProximityHandle_t	m_hSource;
+		int					m_nSerial;
+		int					m_iPlayer;
+		bool				m_bEnter;
+	};
+
+	ProximityHandle_t AddSource( CBaseEntity *pOwner, IProximityListener *pListener );
+	bool IsValidSource( ProximityHandle_t hSource ) const;
+
+	void BuildGrid();
+	static int GridBucket( int x, int y );
+	void UpdateSource( ProximityHandle_t hSource );
+	void DispatchEvents();
+
+	CUtlLinkedList<Source_t, int>	m_Sources;
+	int								m_nNextSerial;
+
+	CBasePlayer				*m_pPlayers[MAX_PLAYERS];	// Live players this tick, by entindex - 1
+	CUtlVector<GridEntry_t>	m_GridEntries;
+	int						m_iGridBuckets[GRID_BUCKETS];
+
+	CUtlVector<Event_t>		m_Events;
+
+	unsigned int			m_nTicks;
+	unsigned int			m_nCandidateTests;
+	unsigned int			m_nEnters;
+	unsigned int			m_nExits;
+};
+
+extern CProximityService g_ProximityService;
+
+#endif // PROXIMITYSERVICE_H
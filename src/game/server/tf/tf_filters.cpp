@@ -11,6 +11,18 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: The winners pass every TF filter during the bonus time, negated
+//			or not. The filters compile again on every round state change.
+//-----------------------------------------------------------------------------
+static int GetBonusTimeWinningTeam( void )
+{
+	if ( TFGameRules() && ( TFGameRules()->State_Get() == GR_STATE_TEAM_WIN ) )
+		return TFGameRules()->GetWinningTeam();
+
+	return TEAM_INVALID;
+}
+
 //=============================================================================
 //
 // Team Fortress Team Filter
@@ -25,6 +37,7 @@ public:
 	void InputRoundActivate( inputdata_t &inputdata );
 
 	inline bool PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity );
+	bool CompileFilterImpl( CompiledFilter_t &compiled );
 
 private:
 
@@ -71,6 +84,25 @@ bool CFilterTFTeam::PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity
 	return ( pEntity->GetTeamNumber() == GetTeamNumber() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CFilterTFTeam::CompileFilterImpl( CompiledFilter_t &compiled )
+{
+	compiled.SetTeam( GetTeamNumber() );
+
+	int iWinningTeam = GetBonusTimeWinningTeam();
+	if ( iWinningTeam >= 0 && iWinningTeam < MAX_TEAMS )
+	{
+		for ( int i = 0; i < FILTER_ENTITY_TYPE_COUNT; i++ )
+		{
+			compiled.m_nAlwaysPassTeams[i] |= ( 1u << iWinningTeam );
+		}
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -110,6 +142,7 @@ class CFilterTFClass : public CBaseFilter
 public:
 
 	inline bool PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity );
+	bool CompileFilterImpl( CompiledFilter_t &compiled );
 
 private:
 
@@ -157,3 +190,24 @@ bool CFilterTFClass::PassesFilterImpl(CBaseEntity *pCaller, CBaseEntity *pEntity
 
 	return (pPlayer->GetTeamNumber() == GetTeamNumber() && pPlayer->IsPlayerClass(m_iAllowedClass));
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: Only players of one class on our team pass, and only players get
+//			the bonus time pass.
+//-----------------------------------------------------------------------------
+bool CFilterTFClass::CompileFilterImpl( CompiledFilter_t &compiled )
+{
+	int iTeam = GetTeamNumber();
+	if ( iTeam >= 0 && iTeam < MAX_TEAMS && m_iAllowedClass >= 0 && m_iAllowedClass < 32 )
+	{
+		compiled.m_nPassClasses[FILTER_ENTITY_PLAYER][iTeam] = ( 1u << m_iAllowedClass );
+	}
+
+	int iWinningTeam = GetBonusTimeWinningTeam();
+	if ( iWinningTeam >= 0 && iWinningTeam < MAX_TEAMS )
+	{
+		compiled.m_nAlwaysPassTeams[FILTER_ENTITY_PLAYER] |= ( 1u << iWinningTeam );
+	}
+
+	return true;
+}
@@ -40,6 +40,7 @@
 #include "tf_obj_sapper.h"
 #include "particle_parse.h"
 #include "tf_fx.h"
+#include "gameeventbuilder.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -689,6 +690,9 @@ void CBaseObject::BaseObjectThink( void )
 		return;
 	}
 
+	if ( WantsThreadedBoneSetup() )
+		QueueThreadedBoneSetup();
+
 	// If we're building, keep going
 	if ( IsBuilding() )
 	{
@@ -1829,6 +1833,32 @@ bool CBaseObject::PassDamageOntoChildren( const CTakeDamageInfo &info, float *fl
 	return false;
 }
 
+enum
+{
+	NPCHURT_ENTINDEX = 0,
+	NPCHURT_ATTACKER_PLAYER,
+	NPCHURT_WEAPONID,
+	NPCHURT_DAMAGEAMOUNT,
+	NPCHURT_HEALTH,
+	NPCHURT_CRIT,
+	NPCHURT_BOSS,
+
+	NPCHURT_FIELD_COUNT
+};
+
+static const GameEventField_t s_NPCHurtFields[] =
+{
+	{ "entindex",			GAMEEVENT_FIELD_INT,	false },
+	{ "attacker_player",	GAMEEVENT_FIELD_INT,	false },
+	{ "weaponid",			GAMEEVENT_FIELD_INT,	false },
+	{ "damageamount",		GAMEEVENT_FIELD_INT,	false },
+	{ "health",				GAMEEVENT_FIELD_INT,	false },
+	{ "crit",				GAMEEVENT_FIELD_BOOL,	false },
+	{ "boss",				GAMEEVENT_FIELD_BOOL,	false },
+};
+
+DEFINE_GAMEEVENT_DESC( s_NPCHurtEvent, "npc_hurt", s_NPCHurtFields, NPCHURT_FIELD_COUNT );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -1906,22 +1936,20 @@ int CBaseObject::OnTakeDamage( const CTakeDamageInfo &info )
 		}
 	}
 
-	IGameEvent *event = gameeventmanager->CreateEvent( "npc_hurt" );
-
-	if ( event )
 	{
 		CTFPlayer *pTFAttacker = ToTFPlayer( info.GetAttacker() );
 		CTFWeaponBase *pTFWeapon = dynamic_cast<CTFWeaponBase *>( info.GetWeapon() );
 
-		event->SetInt( "entindex", entindex() );
-		event->SetInt( "attacker_player", pTFAttacker ? pTFAttacker->GetUserID() : 0 );
-		event->SetInt( "weaponid", pTFWeapon ? pTFWeapon->GetWeaponID() : TF_WEAPON_NONE );
-		event->SetInt( "damageamount", iOldHealth - m_iHealth );
-		event->SetInt( "health", max( 0, m_iHealth ) );
-		event->SetBool( "crit", false );
-		event->SetBool( "boss", false );
+		CGameEventBuilder event( s_NPCHurtEvent );
+		event.SetInt( NPCHURT_ENTINDEX, entindex() );
+		event.SetInt( NPCHURT_ATTACKER_PLAYER, pTFAttacker ? pTFAttacker->GetUserID() : 0 );
+		event.SetInt( NPCHURT_WEAPONID, pTFWeapon ? pTFWeapon->GetWeaponID() : TF_WEAPON_NONE );
+		event.SetInt( NPCHURT_DAMAGEAMOUNT, iOldHealth - m_iHealth );
+		event.SetInt( NPCHURT_HEALTH, max( 0, m_iHealth ) );
+		event.SetBool( NPCHURT_CRIT, false );
+		event.SetBool( NPCHURT_BOSS, false );
 
-		gameeventmanager->FireEvent( event );
+		event.Fire();
 	}
 
 
@@ -152,6 +152,8 @@ public:
 	virtual bool	IsDying( void ) { return m_bDying; }
 	void DestroyScreens( void );
 
+	virtual bool	WantsThreadedBoneSetup( void ) { return !IsPlacing() && !IsDying() && HasRecentBoneCacheRequest(); }
+
 	// Data
 	virtual Class_T	Classify( void );
 	virtual int		GetType( void );
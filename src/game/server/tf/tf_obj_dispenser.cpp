@@ -147,11 +147,15 @@ CObjectDispenser::CObjectDispenser()
 
 	m_hTouchingEntities.Purge();
 
+	m_hAmmoProximity = PROXIMITY_INVALID_HANDLE;
+
 	SetType( OBJ_DISPENSER );
 }
 
 CObjectDispenser::~CObjectDispenser()
 {
+	g_ProximityService.RemoveSource( m_hAmmoProximity );
+
 	if ( m_hTouchTrigger.Get() )
 	{
 		UTIL_Remove( m_hTouchTrigger );
@@ -214,6 +218,9 @@ void CObjectDispenser::MakeCarriedObject( CTFPlayer *pPlayer )
 	SetContextThink( NULL, 0, DISPENSE_CONTEXT );
 	SetContextThink( NULL, 0, REFILL_CONTEXT );
 
+	g_ProximityService.RemoveSource( m_hAmmoProximity );
+	m_hAmmoProximity = PROXIMITY_INVALID_HANDLE;
+
 	BaseClass::MakeCarriedObject( pPlayer );
 }
 
@@ -278,6 +285,10 @@ void CObjectDispenser::OnGoActive( void )
 
 	m_flNextAmmoDispense = gpGlobals->curtime + 0.5;
 
+	// Track the players in ammo range
+	g_ProximityService.RemoveSource( m_hAmmoProximity );
+	m_hAmmoProximity = g_ProximityService.AddSphere( this, NULL, Vector( 0, 0, 32 ), GetDispenserRadius() );
+
 	CDispenserTouchTrigger *pTriggerEnt;
 
 	if ( m_szTriggerName != NULL_STRING )
@@ -639,14 +650,10 @@ void CObjectDispenser::DispenseThink( void )
 		int iNumNearbyPlayers = 0;
 
 		// find players in sphere, that are visible
-		static float flRadius = GetDispenserRadius();
-		Vector vecOrigin = GetAbsOrigin() + Vector(0,0,32);
-
-		CBaseEntity *pListOfNearbyEntities[32];
-		int iNumberOfNearbyEntities = UTIL_EntitiesInSphere( pListOfNearbyEntities, 32, vecOrigin, flRadius, FL_CLIENT );
+		int iNumberOfNearbyEntities = g_ProximityService.GetMemberCount( m_hAmmoProximity );
 		for (int i=0;i<iNumberOfNearbyEntities;i++ )
 		{
-			CTFPlayer *pPlayer = ToTFPlayer( pListOfNearbyEntities[i] );
+			CTFPlayer *pPlayer = ToTFPlayer( g_ProximityService.GetMember( m_hAmmoProximity, i ) );
 
 			if ( !pPlayer || !pPlayer->IsAlive() || !CouldHealTarget(pPlayer) )
 				continue;
@@ -12,6 +12,7 @@
 #endif
 
 #include "tf_obj.h"
+#include "proximityservice.h"
 
 class CTFPlayer;
 
@@ -117,6 +118,9 @@ private:
 	EHANDLE m_hTouchTrigger;
 	string_t m_szTriggerName;
 
+	// Players within the ammo radius
+	ProximityHandle_t m_hAmmoProximity;
+
 	DECLARE_DATADESC();
 };
 
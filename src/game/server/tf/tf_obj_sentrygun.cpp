@@ -959,6 +959,8 @@ bool CObjectSentrygun::FindTarget()
 //-----------------------------------------------------------------------------
 bool CObjectSentrygun::ValidTargetPlayer( CTFPlayer *pPlayer, const Vector &vecStart, const Vector &vecEnd )
 {
+	TRACE_BUDGET_SCOPE( "Sentry targeting" );
+
 	// Keep shooting at spies that go invisible after we acquire them as a target.
 	if ( pPlayer->m_Shared.GetPercentInvisible() > 0.5 )
 		return false;
@@ -980,6 +982,8 @@ bool CObjectSentrygun::ValidTargetPlayer( CTFPlayer *pPlayer, const Vector &vecS
 //-----------------------------------------------------------------------------
 bool CObjectSentrygun::ValidTargetObject( CBaseObject *pObject, const Vector &vecStart, const Vector &vecEnd )
 {
+	TRACE_BUDGET_SCOPE( "Sentry targeting" );
+
 	// Ignore objects being placed, they are not real objects yet.
 	if ( pObject->IsPlacing() )
 		return false;
@@ -56,6 +56,7 @@
 #include "tf_weapon_flamethrower.h"
 #include "tf_weapon_lunchbox.h"
 #include "tf_weapon_laser_pointer.h"
+#include "gameeventbuilder.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -773,6 +774,24 @@ void CTFPlayer::PostThink()
 		m_flTauntAttackTime = 0.0f;
 		DoTauntAttack();
 	}
+
+	if ( WantsThreadedBoneSetup() )
+		QueueThreadedBoneSetup();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Predict whether our hitboxes or attachments will be needed next frame
+//-----------------------------------------------------------------------------
+bool CTFPlayer::WantsThreadedBoneSetup( void )
+{
+	if ( !IsAlive() )
+		return false;
+
+	// Firing pulls muzzle and flame attachments
+	if ( m_nButtons & ( IN_ATTACK | IN_ATTACK2 ) )
+		return true;
+
+	return HasRecentBoneCacheRequest();
 }
 
 //-----------------------------------------------------------------------------
@@ -4269,6 +4288,30 @@ void CTFPlayer::CommitSuicide( bool bExplode /* = false */, bool bForce /*= fals
 	BaseClass::CommitSuicide( bExplode, bForce );
 }
 
+enum
+{
+	PLAYERHURT_USERID = 0,
+	PLAYERHURT_HEALTH,
+	PLAYERHURT_DAMAGEAMOUNT,
+	PLAYERHURT_CRIT,
+	PLAYERHURT_PRIORITY,
+	PLAYERHURT_ATTACKER,
+
+	PLAYERHURT_FIELD_COUNT
+};
+
+static const GameEventField_t s_PlayerHurtFields[] =
+{
+	{ "userid",			GAMEEVENT_FIELD_INT,	false },
+	{ "health",			GAMEEVENT_FIELD_INT,	false },
+	{ "damageamount",	GAMEEVENT_FIELD_INT,	false },
+	{ "crit",			GAMEEVENT_FIELD_INT,	false },
+	{ "priority",		GAMEEVENT_FIELD_INT,	true },		// The HLTV director reads a missing priority as -1
+	{ "attacker",		GAMEEVENT_FIELD_INT,	false },
+};
+
+DEFINE_GAMEEVENT_DESC( s_PlayerHurtEvent, "player_hurt", s_PlayerHurtFields, PLAYERHURT_FIELD_COUNT );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : &info - 
@@ -4373,30 +4416,24 @@ int CTFPlayer::OnTakeDamage_Alive( const CTakeDamageInfo &info )
 	}
 
 	// Fire a global game event - "player_hurt"
-	IGameEvent * event = gameeventmanager->CreateEvent( "player_hurt" );
-	if ( event )
 	{
-		event->SetInt( "userid", GetUserID() );
-		event->SetInt( "health", max( 0, m_iHealth ) );
-		event->SetInt( "damageamount", ( iOldHealth - m_iHealth ) );
-		event->SetInt( "crit", ( info.GetDamageType() & DMG_CRITICAL || info.GetDamageType() & DMG_MINICRITICAL ) ? 1 : 0 );
+		CGameEventBuilder event( s_PlayerHurtEvent );
+		event.SetInt( PLAYERHURT_USERID, GetUserID() );
+		event.SetInt( PLAYERHURT_HEALTH, max( 0, m_iHealth ) );
+		event.SetInt( PLAYERHURT_DAMAGEAMOUNT, ( iOldHealth - m_iHealth ) );
+		event.SetInt( PLAYERHURT_CRIT, ( info.GetDamageType() & DMG_CRITICAL || info.GetDamageType() & DMG_MINICRITICAL ) ? 1 : 0 );
 
 		// HLTV event priority, not transmitted
-		event->SetInt( "priority", 5 );	
+		event.SetInt( PLAYERHURT_PRIORITY, 5 );
 
-		// Hurt by another player.
+		// Hurt by another player. Hurt by world leaves it at 0.
 		if ( pAttacker->IsPlayer() )
 		{
 			CBasePlayer *pPlayer = ToBasePlayer( pAttacker );
-			event->SetInt( "attacker", pPlayer->GetUserID() );
-		}
-		// Hurt by world.
-		else
-		{
-			event->SetInt( "attacker", 0 );
+			event.SetInt( PLAYERHURT_ATTACKER, pPlayer->GetUserID() );
 		}
 
-        gameeventmanager->FireEvent( event );
+		event.Fire();
 	}
 	
 	if ( pAttacker != this && pAttacker->IsPlayer() )
@@ -5600,8 +5637,7 @@ void CTFPlayer::RemoveOwnedProjectiles( void )
 
 		if ( pFlame->GetAttacker() == this )
 		{
-			pFlame->SetThink( &BaseClass::SUB_Remove );
-			pFlame->SetNextThink( gpGlobals->curtime );
+			pFlame->Expire();
 		}
 	}
 }
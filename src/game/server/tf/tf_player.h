@@ -191,6 +191,8 @@ public:
 	virtual void		PreThink();
 	virtual void		PostThink();
 
+	virtual bool		WantsThreadedBoneSetup( void );
+
 	virtual void		ItemPostFrame();
 	virtual void		Weapon_FrameUpdate( void );
 	virtual void		Weapon_HandleAnimEvent( animevent_t *pEvent );
@@ -0,0 +1,286 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per category trace counts for the UTIL_Trace* helpers.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tracebudget.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+bool g_bTraceBudgetActive = false;
+int g_iTraceBudgetCategory = 0;
+
+static void TraceBudgetChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_trace_budget( "sv_trace_budget", "0", 0, "Count the traces made by each game system every tick. See sv_trace_budget_dump.", TraceBudgetChanged );
+
+
+class CTraceBudget : public CAutoGameSystemPerFrame
+{
+public:
+	CTraceBudget();
+
+	virtual void Shutdown();
+	virtual void FrameUpdatePostEntityThink();
+
+	int FindOrAddCategory( const char *pszCategory );
+	void Record( bool bHit, const CCycleCount &duration );
+
+	void Dump();
+	void Reset();
+
+	void StartCSV( const char *pszFilename );
+	void StopCSV();
+
+private:
+	enum
+	{
+		MAX_CATEGORIES = 64,
+	};
+
+	struct Category_t
+	{
+		const char	*m_pszName;
+
+		// This tick.
+		int			m_nTickCalls;
+		int			m_nTickHits;
+		CCycleCount	m_TickTime;
+
+		// Since the last reset.
+		uint64		m_nCalls;
+		uint64		m_nHits;
+		double		m_flTotalMS;
+		int			m_nMaxTickCalls;
+		double		m_flMaxTickMS;
+	};
+
+	static int SortByTotalTime( const int *pLeft, const int *pRight );
+
+	CUtlVector<Category_t>	m_Categories;
+	int						m_nTicks;
+	FileHandle_t			m_hCSV;
+};
+
+static CTraceBudget g_TraceBudget;
+
+static void TraceBudgetChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	g_bTraceBudgetActive = sv_trace_budget.GetBool();
+	g_iTraceBudgetCategory = 0;
+}
+
+
+CTraceBudget::CTraceBudget() : CAutoGameSystemPerFrame( "CTraceBudget" )
+{
+	m_hCSV = FILESYSTEM_INVALID_HANDLE;
+	FindOrAddCategory( "Other" );
+	Reset();
+}
+
+void CTraceBudget::Shutdown()
+{
+	StopCSV();
+}
+
+int CTraceBudget::FindOrAddCategory( const char *pszCategory )
+{
+	for ( int i = 0; i < m_Categories.Count(); i++ )
+	{
+		if ( !Q_strcmp( m_Categories[i].m_pszName, pszCategory ) )
+			return i;
+	}
+
+	if ( m_Categories.Count() >= MAX_CATEGORIES )
+		return 0;
+
+	int i = m_Categories.AddToTail();
+	Category_t &category = m_Categories[i];
+	memset( &category, 0, sizeof( category ) );
+	category.m_pszName = pszCategory;
+	return i;
+}
+
+void CTraceBudget::Record( bool bHit, const CCycleCount &duration )
+{
+	// Traces made off the main thread would race the counters.
+	if ( !ThreadInMainThread() )
+		return;
+
+	Category_t &category = m_Categories[ g_iTraceBudgetCategory ];
+	category.m_nTickCalls++;
+	if ( bHit )
+	{
+		category.m_nTickHits++;
+	}
+	category.m_TickTime += duration;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rolls the counts of the tick that just ran into the totals.
+//-----------------------------------------------------------------------------
+void CTraceBudget::FrameUpdatePostEntityThink()
+{
+	if ( !g_bTraceBudgetActive )
+		return;
+
+	for ( int i = 0; i < m_Categories.Count(); i++ )
+	{
+		Category_t &category = m_Categories[i];
+		if ( !category.m_nTickCalls )
+			continue;
+
+		double flTickMS = category.m_TickTime.GetMillisecondsF();
+
+		category.m_nCalls += category.m_nTickCalls;
+		category.m_nHits += category.m_nTickHits;
+		category.m_flTotalMS += flTickMS;
+		category.m_nMaxTickCalls = MAX( category.m_nMaxTickCalls, category.m_nTickCalls );
+		category.m_flMaxTickMS = MAX( category.m_flMaxTickMS, flTickMS );
+
+		if ( m_hCSV != FILESYSTEM_INVALID_HANDLE )
+		{
+			filesystem->FPrintf( m_hCSV, "%d,%s,%d,%d,%.4f\n", gpGlobals->tickcount, category.m_pszName, category.m_nTickCalls, category.m_nTickHits, flTickMS );
+		}
+
+		category.m_nTickCalls = 0;
+		category.m_nTickHits = 0;
+		category.m_TickTime.Init();
+	}
+
+	m_nTicks++;
+}
+
+int CTraceBudget::SortByTotalTime( const int *pLeft, const int *pRight )
+{
+	double flLeft = g_TraceBudget.m_Categories[*pLeft].m_flTotalMS;
+	double flRight = g_TraceBudget.m_Categories[*pRight].m_flTotalMS;
+	if ( flLeft == flRight )
+		return 0;
+
+	return ( flLeft > flRight ) ? -1 : 1;
+}
+
+void CTraceBudget::Dump()
+{
+	if ( !m_nTicks )
+	{
+		Msg( "No traces counted yet. Set sv_trace_budget 1 first.\n" );
+		return;
+	}
+
+	CUtlVector<int> sorted;
+	for ( int i = 0; i < m_Categories.Count(); i++ )
+	{
+		if ( m_Categories[i].m_nCalls )
+		{
+			sorted.AddToTail( i );
+		}
+	}
+	sorted.Sort( SortByTotalTime );
+
+	Msg( "Traces over %d ticks:\n", m_nTicks );
+	Msg( "%-24s %10s %9s %9s %6s %10s %9s %9s\n", "category", "calls", "avg/tick", "max/tick", "hit%", "total ms", "ms/tick", "max ms" );
+
+	for ( int i = 0; i < sorted.Count(); i++ )
+	{
+		const Category_t &category = m_Categories[ sorted[i] ];
+		Msg( "%-24s %10llu %9.1f %9d %5.1f%% %10.2f %9.3f %9.3f\n",
+			category.m_pszName,
+			(unsigned long long)category.m_nCalls,
+			(double)category.m_nCalls / m_nTicks,
+			category.m_nMaxTickCalls,
+			100.0 * category.m_nHits / category.m_nCalls,
+			category.m_flTotalMS,
+			category.m_flTotalMS / m_nTicks,
+			category.m_flMaxTickMS );
+	}
+}
+
+void CTraceBudget::Reset()
+{
+	for ( int i = 0; i < m_Categories.Count(); i++ )
+	{
+		Category_t &category = m_Categories[i];
+		const char *pszName = category.m_pszName;
+		memset( &category, 0, sizeof( category ) );
+		category.m_pszName = pszName;
+	}
+
+	m_nTicks = 0;
+}
+
+void CTraceBudget::StartCSV( const char *pszFilename )
+{
+	StopCSV();
+
+	m_hCSV = filesystem->Open( pszFilename, "w", "MOD" );
+	if ( m_hCSV == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "Failed to open %s for the trace budget stream\n", pszFilename );
+		return;
+	}
+
+	filesystem->FPrintf( m_hCSV, "tick,category,calls,hits,ms\n" );
+	Msg( "Streaming trace counts to %s\n", pszFilename );
+
+	if ( !g_bTraceBudgetActive )
+	{
+		Msg( "sv_trace_budget is off; nothing will be written until it's turned on.\n" );
+	}
+}
+
+void CTraceBudget::StopCSV()
+{
+	if ( m_hCSV == FILESYSTEM_INVALID_HANDLE )
+		return;
+
+	filesystem->Close( m_hCSV );
+	m_hCSV = FILESYSTEM_INVALID_HANDLE;
+}
+
+
+int TraceBudget_FindOrAddCategory( const char *pszCategory )
+{
+	return g_TraceBudget.FindOrAddCategory( pszCategory );
+}
+
+void TraceBudget_Record( const CGameTrace *ptr, const CCycleCount &duration )
+{
+	g_TraceBudget.Record( ptr->DidHit(), duration );
+}
+
+
+CON_COMMAND( sv_trace_budget_dump, "Show the traces made by each game system since sv_trace_budget was turned on." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TraceBudget.Dump();
+}
+
+CON_COMMAND( sv_trace_budget_reset, "Reset the trace budget counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TraceBudget.Reset();
+}
+
+CON_COMMAND( sv_trace_budget_csv, "Stream the per tick trace counts to a CSV file. Usage: sv_trace_budget_csv <filename>, or no filename to stop." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		g_TraceBudget.StopCSV();
+		return;
+	}
+
+	g_TraceBudget.StartCSV( args[1] );
+}
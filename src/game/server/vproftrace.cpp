@@ -0,0 +1,201 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Streams the VProf tree of every frame to a JSON file in the Chrome
+//			trace format (chrome://tracing, ui.perfetto.dev), so real matches
+//			on a dedicated server can be profiled offline.
+//
+//			VProf only keeps how long each scope took in the last frame, not
+//			when it started, so the children of a scope are laid out back to
+//			back from the start of their parent. Durations, call counts and
+//			nesting are exact; the gaps between siblings are not.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#ifdef VPROF_ENABLED
+
+static void VProfTraceChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_vprof_trace( "sv_vprof_trace", "0", 0, "Stream the VProf timings of every frame to sv_vprof_trace_file in Chrome trace format.", VProfTraceChanged );
+ConVar sv_vprof_trace_file( "sv_vprof_trace_file", "vprof_trace.json", 0, "File under the mod directory that sv_vprof_trace writes to." );
+ConVar sv_vprof_trace_min_ms( "sv_vprof_trace_min_ms", "0.01", 0, "Leave out the scopes that took less than this many milliseconds in a frame." );
+
+
+class CVProfTraceExport : public CAutoGameSystemPerFrame
+{
+public:
+	CVProfTraceExport();
+
+	virtual void Shutdown();
+	virtual void FrameUpdatePreEntityThink();
+
+	void Start( const char *pszFilename );
+	void Stop();
+
+private:
+	void WriteNode( CVProfNode *pNode, double flStartUS, double flMinMS );
+	void WriteEvent( const char *pszName, const char *pszCategory, double flStartUS, double flDurationUS, int nCalls );
+	void WriteString( const char *pszString );
+
+	FileHandle_t	m_hFile;
+	CUtlBuffer		m_Buffer;
+	bool			m_bFirstEvent;
+	int				m_nLastFrame;
+	double			m_flStartTime;
+	double			m_flLastFrameEndUS;
+};
+
+static CVProfTraceExport g_VProfTraceExport;
+
+static void VProfTraceChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	if ( sv_vprof_trace.GetBool() )
+	{
+		g_VProfTraceExport.Start( sv_vprof_trace_file.GetString() );
+	}
+	else
+	{
+		g_VProfTraceExport.Stop();
+	}
+}
+
+
+CVProfTraceExport::CVProfTraceExport() : CAutoGameSystemPerFrame( "CVProfTraceExport" ), m_Buffer( 0, 0, CUtlBuffer::TEXT_BUFFER )
+{
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+	m_bFirstEvent = true;
+	m_nLastFrame = 0;
+	m_flStartTime = 0.0;
+	m_flLastFrameEndUS = 0.0;
+}
+
+void CVProfTraceExport::Shutdown()
+{
+	Stop();
+}
+
+void CVProfTraceExport::Start( const char *pszFilename )
+{
+	Stop();
+
+	m_hFile = filesystem->Open( pszFilename, "w", "MOD" );
+	if ( m_hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "Failed to open %s for the VProf trace\n", pszFilename );
+		return;
+	}
+
+	// The closing bracket is optional in this format, so a trace cut short
+	// by a crash still loads.
+	filesystem->FPrintf( m_hFile, "[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Server main thread\"}}" );
+	m_bFirstEvent = false;
+
+	m_flStartTime = Plat_FloatTime();
+	m_flLastFrameEndUS = 0.0;
+
+	g_VProfCurrentProfile.Start();
+	m_nLastFrame = g_VProfCurrentProfile.NumFramesSampled();
+
+	Msg( "Streaming VProf frames to %s\n", pszFilename );
+}
+
+void CVProfTraceExport::Stop()
+{
+	if ( m_hFile == FILESYSTEM_INVALID_HANDLE )
+		return;
+
+	g_VProfCurrentProfile.Stop();
+
+	filesystem->FPrintf( m_hFile, "\n]\n" );
+	filesystem->Close( m_hFile );
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes out the frame the engine just marked.
+//-----------------------------------------------------------------------------
+void CVProfTraceExport::FrameUpdatePreEntityThink()
+{
+	if ( m_hFile == FILESYSTEM_INVALID_HANDLE )
+		return;
+
+	// Several ticks can run in one engine frame; only write each frame once.
+	int nFrame = g_VProfCurrentProfile.NumFramesSampled();
+	if ( nFrame == m_nLastFrame )
+		return;
+	m_nLastFrame = nFrame;
+
+	CVProfNode *pRoot = g_VProfCurrentProfile.GetRoot();
+	double flFrameUS = pRoot->GetPrevTime() * 1000.0;
+
+	// The frame ended when the engine marked it, just before this update.
+	double flNowUS = ( Plat_FloatTime() - m_flStartTime ) * 1000000.0;
+	double flStartUS = MAX( flNowUS - flFrameUS, m_flLastFrameEndUS );
+	m_flLastFrameEndUS = flStartUS + flFrameUS;
+
+	m_Buffer.Printf( ",\n{\"name\":\"Frame\",\"cat\":\"Frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"tick\":%d}}",
+		flStartUS, flFrameUS, gpGlobals->tickcount );
+
+	double flMinMS = sv_vprof_trace_min_ms.GetFloat();
+	double flChildStartUS = flStartUS;
+	for ( CVProfNode *pChild = pRoot->GetChild(); pChild; pChild = pChild->GetSibling() )
+	{
+		if ( !pChild->GetPrevCalls() )
+			continue;
+
+		WriteNode( pChild, flChildStartUS, flMinMS );
+		flChildStartUS += pChild->GetPrevTime() * 1000.0;
+	}
+
+	filesystem->Write( m_Buffer.Base(), m_Buffer.TellPut(), m_hFile );
+	m_Buffer.Clear();
+}
+
+void CVProfTraceExport::WriteNode( CVProfNode *pNode, double flStartUS, double flMinMS )
+{
+	double flMS = pNode->GetPrevTime();
+	if ( flMS < flMinMS )
+		return;
+
+	WriteEvent( pNode->GetName(), g_VProfCurrentProfile.GetBudgetGroupName( pNode->GetBudgetGroupID() ), flStartUS, flMS * 1000.0, pNode->GetPrevCalls() );
+
+	double flChildStartUS = flStartUS;
+	for ( CVProfNode *pChild = pNode->GetChild(); pChild; pChild = pChild->GetSibling() )
+	{
+		if ( !pChild->GetPrevCalls() )
+			continue;
+
+		WriteNode( pChild, flChildStartUS, flMinMS );
+		flChildStartUS += pChild->GetPrevTime() * 1000.0;
+	}
+}
+
+void CVProfTraceExport::WriteEvent( const char *pszName, const char *pszCategory, double flStartUS, double flDurationUS, int nCalls )
+{
+	m_Buffer.PutString( ",\n{\"name\":\"" );
+	WriteString( pszName );
+	m_Buffer.PutString( "\",\"cat\":\"" );
+	WriteString( pszCategory );
+	m_Buffer.Printf( "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"calls\":%d}}", flStartUS, flDurationUS, nCalls );
+}
+
+void CVProfTraceExport::WriteString( const char *pszString )
+{
+	for ( const char *p = pszString; *p; p++ )
+	{
+		if ( *p == '"' || *p == '\\' )
+		{
+			m_Buffer.PutChar( '\\' );
+		}
+		m_Buffer.PutChar( *p );
+	}
+}
+
+#endif // VPROF_ENABLED
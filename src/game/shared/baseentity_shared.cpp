@@ -35,6 +35,7 @@
 #endif
 
 	#include "gamestats.h"
+	#include "movementtracecache.h"
 
 #endif
 
@@ -440,7 +441,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
-		m_iName = AllocPooledString( szValue );
+		SetName( AllocPooledString( szValue ) );
 		return true;
 	}
 
@@ -2501,6 +2502,10 @@ void CBaseEntity::SetCollisionGroup( int collisionGroup )
 
 void CBaseEntity::CollisionRulesChanged()
 {
+#ifndef CLIENT_DLL
+	g_MovementTraceCache.CollisionRulesChanged();
+#endif
+
 	// ivp maintains state based on recent return values from the collision filter, so anything
 	// that can change the state that a collision filter will return (like m_Solid) needs to call RecheckCollisionFilter.
 	if ( VPhysicsGetObject() )
@@ -7,6 +7,8 @@
 
 #include "cbase.h"
 #include "baseprojectile.h"
+#include "movevars_shared.h"
+#include "coordsize.h"
 
 
 IMPLEMENT_NETWORKCLASS_ALIASED( BaseProjectile, DT_BaseProjectile )
@@ -14,14 +16,41 @@ IMPLEMENT_NETWORKCLASS_ALIASED( BaseProjectile, DT_BaseProjectile )
 BEGIN_NETWORK_TABLE( CBaseProjectile, DT_BaseProjectile )
 #if !defined( CLIENT_DLL )
 	SendPropEHandle( SENDINFO( m_hOriginalLauncher ) ),
+	SendPropInt( SENDINFO( m_bParametric ), 1, SPROP_UNSIGNED ),
+	SendPropVector( SENDINFO( m_vecLaunchOrigin ), -1, SPROP_NOSCALE ),
+	SendPropVector( SENDINFO( m_vecLaunchVelocity ), -1, SPROP_NOSCALE ),
+	SendPropFloat( SENDINFO( m_flLaunchGravity ), -1, SPROP_NOSCALE ),
+	SendPropInt( SENDINFO( m_nLaunchTick ) ),
 #else
 	RecvPropEHandle( RECVINFO( m_hOriginalLauncher ) ),
+	RecvPropInt( RECVINFO( m_bParametric ) ),
+	RecvPropVector( RECVINFO( m_vecLaunchOrigin ) ),
+	RecvPropVector( RECVINFO( m_vecLaunchVelocity ) ),
+	RecvPropFloat( RECVINFO( m_flLaunchGravity ) ),
+	RecvPropInt( RECVINFO( m_nLaunchTick ) ),
 #endif // CLIENT_DLL
 END_NETWORK_TABLE()
 
 
 #ifndef CLIENT_DLL
 IMPLEMENT_AUTO_LIST( IBaseProjectileAutoList );
+
+ConVar sv_parametric_projectiles( "sv_parametric_projectiles", "0", FCVAR_NOTIFY, "Network flying projectiles as a launch origin, velocity and tick that clients simulate, instead of sending their origin every tick." );
+ConVar sv_parametric_projectiles_tolerance( "sv_parametric_projectiles_tolerance", "1", 0, "How far a parametric projectile can drift from its networked trajectory before it is relaunched." );
+
+// Bandwidth bookkeeping, see sv_parametric_projectiles_stats. Origins are
+// packed from the snapshot threads.
+static CInterlockedInt s_nOriginsSent;
+static CInterlockedInt s_nOriginBitsSent;
+static CInterlockedInt s_nOriginsSuppressed;
+static CInterlockedInt s_nOriginBitsSuppressed;
+static CInterlockedInt s_nParametricLaunches;
+
+// Rough cost of a delta encoded prop index.
+#define PROP_INDEX_BITS_ESTIMATE	6
+
+// m_bParametric, both vectors, gravity and tick.
+#define PARAMETRIC_LAUNCH_BITS_ESTIMATE	( 1 + 3 * 32 + 3 * 32 + 32 + 32 + 5 * PROP_INDEX_BITS_ESTIMATE )
 #endif // !CLIENT_DLL
 
 
@@ -36,6 +65,17 @@ CBaseProjectile::CBaseProjectile()
 	m_bCanCollideWithTeammates = false;
 #endif
 	m_hOriginalLauncher = NULL;
+
+	m_bParametric = false;
+	m_vecLaunchOrigin.Init();
+	m_vecLaunchVelocity.Init();
+	m_flLaunchGravity = 0.0f;
+	m_nLaunchTick = 0;
+
+#ifdef CLIENT_DLL
+	m_OldLaunch.m_bValid = false;
+	m_PrevLaunch.m_bValid = false;
+#endif
 }
 
 
@@ -68,6 +108,20 @@ void CBaseProjectile::Spawn()
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Position and velocity flTime seconds after launch.
+//-----------------------------------------------------------------------------
+void CBaseProjectile::EvaluateParametricTrajectory( const Vector &vecLaunchOrigin, const Vector &vecLaunchVelocity, float flGravity, float flTime,
+	Vector *pOrigin, Vector *pVelocity )
+{
+	*pOrigin = vecLaunchOrigin + vecLaunchVelocity * flTime;
+	pOrigin->z -= 0.5f * flGravity * flTime * flTime;
+
+	*pVelocity = vecLaunchVelocity;
+	pVelocity->z -= flGravity * flTime;
+}
+
+
 #ifdef GAME_DLL
 
 //-----------------------------------------------------------------------------
@@ -90,5 +144,273 @@ void CBaseProjectile::ResetCollideWithTeammates()
 	SetContextThink( &CBaseProjectile::CollideWithTeammatesThink, gpGlobals->curtime + GetCollideWithTeammatesDelay(), "CollideWithTeammates" );
 }
 
-#endif // GAME_DLL
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CBaseProjectile::StartParametricNetworking()
+{
+	if ( !sv_parametric_projectiles.GetBool() )
+		return;
+
+	// The first think launches, by then the creator has set our velocity.
+	SetContextThink( &CBaseProjectile::ParametricThink, gpGlobals->curtime, "ParametricThink" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Relaunch whenever the real flight leaves the networked trajectory,
+//			and drop back to sending the origin once we stop flying.
+//-----------------------------------------------------------------------------
+void CBaseProjectile::ParametricThink()
+{
+	if ( !sv_parametric_projectiles.GetBool() || GetMoveParent() ||
+		( GetMoveType() != MOVETYPE_FLY && GetMoveType() != MOVETYPE_FLYGRAVITY ) )
+	{
+		m_bParametric = false;
+		return;
+	}
+
+	if ( !m_bParametric )
+	{
+		ParametricLaunch();
+	}
+	else
+	{
+		// Thinking happens before this tick's move, so our origin is the one
+		// stamped with the current simulation time.
+		Vector vecOrigin, vecVelocity;
+		float flTime = GetSimulationTime() - TICKS_TO_TIME( m_nLaunchTick );
+		EvaluateParametricTrajectory( m_vecLaunchOrigin, m_vecLaunchVelocity, m_flLaunchGravity, flTime, &vecOrigin, &vecVelocity );
+
+		float flTolerance = sv_parametric_projectiles_tolerance.GetFloat();
+		if ( vecOrigin.DistToSqr( GetAbsOrigin() ) > flTolerance * flTolerance ||
+			vecVelocity.DistToSqr( GetAbsVelocity() ) > flTolerance * flTolerance ||
+			m_flLaunchGravity != GetParametricGravity() )
+		{
+			ParametricLaunch();
+		}
+	}
+
+	SetNextThink( gpGlobals->curtime, "ParametricThink" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CBaseProjectile::RestartParametricTrajectory()
+{
+	if ( m_bParametric )
+	{
+		ParametricLaunch();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Start a new trajectory from where we are now.
+//-----------------------------------------------------------------------------
+void CBaseProjectile::ParametricLaunch()
+{
+	m_bParametric = true;
+	m_vecLaunchOrigin = GetAbsOrigin();
+	m_vecLaunchVelocity = GetAbsVelocity();
+	m_flLaunchGravity = GetParametricGravity();
+	m_nLaunchTick = TIME_TO_TICKS( GetSimulationTime() );
+
+	++s_nParametricLaunches;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Gravity acceleration the engine applies to us, see GetActualGravity().
+//-----------------------------------------------------------------------------
+float CBaseProjectile::GetParametricGravity() const
+{
+	if ( GetMoveType() != MOVETYPE_FLYGRAVITY )
+		return 0.0f;
+
+	float flGravity = GetGravity();
+	if ( flGravity == 0.0f )
+	{
+		flGravity = 1.0f;
+	}
+	return flGravity * GetCurrentGravity();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Approximate size of an origin update for the stats.
+//-----------------------------------------------------------------------------
+static int EstimateOriginBits( const SendProp *pProp )
+{
+	int nFlags = pProp->GetFlags();
+
+	int nComponentBits;
+	if ( nFlags & SPROP_NOSCALE )
+	{
+		nComponentBits = 32;
+	}
+	else if ( nFlags & SPROP_COORD )
+	{
+		nComponentBits = 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS;
+	}
+	else if ( nFlags & ( SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION | SPROP_COORD_MP_INTEGRAL ) )
+	{
+		nComponentBits = 3 + COORD_INTEGER_BITS_MP;
+	}
+	else
+	{
+		nComponentBits = pProp->m_nBits;
+	}
+
+	return 3 * nComponentBits + PROP_INDEX_BITS_ESTIMATE;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Origin proxy for projectiles. Parametric projectiles keep sending
+//			their launch origin, so the per tick movement never shows up in
+//			the delta.
+//-----------------------------------------------------------------------------
+void SendProxy_ProjectileOrigin( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID )
+{
+	extern void SendProxy_Origin( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID );
+
+	const CBaseProjectile *pProjectile = (const CBaseProjectile *)pStruct;
+	if ( !pProjectile->IsParametric() )
+	{
+		SendProxy_Origin( pProp, pStruct, pData, pOut, iElement, objectID );
+
+		++s_nOriginsSent;
+		s_nOriginBitsSent += EstimateOriginBits( pProp );
+		return;
+	}
+
+	const Vector &vecLaunchOrigin = pProjectile->GetLaunchOrigin();
+	pOut->m_Vector[ 0 ] = vecLaunchOrigin.x;
+	pOut->m_Vector[ 1 ] = vecLaunchOrigin.y;
+	pOut->m_Vector[ 2 ] = vecLaunchOrigin.z;
+
+	if ( pProjectile->GetLocalOrigin() != vecLaunchOrigin )
+	{
+		++s_nOriginsSuppressed;
+		s_nOriginBitsSuppressed += EstimateOriginBits( pProp );
+	}
+}
+
+
+CON_COMMAND( sv_parametric_projectiles_stats, "sv_parametric_projectiles_stats [reset] - estimated projectile origin bandwidth with and without parametric networking." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		s_nOriginsSent = 0;
+		s_nOriginBitsSent = 0;
+		s_nOriginsSuppressed = 0;
+		s_nOriginBitsSuppressed = 0;
+		s_nParametricLaunches = 0;
+		return;
+	}
+
+	int nLaunchBits = s_nParametricLaunches * PARAMETRIC_LAUNCH_BITS_ESTIMATE;
+
+	// Each packed origin goes out once to every client the projectile is transmitted to.
+	Msg( "Projectile origin packs, per receiving client:\n" );
+	Msg( "  sent:       %8d (~%d bytes)\n", (int)s_nOriginsSent, s_nOriginBitsSent / 8 );
+	Msg( "  suppressed: %8d (~%d bytes)\n", (int)s_nOriginsSuppressed, s_nOriginBitsSuppressed / 8 );
+	Msg( "  launches:   %8d (~%d bytes)\n", (int)s_nParametricLaunches, nLaunchBits / 8 );
+	Msg( "  net saving: ~%d bytes\n", ( s_nOriginBitsSuppressed - nLaunchBits ) / 8 );
+}
+
+#else
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CBaseProjectile::GetParametricLaunch( ParametricLaunch_t *pLaunch ) const
+{
+	pLaunch->m_vecOrigin = m_vecLaunchOrigin;
+	pLaunch->m_vecVelocity = m_vecLaunchVelocity;
+	pLaunch->m_flGravity = m_flLaunchGravity;
+	pLaunch->m_nTick = m_nLaunchTick;
+	pLaunch->m_bValid = m_bParametric;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CBaseProjectile::OnPreDataChanged( DataUpdateType_t updateType )
+{
+	BaseClass::OnPreDataChanged( updateType );
+
+	GetParametricLaunch( &m_OldLaunch );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CBaseProjectile::OnDataChanged( DataUpdateType_t updateType )
+{
+	BaseClass::OnDataChanged( updateType );
+
+	if ( m_nLaunchTick != m_OldLaunch.m_nTick )
+	{
+		m_PrevLaunch = m_OldLaunch;
+	}
+
+	// Our origin keeps moving without any new data arriving.
+	if ( m_bParametric )
+	{
+		m_EntClientFlags |= ENTCLIENTFLAG_ALWAYS_INTERPOLATE;
+		AddToInterpolationList();
+	}
+	else
+	{
+		m_EntClientFlags &= ~ENTCLIENTFLAG_ALWAYS_INTERPOLATE;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Parametric projectiles fly themselves along the launch trajectory
+//			at the interpolated render time.
+//-----------------------------------------------------------------------------
+bool CBaseProjectile::Interpolate( float currentTime )
+{
+	bool bRet = BaseClass::Interpolate( currentTime );
+
+	if ( !m_bParametric || GetMoveParent() )
+		return bRet;
+
+	ParametricLaunch_t launch;
+	GetParametricLaunch( &launch );
+
+	float flTime = currentTime - GetInterpolationAmount( LATCH_SIMULATION_VAR );
+	if ( flTime < TICKS_TO_TIME( launch.m_nTick ) && m_PrevLaunch.m_bValid && m_PrevLaunch.m_nTick < launch.m_nTick )
+	{
+		launch = m_PrevLaunch;
+	}
+
+	Vector vecOrigin, vecVelocity;
+	EvaluateParametricTrajectory( launch.m_vecOrigin, launch.m_vecVelocity, launch.m_flGravity, MAX( flTime - TICKS_TO_TIME( launch.m_nTick ), 0.0f ),
+		&vecOrigin, &vecVelocity );
+	SetLocalOrigin( vecOrigin );
+
+	// Arcing projectiles point along their velocity, the server only updates the angles now and then.
+	if ( launch.m_flGravity != 0.0f )
+	{
+		QAngle angles;
+		VectorAngles( vecVelocity, angles );
+		SetLocalAngles( angles );
+	}
+
+	return bRet;
+}
+
+#endif // GAME_DLL
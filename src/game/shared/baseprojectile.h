@@ -58,10 +58,31 @@ public:
 	virtual void SetLauncher( CBaseEntity *pLauncher );
 	CBaseEntity *GetOriginalLauncher() const { return m_hOriginalLauncher; }
 
+	// Parametric networking (sv_parametric_projectiles): while set, clients
+	// fly the projectile along the networked launch trajectory and the origin
+	// isn't sent every tick.
+	bool IsParametric() const { return m_bParametric; }
+	const Vector &GetLaunchOrigin() const { return m_vecLaunchOrigin.Get(); }
+
+	static void EvaluateParametricTrajectory( const Vector &vecLaunchOrigin, const Vector &vecLaunchVelocity, float flGravity, float flTime,
+		Vector *pOrigin, Vector *pVelocity );
+
+#ifdef GAME_DLL
+	// Call after changing the velocity of a flying projectile (deflection, homing).
+	void RestartParametricTrajectory();
+#else
+	virtual bool Interpolate( float currentTime );
+	virtual void OnPreDataChanged( DataUpdateType_t updateType );
+	virtual void OnDataChanged( DataUpdateType_t updateType );
+#endif
+
 protected:
 #ifdef GAME_DLL
 	void CollideWithTeammatesThink();
 
+	// Classes whose network table sends the origin through SendProxy_ProjectileOrigin call this from Spawn().
+	void StartParametricNetworking();
+
 	int m_iDestroyableHitCount;
 #endif // GAME_DLL
 
@@ -69,11 +90,40 @@ private:
 
 #ifdef GAME_DLL
 	void	ResetCollideWithTeammates();
+	void	ParametricThink();
+	void	ParametricLaunch();
+	float	GetParametricGravity() const;
 
 	bool					m_bCanCollideWithTeammates;
+#else
+	struct ParametricLaunch_t
+	{
+		Vector	m_vecOrigin;
+		Vector	m_vecVelocity;
+		float	m_flGravity;
+		int		m_nTick;
+		bool	m_bValid;
+	};
+
+	void	GetParametricLaunch( ParametricLaunch_t *pLaunch ) const;
+
+	// The launch before the last one, so render times from before a
+	// deflection still follow the old path.
+	ParametricLaunch_t		m_OldLaunch;
+	ParametricLaunch_t		m_PrevLaunch;
 #endif // GAME_DLL
 
 	CNetworkHandle( CBaseEntity, m_hOriginalLauncher );
+
+	CNetworkVar( bool, m_bParametric );
+	CNetworkVector( m_vecLaunchOrigin );
+	CNetworkVector( m_vecLaunchVelocity );
+	CNetworkVar( float, m_flLaunchGravity );
+	CNetworkVar( int, m_nLaunchTick );
 };
 
+#ifdef GAME_DLL
+void SendProxy_ProjectileOrigin( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID );
+#endif
+
 #endif // BASEPROJECTILE_H
@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "movementtracecache.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1296,6 +1297,9 @@ void CCollisionProperty::DestroyPartitionHandle()
 {
 	if ( m_Partition != PARTITION_INVALID_HANDLE )
 	{
+#ifndef CLIENT_DLL
+		g_MovementTraceCache.EntityChanged( m_pOuter );
+#endif
 		partition->DestroyHandle( m_Partition );
 		m_Partition = PARTITION_INVALID_HANDLE;
 	}
@@ -1312,6 +1316,8 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	if ( handle == PARTITION_INVALID_HANDLE )
 		return;
 
+	g_MovementTraceCache.EntityChanged( m_pOuter );
+
 	// Remove it from whatever lists it may be in at the moment
 	// We'll re-add it below if we need to.
 	partition->Remove( handle );
@@ -1359,6 +1365,13 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 	// don't bother with the world
 	if ( m_pOuter->entindex() == 0 )
 		return;
+
+#ifndef CLIENT_DLL
+	if ( IsSolid() )
+	{
+		g_MovementTraceCache.EntityChanged( m_pOuter );
+	}
+#endif
 	
 	if ( !m_pOuter->IsEFlagSet( EFL_DIRTY_SPATIAL_PARTITION ) )
 	{
@@ -1,6 +1,7 @@
 #include "cbase.h"
 #include "attribute_manager.h"
 #include "econ_item_schema.h"
+#include "tier0/vprof.h"
 
 #ifdef CLIENT_DLL
 #include "prediction.h"
@@ -105,6 +106,8 @@ void CAttributeManager::InitializeAttributes( CBaseEntity *pEntity )
 
 float CAttributeManager::ApplyAttributeFloat( float flValue, const CBaseEntity *pEntity, string_t strAttributeClass )
 {
+	VPROF_BUDGET( "CAttributeManager::ApplyAttributeFloat", VPROF_BUDGETGROUP_ATTRIBUTES );
+
 	if ( m_bParsingMyself || m_hOuter.Get() == NULL )
 	{
 		return flValue;
@@ -150,6 +153,8 @@ float CAttributeManager::ApplyAttributeFloat( float flValue, const CBaseEntity *
 //-----------------------------------------------------------------------------
 string_t CAttributeManager::ApplyAttributeString( string_t strValue, const CBaseEntity *pEntity, string_t strAttributeClass )
 {
+	VPROF_BUDGET( "CAttributeManager::ApplyAttributeString", VPROF_BUDGETGROUP_ATTRIBUTES );
+
 	if ( m_bParsingMyself || m_hOuter.Get() == NULL )
 	{
 		return strValue;
@@ -25,6 +25,8 @@
 	#include "team_control_point_master.h"
 	#include "team_train_watcher.h"
 	#include "serverbenchmark_base.h"
+	#include "filters.h"
+	#include "tier0/fasttimer.h"
 
 #if defined( REPLAY_ENABLED )	
 	#include "replay/ireplaysystem.h"
@@ -1281,6 +1283,9 @@ void CTeamplayRoundBasedRules::State_Enter( gamerules_roundstate_t newState )
 
 	m_flLastRoundStateChangeTime = gpGlobals->curtime;
 
+	// Some filters let the winners through while the round is won.
+	CBaseFilter::InvalidateCompiledFilters();
+
 	if ( mp_showroundtransitions.GetInt() > 0 )
 	{
 		if ( m_pCurStateInfo )
@@ -2936,7 +2941,17 @@ void CTeamplayRoundBasedRules::CleanUpMap()
 
 	// DO NOT CALL SPAWN ON info_node ENTITIES!
 
-	MapEntity_ParseAllEntities( engine->GetMapEntitiesString(), &filter, true );
+	CFastTimer timer;
+	timer.Start();
+
+	bool bCached = MapEntity_RespawnAllEntities( &filter, true );
+
+	timer.End();
+
+	if ( mp_showcleanedupents.GetInt() )
+	{
+		Msg( "  Respawned map entities from the %s in %.2f ms\n", bCached ? "entity cache" : "entity lump", timer.GetDuration().GetMillisecondsF() );
+	}
 }
 
 //-----------------------------------------------------------------------------
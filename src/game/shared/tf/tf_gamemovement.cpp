@@ -27,6 +27,7 @@
 #else
 	#include "tf_player.h"
 	#include "team.h"
+	#include "movementtracecache.h"
 #endif
 
 ConVar	tf_maxspeed( "tf_maxspeed", "400", FCVAR_NOTIFY | FCVAR_REPLICATED | FCVAR_CHEAT  | FCVAR_DEVELOPMENTONLY);
@@ -204,6 +205,9 @@ void CTFGameMovement::ProcessMovement( CBasePlayer *pBasePlayer, CMoveData *pMov
 	if ( !pBasePlayer || !pMove )
 		return;
 
+	VPROF_BUDGET( "CTFGameMovement::ProcessMovement", VPROF_BUDGETGROUP_PLAYER );
+	TRACE_BUDGET_SCOPE( "Game movement" );
+
 	// Reset point contents for water check.
 	ResetGetPointContentsCache();
 
@@ -227,6 +231,8 @@ void CTFGameMovement::ProcessMovement( CBasePlayer *pBasePlayer, CMoveData *pMov
 
 #ifdef GAME_DLL
 	m_pTFPlayer->m_bBlastLaunched = false;
+
+	g_MovementTraceCache.UsercmdProcessed();
 #endif
 }
 
@@ -953,14 +959,8 @@ bool CTraceFilterObject::ShouldHitEntity( IHandleEntity *pHandleEntity, int cont
 
 CBaseHandle CTFGameMovement::TestPlayerPosition( const Vector& pos, int collisionGroup, trace_t& pm )
 {
-	if( tf_solidobjects.GetBool() == false )
-		return BaseClass::TestPlayerPosition( pos, collisionGroup, pm );
-
-	Ray_t ray;
-	ray.Init( pos, pos, GetPlayerMins(), GetPlayerMaxs() );
-	
-	CTraceFilterObject traceFilter( mv->m_nPlayerHandle.Get(), collisionGroup );
-	enginetrace->TraceRay( ray, PlayerSolidMask(), &traceFilter, &pm );
+	// Same trace as the base class and the solid objects version, but shares the movement trace cache.
+	TracePlayerBBox( pos, pos, PlayerSolidMask(), collisionGroup, pm );
 
 	if ( (pm.contents & PlayerSolidMask()) && pm.m_pEnt )
 	{
@@ -977,15 +977,31 @@ CBaseHandle CTFGameMovement::TestPlayerPosition( const Vector& pos, int collisio
 //-----------------------------------------------------------------------------
 void CTFGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, unsigned int fMask, int collisionGroup, trace_t& pm )
 {
-	if( tf_solidobjects.GetBool() == false )
-		return BaseClass::TracePlayerBBox( start, end, fMask, collisionGroup, pm );
+	bool bSolidObjects = tf_solidobjects.GetBool();
 
 	Ray_t ray;
 	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
-	
-	CTraceFilterObject traceFilter( mv->m_nPlayerHandle.Get(), collisionGroup );
 
-	enginetrace->TraceRay( ray, fMask, &traceFilter, &pm );
+#ifdef GAME_DLL
+	// The filter kind is part of the key, the two filters don't agree on buildings.
+	if ( g_MovementTraceCache.Lookup( player, ray, fMask, collisionGroup, bSolidObjects, pm ) )
+		return;
+#endif
+
+	if ( bSolidObjects )
+	{
+		CTraceFilterObject traceFilter( mv->m_nPlayerHandle.Get(), collisionGroup );
+		TRACE_BUDGET_TIMER( &pm );
+		enginetrace->TraceRay( ray, fMask, &traceFilter, &pm );
+	}
+	else
+	{
+		BaseClass::TracePlayerBBox( start, end, fMask, collisionGroup, pm );
+	}
+
+#ifdef GAME_DLL
+	g_MovementTraceCache.Store( player, ray, fMask, collisionGroup, bSolidObjects, pm );
+#endif
 }
 
 //-----------------------------------------------------------------------------
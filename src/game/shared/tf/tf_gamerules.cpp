@@ -11,6 +11,7 @@
 #include "tf_weaponbase.h"
 #include "time.h"
 #include "viewport_panel_names.h"
+#include "tier0/vprof.h"
 #ifdef CLIENT_DLL
 	#include <game/client/iviewport.h>
 	#include "c_tf_player.h"
@@ -1349,28 +1350,22 @@ void CTFGameRules::SetTeamGoalString( int iTeam, const char *pszGoal )
 	{
 		if ( !pszGoal || !pszGoal[0] )
 		{
-			m_pszTeamGoalStringRed.GetForModify()[0] = '\0';
+			m_pszTeamGoalStringRed.Set( "" );
 		}
 		else
 		{
-			if ( Q_stricmp( m_pszTeamGoalStringRed.Get(), pszGoal ) )
-			{
-				Q_strncpy( m_pszTeamGoalStringRed.GetForModify(), pszGoal, MAX_TEAMGOAL_STRING );
-			}
+			m_pszTeamGoalStringRed.Set( pszGoal );
 		}
 	}
 	else if ( iTeam == TF_TEAM_BLUE )
 	{
 		if ( !pszGoal || !pszGoal[0] )
 		{
-			m_pszTeamGoalStringBlue.GetForModify()[0] = '\0';
+			m_pszTeamGoalStringBlue.Set( "" );
 		}
 		else
 		{
-			if ( Q_stricmp( m_pszTeamGoalStringBlue.Get(), pszGoal ) )
-			{
-				Q_strncpy( m_pszTeamGoalStringBlue.GetForModify(), pszGoal, MAX_TEAMGOAL_STRING );
-			}
+			m_pszTeamGoalStringBlue.Set( pszGoal );
 		}
 	}
 }
@@ -1697,6 +1692,8 @@ ConVar tf_fixedup_damage_radius( "tf_fixedup_damage_radius", "1", FCVAR_DEVELOPM
 
 bool CTFRadiusDamageInfo::ApplyToEntity( CBaseEntity *pEntity )
 {
+	TRACE_BUDGET_SCOPE( "Radius damage" );
+
 	const int MASK_RADIUS_DAMAGE = MASK_SHOT&( ~CONTENTS_HITBOX );
 	trace_t		tr;
 	float		falloff;
@@ -2221,6 +2218,8 @@ void CTFGameRules::RadiusDamage( const CTakeDamageInfo &info, const Vector &vecS
 	// Add the ability to ignore the world trace
 	void CTFGameRules::Think()
 	{
+		VPROF_BUDGET( "CTFGameRules::Think", VPROF_BUDGETGROUP_GAME );
+
 		if ( !g_fGameOver )
 		{
 			if ( gpGlobals->curtime > m_flNextPeriodicThink )
@@ -315,35 +315,35 @@ void CTFPlayerShared::Init( CTFPlayer *pPlayer )
 void CTFPlayerShared::AddCond( int nCond, float flDuration /* = PERMANENT_CONDITION */ )
 {
 	Assert( nCond >= 0 && nCond < TF_COND_LAST );
+
+	// Set through the network vars so re-adding a condition we already have doesn't dirty them
 	int nCondFlag = nCond;
-	int *pVar = NULL;
 	if ( nCond < 96 )
 	{
 		if ( nCond < 64 )
 		{
 			if ( nCond < 32 )
 			{
-				pVar = &m_nPlayerCond.GetForModify();
+				m_nPlayerCond |= ( 1 << nCondFlag );
 			}
 			else
 			{
-				pVar = &m_nPlayerCondEx.GetForModify();
 				nCondFlag -= 32;
+				m_nPlayerCondEx |= ( 1 << nCondFlag );
 			}
 		}
 		else
 		{
-			pVar = &m_nPlayerCondEx2.GetForModify();
 			nCondFlag -= 64;
+			m_nPlayerCondEx2 |= ( 1 << nCondFlag );
 		}
 	}
 	else
 	{
-		pVar = &m_nPlayerCondEx3.GetForModify();
 		nCondFlag -= 96;
+		m_nPlayerCondEx3 |= ( 1 << nCondFlag );
 	}
 
-	*pVar |= ( 1 << nCondFlag );
 	m_flCondExpireTimeLeft.Set( nCond, flDuration );
 	OnConditionAdded( nCond );
 }
@@ -356,34 +356,32 @@ void CTFPlayerShared::RemoveCond(int nCond)
 	Assert(nCond >= 0 && nCond < TF_COND_LAST);
 
 	int nCondFlag = nCond;
-	int *pVar = NULL;
 	if (nCond < 96)
 	{
 		if (nCond < 64)
 		{
 			if (nCond < 32)
 			{
-				pVar = &m_nPlayerCond.GetForModify();
+				m_nPlayerCond &= ~(1 << nCondFlag);
 			}
 			else
 			{
-				pVar = &m_nPlayerCondEx.GetForModify();
 				nCondFlag -= 32;
+				m_nPlayerCondEx &= ~(1 << nCondFlag);
 			}
 		}
 		else
 		{
-			pVar = &m_nPlayerCondEx2.GetForModify();
 			nCondFlag -= 64;
+			m_nPlayerCondEx2 &= ~(1 << nCondFlag);
 		}
 	}
 	else
 	{
-		pVar = &m_nPlayerCondEx3.GetForModify();
 		nCondFlag -= 96;
+		m_nPlayerCondEx3 &= ~(1 << nCondFlag);
 	}
 
-	*pVar &= ~(1 << nCondFlag);
 	m_flCondExpireTimeLeft.Set(nCond, 0);
 
 	OnConditionRemoved(nCond);
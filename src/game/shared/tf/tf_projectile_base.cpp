@@ -27,9 +27,14 @@ IMPLEMENT_NETWORKCLASS_ALIASED( TFBaseProjectile, DT_TFBaseProjectile )
 
 BEGIN_NETWORK_TABLE( CTFBaseProjectile, DT_TFBaseProjectile )
 #ifdef CLIENT_DLL
-	RecvPropVector( RECVINFO( m_vInitialVelocity ) )
+	RecvPropVector( RECVINFO( m_vInitialVelocity ) ),
+
+	RecvPropVector( RECVINFO_NAME( m_vecNetworkOrigin, m_vecOrigin ) ),
 #else
-	SendPropVector( SENDINFO( m_vInitialVelocity ), 20 /*nbits*/, 0 /*flags*/, -3000 /*low value*/, 3000 /*high value*/	)
+	SendPropVector( SENDINFO( m_vInitialVelocity ), 20 /*nbits*/, 0 /*flags*/, -3000 /*low value*/, 3000 /*high value*/	),
+
+	SendPropExclude( "DT_BaseEntity", "m_vecOrigin" ),
+	SendPropVector	(SENDINFO(m_vecOrigin), -1,  SPROP_COORD|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_ProjectileOrigin ),
 #endif
 END_NETWORK_TABLE()
 
@@ -122,6 +127,8 @@ void CTFBaseProjectile::Spawn( void )
 	SetTouch( &CTFBaseProjectile::ProjectileTouch );
 	SetThink( &CTFBaseProjectile::FlyThink );
 	SetNextThink( gpGlobals->curtime );
+
+	StartParametricNetworking();
 #endif
 }
 
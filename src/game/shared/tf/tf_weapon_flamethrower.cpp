@@ -45,6 +45,7 @@
 	ConVar  tf_flamethrower_shortrangedamagemultiplier("tf_flamethrower_shortrangedamagemultiplier", "1.2", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Damage multiplier for close-in flamethrower damage." );
 	ConVar  tf_flamethrower_velocityfadestart("tf_flamethrower_velocityfadestart", ".3", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Time at which attacker's velocity contribution starts to fade." );
 	ConVar  tf_flamethrower_velocityfadeend("tf_flamethrower_velocityfadeend", ".5", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Time at which attacker's velocity contribution finishes fading." );
+	ConVar  tf_flamethrower_poolsize( "tf_flamethrower_poolsize", "64", 0, "Number of expired flame damage entities kept around for reuse. 0 removes them right away." );
 	//ConVar  tf_flame_force( "tf_flame_force", "30" );
 #endif
 
@@ -1081,6 +1082,95 @@ IMPLEMENT_AUTO_LIST( ITFFlameEntityAutoList );
 
 LINK_ENTITY_TO_CLASS( tf_flame, CTFFlameEntity );
 
+//-----------------------------------------------------------------------------
+// Purpose: Keeps expired flames around so the flamethrower can fire them again
+//			instead of creating and removing an entity for every flame puff.
+//-----------------------------------------------------------------------------
+class CTFFlameEntityPool : public CAutoGameSystem
+{
+public:
+	CTFFlameEntityPool() : CAutoGameSystem( "CTFFlameEntityPool" )
+	{
+		ResetStats();
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		m_FreeFlames.Purge();
+	}
+
+	CTFFlameEntity *Acquire( void )
+	{
+		while ( m_FreeFlames.Count() )
+		{
+			CTFFlameEntity *pFlame = m_FreeFlames.Tail();
+			m_FreeFlames.RemoveMultipleFromTail( 1 );
+			if ( pFlame )
+			{
+				m_nReused++;
+				return pFlame;
+			}
+		}
+
+		return NULL;
+	}
+
+	bool Release( CTFFlameEntity *pFlame )
+	{
+		if ( m_FreeFlames.Count() >= tf_flamethrower_poolsize.GetInt() )
+		{
+			m_nRemoved++;
+			return false;
+		}
+
+		m_FreeFlames.AddToTail( pFlame );
+		m_nPooled++;
+		return true;
+	}
+
+	void FlameCreated( void )	{ m_nCreated++; }
+
+	void PrintStats( void )
+	{
+		Msg( "Flames: %u created, %u reused, %u returned to the pool, %u removed, %d idle\n",
+			m_nCreated, m_nReused, m_nPooled, m_nRemoved, m_FreeFlames.Count() );
+		Msg( "Entity churn saved: %u creations, %u removals\n", m_nReused, m_nPooled );
+	}
+
+	void ResetStats( void )
+	{
+		m_nCreated = 0;
+		m_nReused = 0;
+		m_nPooled = 0;
+		m_nRemoved = 0;
+	}
+
+private:
+	CUtlVector< CHandle<CTFFlameEntity> >	m_FreeFlames;
+	unsigned int							m_nCreated;
+	unsigned int							m_nReused;
+	unsigned int							m_nPooled;
+	unsigned int							m_nRemoved;
+};
+
+static CTFFlameEntityPool g_TFFlameEntityPool;
+
+CON_COMMAND( tf_flamethrower_pool_stats, "Show how many flame entities were reused instead of created and removed." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TFFlameEntityPool.PrintStats();
+}
+
+CON_COMMAND( tf_flamethrower_pool_stats_reset, "Reset the flame pool counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TFFlameEntityPool.ResetStats();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Spawns this entitye
 //-----------------------------------------------------------------------------
@@ -1105,6 +1195,7 @@ void CTFFlameEntity::Spawn( void )
 	m_vecPrevPos = m_vecInitialPos;
 	m_flTimeRemove = gpGlobals->curtime + ( tf_flamethrower_flametime.GetFloat() * random->RandomFloat( 0.9, 1.1 ) );
 	m_hLauncher = dynamic_cast<CTFFlameThrower *>( GetOwnerEntity() );
+	m_bInPool = false;
 	
 	// Setup the think function.
 	SetThink( &CTFFlameEntity::FlameThink );
@@ -1116,9 +1207,23 @@ void CTFFlameEntity::Spawn( void )
 //-----------------------------------------------------------------------------
 CTFFlameEntity *CTFFlameEntity::Create( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, int iDmgType, float flDmgAmount )
 {
-	CTFFlameEntity *pFlame = static_cast<CTFFlameEntity*>( CBaseEntity::Create( "tf_flame", vecOrigin, vecAngles, pOwner ) );
-	if ( !pFlame )
-		return NULL;
+	CTFFlameEntity *pFlame = g_TFFlameEntityPool.Acquire();
+	if ( pFlame )
+	{
+		// Same setup CBaseEntity::Create() does for a new entity.
+		pFlame->SetAbsOrigin( vecOrigin );
+		pFlame->SetAbsAngles( vecAngles );
+		pFlame->SetOwnerEntity( pOwner );
+		pFlame->Spawn();
+	}
+	else
+	{
+		pFlame = static_cast<CTFFlameEntity*>( CBaseEntity::Create( "tf_flame", vecOrigin, vecAngles, pOwner ) );
+		if ( !pFlame )
+			return NULL;
+
+		g_TFFlameEntityPool.FlameCreated();
+	}
 
 	// Initialize the owner.
 	pFlame->SetOwnerEntity( pOwner );
@@ -1149,6 +1254,34 @@ CTFFlameEntity *CTFFlameEntity::Create( const Vector &vecOrigin, const QAngle &v
 	return pFlame;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Parks the flame in the pool until Create() needs it again
+//-----------------------------------------------------------------------------
+void CTFFlameEntity::Expire( void )
+{
+	if ( m_bInPool )
+		return;
+
+	if ( !g_TFFlameEntityPool.Release( this ) )
+	{
+		UTIL_Remove( this );
+		return;
+	}
+
+	m_bInPool = true;
+
+	SetThink( NULL );
+	SetNextThink( TICK_NEVER_THINK );
+	SetMoveType( MOVETYPE_NONE );
+	SetAbsVelocity( vec3_origin );
+	SetOwnerEntity( NULL );
+
+	m_hEntitiesBurnt.RemoveAll();
+	m_hAttacker = NULL;
+	m_iAttackerTeam = TEAM_UNASSIGNED;
+	m_hLauncher = NULL;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Think method
 //-----------------------------------------------------------------------------
@@ -1157,7 +1290,7 @@ void CTFFlameEntity::FlameThink( void )
 	// if we've expired, remove ourselves
 	if ( gpGlobals->curtime >= m_flTimeRemove )
 	{
-		UTIL_Remove( this );
+		Expire();
 		return;
 	}
 
@@ -1271,6 +1404,8 @@ void CTFFlameEntity::FlameThink( void )
 //-----------------------------------------------------------------------------
 void CTFFlameEntity::CheckCollision( CBaseEntity *pOther, bool *pbHitWorld )
 {
+	TRACE_BUDGET_SCOPE( "Flame collision" );
+
 	CTFCompoundBow *pBow = NULL;
 	*pbHitWorld = false;
 
@@ -1336,7 +1471,7 @@ void CTFFlameEntity::CheckCollision( CBaseEntity *pOther, bool *pbHitWorld )
 		{
 			// we hit the world, remove ourselves
 			*pbHitWorld = true;
-			UTIL_Remove( this );
+			Expire();
 		}
 	}
 
@@ -163,6 +163,9 @@ public:
 public:
 	static CTFFlameEntity *Create( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, int iDmgType, float m_flDmgAmount );
 
+	// Takes the flame out of play. It goes back to the flame pool if there's room, otherwise it's removed.
+	void Expire( void );
+
 	void FlameThink( void );
 	void CheckCollision( CBaseEntity *pOther, bool *pbHitWorld );
 	CBaseEntity *GetAttacker( void ) { return m_hAttacker.Get(); }
@@ -181,6 +184,7 @@ private:
 	EHANDLE						m_hAttacker;			// attacking player
 	int							m_iAttackerTeam;		// team of attacking player
 	CHandle<CTFFlameThrower>	m_hLauncher;			// weapon that fired this flame
+	bool						m_bInPool;				// expired and waiting to be reused
 };
 
 #endif // GAME_DLL
@@ -14,7 +14,6 @@
 #include "te_effect_dispatch.h"
 #include "tf_fx.h"
 #include "iscorer.h"
-extern void SendProxy_Origin( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID );
 extern void SendProxy_Angles( const SendProp *pProp, const void *pStruct, const void *pData, DVariant *pOut, int iElement, int objectID );
 #endif
 
@@ -43,7 +42,7 @@ SendPropVector( SENDINFO( m_vInitialVelocity ), 12 /*nbits*/, 0 /*flags*/, -3000
 SendPropExclude( "DT_BaseEntity", "m_vecOrigin" ),
 SendPropExclude( "DT_BaseEntity", "m_angRotation" ),
 
-SendPropVector	(SENDINFO(m_vecOrigin), -1,  SPROP_COORD_MP_INTEGRAL|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_Origin ),
+SendPropVector	(SENDINFO(m_vecOrigin), -1,  SPROP_COORD_MP_INTEGRAL|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_ProjectileOrigin ),
 SendPropQAngles	(SENDINFO(m_angRotation), 6, SPROP_CHANGES_OFTEN, SendProxy_Angles ),
 
 SendPropInt( SENDINFO( m_iDeflected ), 4, SPROP_UNSIGNED ),
@@ -150,6 +149,8 @@ void CTFBaseRocket::Spawn( void )
 	SetThink( &CTFBaseRocket::FlyThink );
 	SetNextThink( gpGlobals->curtime );
 
+	StartParametricNetworking();
+
 	// Don't collide with players on the owner's team for the first bit of our life
 	m_flCollideWithTeammatesTime = gpGlobals->curtime + 0.25;
 	m_bCollideWithTeammates = false;
@@ -458,6 +459,9 @@ void CTFBaseRocket::DrawRadius( float flRadius )
 void CTFBaseRocket::IncremenentDeflected( void )
 {
 	m_iDeflected++;
+
+	// Deflecting always sets the new velocity first.
+	RestartParametricTrajectory();
 }
 
 //-----------------------------------------------------------------------------
@@ -515,6 +519,7 @@ void CTFBaseRocket::FlyThink( void )
 			VectorAngles( vecDir, angForward );
 			SetAbsAngles( angForward );
 			SetAbsVelocity( vecDir * flSpeed );
+			RestartParametricTrajectory();
 		}
 	}
 	
@@ -0,0 +1,109 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Counts the engine traces made through the UTIL_Trace* helpers on
+//			the server, grouped by the game system that asked for them.
+//			Callers tag a block with TRACE_BUDGET_SCOPE( "Name" ); any trace
+//			made inside it is charged to that category, and untagged traces
+//			are charged to "Other". Calls, hits and time are rolled up once
+//			per tick for sv_trace_budget_dump and the CSV stream.
+//
+//=============================================================================//
+
+#ifndef TRACEBUDGET_H
+#define TRACEBUDGET_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#ifdef GAME_DLL
+
+#include "tier0/fasttimer.h"
+
+class CGameTrace;
+
+// Set while sv_trace_budget is on, so the trace helpers only pay for a bool
+// test otherwise.
+extern bool g_bTraceBudgetActive;
+
+// Category the next trace is charged to.
+extern int g_iTraceBudgetCategory;
+
+int TraceBudget_FindOrAddCategory( const char *pszCategory );
+void TraceBudget_Record( const CGameTrace *ptr, const CCycleCount &duration );
+
+//-----------------------------------------------------------------------------
+// Purpose: Charges the traces made while it's in scope to a category.
+//-----------------------------------------------------------------------------
+class CTraceBudgetScope
+{
+public:
+	CTraceBudgetScope( const char *pszCategory, int &iCategory )
+	{
+		m_iPrevCategory = -1;
+		if ( g_bTraceBudgetActive )
+		{
+			if ( iCategory < 0 )
+			{
+				iCategory = TraceBudget_FindOrAddCategory( pszCategory );
+			}
+
+			m_iPrevCategory = g_iTraceBudgetCategory;
+			g_iTraceBudgetCategory = iCategory;
+		}
+	}
+
+	~CTraceBudgetScope()
+	{
+		if ( m_iPrevCategory >= 0 )
+		{
+			g_iTraceBudgetCategory = m_iPrevCategory;
+		}
+	}
+
+private:
+	int m_iPrevCategory;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Times one trace and charges it to the current category.
+//-----------------------------------------------------------------------------
+class CTraceBudgetTimer
+{
+public:
+	CTraceBudgetTimer( const CGameTrace *ptr )
+	{
+		m_pTrace = g_bTraceBudgetActive ? ptr : NULL;
+		if ( m_pTrace )
+		{
+			m_Timer.Start();
+		}
+	}
+
+	~CTraceBudgetTimer()
+	{
+		if ( m_pTrace )
+		{
+			m_Timer.End();
+			TraceBudget_Record( m_pTrace, m_Timer.GetDuration() );
+		}
+	}
+
+private:
+	const CGameTrace	*m_pTrace;
+	CFastTimer			m_Timer;
+};
+
+#define TRACE_BUDGET_SCOPE( pszCategory )	\
+	static int s_iTraceBudgetCategory = -1;	\
+	CTraceBudgetScope traceBudgetScope( pszCategory, s_iTraceBudgetCategory )
+
+#define TRACE_BUDGET_TIMER( ptr )	CTraceBudgetTimer traceBudgetTimer( ptr )
+
+#else
+
+#define TRACE_BUDGET_SCOPE( pszCategory )	((void)0)
+#define TRACE_BUDGET_TIMER( ptr )			((void)0)
+
+#endif // GAME_DLL
+
+#endif // TRACEBUDGET_H
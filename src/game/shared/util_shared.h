@@ -17,6 +17,7 @@
 #include "engine/IEngineTrace.h"
 #include "engine/IStaticPropMgr.h"
 #include "shared_classnames.h"
+#include "tracebudget.h"
 
 #ifdef CLIENT_DLL
 #include "cdll_client_int.h"
@@ -252,6 +253,7 @@ inline void UTIL_TraceLine( const Vector& vecAbsStart, const Vector& vecAbsEnd,
 	ray.Init( vecAbsStart, vecAbsEnd );
 	CTraceFilterSimple traceFilter( ignore, collisionGroup );
 
+	TRACE_BUDGET_TIMER( ptr );
 	enginetrace->TraceRay( ray, mask, &traceFilter, ptr );
 
 	if( r_visualizetraces.GetBool() )
@@ -266,6 +268,7 @@ inline void UTIL_TraceLine( const Vector& vecAbsStart, const Vector& vecAbsEnd,
 	Ray_t ray;
 	ray.Init( vecAbsStart, vecAbsEnd );
 
+	TRACE_BUDGET_TIMER( ptr );
 	enginetrace->TraceRay( ray, mask, pFilter, ptr );
 
 	if( r_visualizetraces.GetBool() )
@@ -282,6 +285,7 @@ inline void UTIL_TraceHull( const Vector &vecAbsStart, const Vector &vecAbsEnd,
 	ray.Init( vecAbsStart, vecAbsEnd, hullMin, hullMax );
 	CTraceFilterSimple traceFilter( ignore, collisionGroup );
 
+	TRACE_BUDGET_TIMER( ptr );
 	enginetrace->TraceRay( ray, mask, &traceFilter, ptr );
 
 	if( r_visualizetraces.GetBool() )
@@ -296,6 +300,7 @@ inline void UTIL_TraceHull( const Vector &vecAbsStart, const Vector &vecAbsEnd,
 	Ray_t ray;
 	ray.Init( vecAbsStart, vecAbsEnd, hullMin, hullMax );
 
+	TRACE_BUDGET_TIMER( ptr );
 	enginetrace->TraceRay( ray, mask, pFilter, ptr );
 
 	if( r_visualizetraces.GetBool() )
@@ -309,6 +314,7 @@ inline void UTIL_TraceRay( const Ray_t &ray, unsigned int mask,
 {
 	CTraceFilterSimple traceFilter( ignore, collisionGroup, pExtraShouldHitCheckFn );
 
+	TRACE_BUDGET_TIMER( ptr );
 	enginetrace->TraceRay( ray, mask, &traceFilter, ptr );
 	
 	if( r_visualizetraces.GetBool() )
@@ -7,7 +7,7 @@
 
 #include "KeyValues.h"
 #include "tier1/strtools.h"
-#include "FileSystem_Tools.h"
+#include "filesystem_tools.h"
 #include "tier1/utlstring.h"
 
 // So we know whether or not we own argv's memory
@@ -13,6 +13,7 @@
 
 #include "tier0/dbg.h"
 #include "convar.h"
+#include "tier1/strtools.h"
 
 #if defined( CLIENT_DLL ) || defined( GAME_DLL )
 	#include "basehandle.h"
@@ -686,10 +687,18 @@ private:
 			NetworkStateChanged(); \
 			return m_Value; \
 		} \
+		void Set( const char *pszValue ) \
+		{ \
+			if ( Q_strncmp( m_Value, pszValue, length ) ) \
+			{ \
+				NetworkStateChanged(); \
+				Q_strncpy( m_Value, pszValue, length ); \
+			} \
+		} \
 	protected: \
 		inline void NetworkStateChanged() \
 		{ \
-		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged(); \
+		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged( m_Value ); \
 		} \
 	private: \
 		char m_Value[length]; \
@@ -0,0 +1,313 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compares the lumps of two .bsp files byte for byte, to check that
+//			two ways of compiling the same map (threaded or -distribute,
+//			SIMD or scalar, old or new vrad) wrote the same data.
+//
+//			The pakfile lump is compared file by file, since the zip
+//			stamps every file with the time it was written.
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "bspfile.h"
+
+struct BSPFile_t
+{
+	const char		*m_pFileName;
+	unsigned char	*m_pData;
+	int				m_nSize;
+	dheader_t		*m_pHeader;
+};
+
+void Usage( void )
+{
+	printf( "Usage: bspdiff [-lump <n>]... [-skiplump <n>]... src1.bsp src2.bsp\n" );
+	printf( "Compares every lump, or only the ones given with -lump.\n" );
+	printf( "Exits with 0 if they match, 1 if they differ.\n" );
+	exit( -1 );
+}
+
+static bool LoadBSP( const char *pFileName, BSPFile_t &bsp )
+{
+	bsp.m_pFileName = pFileName;
+
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+	{
+		fprintf( stderr, "%s not found\n", pFileName );
+		return false;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	bsp.m_nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	bsp.m_pData = (unsigned char *)malloc( bsp.m_nSize > 0 ? bsp.m_nSize : 1 );
+	bool bRead = ( fread( bsp.m_pData, 1, bsp.m_nSize, fp ) == (size_t)bsp.m_nSize );
+	fclose( fp );
+
+	if ( !bRead || bsp.m_nSize < (int)sizeof( dheader_t ) )
+	{
+		fprintf( stderr, "error reading %s\n", pFileName );
+		return false;
+	}
+
+	bsp.m_pHeader = (dheader_t *)bsp.m_pData;
+	if ( bsp.m_pHeader->ident != IDBSPHEADER )
+	{
+		fprintf( stderr, "%s is not a little endian .bsp file\n", pFileName );
+		return false;
+	}
+
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		const lump_t &lump = bsp.m_pHeader->lumps[i];
+		if ( lump.fileofs < 0 || lump.filelen < 0 || lump.fileofs > bsp.m_nSize - lump.filelen )
+		{
+			fprintf( stderr, "%s: lump %d runs past the end of the file\n", pFileName, i );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static const unsigned char *GetLumpData( const BSPFile_t &bsp, int iLump )
+{
+	return bsp.m_pData + bsp.m_pHeader->lumps[iLump].fileofs;
+}
+
+static int FirstDifference( const unsigned char *p1, const unsigned char *p2, int nBytes )
+{
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		if ( p1[i] != p2[i] )
+			return i;
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the directory of the zip in a pakfile lump, or returns NULL.
+//-----------------------------------------------------------------------------
+static const ZIP_EndOfCentralDirRecord *FindZipDirectory( const unsigned char *pZip, int nSize )
+{
+	for ( int i = nSize - (int)sizeof( ZIP_EndOfCentralDirRecord ); i >= 0; i-- )
+	{
+		const ZIP_EndOfCentralDirRecord *pRecord = (const ZIP_EndOfCentralDirRecord *)( pZip + i );
+		if ( pRecord->signature == PKID( 5, 6 ) )
+			return pRecord;
+	}
+	return NULL;
+}
+
+// Returns the zip's central directory entry for the file, or NULL. pData gets the stored bytes.
+static const ZIP_FileHeader *FindZipFile( const unsigned char *pZip, int nSize, const char *pName, int nNameLength, const unsigned char **pData )
+{
+	const ZIP_EndOfCentralDirRecord *pRecord = FindZipDirectory( pZip, nSize );
+	if ( !pRecord )
+		return NULL;
+
+	unsigned int nOffset = pRecord->startOfCentralDirOffset;
+	for ( int i = 0; i < pRecord->nCentralDirectoryEntries_Total; i++ )
+	{
+		if ( nOffset + sizeof( ZIP_FileHeader ) > (unsigned int)nSize )
+			return NULL;
+
+		const ZIP_FileHeader *pFile = (const ZIP_FileHeader *)( pZip + nOffset );
+		const char *pFileName = (const char *)( pFile + 1 );
+		if ( pFile->fileNameLength == nNameLength && !memcmp( pFileName, pName, nNameLength ) )
+		{
+			unsigned int nLocalOffset = pFile->relativeOffsetOfLocalHeader;
+			if ( nLocalOffset + sizeof( ZIP_LocalFileHeader ) > (unsigned int)nSize )
+				return NULL;
+
+			const ZIP_LocalFileHeader *pLocal = (const ZIP_LocalFileHeader *)( pZip + nLocalOffset );
+			unsigned int nDataOffset = nLocalOffset + sizeof( ZIP_LocalFileHeader ) + pLocal->fileNameLength + pLocal->extraFieldLength;
+			if ( nDataOffset + pFile->compressedSize > (unsigned int)nSize )
+				return NULL;
+
+			*pData = pZip + nDataOffset;
+			return pFile;
+		}
+
+		nOffset += sizeof( ZIP_FileHeader ) + pFile->fileNameLength + pFile->extraFieldLength + pFile->fileCommentLength;
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints the files in pZip1 that pZip2 is missing or stores differently.
+//			Returns the number printed.
+//-----------------------------------------------------------------------------
+static int ComparePakFiles( const BSPFile_t &bsp1, const unsigned char *pZip1, int nSize1, const BSPFile_t &bsp2, const unsigned char *pZip2, int nSize2, bool bReportChanged )
+{
+	const ZIP_EndOfCentralDirRecord *pRecord = FindZipDirectory( pZip1, nSize1 );
+	if ( !pRecord )
+		return 0;
+
+	int nDifferences = 0;
+	unsigned int nOffset = pRecord->startOfCentralDirOffset;
+	for ( int i = 0; i < pRecord->nCentralDirectoryEntries_Total; i++ )
+	{
+		if ( nOffset + sizeof( ZIP_FileHeader ) > (unsigned int)nSize1 )
+			break;
+
+		const ZIP_FileHeader *pFile = (const ZIP_FileHeader *)( pZip1 + nOffset );
+		const char *pName = (const char *)( pFile + 1 );
+		int nNameLength = pFile->fileNameLength;
+		nOffset += sizeof( ZIP_FileHeader ) + pFile->fileNameLength + pFile->extraFieldLength + pFile->fileCommentLength;
+
+		const unsigned char *pData1, *pData2;
+		if ( !FindZipFile( pZip1, nSize1, pName, nNameLength, &pData1 ) )
+			continue;
+
+		const ZIP_FileHeader *pOther = FindZipFile( pZip2, nSize2, pName, nNameLength, &pData2 );
+		if ( !pOther )
+		{
+			printf( "  pakfile: %.*s is only in %s\n", nNameLength, pName, bsp1.m_pFileName );
+			++nDifferences;
+		}
+		else if ( bReportChanged )
+		{
+			if ( pOther->compressedSize != pFile->compressedSize || pOther->compressionMethod != pFile->compressionMethod ||
+				 FirstDifference( pData1, pData2, pFile->compressedSize ) != -1 )
+			{
+				printf( "  pakfile: %.*s differs\n", nNameLength, pName );
+				++nDifferences;
+			}
+		}
+	}
+
+	return nDifferences;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints how lump iLump differs. Returns false if it does.
+//-----------------------------------------------------------------------------
+static bool CompareLump( const BSPFile_t &bsp1, const BSPFile_t &bsp2, int iLump )
+{
+	const lump_t &lump1 = bsp1.m_pHeader->lumps[iLump];
+	const lump_t &lump2 = bsp2.m_pHeader->lumps[iLump];
+	const unsigned char *pData1 = GetLumpData( bsp1, iLump );
+	const unsigned char *pData2 = GetLumpData( bsp2, iLump );
+
+	if ( iLump == LUMP_PAKFILE )
+	{
+		int nDifferences = ComparePakFiles( bsp1, pData1, lump1.filelen, bsp2, pData2, lump2.filelen, true );
+		nDifferences += ComparePakFiles( bsp2, pData2, lump2.filelen, bsp1, pData1, lump1.filelen, false );
+		if ( nDifferences )
+		{
+			printf( "lump %2d: %d pakfile file(s) differ\n", iLump, nDifferences );
+			return false;
+		}
+		return true;
+	}
+
+	if ( lump1.version != lump2.version )
+	{
+		printf( "lump %2d: version %d vs %d\n", iLump, lump1.version, lump2.version );
+		return false;
+	}
+
+	int nCompare = ( lump1.filelen < lump2.filelen ) ? lump1.filelen : lump2.filelen;
+	int iDiff = FirstDifference( pData1, pData2, nCompare );
+	if ( lump1.filelen != lump2.filelen )
+	{
+		printf( "lump %2d: %d vs %d bytes", iLump, lump1.filelen, lump2.filelen );
+		if ( iDiff != -1 )
+		{
+			printf( ", first difference at byte %d", iDiff );
+		}
+		printf( "\n" );
+		return false;
+	}
+
+	if ( iDiff != -1 )
+	{
+		int nDiffBytes = 0;
+		for ( int i = iDiff; i < nCompare; i++ )
+		{
+			if ( pData1[i] != pData2[i] )
+				++nDiffBytes;
+		}
+
+		printf( "lump %2d: %d of %d bytes differ, the first at byte %d\n", iLump, nDiffBytes, nCompare, iDiff );
+		return false;
+	}
+
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	bool bCompare[HEADER_LUMPS];
+	bool bLumpsGiven = false;
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		bCompare[i] = true;
+	}
+
+	int iArg = 1;
+	for ( ; iArg < argc - 2; iArg++ )
+	{
+		bool bSkip = !strcmp( argv[iArg], "-skiplump" );
+		if ( !bSkip && strcmp( argv[iArg], "-lump" ) )
+			break;
+
+		int iLump = atoi( argv[++iArg] );
+		if ( iLump < 0 || iLump >= HEADER_LUMPS )
+		{
+			Usage();
+		}
+
+		if ( !bSkip && !bLumpsGiven )
+		{
+			// The first -lump narrows the comparison down to the lumps given.
+			for ( int i = 0; i < HEADER_LUMPS; i++ )
+			{
+				bCompare[i] = false;
+			}
+			bLumpsGiven = true;
+		}
+
+		bCompare[iLump] = !bSkip;
+	}
+
+	if ( iArg != argc - 2 )
+	{
+		Usage();
+	}
+
+	BSPFile_t bsp1, bsp2;
+	if ( !LoadBSP( argv[iArg], bsp1 ) || !LoadBSP( argv[iArg + 1], bsp2 ) )
+		return -1;
+
+	if ( bsp1.m_pHeader->version != bsp2.m_pHeader->version )
+	{
+		printf( "bsp version %d vs %d\n", bsp1.m_pHeader->version, bsp2.m_pHeader->version );
+		return 1;
+	}
+
+	int nCompared = 0, nDiffering = 0;
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		if ( !bCompare[i] )
+			continue;
+
+		++nCompared;
+		if ( !CompareLump( bsp1, bsp2, i ) )
+		{
+			++nDiffering;
+		}
+	}
+
+	printf( "%d of %d lumps compared differ\n", nDiffering, nCompared );
+
+	free( bsp1.m_pData );
+	free( bsp2.m_pData );
+	return nDiffering ? 1 : 0;
+}
@@ -26,7 +26,10 @@
 #include "tier0/dbg.h"
 #include "lumpfiles.h"
 #include "vtf/vtf.h"
+#ifdef _WIN32
+// The LZMA encoder (lib/common/lzma.lib) is only built for Windows.
 #include "lzma/lzma.h"
+#endif
 #include "tier1/lzmaDecoder.h"
 
 //=============================================================================
@@ -4562,6 +4565,7 @@ bool RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
 		return false;
 	}
 
+#ifdef _WIN32
 	unsigned int originalSize = inputBuffer.TellPut() - inputBuffer.TellGet();
 	unsigned int compressedSize = 0;
 	unsigned char *pCompressedOutput = LZMA_Compress( (unsigned char *)inputBuffer.Base() + inputBuffer.TellGet(),
@@ -4573,6 +4577,7 @@ bool RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
 		free( pCompressedOutput );
 		return true;
 	}
+#endif
 
 	return false;
 }
@@ -0,0 +1,816 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Stand-in for VMPI's DistributeWork() that runs one master and a
+//			set of worker processes on the same machine, over loopback
+//			sockets.
+//
+//			Every message is a length, a type and two ints, optionally
+//			followed by a payload. Every exchange starts with a worker
+//			request and gets exactly one reply from the master, so neither
+//			side needs to buffer anything it didn't ask for.
+//
+//=============================================================================//
+
+#ifdef _WIN32
+	// Each worker thread has its own connection, so allow more than the default 64.
+	#define FD_SETSIZE	1024
+	#include <winsock2.h>
+	#include <windows.h>
+	typedef int socklen_t;
+	#define DISTRIBUTE_SEND_FLAGS	0
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/wait.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <unistd.h>
+	typedef int SOCKET;
+	#define INVALID_SOCKET	-1
+	#define closesocket		close
+	// A write to a worker that just exited must fail, not raise SIGPIPE and
+	// kill the master, so the lost connection's units go back in the queue.
+	#define DISTRIBUTE_SEND_FLAGS	MSG_NOSIGNAL
+#endif
+
+#include "cmdlib.h"
+#include "threads.h"
+#include "pacifier.h"
+#include "loopback_distribute.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+
+
+enum EDistributeMsg
+{
+	DISTMSG_HELLO = 0,		// worker -> master: process id, thread index
+	DISTMSG_REQUEST,		// worker -> master: stage, finished work unit or -1, results. Asks for more work.
+	DISTMSG_BROADCAST_REQUEST,	// worker -> master: broadcast sequence number. Acks every broadcast before it.
+	DISTMSG_WORK,			// master -> worker: stage, work unit
+	DISTMSG_STAGE_DONE,		// master -> worker: stage. Nothing left to hand out.
+	DISTMSG_BROADCAST,		// master -> worker: sequence number, broadcast data
+};
+
+struct DistributeConnection_t
+{
+	SOCKET	m_Socket;
+	int		m_iProcessID;	// From the hello message, for diagnostics.
+	int		m_iThread;
+	int		m_iWorkUnit;	// Unit this connection is processing, or -1.
+	int		m_iWaitingStage;	// Asked for work in this stage while there was none to give, or -1.
+	int		m_iBroadcastAcked;	// Thread 0 only: the worker process has every broadcast up to this one.
+};
+
+struct DistributeWorkUnit_t
+{
+	bool	m_bDone;
+	int		m_nHolders;		// Connections currently processing it.
+	double	m_flIssueTime;
+};
+
+
+bool g_bDistribute = false;
+bool g_bDistributeMaster = false;
+
+static int		s_nWorkerProcesses = 0;
+static int		s_iPort = 0;			// 0 lets the master pick a free port.
+static float	s_flUnitTimeout = 300;	// Seconds before a unit is handed to someone else.
+static int		s_iStage = 0;
+static bool		s_bInitialized = false;
+
+// Master side.
+static SOCKET	s_ListenSocket = INVALID_SOCKET;
+static CUtlVector<DistributeConnection_t> s_Connections;
+static int		s_iBroadcast = 0;
+
+// Master side, indexed by sequence number - 1. Each is kept until every
+// worker process has acked it, then freed and left NULL.
+static CUtlVector<CUtlBuffer*> s_Broadcasts;
+static int		s_nLostWorkerProcesses = 0;
+
+// Worker side, one connection per thread.
+static CUtlVector<SOCKET> s_WorkerSockets;
+static DistributeProcessFn s_pProcessFn = NULL;
+
+
+//-----------------------------------------------------------------------------
+// Socket helpers.
+//-----------------------------------------------------------------------------
+static bool SendAll( SOCKET s, const void *pData, int nBytes )
+{
+	const char *pCur = (const char*)pData;
+	while ( nBytes > 0 )
+	{
+		int nSent = send( s, pCur, nBytes, DISTRIBUTE_SEND_FLAGS );
+		if ( nSent <= 0 )
+			return false;
+
+		pCur += nSent;
+		nBytes -= nSent;
+	}
+	return true;
+}
+
+static bool RecvAll( SOCKET s, void *pData, int nBytes )
+{
+	char *pCur = (char*)pData;
+	while ( nBytes > 0 )
+	{
+		int nReceived = recv( s, pCur, nBytes, 0 );
+		if ( nReceived <= 0 )
+			return false;
+
+		pCur += nReceived;
+		nBytes -= nReceived;
+	}
+	return true;
+}
+
+static bool SendMsg( SOCKET s, int type, int arg0, int arg1, const CUtlBuffer *pPayload = NULL )
+{
+	int nPayload = pPayload ? pPayload->TellPut() : 0;
+	int header[4] = { (int)( 3 * sizeof( int ) ) + nPayload, type, arg0, arg1 };
+	if ( !SendAll( s, header, sizeof( header ) ) )
+		return false;
+
+	return nPayload == 0 || SendAll( s, pPayload->Base(), nPayload );
+}
+
+static bool RecvMsg( SOCKET s, int &type, int &arg0, int &arg1, CUtlBuffer &payload )
+{
+	int header[4];
+	if ( !RecvAll( s, header, sizeof( header ) ) )
+		return false;
+
+	int nPayload = header[0] - (int)( 3 * sizeof( int ) );
+	if ( nPayload < 0 )
+		return false;
+
+	type = header[1];
+	arg0 = header[2];
+	arg1 = header[3];
+
+	payload.Clear();
+	payload.EnsureCapacity( nPayload );
+
+	char chunk[16 * 1024];
+	while ( nPayload > 0 )
+	{
+		int nChunk = MIN( nPayload, (int)sizeof( chunk ) );
+		if ( !RecvAll( s, chunk, nChunk ) )
+			return false;
+
+		payload.Put( chunk, nChunk );
+		nPayload -= nChunk;
+	}
+	return true;
+}
+
+static void InitSockets()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if ( WSAStartup( MAKEWORD( 2, 2 ), &wsaData ) != 0 )
+		Error( "Distribute: WSAStartup failed.\n" );
+#endif
+}
+
+static void SetNoDelay( SOCKET s )
+{
+	// Requests and replies are small and strictly alternate.
+	int iNoDelay = 1;
+	setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char*)&iNoDelay, sizeof( iNoDelay ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Command line.
+//-----------------------------------------------------------------------------
+bool Distribute_ParseArg( int argc, char **argv, int &i )
+{
+	if ( !Q_stricmp( argv[i], "-distribute" ) )
+	{
+		if ( ++i >= argc || atoi( argv[i] ) <= 0 )
+			Error( "Error: expected a worker count after '-distribute'\n" );
+
+		s_nWorkerProcesses = atoi( argv[i] );
+		g_bDistribute = true;
+		g_bDistributeMaster = true;
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distributeport" ) )
+	{
+		if ( ++i >= argc )
+			Error( "Error: expected a port after '-distributeport'\n" );
+
+		s_iPort = atoi( argv[i] );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distributetimeout" ) )
+	{
+		if ( ++i >= argc || atof( argv[i] ) <= 0 )
+			Error( "Error: expected a number of seconds after '-distributetimeout'\n" );
+
+		s_flUnitTimeout = atof( argv[i] );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distributeworker" ) )
+	{
+		if ( ++i >= argc || atoi( argv[i] ) <= 0 )
+			Error( "Error: expected a port after '-distributeworker'\n" );
+
+		s_iPort = atoi( argv[i] );
+		g_bDistribute = true;
+		g_bDistributeMaster = false;
+		return true;
+	}
+
+	return false;
+}
+
+void Distribute_Disable( const char *pReason )
+{
+	if ( !g_bDistribute )
+		return;
+
+	Warning( "-distribute is ignored %s\n", pReason );
+	g_bDistribute = false;
+	g_bDistributeMaster = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Launches one worker. args is the full argument list including the exe.
+//-----------------------------------------------------------------------------
+static bool LaunchWorker( CUtlVector<char*> &args )
+{
+#ifdef _WIN32
+	char szExe[MAX_PATH];
+	GetModuleFileName( NULL, szExe, sizeof( szExe ) );
+
+	CUtlVector<char> cmdLine;
+	for ( int i=0; i < args.Count(); i++ )
+	{
+		const char *pArg = ( i == 0 ) ? szExe : args[i];
+		if ( i > 0 )
+			cmdLine.AddToTail( ' ' );
+		cmdLine.AddToTail( '"' );
+		cmdLine.AddMultipleToTail( V_strlen( pArg ), pArg );
+		cmdLine.AddToTail( '"' );
+	}
+	cmdLine.AddToTail( 0 );
+
+	STARTUPINFO si;
+	memset( &si, 0, sizeof( si ) );
+	si.cb = sizeof( si );
+
+	PROCESS_INFORMATION pi;
+	if ( !CreateProcess( szExe, cmdLine.Base(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi ) )
+		return false;
+
+	CloseHandle( pi.hThread );
+	CloseHandle( pi.hProcess );
+	return true;
+#else
+	char szExe[MAX_PATH];
+	int nLen = readlink( "/proc/self/exe", szExe, sizeof( szExe ) - 1 );
+	if ( nLen <= 0 )
+		V_strncpy( szExe, args[0], sizeof( szExe ) );
+	else
+		szExe[nLen] = 0;
+
+	args.AddToTail( NULL );
+	pid_t pid = fork();
+	if ( pid == 0 )
+	{
+		execv( szExe, args.Base() );
+		_exit( 1 );
+	}
+	args.Remove( args.Count() - 1 );
+
+	return pid > 0;
+#endif
+}
+
+void Distribute_Init( int argc, char **argv )
+{
+	if ( !g_bDistribute || s_bInitialized )
+		return;
+
+	s_bInitialized = true;
+	InitSockets();
+	CmdLib_AtCleanup( Distribute_Shutdown );
+
+	if ( !g_bDistributeMaster )
+	{
+		// Workers only report problems, the master does the talking.
+		g_bSuppressPrintfOutput = true;
+		return;
+	}
+
+	// Listen on loopback only.
+	s_ListenSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( s_ListenSocket == INVALID_SOCKET )
+		Error( "Distribute: can't create the listen socket.\n" );
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	addr.sin_port = htons( (unsigned short)s_iPort );
+	if ( bind( s_ListenSocket, (sockaddr*)&addr, sizeof( addr ) ) != 0 || listen( s_ListenSocket, SOMAXCONN ) != 0 )
+		Error( "Distribute: can't listen on port %d.\n", s_iPort );
+
+	socklen_t addrLen = sizeof( addr );
+	getsockname( s_ListenSocket, (sockaddr*)&addr, &addrLen );
+	s_iPort = ntohs( addr.sin_port );
+
+	// Split the machine between the workers unless -threads says otherwise.
+	int nWorkerThreads = numthreads;
+	if ( nWorkerThreads <= 0 )
+		nWorkerThreads = MAX( 1, GetCPUInformation()->m_nLogicalProcessors / s_nWorkerProcesses );
+
+	char szPort[16], szThreads[16];
+	Q_snprintf( szPort, sizeof( szPort ), "%d", s_iPort );
+	Q_snprintf( szThreads, sizeof( szThreads ), "%d", nWorkerThreads );
+
+	// Same command line minus our own options, with the map staying last.
+	CUtlVector<char*> args;
+	for ( int i=0; i < argc - 1; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-distribute" ) || !Q_stricmp( argv[i], "-distributeport" ) )
+		{
+			++i;
+			continue;
+		}
+		args.AddToTail( argv[i] );
+	}
+	args.AddToTail( (char*)"-distributeworker" );
+	args.AddToTail( szPort );
+	args.AddToTail( (char*)"-threads" );
+	args.AddToTail( szThreads );
+	args.AddToTail( argv[argc - 1] );
+
+	for ( int i=0; i < s_nWorkerProcesses; i++ )
+	{
+		if ( !LaunchWorker( args ) )
+			Error( "Distribute: couldn't launch worker %d.\n", i );
+	}
+
+	Msg( "Distributing to %d worker processes with %d threads each on port %d.\n", s_nWorkerProcesses, nWorkerThreads, s_iPort );
+}
+
+void Distribute_Shutdown()
+{
+	for ( int i=0; i < s_Connections.Count(); i++ )
+		closesocket( s_Connections[i].m_Socket );
+	s_Connections.Purge();
+
+	for ( int i=0; i < s_WorkerSockets.Count(); i++ )
+		closesocket( s_WorkerSockets[i] );
+	s_WorkerSockets.Purge();
+
+	if ( s_ListenSocket != INVALID_SOCKET )
+	{
+		closesocket( s_ListenSocket );
+		s_ListenSocket = INVALID_SOCKET;
+	}
+
+	s_Broadcasts.PurgeAndDeleteElements();
+
+#ifndef _WIN32
+	while ( waitpid( -1, NULL, WNOHANG ) > 0 )
+	{
+	}
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Master side.
+//-----------------------------------------------------------------------------
+static void AcceptConnection()
+{
+	SOCKET s = accept( s_ListenSocket, NULL, NULL );
+	if ( s == INVALID_SOCKET )
+		return;
+
+	SetNoDelay( s );
+
+	DistributeConnection_t conn;
+	conn.m_Socket = s;
+	conn.m_iProcessID = -1;
+	conn.m_iThread = -1;
+	conn.m_iWorkUnit = -1;
+	conn.m_iWaitingStage = -1;
+	conn.m_iBroadcastAcked = 0;
+	s_Connections.AddToTail( conn );
+}
+
+// Frees the broadcasts that every worker process has acked. Processes that
+// haven't connected yet will still ask for all of them.
+static void ReleaseAckedBroadcasts()
+{
+	int nProcesses = s_nLostWorkerProcesses;
+	int iAcked = s_Broadcasts.Count();
+	for ( int i=0; i < s_Connections.Count(); i++ )
+	{
+		if ( s_Connections[i].m_iThread == 0 )
+		{
+			++nProcesses;
+			iAcked = MIN( iAcked, s_Connections[i].m_iBroadcastAcked );
+		}
+	}
+
+	if ( nProcesses < s_nWorkerProcesses )
+		return;
+
+	for ( int i=0; i < iAcked; i++ )
+	{
+		delete s_Broadcasts[i];
+		s_Broadcasts[i] = NULL;
+	}
+}
+
+// Drops a connection. Its unit goes back in the queue unless another worker is on it too.
+static void DropConnection( int iConn, CUtlVector<DistributeWorkUnit_t> &units, CUtlVector<int> &pending )
+{
+	DistributeConnection_t &conn = s_Connections[iConn];
+	if ( conn.m_iWorkUnit != -1 )
+	{
+		DistributeWorkUnit_t &unit = units[conn.m_iWorkUnit];
+		if ( --unit.m_nHolders == 0 && !unit.m_bDone )
+			pending.AddToTail( conn.m_iWorkUnit );
+	}
+
+	// Workers exit when any of their connections drop, so the process won't ask for broadcasts again.
+	if ( conn.m_iThread == 0 )
+		++s_nLostWorkerProcesses;
+
+	Warning( "Distribute: lost worker %d (thread %d).\n", conn.m_iProcessID, conn.m_iThread );
+	closesocket( conn.m_Socket );
+	s_Connections.Remove( iConn );
+}
+
+// Next unit from the queue. Once the queue is empty, returns the oldest unit
+// that only one worker is processing so a slow worker can't hold up the stage.
+static int PickWorkUnit( CUtlVector<DistributeWorkUnit_t> &units, CUtlVector<int> &pending )
+{
+	while ( pending.Count() )
+	{
+		int iUnit = pending.Tail();
+		pending.Remove( pending.Count() - 1 );
+		if ( !units[iUnit].m_bDone )
+			return iUnit;
+	}
+
+	int iBest = -1;
+	for ( int i=0; i < units.Count(); i++ )
+	{
+		if ( units[i].m_bDone || units[i].m_nHolders != 1 )
+			continue;
+
+		if ( iBest == -1 || units[i].m_flIssueTime < units[iBest].m_flIssueTime )
+			iBest = i;
+	}
+	return iBest;
+}
+
+// Gives a connection its next unit, or tells it the stage is over. If
+// neither is possible yet, it waits until a unit frees up.
+static bool AssignWork( DistributeConnection_t &conn, CUtlVector<DistributeWorkUnit_t> &units, CUtlVector<int> &pending, int nDone )
+{
+	conn.m_iWaitingStage = -1;
+
+	if ( nDone == units.Count() )
+		return SendMsg( conn.m_Socket, DISTMSG_STAGE_DONE, s_iStage, 0 );
+
+	int iUnit = PickWorkUnit( units, pending );
+	if ( iUnit == -1 )
+	{
+		conn.m_iWaitingStage = s_iStage;
+		return true;
+	}
+
+	DistributeWorkUnit_t &unit = units[iUnit];
+	if ( unit.m_nHolders++ == 0 )
+		unit.m_flIssueTime = Plat_FloatTime();
+
+	conn.m_iWorkUnit = iUnit;
+	return SendMsg( conn.m_Socket, DISTMSG_WORK, s_iStage, iUnit );
+}
+
+static double MasterWork( int nWorkUnits, DistributeReceiveFn receiveFn )
+{
+	double flStart = Plat_FloatTime();
+
+	CUtlVector<DistributeWorkUnit_t> units;
+	units.SetCount( nWorkUnits );
+	CUtlVector<int> pending;
+	pending.EnsureCapacity( nWorkUnits );
+	for ( int i=0; i < nWorkUnits; i++ )
+	{
+		units[i].m_bDone = false;
+		units[i].m_nHolders = 0;
+		units[i].m_flIssueTime = 0;
+
+		// Handed out from the tail, so unit 0 goes first.
+		pending.AddToTail( nWorkUnits - 1 - i );
+	}
+
+	for ( int i=0; i < s_Connections.Count(); i++ )
+		s_Connections[i].m_iWorkUnit = -1;
+
+	int nDone = 0;
+	int nReissued = 0;
+	double flLastWorker = flStart;
+	CUtlBuffer payload;
+
+	// Connections that asked for work in this stage before the master got here.
+	for ( int i=s_Connections.Count()-1; i >= 0; i-- )
+	{
+		if ( s_Connections[i].m_iWaitingStage == s_iStage && !AssignWork( s_Connections[i], units, pending, nDone ) )
+			DropConnection( i, units, pending );
+	}
+
+	while ( nDone < nWorkUnits )
+	{
+		fd_set readSet;
+		FD_ZERO( &readSet );
+		FD_SET( s_ListenSocket, &readSet );
+		SOCKET maxSocket = s_ListenSocket;
+		for ( int i=0; i < s_Connections.Count(); i++ )
+		{
+			FD_SET( s_Connections[i].m_Socket, &readSet );
+			maxSocket = MAX( maxSocket, s_Connections[i].m_Socket );
+		}
+
+		timeval timeout = { 1, 0 };
+		int nReady = select( (int)maxSocket + 1, &readSet, NULL, NULL, &timeout );
+		double flNow = Plat_FloatTime();
+
+		if ( nReady > 0 )
+		{
+			for ( int i=s_Connections.Count()-1; i >= 0; i-- )
+			{
+				DistributeConnection_t &conn = s_Connections[i];
+				if ( !FD_ISSET( conn.m_Socket, &readSet ) )
+					continue;
+
+				int type, arg0, arg1;
+				bool bOk = RecvMsg( conn.m_Socket, type, arg0, arg1, payload );
+				if ( bOk )
+				{
+					if ( type == DISTMSG_HELLO )
+					{
+						conn.m_iProcessID = arg0;
+						conn.m_iThread = arg1;
+					}
+					else if ( type == DISTMSG_BROADCAST_REQUEST )
+					{
+						// A worker that's behind gets the broadcast its stage was built on,
+						// not the newest one.
+						if ( arg0 < 1 || arg0 > s_Broadcasts.Count() || !s_Broadcasts[arg0 - 1] )
+						{
+							Warning( "Distribute: worker %d asked for broadcast %d, which isn't available.\n", conn.m_iProcessID, arg0 );
+							bOk = false;
+						}
+						else
+						{
+							bOk = SendMsg( conn.m_Socket, DISTMSG_BROADCAST, arg0, 0, s_Broadcasts[arg0 - 1] );
+							conn.m_iBroadcastAcked = MAX( conn.m_iBroadcastAcked, arg0 - 1 );
+							ReleaseAckedBroadcasts();
+						}
+					}
+					else if ( type == DISTMSG_REQUEST && arg0 < s_iStage )
+					{
+						// Left over from a stage that already finished.
+						bOk = SendMsg( conn.m_Socket, DISTMSG_STAGE_DONE, arg0, 0 );
+					}
+					else if ( type == DISTMSG_REQUEST && arg0 > s_iStage )
+					{
+						// The worker is already on a stage we haven't started.
+						conn.m_iWaitingStage = arg0;
+					}
+					else if ( type == DISTMSG_REQUEST )
+					{
+						int iUnit = arg1;
+						if ( iUnit >= 0 && iUnit < nWorkUnits )
+						{
+							DistributeWorkUnit_t &unit = units[iUnit];
+							if ( !unit.m_bDone )
+							{
+								receiveFn( iUnit, payload, i );
+								unit.m_bDone = true;
+								++nDone;
+								UpdatePacifier( (float)nDone / nWorkUnits );
+							}
+							--unit.m_nHolders;
+						}
+
+						conn.m_iWorkUnit = -1;
+						bOk = AssignWork( conn, units, pending, nDone );
+					}
+				}
+
+				if ( !bOk )
+					DropConnection( i, units, pending );
+			}
+
+			if ( FD_ISSET( s_ListenSocket, &readSet ) )
+				AcceptConnection();
+		}
+
+		// Units that have been out too long go back in the queue.
+		for ( int i=0; i < nWorkUnits; i++ )
+		{
+			DistributeWorkUnit_t &unit = units[i];
+			if ( !unit.m_bDone && unit.m_nHolders > 0 && flNow - unit.m_flIssueTime > s_flUnitTimeout )
+			{
+				pending.AddToTail( i );
+				unit.m_flIssueTime = flNow;
+				++nReissued;
+			}
+		}
+
+		// Wake up anyone waiting for work: a unit may have been freed, or the stage may be done.
+		for ( int i=s_Connections.Count()-1; i >= 0; i-- )
+		{
+			if ( s_Connections[i].m_iWaitingStage == s_iStage && !AssignWork( s_Connections[i], units, pending, nDone ) )
+				DropConnection( i, units, pending );
+		}
+
+		if ( s_Connections.Count() )
+		{
+			flLastWorker = flNow;
+		}
+		else if ( flNow - flLastWorker > s_flUnitTimeout )
+		{
+			Error( "Distribute: no workers connected for %.0f seconds.\n", s_flUnitTimeout );
+		}
+	}
+
+	if ( nReissued )
+	{
+		Warning( "Distribute: %d work units were re-issued after timing out.\n", nReissued );
+	}
+
+	return Plat_FloatTime() - flStart;
+}
+
+
+//-----------------------------------------------------------------------------
+// Worker side.
+//-----------------------------------------------------------------------------
+static void LostMaster()
+{
+	// The master exits as soon as it has what it needs, so this is the
+	// normal way for workers to stop when they aren't done yet.
+	CmdLib_Exit( 0 );
+}
+
+static void ConnectWorkerThreads()
+{
+	if ( s_WorkerSockets.Count() )
+		return;
+
+	int nThreads = MAX( 1, MIN( numthreads, MAX_TOOL_THREADS ) );
+	for ( int i=0; i < nThreads; i++ )
+	{
+		SOCKET s = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+
+		sockaddr_in addr;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		addr.sin_port = htons( (unsigned short)s_iPort );
+		if ( s == INVALID_SOCKET || connect( s, (sockaddr*)&addr, sizeof( addr ) ) != 0 )
+			LostMaster();
+
+		SetNoDelay( s );
+		s_WorkerSockets.AddToTail( s );
+
+#ifdef _WIN32
+		int iProcessID = (int)GetCurrentProcessId();
+#else
+		int iProcessID = (int)getpid();
+#endif
+		if ( !SendMsg( s, DISTMSG_HELLO, iProcessID, i ) )
+			LostMaster();
+	}
+}
+
+static void WorkerThread( int iThread, void *pUserData )
+{
+	if ( iThread >= s_WorkerSockets.Count() )
+		return;
+
+	SOCKET s = s_WorkerSockets[iThread];
+	int iWorkUnit = -1;
+	CUtlBuffer results, msg;
+
+	while ( 1 )
+	{
+		if ( !SendMsg( s, DISTMSG_REQUEST, s_iStage, iWorkUnit, &results ) )
+			LostMaster();
+
+		int type, arg0, arg1;
+		if ( !RecvMsg( s, type, arg0, arg1, msg ) )
+			LostMaster();
+
+		if ( type == DISTMSG_STAGE_DONE )
+			break;
+
+		if ( type != DISTMSG_WORK || arg0 != s_iStage )
+			Error( "Distribute: unexpected message %d from the master.\n", type );
+
+		iWorkUnit = arg1;
+		results.Clear();
+		s_pProcessFn( iThread, iWorkUnit, results );
+	}
+}
+
+static double WorkerWork( DistributeProcessFn processFn )
+{
+	double flStart = Plat_FloatTime();
+
+	ConnectWorkerThreads();
+
+	s_pProcessFn = processFn;
+	RunThreads_Start( WorkerThread, NULL );
+	RunThreads_End();
+	s_pProcessFn = NULL;
+
+	return Plat_FloatTime() - flStart;
+}
+
+void Distribute_WorkerFinished()
+{
+	if ( !Distribute_IsWorker() )
+		return;
+
+	CmdLib_Cleanup();
+	CmdLib_Exit( 0 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Shared.
+//-----------------------------------------------------------------------------
+double Distribute_Work( const char *pStageName, int nWorkUnits, DistributeProcessFn processFn, DistributeReceiveFn receiveFn )
+{
+	Assert( g_bDistribute && s_bInitialized );
+
+	++s_iStage;
+	if ( nWorkUnits <= 0 )
+		return 0;
+
+	if ( !g_bDistributeMaster )
+		return WorkerWork( processFn );
+
+	if ( pStageName )
+	{
+		Msg( "%-20s ", pStageName );
+		StartPacifier( "" );
+	}
+
+	double flElapsed = MasterWork( nWorkUnits, receiveFn );
+
+	if ( pStageName )
+	{
+		EndPacifier( false );
+		Msg( " (%d)\n", (int)flElapsed );
+	}
+	return flElapsed;
+}
+
+void Distribute_Broadcast( CUtlBuffer &buf )
+{
+	Assert( g_bDistribute && s_bInitialized );
+
+	++s_iBroadcast;
+	if ( g_bDistributeMaster )
+	{
+		CUtlBuffer *pBroadcast = new CUtlBuffer;
+		pBroadcast->Put( buf.Base(), buf.TellPut() );
+		s_Broadcasts.AddToTail( pBroadcast );
+		Assert( s_Broadcasts.Count() == s_iBroadcast );
+		return;
+	}
+
+	ConnectWorkerThreads();
+
+	// The worker threads are idle between stages, so the main thread can borrow thread 0's connection.
+	int type, arg0, arg1;
+	if ( !SendMsg( s_WorkerSockets[0], DISTMSG_BROADCAST_REQUEST, s_iBroadcast, 0 ) ||
+		 !RecvMsg( s_WorkerSockets[0], type, arg0, arg1, buf ) )
+	{
+		LostMaster();
+	}
+
+	if ( type != DISTMSG_BROADCAST || arg0 != s_iBroadcast )
+		Error( "Distribute: unexpected message %d from the master.\n", type );
+}
@@ -0,0 +1,80 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Stand-in for VMPI's DistributeWork() that needs no VMPI services.
+//			One master and a set of worker processes run on the same machine
+//			and talk over loopback sockets.
+//
+//			The master launches copies of its own exe with -distributeworker.
+//			The workers go through the same program flow as the master and
+//			call Distribute_Work() at the same points. Each worker thread has
+//			its own connection and pulls one work unit at a time, so faster
+//			workers take more of a stage. When a worker disconnects or sits
+//			on a unit for too long, its units are handed out again. Once the
+//			queue is empty, idle workers also take a copy of the oldest
+//			outstanding unit. The first result for a unit wins.
+//
+//			A -distribute compile has to write the same lumps as a threaded
+//			one. devtools\bin\comparecompile.pl checks that, e.g.
+//			perl comparecompile.pl -lump 4 maps\foo.bsp "vvis" "vvis -distribute 4"
+//
+//=============================================================================//
+
+#ifndef LOOPBACK_DISTRIBUTE_H
+#define LOOPBACK_DISTRIBUTE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlbuffer.h"
+
+
+// Set when either -distribute or -distributeworker is on the command line.
+extern bool g_bDistribute;
+
+// Set on the process that launched the workers.
+extern bool g_bDistributeMaster;
+
+inline bool Distribute_IsWorker() { return g_bDistribute && !g_bDistributeMaster; }
+
+
+// Called on a worker thread to process a work unit and write the results into buf.
+typedef void (*DistributeProcessFn)( int iThread, int iWorkUnit, CUtlBuffer &buf );
+
+// Called on the master with the first result that comes back for a work unit.
+typedef void (*DistributeReceiveFn)( int iWorkUnit, CUtlBuffer &buf, int iWorker );
+
+
+// Handles these options:
+//   -distribute <workers>, -distributeport <port>,
+//   -distributetimeout <seconds>, -distributeworker <port>.
+// If argv[i] is one of them, this returns true and moves i past its value.
+bool Distribute_ParseArg( int argc, char **argv, int &i );
+
+// Turns distribution back off before Distribute_Init(), for modes that can't use it.
+void Distribute_Disable( const char *pReason );
+
+// On the master, opens the listen socket and launches the workers with the
+// master's own command line. Workers connect at their first Distribute_Work() call.
+void Distribute_Init( int argc, char **argv );
+
+// Runs one stage. The master hands out the units and receives the results;
+// the workers process them. Both sides must run the stages in the same
+// order. Returns the time the stage took, in seconds. The master shows a
+// pacifier for the stage, unless pStageName is NULL because the caller
+// already has one running.
+double Distribute_Work( const char *pStageName, int nWorkUnits, DistributeProcessFn processFn, DistributeReceiveFn receiveFn );
+
+// The master publishes buf. Each worker blocks until it has a copy in buf.
+// The master answers these requests while it runs the next stage, so a
+// broadcast must be followed by a Distribute_Work() call.
+void Distribute_Broadcast( CUtlBuffer &buf );
+
+// Workers call this after their last stage. It disconnects and exits the
+// process. It does nothing on the master.
+void Distribute_WorkerFinished();
+
+// Closes the sockets. Registered with CmdLib_AtCleanup() by Distribute_Init().
+void Distribute_Shutdown();
+
+
+#endif // LOOPBACK_DISTRIBUTE_H
@@ -16,7 +16,8 @@
 #include "xbox\xbox_win32stubs.h"
 #endif
 #if defined(POSIX)
-#include "../../filesystem/linux_support.h"
+#include <dirent.h>
+#include <fnmatch.h>
 #include <sys/stat.h>
 #endif
 /*
@@ -1213,55 +1214,48 @@ int CScriptLib::GetFileList( const char* pDirPath, const char* pPattern, CUtlVec
 
 	_findclose( h );
 #elif defined(POSIX)
-	FIND_DATA findData;
-	Q_FixSlashes( fullPath );
-	void *h = FindFirstFile( fullPath, &findData );
-	if ( (int)h == -1 )
+	Q_FixSlashes( sourcePath );
+	DIR *pDir = opendir( sourcePath );
+	if ( !pDir )
 	{
 		return 0;
 	}
 
-	do
+	// Match the way _findfirst does on Windows: case insensitive, and "*" for directories.
+	const char *pMatch = bFindDirs ? "*" : pPattern;
+	while ( dirent *pEntry = readdir( pDir ) )
 	{
-		// dos attribute complexities i.e. _A_NORMAL is 0
-		if ( bFindDirs )
-		{
-			// skip non dirs
-			if ( !( findData.dwFileAttributes & S_IFDIR ) )
-				continue;
-		}
-		else
-		{
-			// skip dirs
-			if ( findData.dwFileAttributes & S_IFDIR )
-				continue;
-		}
+		if ( !stricmp( pEntry->d_name, "." ) )
+			continue;
 
-		if ( !stricmp( findData.cFileName, "." ) )
+		if ( !stricmp( pEntry->d_name, ".." ) )
 			continue;
 
-		if ( !stricmp( findData.cFileName, ".." ) )
+		if ( fnmatch( pMatch, pEntry->d_name, FNM_CASEFOLD ) != 0 )
 			continue;
 
 		char fileName[MAX_PATH];
 		strcpy( fileName, sourcePath );
-		strcat( fileName, findData.cFileName );
+		strcat( fileName, pEntry->d_name );
 
-		int j = fileList.AddToTail();
-		fileList[j].fileName.Set( fileName );
 		struct stat statbuf;
 		if ( stat( fileName, &statbuf ) )
+			continue;
+
+		// skip dirs when finding files and files when finding dirs
+		if ( S_ISDIR( statbuf.st_mode ) != bFindDirs )
+			continue;
+
+		int j = fileList.AddToTail();
+		fileList[j].fileName.Set( fileName );
 #ifdef OSX
-			fileList[j].timeWrite = statbuf.st_mtimespec.tv_sec;
+		fileList[j].timeWrite = statbuf.st_mtimespec.tv_sec;
 #else
-			fileList[j].timeWrite = statbuf.st_mtime;
+		fileList[j].timeWrite = statbuf.st_mtime;
 #endif
-		else
-			fileList[j].timeWrite = 0;
 	}
-	while ( !FindNextFile( h, &findData ) );
 
-	FindClose( h );
+	closedir( pDir );
 
 #else
 #error
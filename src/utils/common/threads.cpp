@@ -13,11 +13,16 @@
 
 #define	USED
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "cmdlib.h"
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
+#include "tier0/threadtools.h"
 
 #define	MAX_THREADS	16
 
@@ -40,7 +45,7 @@ qboolean		pacifier;
 qboolean	threaded;
 bool g_bLowPriorityThreads = false;
 
-HANDLE g_ThreadHandles[MAX_THREADS];
+ThreadHandle_t g_ThreadHandles[MAX_THREADS];
 
 
 
@@ -101,41 +106,41 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 /*
 ===================================================================
 
-WIN32
+Threads come from tier0, so this builds on Win32 and POSIX alike.
 
 ===================================================================
 */
 
 int		numthreads = -1;
-CRITICAL_SECTION		crit;
+CThreadMutex	crit;
 static int enter;
 
 
-class CCritInit
-{
-public:
-	CCritInit()
-	{
-		InitializeCriticalSection (&crit);
-	}
-} g_CritInit;
-
-
 
 void SetLowPriority()
 {
+#ifdef _WIN32
 	SetPriorityClass( GetCurrentProcess(), IDLE_PRIORITY_CLASS );
+#else
+	nice( 19 );
+#endif
 }
 
 
-void ThreadSetDefault (void)
+// Per-thread priorities only mean something to the Windows scheduler.
+static void SetToolThreadPriority( ThreadHandle_t hThread, bool bIdle )
 {
-	SYSTEM_INFO info;
+#ifdef _WIN32
+	ThreadSetPriority( hThread, bIdle ? THREAD_PRIORITY_IDLE : THREAD_PRIORITY_LOWEST );
+#endif
+}
+
 
+void ThreadSetDefault (void)
+{
 	if (numthreads == -1)	// not set manually
 	{
-		GetSystemInfo (&info);
-		numthreads = info.dwNumberOfProcessors;
+		numthreads = GetCPUInformation()->m_nLogicalProcessors;
 		if (numthreads < 1 || numthreads > 32)
 			numthreads = 1;
 	}
@@ -148,7 +153,7 @@ void ThreadLock (void)
 {
 	if (!threaded)
 		return;
-	EnterCriticalSection (&crit);
+	crit.Lock();
 	if (enter)
 		Error ("Recursive ThreadLock\n");
 	enter = 1;
@@ -161,12 +166,12 @@ void ThreadUnlock (void)
 	if (!enter)
 		Error ("ThreadUnlock without lock\n");
 	enter = 0;
-	LeaveCriticalSection (&crit);
+	crit.Unlock();
 }
 
 
 // This runs in the thread and dispatches a RunThreadsFn call.
-DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
+unsigned InternalRunThreadsFn( void *pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
@@ -188,23 +193,18 @@ void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePr
 		g_RunThreadsData[i].m_pUserData = pUserData;
 		g_RunThreadsData[i].m_Fn = fn;
 
-		DWORD dwDummy;
-		g_ThreadHandles[i] = CreateThread(
-		   NULL,	// LPSECURITY_ATTRIBUTES lpsa,
-		   0,		// DWORD cbStack,
-		   InternalRunThreadsFn,	// LPTHREAD_START_ROUTINE lpStartAddr,
-		   &g_RunThreadsData[i],	// LPVOID lpvThreadParm,
-		   0,			// DWORD fdwCreate,
-		   &dwDummy );
+		g_ThreadHandles[i] = CreateSimpleThread( InternalRunThreadsFn, &g_RunThreadsData[i] );
+		if ( !g_ThreadHandles[i] )
+			Error( "RunThreads_Start: failed to create thread %d\n", i );
 
 		if ( ePriority == k_eRunThreadsPriority_UseGlobalState )
 		{
 			if( g_bLowPriorityThreads )
-				SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_LOWEST );
+				SetToolThreadPriority( g_ThreadHandles[i], false );
 		}
 		else if ( ePriority == k_eRunThreadsPriority_Idle )
 		{
-			SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_IDLE );
+			SetToolThreadPriority( g_ThreadHandles[i], true );
 		}
 	}
 }
@@ -212,14 +212,54 @@ void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePr
 
 void RunThreads_End()
 {
-	WaitForMultipleObjects( numthreads, g_ThreadHandles, TRUE, INFINITE );
 	for ( int i=0; i < numthreads; i++ )
-		CloseHandle( g_ThreadHandles[i] );
+	{
+		ThreadJoin( g_ThreadHandles[i] );
+		ReleaseThreadHandle( g_ThreadHandles[i] );
+	}
 
 	threaded = false;
 }
 	
 
+void RunThreadsNested( int nThreads, RunThreadsFn fn, void *pUserData )
+{
+	CRunThreadsData data[MAX_TOOL_THREADS];
+	ThreadHandle_t handles[MAX_TOOL_THREADS];
+
+	if ( nThreads > MAX_TOOL_THREADS )
+		nThreads = MAX_TOOL_THREADS;
+
+	int nSaveThreads = numthreads;
+	qboolean bSaveThreaded = threaded;
+	numthreads = nThreads;
+	threaded = true;
+
+	for ( int i=0; i < nThreads; i++ )
+	{
+		data[i].m_iThread = i;
+		data[i].m_pUserData = pUserData;
+		data[i].m_Fn = fn;
+
+		handles[i] = CreateSimpleThread( InternalRunThreadsFn, &data[i] );
+		if ( !handles[i] )
+			Error( "RunThreadsNested: failed to create thread %d\n", i );
+
+		if ( g_bLowPriorityThreads )
+			SetToolThreadPriority( handles[i], false );
+	}
+
+	for ( int i=0; i < nThreads; i++ )
+	{
+		ThreadJoin( handles[i] );
+		ReleaseThreadHandle( handles[i] );
+	}
+
+	threaded = bSaveThreaded;
+	numthreads = nSaveThreads;
+}
+
+
 /*
 =============
 RunThreadsOn
@@ -53,6 +53,12 @@ void RunThreadsOn ( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *p
 void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority=k_eRunThreadsPriority_UseGlobalState );
 void RunThreads_End();
 
+// Runs fn on nThreads threads of its own and waits for them to finish. This
+// doesn't use the work dispatch or pacifier of RunThreadsOn(), so it can be
+// called from inside a single RunThreadsOn() worker. numthreads is set to
+// nThreads and ThreadLock() is live while the threads run.
+void RunThreadsNested( int nThreads, RunThreadsFn fn, void *pUserData );
+
 void ThreadLock (void);
 void ThreadUnlock (void);
 
@@ -5,10 +5,13 @@
 // $NoKeywords: $
 //=============================================================================//
 
+#include "tools_minidump.h"
+
+#ifdef _WIN32
+
 #include <windows.h>
 #include <dbghelp.h>
 #include "tier0/minidump.h"
-#include "tools_minidump.h"
 
 static bool g_bToolsWriteFullMinidumps = false;
 static ToolsExceptionHandler g_pCustomExceptionHandler = NULL;
@@ -59,3 +62,22 @@ void SetupToolsMinidumpHandler( ToolsExceptionHandler fn )
 	g_pCustomExceptionHandler = fn;
 	SetUnhandledExceptionFilter( ToolsExceptionFilter_Custom );
 }
+
+#else
+
+// Minidumps are a Windows thing; elsewhere a crash leaves a core file instead.
+void EnableFullMinidumps( bool bFull )
+{
+}
+
+
+void SetupDefaultToolsMinidumpHandler()
+{
+}
+
+
+void SetupToolsMinidumpHandler( ToolsExceptionHandler fn )
+{
+}
+
+#endif // _WIN32
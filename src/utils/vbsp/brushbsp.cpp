@@ -7,12 +7,20 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier0/threadtools.h"
 
 
 int		c_nodes;
 int		c_nonvis;
 int		c_active_brushes;
 
+int		g_nBrushBSPThreads = 1;
+
+// Nodes with at least this many brushes are split one at a time, with their
+// candidate planes spread over the threads. Smaller subtrees are queued and
+// each one is built whole by a single thread.
+#define	BUILDTREE_JOB_BRUSHES	256
+
 // if a brush just barely pokes onto the other side,
 // let it slide by without chopping
 #define	PLANESIDE_EPSILON	0.001
@@ -316,11 +324,9 @@ node_t *AllocNode (void)
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = ThreadInterlockedIncrement( &s_NodeCount ) - 1;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
@@ -340,7 +346,7 @@ bspbrush_t *AllocBrush (int numsides)
 	c = (int)&(((bspbrush_t *)0)->sides[numsides]);
 	bb = (bspbrush_t*)malloc(c);
 	memset (bb, 0, c);
-	bb->id = s_BrushId++;
+	bb->id = ThreadInterlockedIncrement( &s_BrushId ) - 1;
 	if (numthreads == 1)
 		c_active_brushes++;
 	return bb;
@@ -977,8 +983,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 		{
 			if (pass > 0)
 			{
-				if (numthreads == 1)
-					c_nonvis++;
+				ThreadInterlockedIncrement( &c_nonvis );
 			}
 			break;
 		}
@@ -997,6 +1002,206 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 }
 
 
+//-----------------------------------------------------------------------------
+// SelectSplitSide for the large nodes at the top of the tree. Each distinct
+// plane is tested on its own thread, and the results are then scored in the
+// same order SelectSplitSide walks the sides, so the same side wins.
+//-----------------------------------------------------------------------------
+struct splitcandidate_t
+{
+	side_t		*side;		// first side on the plane, which the score uses
+	int			pnum;
+	qboolean	valid;		// false if it would produce a tiny volume
+	qboolean	hintsplit;	// as left by the last brush, like SelectSplitSide
+	int			front, back, facing, splits, epsilonbrush;
+};
+
+struct splitcandidatework_t
+{
+	bspbrush_t			*brushes;
+	node_t				*node;
+	splitcandidate_t	*candidates;
+	int					count;
+	int volatile		next;
+};
+
+static void TestSplitCandidate (bspbrush_t *brushes, node_t *node, splitcandidate_t *cand)
+{
+	bspbrush_t	*test;
+	int			s, bsplits;
+
+	cand->hintsplit = false;
+	cand->front = cand->back = cand->facing = cand->splits = cand->epsilonbrush = 0;
+
+	cand->valid = CheckPlaneAgainstVolume (cand->pnum, node);
+	if (!cand->valid)
+		return;
+
+	for (test = brushes ; test ; test=test->next)
+	{
+		s = TestBrushToPlanenum (test, cand->pnum, &bsplits, &cand->hintsplit, &cand->epsilonbrush);
+
+		cand->splits += bsplits;
+		if (bsplits && (s&PSIDE_FACING) )
+			Error ("PSIDE_FACING with splits");
+
+		if (s & PSIDE_FACING)
+			cand->facing++;
+		if (s & PSIDE_FRONT)
+			cand->front++;
+		if (s & PSIDE_BACK)
+			cand->back++;
+	}
+}
+
+static void SelectSplitSide_Thread (int iThread, void *pUserData)
+{
+	splitcandidatework_t *work = (splitcandidatework_t *)pUserData;
+
+	while (1)
+	{
+		int i = ThreadInterlockedIncrement( &work->next ) - 1;
+		if (i >= work->count)
+			break;
+
+		TestSplitCandidate (work->brushes, work->node, &work->candidates[i]);
+	}
+}
+
+static side_t *SelectSplitSide_Threaded (bspbrush_t *brushes, node_t *node)
+{
+	int			value, bestvalue;
+	bspbrush_t	*brush, *test;
+	side_t		*side, *bestside;
+	int			i, pass, numpasses;
+	int			pnum, bestpnum;
+	int			bsplits, epsilonbrush;
+	qboolean	hintsplit;
+
+	bestside = NULL;
+	bestvalue = -99999;
+	bestpnum = -1;
+
+	// SelectSplitSide flags the sides on a plane once it has tested it. A
+	// plane that fails the volume check fails it again, so each plane is
+	// only ever tested once here.
+	CUtlVector<unsigned char> planeSeen;
+	planeSeen.SetCount (g_MainMap->nummapplanes);
+	memset (planeSeen.Base(), 0, planeSeen.Count());
+
+	CUtlVector<splitcandidate_t> candidates;
+
+	numpasses = 2;
+	for (pass = 0 ; pass < numpasses ; pass++)
+	{
+		candidates.RemoveAll ();
+
+		for (brush = brushes ; brush ; brush=brush->next)
+		{
+			for (i=0 ; i<brush->numsides ; i++)
+			{
+				side = brush->sides + i;
+
+				if (side->bevel)
+					continue;
+				if (!side->winding)
+					continue;
+				if (side->texinfo == TEXINFO_NODE)
+					continue;
+				if (side->tested)
+					continue;
+				if (side->surf & SURF_SKIP)
+					continue;
+				if ( side->visible ^ (pass<1) )
+					continue;
+
+				pnum = side->planenum;
+				pnum &= ~1;
+
+				if (planeSeen[pnum])
+					continue;
+				planeSeen[pnum] = 1;
+
+				CheckPlaneAgainstParents (pnum, node);
+
+				splitcandidate_t &cand = candidates[candidates.AddToTail()];
+				cand.side = side;
+				cand.pnum = pnum;
+			}
+		}
+
+		splitcandidatework_t work;
+		work.brushes = brushes;
+		work.node = node;
+		work.candidates = candidates.Base();
+		work.count = candidates.Count();
+		work.next = 0;
+
+		if (work.count > 1)
+			RunThreadsNested (min (g_nBrushBSPThreads, work.count), SelectSplitSide_Thread, &work);
+		else
+			SelectSplitSide_Thread (0, &work);
+
+		// same scoring as SelectSplitSide
+		for (i=0 ; i<candidates.Count() ; i++)
+		{
+			splitcandidate_t &cand = candidates[i];
+			if (!cand.valid)
+				continue;
+
+			side = cand.side;
+			value =  5*cand.facing - 5*cand.splits - abs(cand.front-cand.back);
+			if (g_MainMap->mapplanes[cand.pnum].type < 3)
+				value+=5;
+			value -= cand.epsilonbrush*1000;
+
+			if ( side->surf & SURF_TRANS )
+			{
+				value -= 500;
+			}
+
+			if (cand.hintsplit && !(side->surf & SURF_HINT) )
+				value = -9999999;
+
+			if (side->contents & (CONTENTS_WATER | CONTENTS_SLIME))
+				value = 9999999;
+
+			if (value > bestvalue)
+			{
+				bestvalue = value;
+				bestside = side;
+				bestpnum = cand.pnum;
+			}
+		}
+
+		if (bestside)
+		{
+			if (pass > 0)
+			{
+				ThreadInterlockedIncrement( &c_nonvis );
+			}
+			break;
+		}
+	}
+
+	if (bestside)
+	{
+		// SplitBrushList reads the side of each brush from the winning test
+		epsilonbrush = 0;
+		for (test = brushes ; test ; test=test->next)
+			test->side = TestBrushToPlanenum (test, bestpnum, &bsplits, &hintsplit, &epsilonbrush);
+	}
+
+	for (brush = brushes ; brush ; brush=brush->next)
+	{
+		for (i=0 ; i<brush->numsides ; i++)
+			brush->sides[i].tested = false;
+	}
+
+	return bestside;
+}
+
+
 /*
 ==================
 BrushMostlyOnSide
@@ -1331,6 +1536,26 @@ BuildTree_r
 */
 
 
+//-----------------------------------------------------------------------------
+// While the top of the tree is built, subtrees below BUILDTREE_JOB_BRUSHES
+// are queued here instead of recursed into.
+//-----------------------------------------------------------------------------
+struct buildtreejob_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+	int			numbrushes;
+};
+
+struct buildtreework_t
+{
+	buildtreejob_t	*jobs;
+	int				count;
+	int volatile	next;
+};
+
+static CUtlVector<buildtreejob_t> *s_pBuildTreeJobs = NULL;
+
 node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 {
 	node_t		*newnode;
@@ -1338,11 +1563,13 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	int			i;
 	bspbrush_t	*children[2];
 
-	if (numthreads == 1)
-		c_nodes++;
+	ThreadInterlockedIncrement( &c_nodes );
 
 	// find the best plane to use as a splitter
-	bestside = SelectSplitSide (brushes, node);
+	if (s_pBuildTreeJobs)
+		bestside = SelectSplitSide_Threaded (brushes, node);
+	else
+		bestside = SelectSplitSide (brushes, node);
 
 	if (!bestside)
 	{
@@ -1374,11 +1601,95 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	// recursively process children
 	for (i=0 ; i<2 ; i++)
 	{
+		if (s_pBuildTreeJobs)
+		{
+			int numbrushes = CountBrushList (children[i]);
+			if (numbrushes < BUILDTREE_JOB_BRUSHES)
+			{
+				buildtreejob_t &job = (*s_pBuildTreeJobs)[s_pBuildTreeJobs->AddToTail()];
+				job.node = node->children[i];
+				job.brushes = children[i];
+				job.numbrushes = numbrushes;
+				continue;
+			}
+		}
+
 		node->children[i] = BuildTree_r (node->children[i], children[i]);
 	}
 
 	return node;
 }
+
+static void BuildTree_Thread (int iThread, void *pUserData)
+{
+	buildtreework_t *work = (buildtreework_t *)pUserData;
+
+	while (1)
+	{
+		int i = ThreadInterlockedIncrement( &work->next ) - 1;
+		if (i >= work->count)
+			break;
+
+		BuildTree_r (work->jobs[i].node, work->jobs[i].brushes);
+	}
+}
+
+static int BuildTreeJobCompare (const buildtreejob_t *a, const buildtreejob_t *b)
+{
+	return b->numbrushes - a->numbrushes;
+}
+
+/*
+================
+RenumberNodes_r
+
+Gives the nodes the ids AllocNode hands out when BuildTree_r runs on one thread
+================
+*/
+static void RenumberNodes_r (node_t *node, int &nextid)
+{
+	if (node->planenum == PLANENUM_LEAF)
+		return;
+
+	node->children[0]->id = nextid++;
+	node->children[1]->id = nextid++;
+	RenumberNodes_r (node->children[0], nextid);
+	RenumberNodes_r (node->children[1], nextid);
+}
+
+/*
+================
+BuildTree_Threaded
+
+Splits the nodes above BUILDTREE_JOB_BRUSHES on this thread, then builds
+the queued subtrees on g_nBrushBSPThreads threads, largest first.
+================
+*/
+static node_t *BuildTree_Threaded (node_t *node, bspbrush_t *brushes)
+{
+	CUtlVector<buildtreejob_t> jobs;
+
+	s_pBuildTreeJobs = &jobs;
+	BuildTree_r (node, brushes);
+	s_pBuildTreeJobs = NULL;
+
+	jobs.Sort (BuildTreeJobCompare);
+
+	buildtreework_t work;
+	work.jobs = jobs.Base();
+	work.count = jobs.Count();
+	work.next = 0;
+
+	if (work.count > 1)
+		RunThreadsNested (min (g_nBrushBSPThreads, work.count), BuildTree_Thread, &work);
+	else
+		BuildTree_Thread (0, &work);
+
+	int nextid = node->id + 1;
+	RenumberNodes_r (node, nextid);
+
+	return node;
+}
 	  
 
 //===========================================================
@@ -1447,7 +1758,11 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 
 	tree->headnode = node;
 
-	node = BuildTree_r (node, brushlist);
+	// Only split the work up when we aren't already on one of many threads.
+	if (g_nBrushBSPThreads > 1 && numthreads == 1 && c_brushes >= BUILDTREE_JOB_BRUSHES)
+		node = BuildTree_Threaded (node, brushlist);
+	else
+		node = BuildTree_r (node, brushlist);
 	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
 	qprintf ("%5i leafs\n", (c_nodes+1)/2);
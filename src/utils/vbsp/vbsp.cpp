@@ -1277,6 +1277,7 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
+	g_nBrushBSPThreads = numthreads;
 	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
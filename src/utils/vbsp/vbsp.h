@@ -483,6 +483,10 @@ node_t	*PointInLeaf (node_t *node, Vector& point);
 
 tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs);
 
+// Number of threads BrushBSP spreads a large tree over. The tree is the same
+// as the one a single thread builds.
+extern int	g_nBrushBSPThreads;
+
 #define	PSIDE_FRONT			1
 #define	PSIDE_BACK			2
 #define	PSIDE_BOTH			(PSIDE_FRONT|PSIDE_BACK)
@@ -0,0 +1,224 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vrad stages that can run on -distribute worker processes. These
+//			mirror the work units in mpivrad.cpp: one face per unit for
+//			BuildFacelights and one cluster per unit for BuildVisLeafs.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "vismat.h"
+#include "threads.h"
+#include "utlbuffer.h"
+#include "distributevrad.h"
+
+
+extern int total_transfer;
+extern int max_transfer;
+
+extern void BuildPatchLights( int facenum );
+
+
+//-----------------------------------------------------------------------------
+// BuildFacelights.
+//-----------------------------------------------------------------------------
+static void DistributeProcessFace( int iThread, int iFace, CUtlBuffer &buf )
+{
+	BuildFacelights( iThread, iFace );
+
+	dface_t *f = &g_pFaces[iFace];
+	facelight_t *fl = &facelight[iFace];
+
+	buf.Put( f, sizeof( dface_t ) );
+	buf.Put( fl, sizeof( facelight_t ) );
+	buf.Put( fl->sample, fl->numsamples * sizeof( sample_t ) );
+
+	for ( int i=0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n=0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			if ( fl->light[i][n] )
+				buf.Put( fl->light[i][n], fl->numsamples * sizeof( LightingValue_t ) );
+		}
+	}
+
+	if ( fl->luxel )
+		buf.Put( fl->luxel, fl->numluxels * sizeof( Vector ) );
+
+	if ( fl->luxelNormals )
+		buf.Put( fl->luxelNormals, fl->numluxels * sizeof( Vector ) );
+}
+
+static void DistributeReceiveFace( int iFace, CUtlBuffer &buf, int iWorker )
+{
+	dface_t *f = &g_pFaces[iFace];
+	facelight_t *fl = &facelight[iFace];
+
+	buf.Get( f, sizeof( dface_t ) );
+	buf.Get( fl, sizeof( facelight_t ) );
+
+	fl->sample = (sample_t *)calloc( fl->numsamples, sizeof( sample_t ) );
+	buf.Get( fl->sample, fl->numsamples * sizeof( sample_t ) );
+
+	// The windings point into the worker's memory.
+	for ( int i=0; i < fl->numsamples; i++ )
+	{
+		fl->sample[i].w = NULL;
+	}
+
+	for ( int i=0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n=0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			if ( fl->light[i][n] )
+			{
+				fl->light[i][n] = (LightingValue_t *)calloc( fl->numsamples, sizeof( LightingValue_t ) );
+				buf.Get( fl->light[i][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+	}
+
+	if ( fl->luxel )
+	{
+		fl->luxel = (Vector *)calloc( fl->numluxels, sizeof( Vector ) );
+		buf.Get( fl->luxel, fl->numluxels * sizeof( Vector ) );
+	}
+
+	if ( fl->luxelNormals )
+	{
+		fl->luxelNormals = (Vector *)calloc( fl->numluxels, sizeof( Vector ) );
+		buf.Get( fl->luxelNormals, fl->numluxels * sizeof( Vector ) );
+	}
+
+	if ( !buf.IsValid() )
+		Error( "DistributeReceiveFace: bad results for face %d from worker %d.\n", iFace, iWorker );
+}
+
+void RunDistributeBuildFacelights()
+{
+	Distribute_Work( "BuildFaceLights:", numfaces, DistributeProcessFace, DistributeReceiveFace );
+
+	// BuildFacelights() leaves this to the master, as with VMPI.
+	if ( g_bDistributeMaster )
+	{
+		for ( int i=0; i < numfaces; ++i )
+		{
+			BuildPatchLights( i );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// BuildVisLeafs.
+//-----------------------------------------------------------------------------
+static transfer_t *s_pDistributeTransfers[MAX_TOOL_THREADS+1];
+static CUtlBuffer *s_pDistributeVisLeafsBuf[MAX_TOOL_THREADS+1];
+
+static void DistributeAddPatchData( int iThread, int patchnum, CPatch *patch )
+{
+	CUtlBuffer &buf = *s_pDistributeVisLeafsBuf[iThread];
+	buf.PutInt( patchnum );
+	buf.PutInt( patch->numtransfers );
+	buf.Put( patch->transfers, patch->numtransfers * sizeof( transfer_t ) );
+
+	// Only the master bounces light, so the worker's copy isn't needed.
+	free( patch->transfers );
+	patch->transfers = NULL;
+	patch->numtransfers = 0;
+}
+
+static void DistributeProcessVisLeafs( int iThread, int iCluster, CUtlBuffer &buf )
+{
+	if ( !s_pDistributeTransfers[iThread] )
+		s_pDistributeTransfers[iThread] = BuildVisLeafs_Start();
+
+	s_pDistributeVisLeafsBuf[iThread] = &buf;
+	BuildVisLeafs_Cluster( iThread, s_pDistributeTransfers[iThread], iCluster, DistributeAddPatchData );
+	s_pDistributeVisLeafsBuf[iThread] = NULL;
+}
+
+static void DistributeReceiveVisLeafs( int iCluster, CUtlBuffer &buf, int iWorker )
+{
+	while ( buf.GetBytesRemaining() > 0 )
+	{
+		int patchnum = buf.GetInt();
+		int numtransfers = buf.GetInt();
+		if ( !buf.IsValid() || patchnum < 0 || patchnum >= g_Patches.Count() || numtransfers < 0 )
+			Error( "DistributeReceiveVisLeafs: bad results for cluster %d from worker %d.\n", iCluster, iWorker );
+
+		CPatch *patch = &g_Patches[patchnum];
+		patch->numtransfers = numtransfers;
+		if ( numtransfers )
+		{
+			patch->transfers = (transfer_t *)calloc( numtransfers, sizeof( transfer_t ) );
+			buf.Get( patch->transfers, numtransfers * sizeof( transfer_t ) );
+		}
+
+		total_transfer += numtransfers;
+		if ( max_transfer < numtransfers )
+			max_transfer = numtransfers;
+	}
+}
+
+void RunDistributeBuildVisLeafs()
+{
+	memset( s_pDistributeTransfers, 0, sizeof( s_pDistributeTransfers ) );
+
+	Distribute_Work( "BuildVisLeafs:", dvis->numclusters, DistributeProcessVisLeafs, DistributeReceiveVisLeafs );
+
+	for ( int i=0; i < ARRAYSIZE( s_pDistributeTransfers ); i++ )
+	{
+		if ( s_pDistributeTransfers[i] )
+			BuildVisLeafs_End( s_pDistributeTransfers[i] );
+		s_pDistributeTransfers[i] = NULL;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Same layout as VMPI_DistributeLightData(): the light lump followed by the
+// styles and light offset of every face.
+//-----------------------------------------------------------------------------
+void DistributeLightData()
+{
+	if ( !g_bDistribute )
+		return;
+
+	CUtlBuffer lightFaceData;
+
+	if ( g_bDistributeMaster )
+	{
+		lightFaceData.PutInt( pdlightdata->Count() );
+		lightFaceData.Put( pdlightdata->Base(), pdlightdata->Count() );
+		for ( int i = 0; i < numfaces; i++ )
+		{
+			for ( int j = 0; j < MAXLIGHTMAPS; j++ )
+			{
+				lightFaceData.PutChar( g_pFaces[i].styles[j] );
+			}
+			lightFaceData.PutInt( g_pFaces[i].lightofs );
+		}
+
+		Distribute_Broadcast( lightFaceData );
+		return;
+	}
+
+	Distribute_Broadcast( lightFaceData );
+
+	int lightSize = lightFaceData.GetInt();
+	pdlightdata->SetCount( lightSize );
+	lightFaceData.Get( pdlightdata->Base(), lightSize );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		for ( int j = 0; j < MAXLIGHTMAPS; j++ )
+		{
+			g_pFaces[i].styles[j] = lightFaceData.GetChar();
+		}
+		g_pFaces[i].lightofs = lightFaceData.GetInt();
+	}
+
+	if ( !lightFaceData.IsValid() )
+		Error( "DistributeLightData: bad light data from the master.\n" );
+}
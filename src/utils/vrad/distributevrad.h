@@ -0,0 +1,24 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vrad stages that can run on -distribute worker processes.
+//
+//=============================================================================//
+
+#ifndef DISTRIBUTEVRAD_H
+#define DISTRIBUTEVRAD_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "loopback_distribute.h"
+
+
+void	RunDistributeBuildFacelights();
+void	RunDistributeBuildVisLeafs();
+
+// Sends the finished lightmaps from the master to the workers, which need
+// them for the static prop and leaf ambient stages.
+void	DistributeLightData();
+
+
+#endif // DISTRIBUTEVRAD_H
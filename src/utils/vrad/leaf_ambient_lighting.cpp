@@ -13,9 +13,12 @@
 #include "coordsize.h"
 #include "vstdlib/random.h"
 #include "bsptreedata.h"
+#ifdef MPI
 #include "messbuf.h"
 #include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#endif
+#include "loopback_distribute.h"
 
 static TableVector g_BoxDirections[6] = 
 {
@@ -54,47 +57,18 @@ static void ComputeAmbientFromSurface( dface_t *surfID, dworldlight_t* pSkylight
 }
 
 
-// TODO: it's CRAZY how much lighting code we share with the engine. It should all be shared code.
-float Engine_WorldLightAngle( const dworldlight_t *wl, const Vector& lnormal, const Vector& snormal, const Vector& delta )
-{
-	float dot, dot2;
-
-	Assert( wl->type == emit_surface );
-
-	dot = DotProduct( snormal, delta );
-	if (dot < 0)
-		return 0;
-
-	dot2 = -DotProduct (delta, lnormal);
-	if (dot2 <= ON_EPSILON/10)
-		return 0; // behind light surface
-
-	return dot * dot2;
-}
-
-
-// TODO: it's CRAZY how much lighting code we share with the engine. It should all be shared code.
-float Engine_WorldLightDistanceFalloff( const dworldlight_t *wl, const Vector& delta )
-{
-	Assert( wl->type == emit_surface );
-
-	// Cull out stuff that's too far
-	if (wl->radius != 0)
-	{
-		if ( DotProduct( delta, delta ) > (wl->radius * wl->radius))
-			return 0.0f;
-	}
-
-	return InvRSquared(delta);
-}
-
-
-void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
+//-----------------------------------------------------------------------------
+// Adds the emit_surface lights to the ambient cubes of up to four sample
+// points at once. This is the engine's emit_surface falloff (see
+// WorldLightDistanceFalloff and WorldLightAngle in the engine) evaluated for
+// the whole packet. A light is culled by its radius and by which side of it
+// the packet is on before any rays are traced.
+//-----------------------------------------------------------------------------
+static void AddEmitSurfaceLights4( const FourVectors &vStart4, int numSamples, Vector lightBoxColor[][6] )
 {
+	const int validMask = ( 1 << numSamples ) - 1;
 	fltx4 fractionVisible;
-
-	FourVectors vStart4, wlOrigin4;
-	vStart4.DuplicateVector ( vStart );
+	FourVectors wlOrigin4, wlNormal4;
 
 	for ( int iLight=0; iLight < *pNumworldlights; iLight++ )
 	{
@@ -106,33 +80,72 @@ void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
 
 		Assert( wl->type == emit_surface );
 
-		// Can this light see the point?
-		wlOrigin4.DuplicateVector ( wl->origin );
-		TestLine ( vStart4, wlOrigin4, &fractionVisible );
-		if ( !TestSignSIMD ( CmpGtSIMD ( fractionVisible, Four_Zeros ) ) )
+		wlOrigin4.DuplicateVector( wl->origin );
+		wlNormal4.DuplicateVector( wl->normal );
+
+		FourVectors vDelta4 = wlOrigin4;
+		vDelta4 -= vStart4;
+		fltx4 dist2 = vDelta4.length2();
+
+		// Behind the light surface? The sign doesn't need the delta normalized.
+		fltx4 contributes = CmpLtSIMD( vDelta4 * wlNormal4, Four_Zeros );
+
+		// Cull out stuff that's too far
+		if ( wl->radius != 0 )
+		{
+			contributes = AndSIMD( contributes, CmpLeSIMD( dist2, ReplicateX4( wl->radius * wl->radius ) ) );
+		}
+
+		if ( !( TestSignSIMD( contributes ) & validMask ) )
+			continue;
+
+		// Can this light see the points?
+		TestLine( vStart4, wlOrigin4, &fractionVisible );
+		contributes = AndSIMD( contributes, CmpGtSIMD( fractionVisible, Four_Zeros ) );
+		if ( !( TestSignSIMD( contributes ) & validMask ) )
 			continue;
 
-		// Add this light's contribution.
-		Vector vDelta = wl->origin - vStart;
-		float flDistanceScale = Engine_WorldLightDistanceFalloff( wl, vDelta );
+		// Add this light's contribution. The falloff and the normalization use
+		// the same estimates as InvRSquared() and VectorNormalize() do in x86
+		// builds, so the cubes match the ones lit one point at a time.
+		fltx4 dist2Eps = AddSIMD( dist2, ReplicateX4( 1.0e-10f ) );
+		fltx4 flDistanceScale = ReciprocalEstSIMD( MaxSIMD( Four_Ones, dist2Eps ) );
+
+		FourVectors vDeltaNorm4 = vDelta4;
+		vDeltaNorm4 *= ReciprocalSqrtSIMD( dist2Eps );
 
-		Vector vDeltaNorm = vDelta;
-		VectorNormalize( vDeltaNorm );
-		float flAngleScale = Engine_WorldLightAngle( wl, wl->normal, vDeltaNorm, vDeltaNorm );
+		// Engine_WorldLightAngle() with the light direction as the surface normal.
+		fltx4 flAngleScale = NegSIMD( vDeltaNorm4 * wlNormal4 );
+		contributes = AndSIMD( contributes, CmpGtSIMD( flAngleScale, ReplicateX4( ON_EPSILON / 10 ) ) );
+		flAngleScale = MulSIMD( vDeltaNorm4.length2(), flAngleScale );
 
-		float ratio = flDistanceScale * flAngleScale * SubFloat ( fractionVisible, 0 );
-		if ( ratio == 0 )
+		fltx4 ratio = MulSIMD( MulSIMD( flDistanceScale, flAngleScale ), fractionVisible );
+		ratio = AndSIMD( contributes, ratio );
+		if ( IsAllZeros( ratio ) )
 			continue;
 
-		for ( int i=0; i < 6; i++ )
+		// The box directions are the axes, so the dot product with each
+		// of them is one component of the light direction.
+		fltx4 t[6];
+		t[0] = MulSIMD( MaxSIMD( vDeltaNorm4.x, Four_Zeros ), ratio );
+		t[1] = MulSIMD( MaxSIMD( NegSIMD( vDeltaNorm4.x ), Four_Zeros ), ratio );
+		t[2] = MulSIMD( MaxSIMD( vDeltaNorm4.y, Four_Zeros ), ratio );
+		t[3] = MulSIMD( MaxSIMD( NegSIMD( vDeltaNorm4.y ), Four_Zeros ), ratio );
+		t[4] = MulSIMD( MaxSIMD( vDeltaNorm4.z, Four_Zeros ), ratio );
+		t[5] = MulSIMD( MaxSIMD( NegSIMD( vDeltaNorm4.z ), Four_Zeros ), ratio );
+
+		for ( int s = 0; s < numSamples; s++ )
 		{
-			float t = DotProduct( g_BoxDirections[i], vDeltaNorm );
-			if ( t > 0 )
+			for ( int i=0; i < 6; i++ )
 			{
-				lightBoxColor[i] += wl->intensity * (t * ratio);
+				float flScale = SubFloat( t[i], s );
+				if ( flScale > 0 )
+				{
+					lightBoxColor[s][i] += wl->intensity * flScale;
+				}
 			}
 		}
-	}	
+	}
 }
 
 
@@ -173,10 +186,41 @@ void ComputeAmbientFromSphericalSamples( int iThread, const Vector &vStart, Vect
 		
 		lightBoxColor[j] *= 1/t;
 	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Ambient cubes for up to four sample points. The rays into the world are
+// traced one point at a time; the direct light from the emit_surface lights
+// is gathered for the whole packet.
+//-----------------------------------------------------------------------------
+static void ComputeAmbientAt4Points( int iThread, const Vector *pStart, int numSamples, Vector lightBoxColor[][6] )
+{
+	Assert( numSamples >= 1 && numSamples <= 4 );
+
+	for ( int s = 0; s < numSamples; s++ )
+	{
+		ComputeAmbientFromSphericalSamples( iThread, pStart[s], lightBoxColor[s] );
+	}
 
 	// Now add direct light from the emit_surface lights. These go in the ambient cube because
 	// there are a ton of them and they are often so dim that they get filtered out by r_worldlightmin.
-	AddEmitSurfaceLights( vStart, lightBoxColor );
+	FourVectors vStart4;
+	if ( g_bTextureShadows )
+	{
+		// The coverage a ray picks up depends on the rays it is traced with,
+		// so with texture shadows each point gets its own trace.
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			vStart4.DuplicateVector( pStart[s] );
+			AddEmitSurfaceLights4( vStart4, 1, &lightBoxColor[s] );
+		}
+		return;
+	}
+
+	// Unused lanes repeat the last point and are masked out.
+	vStart4.LoadAndSwizzle( pStart[0], pStart[min( 1, numSamples - 1 )], pStart[min( 2, numSamples - 1 )], pStart[numSamples - 1] );
+	AddEmitSurfaceLights4( vStart4, numSamples, lightBoxColor );
 }
 
 
@@ -550,15 +594,22 @@ void ComputeAmbientForLeaf( int iThread, int leafID, CUtlVector<ambientsample_t>
 		// NOTE: We copy the nearest non-solid leaf sample pointers into this leaf at the end
 		return;
 	}
-	Vector cube[6];
-	for ( int i = 0; i < sampleCount; i++ )
+	Vector samplePositions[4];
+	Vector cubes[4][6];
+	for ( int i = 0; i < sampleCount; i += 4 )
 	{
-		// compute each candidate sample and add to the list
-		Vector samplePosition;
-		sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samplePosition );
-		ComputeAmbientFromSphericalSamples( iThread, samplePosition, cube );
-		// note this will remove the least valuable sample once the limit is reached
-		AddSampleToList( list, samplePosition, cube );
+		// compute the candidate samples four at a time and add them to the list in order
+		int numSamples = min( 4, sampleCount - i );
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samplePositions[s] );
+		}
+		ComputeAmbientAt4Points( iThread, samplePositions, numSamples, cubes );
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			// note this will remove the least valuable sample once the limit is reached
+			AddSampleToList( list, samplePositions[s], cubes[s] );
+		}
 	}
 
 	// remove any samples that can be reconstructed with the remaining data
@@ -584,6 +635,7 @@ static void ThreadComputeLeafAmbient( int iThread, void *pUserData )
 	}
 }
 
+#ifdef MPI
 void VMPI_ProcessLeafAmbient( int iThread, uint64 iLeaf, MessageBuffer *pBuf )
 {
 	CUtlVector<ambientsample_t> list;
@@ -615,6 +667,27 @@ void VMPI_ReceiveLeafAmbientResults( uint64 leafID, MessageBuffer *pBuf, int iWo
 		pBuf->read(g_LeafAmbientSamples[leafID].Base(), nSamples * sizeof(ambientsample_t) );
 	}
 }
+#endif
+
+
+static void Distribute_ProcessLeafAmbient( int iThread, int iLeaf, CUtlBuffer &buf )
+{
+	CUtlVector<ambientsample_t> list;
+	ComputeAmbientForLeaf( iThread, iLeaf, list );
+
+	buf.PutInt( list.Count() );
+	buf.Put( list.Base(), list.Count() * sizeof( ambientsample_t ) );
+}
+
+static void Distribute_ReceiveLeafAmbientResults( int iLeaf, CUtlBuffer &buf, int iWorker )
+{
+	int nSamples = buf.GetInt();
+	g_LeafAmbientSamples[iLeaf].SetCount( nSamples );
+	buf.Get( g_LeafAmbientSamples[iLeaf].Base(), nSamples * sizeof( ambientsample_t ) );
+
+	if ( !buf.IsValid() )
+		Error( "Distribute_ReceiveLeafAmbientResults: bad results for leaf %d from worker %d.\n", iLeaf, iWorker );
+}
 
 
 void ComputePerLeafAmbientLighting()
@@ -642,6 +715,7 @@ void ComputePerLeafAmbientLighting()
 
 	g_LeafAmbientSamples.SetCount(numleafs);
 
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		// Distribute the work among the workers.
@@ -649,6 +723,12 @@ void ComputePerLeafAmbientLighting()
 		DistributeWork( numleafs, VMPI_DISTRIBUTEWORK_PACKETID, VMPI_ProcessLeafAmbient, VMPI_ReceiveLeafAmbientResults );
 	}
 	else
+#endif
+	if ( g_bDistribute )
+	{
+		Distribute_Work( "LeafAmbient:", numleafs, Distribute_ProcessLeafAmbient, Distribute_ReceiveLeafAmbientResults );
+	}
+	else
 	{
 		RunThreadsOn(numleafs, true, ThreadComputeLeafAmbient);
 	}
@@ -11,7 +11,10 @@
 #include "radial.h"
 #include "mathlib/bumpvects.h"
 #include "tier1/utlvector.h"
+#ifdef MPI
 #include "vmpi.h"
+#endif
+#include "loopback_distribute.h"
 #include "mathlib/anorms.h"
 #include "map_utils.h"
 #include "mathlib/halton.h"
@@ -823,6 +826,39 @@ void FreeSampleWindings( facelight_t *fl )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Free the sample and luxel data of every face. Only call this once
+//			FinalLightFace has run on all of them, since it samples neighbors.
+//-----------------------------------------------------------------------------
+void FreeFacelights()
+{
+	for ( int iFace = 0; iFace < numfaces; iFace++ )
+	{
+		facelight_t *fl = &facelight[iFace];
+
+		// Sample windings that came from VMPI workers are pointers into the
+		// worker's memory, so leave those alone.
+		if ( !g_bUseMPI && fl->sample )
+		{
+			FreeSampleWindings( fl );
+		}
+
+		free( fl->sample );
+		for ( int i = 0; i < MAXLIGHTMAPS; i++ )
+		{
+			for ( int n = 0; n < NUM_BUMP_VECTS+1; n++ )
+			{
+				free( fl->light[i][n] );
+			}
+		}
+		free( fl->luxel );
+		free( fl->luxelNormals );
+
+		memset( fl, 0, sizeof( *fl ) );
+	}
+}
+
+
 
 //-----------------------------------------------------------------------------
 // Purpose: build the sample data for each lightmapped primitive type
@@ -2534,7 +2570,7 @@ static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, i
 			if (info.m_WarnFace != info.m_FaceNum)
 			{
 				Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
-					info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
+					SubFloat( info.m_Points.x, 0 ), SubFloat( info.m_Points.y, 0 ), SubFloat( info.m_Points.z, 0 ) );
 				info.m_WarnFace = info.m_FaceNum;
 			}
 			continue;
@@ -3174,10 +3210,10 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
-	if (!g_bUseMPI) 
+	if (!g_bUseMPI && !g_bDistribute) 
 	{
 		//
-		// This is done on the master node when MPI is used
+		// This is done on the master node when MPI or -distribute is used
 		//
 		BuildPatchLights( facenum );
 	}
@@ -7,8 +7,9 @@
 //=============================================================================//
 
 #include "vrad.h"
-#include "vmpi.h"
+#include "distributevrad.h"
 #ifdef MPI
+#include "vmpi.h"
 #include "messbuf.h"
 static MessageBuffer mb;
 #endif
@@ -467,10 +468,17 @@ BuildVisMatrix
 */
 void BuildVisMatrix (void)
 {
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		RunMPIBuildVisLeafs();
 	}
+	else
+#endif
+	if ( g_bDistribute )
+	{
+		RunDistributeBuildVisLeafs();
+	}
 	else 
 	{
 		RunThreadsOn (dvis->numclusters, true, BuildVisLeafs);
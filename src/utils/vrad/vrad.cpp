@@ -12,13 +12,21 @@
 #include "physdll.h"
 #include "lightmap.h"
 #include "tier1/strtools.h"
+#ifdef MPI
 #include "vmpi.h"
-#include "macro_texture.h"
 #include "vmpi_tools_shared.h"
+#endif
+#include "macro_texture.h"
+#include "distributevrad.h"
 #include "leaf_ambient_lighting.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -61,6 +69,7 @@ bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
 bool        g_bNoSkyRecurse = false;
 bool		g_bDumpPropLightmaps = false;
+bool		g_bLowMemory = false;
 
 
 int			junk;
@@ -112,6 +121,11 @@ float		luxeldensity = 1.0;
 unsigned	num_degenerate_faces;
 
 qboolean	g_bLowPriority = false;
+
+#ifndef MPI
+bool		g_bUseMPI = false;
+bool		g_bMPIMaster = false;
+#endif
 qboolean	g_bLogHashData = false;
 bool		g_bNoDetailLighting = false;
 double		g_flStartTime;
@@ -1057,6 +1071,7 @@ MakeScales
 */
 int	total_transfer;
 int max_transfer;
+int64 total_packed_transfer_bytes;
 
 
 //-----------------------------------------------------------------------------
@@ -1199,6 +1214,141 @@ void MakeTransfer( int ndxPatch1, int ndxPatch2, transfer_t *all_transfers )
 }
 
 
+//-----------------------------------------------------------------------------
+// Packed transfers (-lowmemory)
+//
+// Transfers are sorted by patch and stored as the delta from the previous
+// patch index in 7 bit groups, followed by the transfer with its mantissa
+// rounded to 7 bits. That's about 3 bytes a transfer instead of 8, for a
+// relative error of at most 1/256 in any one transfer.
+//-----------------------------------------------------------------------------
+static int TransferPatchCompare( const void *a, const void *b )
+{
+	return ((const transfer_t *)a)->patch - ((const transfer_t *)b)->patch;
+}
+
+union transferbits_t
+{
+	float			value;
+	unsigned int	bits;
+};
+
+static unsigned short PackTransferValue( float flTransfer )
+{
+	transferbits_t t;
+	t.value = flTransfer;
+	t.bits += 0x7fff + ( ( t.bits >> 16 ) & 1 );		// round to nearest even
+	return (unsigned short)( t.bits >> 16 );
+}
+
+static float UnpackTransferValue( unsigned short nPacked )
+{
+	transferbits_t t;
+	t.bits = (unsigned int)nPacked << 16;
+	return t.value;
+}
+
+static int PackedDeltaSize( unsigned int nDelta )
+{
+	int nSize = 1;
+	while ( nDelta >= 0x80 )
+	{
+		nDelta >>= 7;
+		nSize++;
+	}
+	return nSize;
+}
+
+static void PackTransfers( CPatch *patch, transfer_t *transfers )
+{
+	qsort( transfers, patch->numtransfers, sizeof( transfer_t ), TransferPatchCompare );
+
+	int nSize = 0;
+	int nPrev = 0;
+	for ( int i = 0; i < patch->numtransfers; i++ )
+	{
+		nSize += PackedDeltaSize( transfers[i].patch - nPrev ) + sizeof( unsigned short );
+		nPrev = transfers[i].patch;
+	}
+
+	byte *pOut = (byte *)malloc( nSize );
+	if ( !pOut )
+		Error( "Memory allocation failure" );
+	patch->packedtransfers = pOut;
+
+	nPrev = 0;
+	for ( int i = 0; i < patch->numtransfers; i++ )
+	{
+		unsigned int nDelta = transfers[i].patch - nPrev;
+		nPrev = transfers[i].patch;
+		while ( nDelta >= 0x80 )
+		{
+			*pOut++ = (byte)( nDelta | 0x80 );
+			nDelta >>= 7;
+		}
+		*pOut++ = (byte)nDelta;
+
+		unsigned short nValue = PackTransferValue( transfers[i].transfer );
+		*pOut++ = (byte)( nValue & 0xff );
+		*pOut++ = (byte)( nValue >> 8 );
+	}
+
+	ThreadLock();
+	total_packed_transfer_bytes += nSize;
+	ThreadUnlock();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the patch's transfers, unpacking them into the given
+//			vector if they were packed.
+//-----------------------------------------------------------------------------
+transfer_t *UnpackTransfers( const CPatch *pPatch, CUtlVector<transfer_t> &transfers )
+{
+	if ( !pPatch->packedtransfers )
+		return pPatch->transfers;
+
+	transfers.SetCount( pPatch->numtransfers );
+
+	const byte *pIn = pPatch->packedtransfers;
+	int nPatch = 0;
+	for ( int i = 0; i < pPatch->numtransfers; i++ )
+	{
+		unsigned int nDelta = 0;
+		int nShift = 0;
+		byte b;
+		do
+		{
+			b = *pIn++;
+			nDelta |= (unsigned int)( b & 0x7f ) << nShift;
+			nShift += 7;
+		} while ( b & 0x80 );
+
+		nPatch += nDelta;
+		transfers[i].patch = nPatch;
+		transfers[i].transfer = UnpackTransferValue( pIn[0] | ( pIn[1] << 8 ) );
+		pIn += 2;
+	}
+
+	return transfers.Base();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Transfers are only used to bounce light, release them once that's done
+//-----------------------------------------------------------------------------
+void FreeTransfers()
+{
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+		free( patch->transfers );
+		free( patch->packedtransfers );
+		patch->transfers = NULL;
+		patch->packedtransfers = NULL;
+		patch->numtransfers = 0;
+	}
+}
+
+
 void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 {
 	int		j;
@@ -1219,10 +1369,6 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 		}
 
 
-		patch->transfers = ( transfer_t* )calloc (1, patch->numtransfers * sizeof(transfer_t));
-		if (!patch->transfers)
-			Error ("Memory allocation failure");
-
 		// get total transfer energy
 		t2 = all_transfers;
 
@@ -1238,12 +1384,27 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 		else	
 			total = 1.0f/M_PI;
 
-		t = patch->transfers;
-		t2 = all_transfers;
-		for (j=0 ; j<patch->numtransfers ; j++, t++, t2++)
+		if ( g_bLowMemory )
 		{
-			t->transfer = t2->transfer*total;
-			t->patch = t2->patch;
+			for (j=0 ; j<patch->numtransfers ; j++)
+			{
+				all_transfers[j].transfer *= total;
+			}
+			PackTransfers( patch, all_transfers );
+		}
+		else
+		{
+			patch->transfers = ( transfer_t* )calloc (1, patch->numtransfers * sizeof(transfer_t));
+			if (!patch->transfers)
+				Error ("Memory allocation failure");
+
+			t = patch->transfers;
+			t2 = all_transfers;
+			for (j=0 ; j<patch->numtransfers ; j++, t++, t2++)
+			{
+				t->transfer = t2->transfer*total;
+				t->patch = t2->patch;
+			}
 		}
 		if (patch->numtransfers > max_transfer)
 		{
@@ -1539,6 +1700,7 @@ void GatherLight (int threadnum, void *pUserData)
 	int			num;
 	CPatch		*patch;
 	Vector		sum, v;
+	CUtlVector<transfer_t> unpacked;
 
 	while (1)
 	{
@@ -1548,7 +1710,7 @@ void GatherLight (int threadnum, void *pUserData)
 
 		patch = &g_Patches[j];
 
-		trans = patch->transfers;
+		trans = UnpackTransfers( patch, unpacked );
 		num = patch->numtransfers;
 		if ( patch->needsBumpmap )
 		{
@@ -1932,8 +2094,16 @@ void MakeAllScales (void)
 
 	Msg("transfers %d, max %d\n", total_transfer, max_transfer );
 
-	qprintf ("transfer lists: %5.1f megs\n"
-		, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
+	if ( g_bLowMemory )
+	{
+		qprintf ("transfer lists: %5.1f megs packed\n"
+			, (float)total_packed_transfer_bytes / (1024*1024));
+	}
+	else
+	{
+		qprintf ("transfer lists: %5.1f megs\n"
+			, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
+	}
 }
 
 
@@ -2020,11 +2190,18 @@ bool RadWorld_Go()
 	}
 
 	// build initial facelights
+#ifdef MPI
 	if (g_bUseMPI) 
 	{
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 		RunMPIBuildFacelights();
 	}
+	else
+#endif
+	if ( g_bDistribute )
+	{
+		RunDistributeBuildFacelights();
+	}
 	else 
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
@@ -2042,6 +2219,20 @@ bool RadWorld_Go()
 	{
 		g_pIncremental->Finalize();
 	}
+	else if ( Distribute_IsWorker() )
+	{
+		// -distribute workers only help build the transfers, then wait for
+		// the master's lightmaps for the static prop and leaf ambient stages.
+		ExportDirectLightsToWorldLights();
+
+		if ( numbounce > 0 )
+		{
+			BuildVisMatrix();
+		}
+
+		DistributeLightData();
+		FreeFacelights();
+	}
 	else
 	{
 		// free up the direct lights now that we have facelights
@@ -2069,6 +2260,8 @@ bool RadWorld_Go()
 
 			// spread light around
 			BounceLight ();
+
+			FreeTransfers ();
 		}
 
 		//
@@ -2085,9 +2278,15 @@ bool RadWorld_Go()
 			RunThreadsOnIndividual (numfaces, true, FinalLightFace);
 		
 		// Distribute the lighting data to workers.
+#ifdef MPI
 		VMPI_DistributeLightData();
+#endif
+		DistributeLightData();
 			
 		Msg("FinalLightFace Done\n"); fflush(stdout);
+
+		// Everything after this point works from the finished lightmaps
+		FreeFacelights();
 	}
 
 	return true;
@@ -2120,7 +2319,9 @@ void InitDumpPatchesFiles()
 	}
 }
 
+#ifdef MPI
 extern IFileSystem *g_pOriginalPassThruFileSystem;
+#endif
 
 void VRAD_LoadBSP( char const *pFilename )
 {
@@ -2143,7 +2344,7 @@ void VRAD_LoadBSP( char const *pFilename )
 	// so we prepend qdir here.
 	strcpy( source, ExpandPath( source ) );
 
-	if ( !g_bUseMPI )
+	if ( !g_bUseMPI && !Distribute_IsWorker() )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -2160,7 +2361,12 @@ void VRAD_LoadBSP( char const *pFilename )
 		// Otherwise, try looking in the BIN directory from which we were run from
 		Msg( "Could not find lights.rad in %s.\nTrying VRAD BIN directory instead...\n", 
 			    global_lights );
+#ifdef _WIN32
 		GetModuleFileName( NULL, global_lights, sizeof( global_lights ) );
+#else
+		int nLen = readlink( "/proc/self/exe", global_lights, sizeof( global_lights ) - 1 );
+		global_lights[ MAX( nLen, 0 ) ] = 0;
+#endif
 		Q_ExtractFilePath( global_lights, global_lights, sizeof( global_lights ) );
 		strcat( global_lights, "lights.rad" );
 	}
@@ -2185,13 +2391,16 @@ void VRAD_LoadBSP( char const *pFilename )
 	LoadBSPFile (source);
 
 	// Add this bsp to our search path so embedded resources can be found
+#ifdef MPI
 	if ( g_bUseMPI && g_bMPIMaster )
 	{
 		// MPI Master, MPI workers don't need to do anything
 		g_pOriginalPassThruFileSystem->AddSearchPath(source, "GAME", PATH_ADD_TO_HEAD);
 		g_pOriginalPassThruFileSystem->AddSearchPath(source, "MOD", PATH_ADD_TO_HEAD);
 	}
-	else if ( !g_bUseMPI )
+	else
+#endif
+	if ( !g_bUseMPI )
 	{
 		// Non-MPI
 		g_pFullFileSystem->AddSearchPath(source, "GAME", PATH_ADD_TO_HEAD);
@@ -2296,7 +2505,7 @@ void VRAD_LoadBSP( char const *pFilename )
 void VRAD_ComputeOtherLighting()
 {
 	// Compute lighting for the bsp file
-	if ( !g_bNoDetailLighting )
+	if ( !g_bNoDetailLighting && !Distribute_IsWorker() )
 	{
 		ComputeDetailPropLighting( THREADINDEX_MAIN );
 	}
@@ -2312,6 +2521,20 @@ void VRAD_ComputeOtherLighting()
 
 extern void CloseDispLuxels();
 
+static void PrintPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	counters.cb = sizeof( counters );
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+	{
+		Msg( "Peak memory: %.1f MB working set, %.1f MB committed\n",
+			counters.PeakWorkingSetSize / ( 1024.0 * 1024.0 ),
+			counters.PeakPagefileUsage / ( 1024.0 * 1024.0 ) );
+	}
+#endif
+}
+
 void VRAD_Finish()
 {
 	Msg( "Ready to Finish\n" ); 
@@ -2341,6 +2564,8 @@ void VRAD_Finish()
 
 	StaticPropMgr()->Shutdown();
 
+	PrintPeakMemoryUsage();
+
 	double end = Plat_FloatTime();
 	
 	char str[512];
@@ -2499,6 +2724,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_flSkySampleScale = 16.0;
 		}
+		else if (!Q_stricmp(argv[i],"-lowmemory"))
+		{
+			g_bLowMemory = true;
+		}
 		else if (!Q_stricmp(argv[i],"-extrasky"))
 		{
 			if ( ++i < argc && *argv[i] )
@@ -2751,6 +2980,11 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 			}
 		}
 #endif
+		else if ( Distribute_ParseArg( argc, argv, i ) )
+		{
+			// -distribute and its options.
+		}
+#ifdef MPI
 		// NOTE: the -mpi checks must come last here because they allow the previous argument 
 		// to be -mpi as well. If it game before something else like -game, then if the previous
 		// argument was -mpi and the current argument was something valid like -game, it would skip it.
@@ -2763,6 +2997,7 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 			if ( i == argc - 1 && V_stricmp( argv[i], "-mpi_ListParams" ) != 0 )
 				break;
 		}
+#endif
 		else if ( mapArg == -1 )
 		{
 			mapArg = i;
@@ -2804,8 +3039,13 @@ void PrintUsage( int argc, char **argv )
 		"  -fastambient    : Per-leaf ambient sampling is lower quality to save compute time.\n"
 		"  -final          : High quality processing. equivalent to -extrasky 16.\n"
 		"  -extrasky n     : trace N times as many rays for indirect light and sky ambient.\n"
+		"  -lowmemory      : Pack the bounce light transfers to lower peak memory use.\n"
+		"                    Transfers lose a little precision.\n"
 		"  -low            : Run as an idle-priority process.\n"
+#ifdef MPI
 		"  -mpi            : Use VMPI to distribute computations.\n"
+#endif
+		"  -distribute <n> : Light on <n> worker processes on this machine.\n"
 		"  -rederror       : Show errors in red.\n"
 		"\n"
 		"  -vproject <directory> : Override the VPROJECT environment variable.\n"
@@ -2828,7 +3068,11 @@ void PrintUsage( int argc, char **argv )
 		"  -dlightmap      : Force direct lighting into different lightmap than\n"
 		"                    radiosity.\n"
 		"  -stoponexit	   : Wait for a keypress on exit.\n"
+#ifdef MPI
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
+#endif
+		"  -distributeport <port>      : Loopback port for -distribute (default: any free port).\n"
+		"  -distributetimeout <seconds>: Hand a work unit to another worker after this long (default: 300).\n"
 		"  -nodetaillight  : Don't light detail props.\n"
 		"  -centersamples  : Move sample centers.\n"
 		"  -luxeldensity # : Rescale all luxels by the specified amount (default: 1.0).\n"
@@ -2911,6 +3155,18 @@ int RunVRAD( int argc, char **argv )
 	CmdLib_InitFileSystem( argv[ i ] );
 	Q_FileBase( source, source, sizeof( source ) );
 
+	if ( g_bLowMemory && ( g_bUseMPI || g_bDistribute ) )
+	{
+		Warning( "-lowmemory isn't supported with -mpi or -distribute, ignoring it\n" );
+		g_bLowMemory = false;
+	}
+
+	if ( g_bUseMPI )
+	{
+		Distribute_Disable( "with -mpi" );
+	}
+	Distribute_Init( argc, argv );
+
 	VRAD_LoadBSP( argv[i] );
 
 	if ( (! onlydetail) && (! g_bOnlyStaticProps ) )
@@ -2920,6 +3176,9 @@ int RunVRAD( int argc, char **argv )
 
 	VRAD_ComputeOtherLighting();
 
+	// Everything from here on is the master's.
+	Distribute_WorkerFinished();
+
 	VRAD_Finish();
 
 	VMPI_SetCurrentStage( "master done" );
@@ -2936,6 +3195,7 @@ int VRAD_Main(int argc, char **argv)
 
 	VRAD_Init();
 
+#ifdef MPI
 	// This must come first.
 	VRAD_SetupMPI( argc, argv );
 
@@ -2945,6 +3205,7 @@ int VRAD_Main(int argc, char **argv)
 		SetupToolsMinidumpHandler( VMPI_ExceptionFilter );
 	}
 	else
+#endif
 #endif
 	{
 		LoadCmdLineFromFile( argc, argv, source, "vrad" ); // Don't do this if we're a VMPI worker..
@@ -24,9 +24,9 @@
 #include "polylib.h"
 #include "threads.h"
 #include "builddisp.h"
-#include "VRAD_DispColl.h"
-#include "UtlMemory.h"
-#include "UtlHash.h"
+#include "vrad_dispcoll.h"
+#include "utlmemory.h"
+#include "utlhash.h"
 #include "utlvector.h"
 #include "iincremental.h"
 #include "raytrace.h"
@@ -39,12 +39,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef _WIN32
 #pragma warning(disable: 4142 4028)
 #include <io.h>
 #pragma warning(default: 4142 4028)
+#endif
 
 #include <fcntl.h>
+#ifdef _WIN32
 #include <direct.h>
+#endif
 #include <ctype.h>
 
 
@@ -238,6 +242,7 @@ struct CPatch
 
 	int			numtransfers;
 	transfer_t	*transfers;
+	byte		*packedtransfers;		// -lowmemory: transfers packed by PackTransfers instead
 
 	short		indices[3];				// displacement use these for subdivision
 };
@@ -282,6 +287,7 @@ extern qboolean		do_fast;
 extern bool			g_bInterrupt;		// Was used with background lighting in WC. Tells VRAD to stop lighting.
 extern IIncremental *g_pIncremental;	// null if not doing incremental lighting
 extern bool			g_bDumpPropLightmaps;
+extern bool			g_bLowMemory;		// pack transfers to cut peak memory on big maps
 
 extern float g_flSkySampleScale;								// extra sampling factor for indirect light
 
@@ -336,6 +342,14 @@ extern dface_t *g_pFaces;
 
 extern bool g_bMPIProps;
 
+#ifndef MPI
+// VMPI defines these when it's linked in. Without it, vrad.cpp defines them
+// and -distribute spreads the work instead.
+extern bool g_bUseMPI;
+extern bool g_bMPIMaster;
+inline void VMPI_SetCurrentStage( const char *pCurStage ) {}
+#endif
+
 extern	byte	nodehit[MAX_MAP_NODES];
 extern  float	gamma_value;
 extern	float	indirect_sun;
@@ -363,6 +377,7 @@ int PartialHead (void);
 void BuildFacelights (int facenum, int threadnum);
 void PrecompLightmapOffsets();
 void FinalLightFace (int threadnum, int facenum);
+void FreeFacelights();
 void PvsForOrigin (Vector& org, byte *pvs);
 void ConvertRGBExp32ToRGBA8888( const ColorRGBExp32 *pSrc, unsigned char *pDst, Vector* _optOutLinear = NULL );
 void ConvertRGBExp32ToLinear(const ColorRGBExp32 *pSrc, Vector* pDst);
@@ -400,6 +415,8 @@ void GetPhongNormal( int facenum, Vector const& spot, Vector& phongnormal );
 int LightForString( char *pLight, Vector& intensity );
 void MakeTransfer( int ndxPatch1, int ndxPatch2, transfer_t *all_transfers );
 void MakeScales( int ndxPatch, transfer_t *all_transfers );
+transfer_t *UnpackTransfers( const CPatch *pPatch, CUtlVector<transfer_t> &transfers );
+void FreeTransfers();
 
 // Run startup code like initialize mathlib.
 void VRAD_Init();
@@ -6,11 +6,11 @@
 //=============================================================================//
 
 #include "vrad.h"
-#include "VRAD_DispColl.h"
-#include "DispColl_Common.h"
+#include "vrad_dispcoll.h"
+#include "dispcoll_common.h"
 #include "radial.h"
-#include "CollisionUtils.h"
-#include "tier0\dbg.h"
+#include "collisionutils.h"
+#include "tier0/dbg.h"
 
 #define SAMPLE_BBOX_SLOP		5.0f
 #define TRIEDGE_EPSILON			0.001f
@@ -11,16 +11,16 @@
 
 #include "vrad.h"
 #include "mathlib/vector.h"
-#include "UtlBuffer.h"
+#include "utlbuffer.h"
 #include "utlvector.h"
-#include "GameBSPFile.h"
-#include "BSPTreeData.h"
-#include "VPhysics_Interface.h"
-#include "Studio.h"
-#include "Optimize.h"
-#include "Bsplib.h"
-#include "CModel.h"
-#include "PhysDll.h"
+#include "gamebspfile.h"
+#include "bsptreedata.h"
+#include "vphysics_interface.h"
+#include "studio.h"
+#include "optimize.h"
+#include "bsplib.h"
+#include "cmodel.h"
+#include "physdll.h"
 #include "phyfile.h"
 #include "collisionutils.h"
 #include "tier1/KeyValues.h"
@@ -30,14 +30,17 @@
 #include "materialsystem/hardwaretexels.h"
 #include "byteswap.h"
 #include "mpivrad.h"
+#include "distributevrad.h"
 #include "vtf/vtf.h"
 #include "tier1/utldict.h"
 #include "tier1/utlsymbol.h"
 #include "bitmap/tgawriter.h"
 
+#ifdef MPI
 #include "messbuf.h"
 #include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#endif
 
 
 #define ALIGN_TO_POW2(x,y) (((x)+(y-1))&~(y-1))
@@ -259,11 +262,17 @@ public:
 	void ComputeLighting( int iThread );
 
 private:
+#ifdef MPI
 	// VMPI stuff.
 	static void VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf );
 	static void VMPI_ReceiveStaticPropResults_Static( uint64 iStaticProp, MessageBuffer *pBuf, int iWorker );
 	void VMPI_ProcessStaticProp( int iThread, int iStaticProp, MessageBuffer *pBuf );
 	void VMPI_ReceiveStaticPropResults( int iStaticProp, MessageBuffer *pBuf, int iWorker );
+#endif
+
+	// -distribute stuff.
+	static void Distribute_ProcessStaticProp( int iThread, int iStaticProp, CUtlBuffer &buf );
+	static void Distribute_ReceiveStaticPropResults( int iStaticProp, CUtlBuffer &buf, int iWorker );
 	
 	// local thread version
 	static void ThreadComputeStaticPropLighting( int iThread, void *pUserData );
@@ -1145,17 +1154,80 @@ bool PositionInSolid( Vector &position )
 }
 
 //-----------------------------------------------------------------------------
-// Trace from a vertex to each direct light source, accumulating its contribution.
+// TestLine_DoesHitSky() decides from the first point of a packet whether to
+// also trace through the 3D skybox. Sky lights can only be gathered for the
+// whole packet if every point would make the same decision on its own.
 //-----------------------------------------------------------------------------
-void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
-								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+static bool SkyRecursesFromPoint( const Vector &position )
 {
+	int leafIndex = PointLeafnum( position );
+	if ( leafIndex < 0 )
+		return false;
+
+	int area = dleafs[leafIndex].area;
+	return ( area >= 0 && area < numareas && area_sky_cameras[area] < 0 );
+}
+
+static bool CanGatherSkyFor4Points( const FourVectors &pos4, int numSamples )
+{
+	if ( g_bNoSkyRecurse )
+		return true;
+
+	bool bRecurse = SkyRecursesFromPoint( pos4.Vec( 0 ) );
+	for ( int s = 1; s < numSamples; s++ )
+	{
+		if ( SkyRecursesFromPoint( pos4.Vec( s ) ) != bRecurse )
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Trace from up to four vertexes to each direct light source, accumulating its
+// contribution. The lights are culled against the whole packet: a light is
+// skipped when none of the points are in a cluster it can see, and the fade
+// distance test in GatherSampleLightSSE() runs once for all four points.
+//-----------------------------------------------------------------------------
+static void ComputeDirectLightingAt4Points( const Vector *pPositions, const Vector *pNormals, int numSamples, Vector *pOutColors,
+											int iThread, int static_prop_id_to_skip=-1, int nLFlags = 0 )
+{
+	Assert( numSamples >= 1 && numSamples <= 4 );
+
+	// With texture shadows the coverage a ray picks up depends on the rays it
+	// is traced with, so the points are lit one at a time.
+	if ( g_bTextureShadows && numSamples > 1 )
+	{
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			ComputeDirectLightingAt4Points( &pPositions[s], &pNormals[s], 1, &pOutColors[s], iThread, static_prop_id_to_skip, nLFlags );
+		}
+		return;
+	}
+
 	SSE_sampleLightOutput_t	sampleOutput;
 
-	outColor.Init();
+	// Unused lanes repeat the last point so their traces stay sane; the
+	// PVS mask keeps them out of the results.
+	Vector positions[4], normals[4];
+	int clusters[4];
+	for ( int s = 0; s < 4; s++ )
+	{
+		int src = min( s, numSamples - 1 );
+		positions[s] = pPositions[src];
+		normals[s] = pNormals[src];
+		clusters[s] = ( s < numSamples ) ? ClusterFromPoint( positions[s] ) : -1;
+	}
+
+	for ( int s = 0; s < numSamples; s++ )
+	{
+		pOutColors[s].Init();
+	}
+
+	FourVectors position4, normal4;
+	position4.LoadAndSwizzle( positions[0], positions[1], positions[2], positions[3] );
+	normal4.LoadAndSwizzle( normals[0], normals[1], normals[2], normals[3] );
 
 	// Iterate over all direct lights and accumulate their contribution
-	int cluster = ClusterFromPoint( position );
 	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
 	{
 		if ( dl->light.style )
@@ -1165,43 +1237,112 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 		}
 
 		// is this lights cluster visible?
-		if ( !PVSCheck( dl->pvs, cluster ) )
+		fltx4 pvsMask = Four_Zeros;
+		bool skipLight = true;
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			if ( PVSCheck( dl->pvs, clusters[s] ) )
+			{
+				pvsMask = SetComponentSIMD( pvsMask, s, 1.0f );
+				skipLight = false;
+			}
+		}
+		if ( skipLight )
 			continue;
 
-		// push the vertex towards the light to avoid surface acne
-		Vector adjusted_pos = position;
+		// push the vertexes towards the light to avoid surface acne
+		FourVectors adjusted_pos4 = position4;
+		FourVectors fudge;
 		float flEpsilon = 0.0;
 
-		if  (dl->light.type != emit_skyambient)
+		if ( dl->light.type == emit_skylight )
 		{
-			// push towards the light
-			Vector fudge;
-			if ( dl->light.type == emit_skylight )
-				fudge = -( dl->light.normal);
-			else
-			{
-				fudge = dl->light.origin-position;
-				VectorNormalize( fudge );
-			}
-			fudge *= 4.0;
-			adjusted_pos += fudge;
+			fudge.DuplicateVector( -4.0f * dl->light.normal );
 		}
-		else 
+		else if ( dl->light.type != emit_skyambient )
+		{
+			fudge.DuplicateVector( dl->light.origin );
+			fudge -= position4;
+
+			// Same estimate and epsilon as VectorNormalize() in x86 builds.
+			fltx4 invLen = ReciprocalSqrtSIMD( AddSIMD( fudge.length2(), ReplicateX4( 1.0e-10f ) ) );
+			fudge *= MulSIMD( ReplicateX4( 4.0f ), invLen );
+		}
+		else
 		{
 			// push out along normal
-			adjusted_pos += 4.0 * normal;
+			fudge = normal4;
+			fudge *= 4.0f;
 //			flEpsilon = 1.0;
 		}
+		adjusted_pos4 += fudge;
 
-		FourVectors adjusted_pos4;
-		FourVectors normal4;
-		adjusted_pos4.DuplicateVector( adjusted_pos );
-		normal4.DuplicateVector( normal );
+		if ( ( dl->light.type == emit_skylight || dl->light.type == emit_skyambient ) &&
+			 !CanGatherSkyFor4Points( adjusted_pos4, numSamples ) )
+		{
+			for ( int s = 0; s < numSamples; s++ )
+			{
+				if ( !PVSCheck( dl->pvs, clusters[s] ) )
+					continue;
+
+				FourVectors pos1, normal1;
+				pos1.DuplicateVector( adjusted_pos4.Vec( s ) );
+				normal1.DuplicateVector( normals[s] );
+
+				GatherSampleLightSSE( sampleOutput, dl, -1, pos1, &normal1, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
+				                      static_prop_id_to_skip, flEpsilon );
+
+				VectorMA( pOutColors[s], SubFloat( sampleOutput.m_flFalloff, 0 ) * SubFloat( sampleOutput.m_flDot[0], 0 ), dl->light.intensity, pOutColors[s] );
+			}
+			continue;
+		}
 
 		GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
 		                      static_prop_id_to_skip, flEpsilon );
-		
-		VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
+
+		fltx4 scale = MulSIMD( sampleOutput.m_flFalloff, sampleOutput.m_flDot[0] );
+		scale = AndSIMD( scale, CmpGtSIMD( pvsMask, Four_Zeros ) );
+		if ( IsAllZeros( scale ) )
+			continue;
+
+		for ( int s = 0; s < numSamples; s++ )
+		{
+			VectorMA( pOutColors[s], SubFloat( scale, s ), dl->light.intensity, pOutColors[s] );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Trace from a vertex to each direct light source, accumulating its contribution.
+//-----------------------------------------------------------------------------
+void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
+								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+{
+	ComputeDirectLightingAt4Points( &position, &normal, 1, &outColor, iThread, static_prop_id_to_skip, nLFlags );
+}
+
+//-----------------------------------------------------------------------------
+// Direct and indirect lighting for a list of sample points. The direct
+// lighting is gathered four points at a time.
+//-----------------------------------------------------------------------------
+static void ComputeLightingAtPoints( int numPoints, Vector *pPositions, Vector *pNormals, Vector *pOutColors,
+									 int iThread, int static_prop_id_to_skip, int nLFlags )
+{
+	for ( int i = 0; i < numPoints; i += 4 )
+	{
+		int numSamples = min( 4, numPoints - i );
+		ComputeDirectLightingAt4Points( &pPositions[i], &pNormals[i], numSamples, &pOutColors[i], iThread, static_prop_id_to_skip, nLFlags );
+
+		if ( numbounce < 1 )
+			continue;
+
+		for ( int s = i; s < i + numSamples; s++ )
+		{
+			Vector indirectColor( 0, 0, 0 );
+			ComputeIndirectLightingAtPoint( pPositions[s], pNormals[s], indirectColor, iThread, true,
+											( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0 );
+			pOutColors[s] += indirectColor;
+		}
 	}
 }
 
@@ -1359,6 +1500,13 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 			colorVerts.EnsureCount( pStudioModel->numvertices );
 			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
 
+			CUtlVector<Vector> samplePositions;
+			CUtlVector<Vector> sampleNormals;
+			CUtlVector<int> sampleVertexes;
+			samplePositions.EnsureCapacity( pStudioModel->numvertices );
+			sampleNormals.EnsureCapacity( pStudioModel->numvertices );
+			sampleVertexes.EnsureCapacity( pStudioModel->numvertices );
+
 			int numVertexes = 0;
 			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
 			{
@@ -1393,39 +1541,41 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 					}
 					else
 					{
-						Vector direct_pos=samplePosition;
-							
-						
+						// lit below, once all the vertexes of the model are known
+						samplePositions.AddToTail( samplePosition );
+						sampleNormals.AddToTail( sampleNormal );
+						sampleVertexes.AddToTail( numVertexes );
 
-						Vector directColor(0,0,0);
-						ComputeDirectLightingAtPoint( direct_pos,
-														sampleNormal, directColor, iThread,
-														skip_prop, nFlags );
-						Vector indirectColor(0,0,0);
-
-						if (g_bShowStaticPropNormals)
-						{
-							directColor= sampleNormal;
-							directColor += Vector(1.0,1.0,1.0);
-							directColor *= 50.0;
-						}
-						else
-						{
-							if (numbounce >= 1)
-								ComputeIndirectLightingAtPoint( 
-									samplePosition, sampleNormal, 
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
-						}
-						
 						colorVerts[numVertexes].m_bValid = true;
 						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
 					}
 					
 					numVertexes++;
 				}
 			}
+
+			if ( g_bShowStaticPropNormals )
+			{
+				for ( int i = 0; i < sampleVertexes.Count(); i++ )
+				{
+					Vector &color = colorVerts[sampleVertexes[i]].m_Color;
+					color = sampleNormals[i];
+					color += Vector(1.0,1.0,1.0);
+					color *= 50.0;
+				}
+			}
+			else if ( sampleVertexes.Count() )
+			{
+				CUtlVector<Vector> sampleColors;
+				sampleColors.SetCount( sampleVertexes.Count() );
+				ComputeLightingAtPoints( sampleVertexes.Count(), samplePositions.Base(), sampleNormals.Base(), sampleColors.Base(),
+										 iThread, skip_prop, nFlags );
+
+				for ( int i = 0; i < sampleVertexes.Count(); i++ )
+				{
+					colorVerts[sampleVertexes[i]].m_Color = sampleColors[i];
+				}
+			}
 			
 			// color in the bad vertexes
 			// when entire model has no lighting origin and no valid neighbors
@@ -1655,6 +1805,7 @@ void CVradStaticPropMgr::SerializeLighting()
 	}
 }
 
+#ifdef MPI
 void CVradStaticPropMgr::VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf )
 {
 	g_StaticPropMgr.VMPI_ProcessStaticProp( iThread, iStaticProp, pBuf );
@@ -1739,6 +1890,63 @@ void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iStaticProp, Message
 	// Apply the results.
 	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &results );
 }
+#endif
+
+
+//-----------------------------------------------------------------------------
+// -distribute versions of the above, same encoding.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::Distribute_ProcessStaticProp( int iThread, int iStaticProp, CUtlBuffer &buf )
+{
+	CComputeStaticPropLightingResults results;
+	g_StaticPropMgr.ComputeLighting( g_StaticPropMgr.m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
+
+	buf.PutInt( results.m_ColorVertsArrays.Count() );
+	for ( int i=0; i < results.m_ColorVertsArrays.Count(); i++ )
+	{
+		CUtlVector<colorVertex_t> &curList = *results.m_ColorVertsArrays[i];
+		buf.PutInt( curList.Count() );
+		buf.Put( curList.Base(), curList.Count() * sizeof( colorVertex_t ) );
+	}
+
+	buf.PutInt( results.m_ColorTexelsArrays.Count() );
+	for ( int i=0; i < results.m_ColorTexelsArrays.Count(); i++ )
+	{
+		CUtlVector<colorTexel_t> &curList = *results.m_ColorTexelsArrays[i];
+		buf.PutInt( curList.Count() );
+		buf.Put( curList.Base(), curList.Count() * sizeof( colorTexel_t ) );
+	}
+}
+
+void CVradStaticPropMgr::Distribute_ReceiveStaticPropResults( int iStaticProp, CUtlBuffer &buf, int iWorker )
+{
+	CComputeStaticPropLightingResults results;
+
+	int nLists = buf.GetInt();
+	for ( int i=0; i < nLists; i++ )
+	{
+		CUtlVector<colorVertex_t> *pList = new CUtlVector<colorVertex_t>;
+		results.m_ColorVertsArrays.AddToTail( pList );
+
+		pList->SetSize( buf.GetInt() );
+		buf.Get( pList->Base(), pList->Count() * sizeof( colorVertex_t ) );
+	}
+
+	nLists = buf.GetInt();
+	for ( int i=0; i < nLists; i++ )
+	{
+		CUtlVector<colorTexel_t> *pList = new CUtlVector<colorTexel_t>;
+		results.m_ColorTexelsArrays.AddToTail( pList );
+
+		pList->SetSize( buf.GetInt() );
+		buf.Get( pList->Base(), pList->Count() * sizeof( colorTexel_t ) );
+	}
+
+	if ( !buf.IsValid() )
+		Error( "Distribute_ReceiveStaticPropResults: bad results for prop %d from worker %d.\n", iStaticProp, iWorker );
+
+	g_StaticPropMgr.ApplyLightingToStaticProp( iStaticProp, g_StaticPropMgr.m_StaticProps[iStaticProp], &results );
+}
 
 
 void CVradStaticPropMgr::ComputeLightingForProp( int iThread, int iStaticProp )
@@ -1780,6 +1988,7 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 	// ensure any traces against us are ignored because we have no inherit lighting contribution
 	m_bIgnoreStaticPropTrace = true;
 
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		// Distribute the work among the workers.
@@ -1792,6 +2001,12 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 			&CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static );
 	}
 	else
+#endif
+	if ( g_bDistribute )
+	{
+		Distribute_Work( NULL, count, Distribute_ProcessStaticProp, Distribute_ReceiveStaticPropResults );
+	}
+	else
 	{
 		RunThreadsOn(count, true, ThreadComputeStaticPropLighting);
 	}
@@ -2398,6 +2613,10 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 	// on the other side.
 	// First attempt: Just pretend the triangle was larger and cast a ray from this new world pos 
 	// as above.
+	CUtlVector<Vector> samplePositions;
+	CUtlVector<Vector> sampleNormals;
+	CUtlVector<int> sampleTexels;
+
 	int linearPos = 0;
 	for ( int j = 0; j < _lightmapResY; ++j )
 	{
@@ -2423,22 +2642,24 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 
 			if (shouldProcess)
 			{
-				Vector directColor(0, 0, 0),
-					   indirectColor(0, 0, 0);
-
-
-				ComputeDirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, directColor, _iThread, _skipProp, _flags);
-
-				if (numbounce >= 1) {
-					ComputeIndirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, indirectColor, _iThread, true, (_flags & GATHERLFLAGS_IGNORE_NORMALS) != 0 );
-				}
-
-				VectorAdd(directColor, indirectColor, colorTexels[linearPos].m_Color);
+				samplePositions.AddToTail( colorTexels[linearPos].m_WorldPosition );
+				sampleNormals.AddToTail( colorTexels[linearPos].m_WorldNormal );
+				sampleTexels.AddToTail( linearPos );
 			}
 
 			++linearPos;
 		}
 	}
+
+	// Light the texels four at a time.
+	CUtlVector<Vector> sampleColors;
+	sampleColors.SetCount( sampleTexels.Count() );
+	ComputeLightingAtPoints( sampleTexels.Count(), samplePositions.Base(), sampleNormals.Base(), sampleColors.Base(), _iThread, _skipProp, _flags );
+
+	for ( int i = 0; i < sampleTexels.Count(); i++ )
+	{
+		colorTexels[sampleTexels[i]].m_Color = sampleColors[i];
+	}
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -9,7 +9,9 @@
 //
 
 #include "stdafx.h"
+#ifdef _WIN32
 #include <direct.h>
+#endif
 #include "tier1/strtools.h"
 #include "tier0/icommandline.h"
 
@@ -18,6 +20,7 @@ char* GetLastErrorString()
 {
 	static char err[2048];
 	
+#ifdef _WIN32
 	LPVOID lpMsgBuf;
 	FormatMessage( 
 		FORMAT_MESSAGE_ALLOCATE_BUFFER | 
@@ -35,6 +38,10 @@ char* GetLastErrorString()
 	LocalFree( lpMsgBuf );
 
 	err[ sizeof( err ) - 1 ] = 0;
+#else
+	// Sys_LoadModule has already printed dlopen's error.
+	err[0] = 0;
+#endif
 
 	return err;
 }
@@ -50,7 +57,7 @@ void MakeFullPath( const char *pIn, char *pOut, int outLen )
 	else
 	{
 		_getcwd( pOut, outLen );
-		Q_strncat( pOut, "\\", outLen, COPY_ALL_CHARACTERS );
+		Q_strncat( pOut, CORRECT_PATH_SEPARATOR_S, outLen, COPY_ALL_CHARACTERS );
 		Q_strncat( pOut, pIn, outLen, COPY_ALL_CHARACTERS );
 	}
 }
@@ -73,7 +80,7 @@ int main(int argc, char* argv[])
 	char fullPath[512], redirectFilename[512];
 	MakeFullPath( argv[0], fullPath, sizeof( fullPath ) );
 	Q_StripFilename( fullPath );
-	Q_snprintf( redirectFilename, sizeof( redirectFilename ), "%s\\%s", fullPath, "vrad.redirect" );
+	Q_snprintf( redirectFilename, sizeof( redirectFilename ), "%s%c%s", fullPath, CORRECT_PATH_SEPARATOR, "vrad.redirect" );
 
 	// First, look for vrad.redirect and load the dll specified in there if possible.
 	CSysModule *pModule = NULL;
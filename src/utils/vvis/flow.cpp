@@ -6,7 +6,10 @@
 //
 //=============================================================================//
 #include "vis.h"
+#ifdef MPI
 #include "vmpi.h"
+#endif
+#include "mathlib/ssemath.h"
 
 int g_TraceClusterStart = -1;
 int g_TraceClusterStop = -1;
@@ -50,7 +53,9 @@ int		c_chop, c_nochop;
 
 int		active;
 
+#ifdef MPI
 extern bool g_bVMPIEarlyExit;
+#endif
 
 
 void CheckStack (leaf_t *leaf, threaddata_t *thread)
@@ -102,6 +107,67 @@ void FreeStackWinding (winding_t *w, pstack_t *stack)
 	stack->freewindings[i] = 1;
 }
 
+/*
+==============
+Structure of arrays windings
+
+Lets a whole winding be tested against a plane four points at a time. The
+dot products are summed in the same order as DotProduct() and there's no
+fused multiply-add, so the distances are bit identical to the scalar ones.
+
+With g_bSIMDClip off (-nosimdclip), RecursiveLeafFlow uses the original
+ClipToSeperators and ChopWinding instead, so the two can be compared.
+==============
+*/
+bool g_bSIMDClip = true;
+
+struct fourwinding_t
+{
+	ALIGN16 vec_t	x[MAX_POINTS_ON_WINDING] ALIGN16_POST;
+	ALIGN16 vec_t	y[MAX_POINTS_ON_WINDING] ALIGN16_POST;
+	ALIGN16 vec_t	z[MAX_POINTS_ON_WINDING] ALIGN16_POST;
+	int				numpoints;
+};
+
+static void LoadFourWinding (const winding_t *w, fourwinding_t *four)
+{
+	int		i;
+
+	four->numpoints = w->numpoints;
+	for (i=0 ; i<w->numpoints ; i++)
+	{
+		four->x[i] = w->points[i][0];
+		four->y[i] = w->points[i][1];
+		four->z[i] = w->points[i][2];
+	}
+
+	// pad out the last group
+	for ( ; i & 3 ; i++)
+	{
+		four->x[i] = four->y[i] = four->z[i] = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Fills in the signed plane distance of each point. dists must be 16 byte
+// aligned with room for numpoints rounded up to a multiple of 4.
+//-----------------------------------------------------------------------------
+static void WindingPlaneDists (const fourwinding_t *four, const plane_t *plane, vec_t *dists)
+{
+	int		i;
+
+	fltx4 nx = ReplicateX4( plane->normal[0] );
+	fltx4 ny = ReplicateX4( plane->normal[1] );
+	fltx4 nz = ReplicateX4( plane->normal[2] );
+	fltx4 dist = ReplicateX4( plane->dist );
+	for (i=0 ; i<four->numpoints ; i+=4)
+	{
+		fltx4 dot = AddSIMD( MulSIMD( LoadAlignedSIMD( &four->x[i] ), nx ), MulSIMD( LoadAlignedSIMD( &four->y[i] ), ny ) );
+		dot = AddSIMD( dot, MulSIMD( LoadAlignedSIMD( &four->z[i] ), nz ) );
+		StoreAlignedSIMD( &dists[i], SubSIMD( dot, dist ) );
+	}
+}
+
 /*
 ==============
 ChopWinding
@@ -218,6 +284,363 @@ winding_t	*ChopWinding (winding_t *in, pstack_t *stack, plane_t *split)
 #pragma warning (default:4701)
 #endif
 
+/*
+==============
+ChopWindingByDists
+
+ChopWinding with the point distances already worked out. dists needs room
+for one more than in->numpoints.
+==============
+*/
+
+#ifdef _WIN32
+#pragma warning (disable:4701)
+#endif
+
+static winding_t *ChopWindingByDists (winding_t *in, pstack_t *stack, const plane_t *split, vec_t *dists)
+{
+	int		sides[128];
+	int		counts[3];
+	vec_t	dot;
+	int		i, j;
+	Vector	mid;
+	winding_t	*neww;
+
+	counts[0] = counts[1] = counts[2] = 0;
+
+// determine sides for each point
+	for (i=0 ; i<in->numpoints ; i++)
+	{
+		dot = dists[i];
+		if (dot > ON_VIS_EPSILON)
+			sides[i] = SIDE_FRONT;
+		else if (dot < -ON_VIS_EPSILON)
+			sides[i] = SIDE_BACK;
+		else
+		{
+			sides[i] = SIDE_ON;
+		}
+		counts[sides[i]]++;
+	}
+
+	if (!counts[1])
+		return in;		// completely on front side
+	
+	if (!counts[0])
+	{
+		FreeStackWinding (in, stack);
+		return NULL;
+	}
+
+	sides[i] = sides[0];
+	dists[i] = dists[0];
+	
+	neww = AllocStackWinding (stack);
+
+	neww->numpoints = 0;
+
+	for (i=0 ; i<in->numpoints ; i++)
+	{
+		Vector& p1 = in->points[i];
+
+		if (neww->numpoints == MAX_POINTS_ON_FIXED_WINDING)
+		{
+			FreeStackWinding (neww, stack);
+			return in;		// can't chop -- fall back to original
+		}
+
+		if (sides[i] == SIDE_ON)
+		{
+			VectorCopy (p1, neww->points[neww->numpoints]);
+			neww->numpoints++;
+			continue;
+		}
+	
+		if (sides[i] == SIDE_FRONT)
+		{
+			VectorCopy (p1, neww->points[neww->numpoints]);
+			neww->numpoints++;
+		}
+		
+		if (sides[i+1] == SIDE_ON || sides[i+1] == sides[i])
+			continue;
+			
+		if (neww->numpoints == MAX_POINTS_ON_FIXED_WINDING)
+		{
+			FreeStackWinding (neww, stack);
+			return in;		// can't chop -- fall back to original
+		}
+
+	// generate a split point
+		Vector& p2 = in->points[(i+1)%in->numpoints];
+		
+		dot = dists[i] / (dists[i]-dists[i+1]);
+		for (j=0 ; j<3 ; j++)
+		{	// avoid round off error when possible
+			if (split->normal[j] == 1)
+				mid[j] = split->dist;
+			else if (split->normal[j] == -1)
+				mid[j] = -split->dist;
+			else
+				mid[j] = p1[j] + dot*(p2[j]-p1[j]);
+		}
+			
+		VectorCopy (mid, neww->points[neww->numpoints]);
+		neww->numpoints++;
+	}
+	
+// free the original winding
+	FreeStackWinding (in, stack);
+	
+	return neww;
+}
+
+#ifdef _WIN32
+#pragma warning (default:4701)
+#endif
+
+// Seperating planes from one source/pass pair, kept while a leaf's portals
+// are clipped against the same two windings
+#define MAX_SEPARATOR_PLANES	32
+
+struct separatorcache_t
+{
+	winding_t	*source;
+	winding_t	*pass;
+	int			numplanes;
+	plane_t		planes[MAX_SEPARATOR_PLANES];
+};
+
+/*
+==============
+FindSeperators
+
+Generates seperating planes canidates by taking two points from source and one
+point from pass. Candidates are numbered i * pass->numpoints + j, *next is the
+first candidate to look at and is set to -1 once they have all been looked at.
+Stops after maxplanes planes so the caller can clip in batches.
+==============
+*/
+static int FindSeperators (winding_t *source, winding_t *pass, bool flipclip, int *next, plane_t *planes, int maxplanes)
+{
+	int			i, j, k, l;
+	int			candidate, numcandidates;
+	int			numplanes;
+	plane_t		plane;
+	Vector		v1, v2;
+	float		d;
+	vec_t		length;
+	int			counts[3];
+	bool		fliptest;
+	fourwinding_t	foursource, fourpass;
+	ALIGN16 vec_t	sourcedists[MAX_POINTS_ON_WINDING] ALIGN16_POST;
+	ALIGN16 vec_t	passdists[MAX_POINTS_ON_WINDING] ALIGN16_POST;
+
+	LoadFourWinding (source, &foursource);
+	LoadFourWinding (pass, &fourpass);
+
+	numplanes = 0;
+	numcandidates = source->numpoints * pass->numpoints;
+
+// check all combinations	
+	for (candidate = *next ; candidate<numcandidates ; candidate++)
+	{
+		if (numplanes == maxplanes)
+		{
+			*next = candidate;
+			return numplanes;
+		}
+
+		i = candidate / pass->numpoints;
+		j = candidate % pass->numpoints;
+		l = (i+1)%source->numpoints;
+		VectorSubtract (source->points[l] , source->points[i], v1);
+
+	// fing a vertex of pass that makes a plane that puts all of the
+	// vertexes of pass on the front side and all of the vertexes of
+	// source on the back side
+		VectorSubtract (pass->points[j], source->points[i], v2);
+
+		plane.normal[0] = v1[1]*v2[2] - v1[2]*v2[1];
+		plane.normal[1] = v1[2]*v2[0] - v1[0]*v2[2];
+		plane.normal[2] = v1[0]*v2[1] - v1[1]*v2[0];
+			
+	// if points don't make a valid plane, skip it
+
+		length = plane.normal[0] * plane.normal[0]
+		+ plane.normal[1] * plane.normal[1]
+		+ plane.normal[2] * plane.normal[2];
+			
+		if (length < ON_VIS_EPSILON)
+			continue;
+
+		length = 1/sqrt(length);
+			
+		plane.normal[0] *= length;
+		plane.normal[1] *= length;
+		plane.normal[2] *= length;
+
+		plane.dist = DotProduct (pass->points[j], plane.normal);
+
+	//
+	// find out which side of the generated seperating plane has the
+	// source portal
+	//
+		WindingPlaneDists (&foursource, &plane, sourcedists);
+
+		fliptest = false;
+		for (k=0 ; k<source->numpoints ; k++)
+		{
+			if (k == i || k == l)
+				continue;
+			d = sourcedists[k];
+			if (d < -ON_VIS_EPSILON)
+			{	// source is on the negative side, so we want all
+				// pass and target on the positive side
+				fliptest = false;
+				break;
+			}
+			else if (d > ON_VIS_EPSILON)
+			{	// source is on the positive side, so we want all
+				// pass and target on the negative side
+				fliptest = true;
+				break;
+			}
+		}
+		if (k == source->numpoints)
+			continue;		// planar with source portal
+
+	//
+	// if all of the pass portal points are on the positive side of the
+	// (possibly flipped) plane, this is the seperating plane. Negating the
+	// distances is exact, so they're measured against the unflipped plane.
+	//
+		WindingPlaneDists (&fourpass, &plane, passdists);
+
+	//
+	// flip the normal if the source portal is backwards
+	//
+		if (fliptest)
+		{
+			VectorSubtract (vec3_origin, plane.normal, plane.normal);
+			plane.dist = -plane.dist;
+		}
+
+		counts[0] = counts[1] = counts[2] = 0;
+		for (k=0 ; k<pass->numpoints ; k++)
+		{
+			if (k==j)
+				continue;
+			d = fliptest ? -passdists[k] : passdists[k];
+			if (d < -ON_VIS_EPSILON)
+				break;
+			else if (d > ON_VIS_EPSILON)
+				counts[0]++;
+			else
+				counts[2]++;
+		}
+		if (k != pass->numpoints)
+			continue;	// points on negative side, not a seperating plane
+			
+		if (!counts[0])
+			continue;	// planar with seperating plane
+
+	//
+	// flip the normal if we want the back side
+	//
+		if (flipclip)
+		{
+			VectorSubtract (vec3_origin, plane.normal, plane.normal);
+			plane.dist = -plane.dist;
+		}
+
+		planes[numplanes++] = plane;
+	}
+
+	*next = -1;
+	return numplanes;
+}
+
+/*
+==============
+ClipToPlanes
+
+Clips target by each plane in order. The target's structure of arrays copy
+is kept until a plane actually cuts it, which most of them don't.
+==============
+*/
+static winding_t *ClipToPlanes (winding_t *target, const plane_t *planes, int numplanes, pstack_t *stack)
+{
+	int				i;
+	bool			loaded;
+	winding_t		*clipped;
+	fourwinding_t	four;
+	ALIGN16 vec_t	dists[128] ALIGN16_POST;
+
+	loaded = false;
+	for (i=0 ; i<numplanes ; i++)
+	{
+		if (!loaded)
+		{
+			LoadFourWinding (target, &four);
+			loaded = true;
+		}
+
+		WindingPlaneDists (&four, &planes[i], dists);
+		clipped = ChopWindingByDists (target, stack, &planes[i], dists);
+		if (!clipped)
+			return NULL;
+
+		if (clipped != target)
+		{
+			target = clipped;
+			loaded = false;
+		}
+	}
+
+	return target;
+}
+
+/*
+==============
+ClipToCachedSeperators
+
+ClipToSeperators using FindSeperators and ClipToPlanes. Target is clipped by
+the same planes in the same order.
+
+The planes only depend on source and pass, so when the caller passes a cache
+they're kept for the next target clipped with the same two windings.
+==============
+*/
+static winding_t *ClipToCachedSeperators (winding_t *source, winding_t *pass, winding_t *target, bool flipclip, pstack_t *stack, separatorcache_t *cache)
+{
+	int			next, numplanes;
+	plane_t		planes[MAX_SEPARATOR_PLANES];
+
+	if (cache && cache->source == source && cache->pass == pass)
+		return ClipToPlanes (target, cache->planes, cache->numplanes, stack);
+
+	next = 0;
+	numplanes = FindSeperators (source, pass, flipclip, &next, planes, MAX_SEPARATOR_PLANES);
+
+	if (cache && next < 0)
+	{
+		cache->source = source;
+		cache->pass = pass;
+		cache->numplanes = numplanes;
+		memcpy (cache->planes, planes, numplanes * sizeof(plane_t));
+	}
+
+	while (1)
+	{
+		target = ClipToPlanes (target, planes, numplanes, stack);
+		if (!target || next < 0)
+			return target;
+
+		numplanes = FindSeperators (source, pass, flipclip, &next, planes, MAX_SEPARATOR_PLANES);
+	}
+}
+
 /*
 ==============
 ClipToSeperators
@@ -484,12 +907,16 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	int			i, j;
 	long		*test, *might, *vis, more;
 	int			pnum;
+	separatorcache_t	separators[2];
+	bool		cacheable;
 
 	// Early-out if we're a VMPI worker that's told to exit. If we don't do this here, then the
 	// worker might spin its wheels for a while on an expensive work unit and not be available to the pool.
 	// This is pretty common in vis.
+#ifdef MPI
 	if ( g_bVMPIEarlyExit )
 		return;
+#endif
 
 	if ( leafnum == g_TraceClusterStop )
 	{
@@ -508,6 +935,9 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 
 	might = (long *)stack.mightsee;
 	vis = (long *)thread->base->portalvis;
+
+	separators[0].source = separators[1].source = NULL;
+	separators[0].pass = separators[1].pass = NULL;
 	
 	// check all portals for flowing into other leafs	
 	for (i=0 ; i<leaf->portals.Count() ; i++)
@@ -600,13 +1030,30 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 			continue;
 		}
 
-		stack.pass = ClipToSeperators (stack.source, prevstack->pass, stack.pass, false, &stack);
-		if (!stack.pass)
-			continue;
-		
-		stack.pass = ClipToSeperators (prevstack->pass, stack.source, stack.pass, true, &stack);
-		if (!stack.pass)
-			continue;
+		// an unchopped source is the same for every portal in this leaf,
+		// so the seperating planes can be shared between them
+		cacheable = (stack.source == prevstack->source);
+
+		if (g_bSIMDClip)
+		{
+			stack.pass = ClipToCachedSeperators (stack.source, prevstack->pass, stack.pass, false, &stack, cacheable ? &separators[0] : NULL);
+			if (!stack.pass)
+				continue;
+
+			stack.pass = ClipToCachedSeperators (prevstack->pass, stack.source, stack.pass, true, &stack, cacheable ? &separators[1] : NULL);
+			if (!stack.pass)
+				continue;
+		}
+		else
+		{
+			stack.pass = ClipToSeperators (stack.source, prevstack->pass, stack.pass, false, &stack);
+			if (!stack.pass)
+				continue;
+			
+			stack.pass = ClipToSeperators (prevstack->pass, stack.source, stack.pass, true, &stack);
+			if (!stack.pass)
+				continue;
+		}
 
 		// mark the portal as visible
 		SetBit( thread->base->portalvis, pnum );
@@ -632,6 +1079,11 @@ void PortalFlow (int iThread, int portalnum)
 	int				c_might, c_can;
 
 	p = sorted_portals[portalnum];
+
+	// already filled in from the vis cache
+	if ( p->status == stat_done )
+		return;
+
 	p->status = stat_working;
 				
 	c_might = CountBits (p->portalflood, g_numportals*2);
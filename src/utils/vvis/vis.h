@@ -115,6 +115,15 @@ void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
 void WritePortalTrace( const char *source );
 
+extern bool g_bSIMDClip;
+
+extern bool g_bIncrementalVis;
+extern float g_flIncrementalVisLimit;
+
+void LoadVisCache( const char *pSource );
+void ReuseCachedPortalVis();
+void SaveVisCache( const char *pSource );
+
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
 extern int g_TraceClusterStart, g_TraceClusterStop;
 
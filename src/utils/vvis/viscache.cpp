@@ -0,0 +1,494 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Incremental vis. Keeps the final portalvis bits from the last
+//			compile next to the .bsp and reuses them for every portal whose
+//			flow could not have changed.
+//
+//			Portal numbering isn't stable between vbsp runs, so portals are
+//			matched up by a hash of their winding. A portal's result can be
+//			reused when it matched, the portals in the leaf it flows into
+//			are the same set as before, every portal in its mightsee set
+//			passes the same test and the mightsee set itself is the same.
+//			RecursiveLeafFlow never looks outside of that set, so nothing
+//			else can have affected the result.
+//
+//=============================================================================//
+
+#include "vis.h"
+#include "tier1/utlbuffer.h"
+#include "filesystem.h"
+
+
+#define VISCACHE_ID			(('C'<<24)+('S'<<16)+('I'<<8)+'V')
+#define VISCACHE_VERSION	1
+
+bool		g_bIncrementalVis = false;
+float		g_flIncrementalVisLimit = 0.5f;		// reflow everything if more than this fraction of the portals changed
+
+struct viscacheheader_t
+{
+	int		id;
+	int		version;
+	int		numportals;			// memory portals, so twice the portal file count
+	int		useradius;
+	double	visradius;
+};
+
+struct viscacheportal_t
+{
+	uint64	geometry;
+	uint64	neighbors;
+	uint64	mightsee;
+	int		nummightsee;
+	int		visofs;				// into the compressed portalvis data
+};
+
+static CUtlVector<viscacheportal_t>	s_OldPortals;
+static CUtlVector<byte>				s_OldVis;
+
+static CUtlVector<uint64>	s_GeometryKeys;
+static CUtlVector<uint64>	s_NeighborKeys;
+static CUtlVector<int>		s_NewToOld;
+static CUtlVector<int>		s_OldToNew;
+
+
+//-----------------------------------------------------------------------------
+// 64 bit hashing, a 32 bit key collides far too often with 100k portals
+//-----------------------------------------------------------------------------
+static uint64 HashBytes( uint64 hash, const void *pData, int nBytes )
+{
+	const byte *p = (const byte *)pData;
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Spread a key out before summing it into an order independent set hash
+static uint64 MixKey( uint64 key )
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return key;
+}
+
+static uint64 PortalGeometryKey( portal_t *p )
+{
+	// Point order is part of the key, which keeps the two sides of a
+	// file portal apart since the back side has its winding reversed.
+	winding_t *w = p->winding;
+	uint64 hash = HashBytes( 0xcbf29ce484222325ull, &w->numpoints, sizeof( w->numpoints ) );
+	return HashBytes( hash, w->points, w->numpoints * sizeof( Vector ) );
+}
+
+static uint64 PortalMightSeeKey( portal_t *p )
+{
+	uint64 hash = 0;
+	for ( int i = 0; i < g_numportals*2; i++ )
+	{
+		if ( CheckBit( p->portalflood, i ) )
+		{
+			hash += MixKey( s_GeometryKeys[i] );
+		}
+	}
+	return hash;
+}
+
+static void GetVisCacheFileName( const char *pSource, char *pOut, int nOutSize )
+{
+	V_snprintf( pOut, nOutSize, "%s.viscache", pSource );
+}
+
+
+//-----------------------------------------------------------------------------
+// Zero run length coding like CompressVis, but over portal bit vectors
+//-----------------------------------------------------------------------------
+static void CompressPortalBits( const byte *pBits, CUtlBuffer &buf )
+{
+	for ( int j = 0; j < portalbytes; j++ )
+	{
+		buf.PutUnsignedChar( pBits[j] );
+		if ( pBits[j] )
+			continue;
+
+		int rep = 1;
+		for ( j++; j < portalbytes; j++ )
+		{
+			if ( pBits[j] || rep == 255 )
+				break;
+			rep++;
+		}
+		buf.PutUnsignedChar( rep );
+		j--;
+	}
+}
+
+// Decompresses cached bits into the new portal numbering. Returns false if a
+// visible portal has no match in this compile.
+static bool DecompressPortalBits( const byte *pIn, const byte *pInEnd, int nOldPortals, byte *pOut )
+{
+	int nOldBytes = ((nOldPortals+63)&~63)>>3;
+	int nByte = 0;
+	while ( nByte < nOldBytes )
+	{
+		if ( pIn >= pInEnd )
+			return false;
+
+		byte bits = *pIn++;
+		if ( !bits )
+		{
+			if ( pIn >= pInEnd )
+				return false;
+			nByte += *pIn++;
+			continue;
+		}
+
+		for ( int k = 0; k < 8; k++ )
+		{
+			if ( !( bits & ( 1 << k ) ) )
+				continue;
+
+			int nOld = nByte * 8 + k;
+			if ( nOld >= nOldPortals || s_OldToNew[nOld] < 0 )
+				return false;
+
+			SetBit( pOut, s_OldToNew[nOld] );
+		}
+		nByte++;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Computes the keys for the portals that were just loaded
+//-----------------------------------------------------------------------------
+static void ComputePortalKeys()
+{
+	int nPortals = g_numportals*2;
+
+	s_GeometryKeys.SetCount( nPortals );
+	s_NeighborKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		s_GeometryKeys[i] = PortalGeometryKey( &portals[i] );
+	}
+
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		leaf_t *leaf = &leafs[portals[i].leaf];
+
+		uint64 hash = 0;
+		for ( int j = 0; j < leaf->portals.Count(); j++ )
+		{
+			hash += MixKey( s_GeometryKeys[ leaf->portals[j] - portals ] );
+		}
+		s_NeighborKeys[i] = hash;
+	}
+}
+
+struct portalkey_t
+{
+	uint64	key;
+	int		index;
+};
+
+static int PortalKeyCompare( const void *a, const void *b )
+{
+	uint64 keyA = ((const portalkey_t *)a)->key;
+	uint64 keyB = ((const portalkey_t *)b)->key;
+	if ( keyA < keyB )
+		return -1;
+	return ( keyA > keyB ) ? 1 : 0;
+}
+
+static void SortPortalKeys( CUtlVector<portalkey_t> &keys )
+{
+	qsort( keys.Base(), keys.Count(), sizeof( portalkey_t ), PortalKeyCompare );
+
+	// Duplicated geometry can't be matched reliably, so leave it unmatched
+	for ( int i = 0; i < keys.Count(); )
+	{
+		int j = i + 1;
+		while ( j < keys.Count() && keys[j].key == keys[i].key )
+			j++;
+
+		if ( j - i > 1 )
+		{
+			for ( int k = i; k < j; k++ )
+				keys[k].index = -1;
+		}
+		i = j;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Matches the old portals to the new ones by geometry
+//-----------------------------------------------------------------------------
+static int MatchPortals()
+{
+	int nPortals = g_numportals*2;
+	int nOldPortals = s_OldPortals.Count();
+
+	CUtlVector<portalkey_t> newKeys, oldKeys;
+	newKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		newKeys[i].key = s_GeometryKeys[i];
+		newKeys[i].index = i;
+	}
+	oldKeys.SetCount( nOldPortals );
+	for ( int i = 0; i < nOldPortals; i++ )
+	{
+		oldKeys[i].key = s_OldPortals[i].geometry;
+		oldKeys[i].index = i;
+	}
+	SortPortalKeys( newKeys );
+	SortPortalKeys( oldKeys );
+
+	s_NewToOld.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+		s_NewToOld[i] = -1;
+	s_OldToNew.SetCount( nOldPortals );
+	for ( int i = 0; i < nOldPortals; i++ )
+		s_OldToNew[i] = -1;
+
+	int nMatched = 0;
+	int iNew = 0, iOld = 0;
+	while ( iNew < nPortals && iOld < nOldPortals )
+	{
+		if ( newKeys[iNew].key < oldKeys[iOld].key )
+		{
+			iNew++;
+		}
+		else if ( newKeys[iNew].key > oldKeys[iOld].key )
+		{
+			iOld++;
+		}
+		else
+		{
+			if ( newKeys[iNew].index >= 0 && oldKeys[iOld].index >= 0 )
+			{
+				s_NewToOld[ newKeys[iNew].index ] = oldKeys[iOld].index;
+				s_OldToNew[ oldKeys[iOld].index ] = newKeys[iNew].index;
+				nMatched++;
+			}
+			iNew++;
+			iOld++;
+		}
+	}
+	return nMatched;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the cache from the previous compile, if there is a usable one
+//-----------------------------------------------------------------------------
+void LoadVisCache( const char *pSource )
+{
+	s_OldPortals.Purge();
+	s_OldVis.Purge();
+
+	char szFileName[MAX_PATH];
+	GetVisCacheFileName( pSource, szFileName, sizeof( szFileName ) );
+
+	CUtlBuffer buf;
+	if ( !g_pFileSystem->ReadFile( szFileName, NULL, buf ) )
+	{
+		Msg( "No vis cache (%s), doing a full vis\n", szFileName );
+		return;
+	}
+
+	viscacheheader_t header;
+	buf.Get( &header, sizeof( header ) );
+	if ( !buf.IsValid() || header.id != VISCACHE_ID || header.version != VISCACHE_VERSION )
+	{
+		Warning( "%s is not a valid vis cache, doing a full vis\n", szFileName );
+		return;
+	}
+
+	if ( ( header.useradius != 0 ) != g_bUseRadius || ( g_bUseRadius && header.visradius != g_VisRadius ) )
+	{
+		Msg( "Vis radius changed since the last compile, doing a full vis\n" );
+		return;
+	}
+
+	if ( header.numportals <= 0 || header.numportals >= MAX_PORTALS )
+	{
+		Warning( "%s is corrupt, doing a full vis\n", szFileName );
+		return;
+	}
+
+	s_OldPortals.SetCount( header.numportals );
+	buf.Get( s_OldPortals.Base(), header.numportals * sizeof( viscacheportal_t ) );
+
+	int nVisBytes = buf.TellPut() - buf.TellGet();
+	if ( !buf.IsValid() || nVisBytes < 0 )
+	{
+		Warning( "%s is truncated, doing a full vis\n", szFileName );
+		s_OldPortals.Purge();
+		return;
+	}
+
+	s_OldVis.SetCount( nVisBytes );
+	buf.Get( s_OldVis.Base(), nVisBytes );
+
+	for ( int i = 0; i < header.numportals; i++ )
+	{
+		if ( s_OldPortals[i].visofs < 0 || s_OldPortals[i].visofs > nVisBytes )
+		{
+			Warning( "%s is corrupt, doing a full vis\n", szFileName );
+			s_OldPortals.Purge();
+			s_OldVis.Purge();
+			return;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Marks every portal whose cached portalvis is still exact as done.
+//			Must run after BasePortalVis, since the mightsee sets decide it.
+//-----------------------------------------------------------------------------
+void ReuseCachedPortalVis()
+{
+	int nPortals = g_numportals*2;
+
+	ComputePortalKeys();
+	if ( !s_OldPortals.Count() )
+		return;
+
+	double start = Plat_FloatTime();
+
+	int nMatched = MatchPortals();
+
+	// A portal is stable if its geometry and the portals it flows into
+	// are unchanged
+	byte *stable = (byte *)malloc( portalbytes );
+	memset( stable, 0, portalbytes );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		int iOld = s_NewToOld[i];
+		if ( iOld >= 0 && s_OldPortals[iOld].neighbors == s_NeighborKeys[i] )
+		{
+			SetBit( stable, i );
+		}
+	}
+
+	CUtlVector<portal_t *> reusable;
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		portal_t *p = &portals[i];
+		if ( !CheckBit( stable, i ) )
+			continue;
+
+		const viscacheportal_t &old = s_OldPortals[ s_NewToOld[i] ];
+		if ( old.nummightsee != p->nummightsee )
+			continue;
+
+		// Everything this portal might see has to be stable as well
+		int j;
+		for ( j = 0; j < portallongs; j++ )
+		{
+			if ( ((long *)p->portalflood)[j] & ~((long *)stable)[j] )
+				break;
+		}
+		if ( j != portallongs )
+			continue;
+
+		if ( old.mightsee != PortalMightSeeKey( p ) )
+			continue;
+
+		reusable.AddToTail( p );
+	}
+
+	free( stable );
+
+	int nReflow = nPortals - reusable.Count();
+	Msg( "Vis cache: %d of %d portals matched, %d need to be flowed\n", nMatched, nPortals, nReflow );
+
+	if ( nReflow > nPortals * g_flIncrementalVisLimit )
+	{
+		Msg( "Too much changed since the last compile, doing a full vis\n" );
+		return;
+	}
+
+	int nReused = 0;
+	const byte *pVisEnd = s_OldVis.Base() + s_OldVis.Count();
+	for ( int i = 0; i < reusable.Count(); i++ )
+	{
+		portal_t *p = reusable[i];
+		const viscacheportal_t &old = s_OldPortals[ s_NewToOld[ p - portals ] ];
+
+		if ( !DecompressPortalBits( s_OldVis.Base() + old.visofs, pVisEnd, s_OldPortals.Count(), p->portalvis ) )
+		{
+			memset( p->portalvis, 0, portalbytes );
+			continue;
+		}
+
+		p->status = stat_done;
+		nReused++;
+	}
+
+	Msg( "Vis cache: reused %d portals (%.2f seconds)\n", nReused, Plat_FloatTime() - start );
+
+	s_OldPortals.Purge();
+	s_OldVis.Purge();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the portal keys and final portalvis bits for the next compile
+//-----------------------------------------------------------------------------
+void SaveVisCache( const char *pSource )
+{
+	int nPortals = g_numportals*2;
+
+	if ( s_GeometryKeys.Count() != nPortals )
+	{
+		ComputePortalKeys();
+	}
+
+	viscacheheader_t header;
+	header.id = VISCACHE_ID;
+	header.version = VISCACHE_VERSION;
+	header.numportals = nPortals;
+	header.useradius = g_bUseRadius;
+	header.visradius = g_bUseRadius ? g_VisRadius : 0.0;
+
+	CUtlBuffer visBuf;
+	CUtlVector<viscacheportal_t> cachePortals;
+	cachePortals.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		portal_t *p = &portals[i];
+		viscacheportal_t &out = cachePortals[i];
+
+		out.geometry = s_GeometryKeys[i];
+		out.neighbors = s_NeighborKeys[i];
+		out.mightsee = PortalMightSeeKey( p );
+		out.nummightsee = p->nummightsee;
+		out.visofs = visBuf.TellPut();
+
+		CompressPortalBits( p->portalvis, visBuf );
+	}
+
+	CUtlBuffer buf;
+	buf.Put( &header, sizeof( header ) );
+	buf.Put( cachePortals.Base(), nPortals * sizeof( viscacheportal_t ) );
+	buf.Put( visBuf.Base(), visBuf.TellPut() );
+
+	char szFileName[MAX_PATH];
+	GetVisCacheFileName( pSource, szFileName, sizeof( szFileName ) );
+
+	Msg( "writing %s\n", szFileName );
+	if ( !g_pFileSystem->WriteFile( szFileName, NULL, buf ) )
+	{
+		Warning( "Couldn't write vis cache %s\n", szFileName );
+	}
+}
@@ -7,21 +7,26 @@
 //=============================================================================//
 // vis.c
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include "vis.h"
 #include "threads.h"
 #include "stdlib.h"
 #include "pacifier.h"
+#ifdef MPI
 #include "vmpi.h"
 #include "mpivis.h"
+#include "vmpi_tools_shared.h"
+#endif
 #include "tier1/strtools.h"
 #include "collisionutils.h"
 #include "tier0/icommandline.h"
-#include "vmpi_tools_shared.h"
 #include "ilaunchabledll.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "loopback_distribute.h"
 
 
 int			g_numportals;
@@ -56,6 +61,12 @@ double		g_VisRadius = 4096.0f * 4096.0f;
 
 bool		g_bLowPriority = false;
 
+#ifndef MPI
+// VMPI defines these when it's linked in. Without it, -distribute spreads the work instead.
+bool		g_bUseMPI = false;
+bool		g_bMPIMaster = false;
+#endif
+
 //=============================================================================
 
 void PlaneFromWinding (winding_t *w, plane_t *plane)
@@ -281,6 +292,24 @@ static int CompressAndCrosscheckClusterVis( int clusternum )
 }
 
 
+//-----------------------------------------------------------------------------
+// -distribute work units for the portal flow. Every worker runs BasePortalVis
+// itself, so only the flowed portalvis bits have to come back.
+//-----------------------------------------------------------------------------
+static void DistributeProcessPortalFlow( int iThread, int iPortal, CUtlBuffer &buf )
+{
+	PortalFlow( iThread, iPortal );
+	buf.Put( sorted_portals[iPortal]->portalvis, portalbytes );
+}
+
+static void DistributeReceivePortalFlow( int iPortal, CUtlBuffer &buf, int iWorker )
+{
+	portal_t *p = sorted_portals[iPortal];
+	buf.Get( p->portalvis, portalbytes );
+	p->status = stat_done;
+}
+
+
 /*
 ==================
 CalcPortalVis
@@ -302,10 +331,17 @@ void CalcPortalVis (void)
 	}
 
 
+#ifdef MPI
     if (g_bUseMPI) 
 	{
  		RunMPIPortalFlow();
 	}
+	else
+#endif
+	if ( g_bDistribute )
+	{
+		Distribute_Work( "PortalFlow:", g_numportals*2, DistributeProcessPortalFlow, DistributeReceivePortalFlow );
+	}
 	else 
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
@@ -331,19 +367,29 @@ void CalcVis (void)
 {
 	int		i;
 
+#ifdef MPI
 	if (g_bUseMPI) 
 	{
 		RunMPIBasePortalVis();
 	}
 	else 
+#endif
 	{
 	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
 	}
 
 	SortPortals ();
 
+	if ( g_bIncrementalVis )
+	{
+		ReuseCachedPortalVis();
+	}
+
 	CalcPortalVis ();
 
+	// -distribute workers are only here for the portal flow.
+	Distribute_WorkerFinished();
+
 	//
 	// assemble the leaf vis lists by oring the portal lists
 	//
@@ -414,6 +460,7 @@ void LoadPortals (char *name)
 	FILE *f;
 
 	// Open the portal file.
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		// If we're using MPI, copy off the file to a temporary first. This will download the file
@@ -448,6 +495,7 @@ void LoadPortals (char *name)
 		f = fopen( tempFile, "rSTD" ); // read only, sequential, temporary, delete on close
 	}
 	else
+#endif
 	{
 		f = fopen( name, "r" );
 	}
@@ -942,6 +990,21 @@ int ParseCommandLine( int argc, char **argv )
 			i++;
 			Msg( "Tracing vis from cluster %d to %d\n", g_TraceClusterStart, g_TraceClusterStop );
 		}
+		else if (!Q_stricmp (argv[i],"-nosimdclip"))
+		{
+			Msg ("simd clipping = false\n");
+			g_bSIMDClip = false;
+		}
+		else if (!Q_stricmp (argv[i],"-incremental"))
+		{
+			Msg ("incremental = true\n");
+			g_bIncrementalVis = true;
+		}
+		else if (!Q_stricmp (argv[i],"-incremental_limit"))
+		{
+			g_flIncrementalVisLimit = atof( argv[i+1] );
+			i++;
+		}
 		else if (!Q_stricmp (argv[i],"-nosort"))
 		{
 			Msg ("nosort = true\n");
@@ -968,6 +1031,11 @@ int ParseCommandLine( int argc, char **argv )
 		{
 			// nothing to do here, but don't bail on this option
 		}
+		else if ( Distribute_ParseArg( argc, argv, i ) )
+		{
+			// -distribute and its options.
+		}
+#ifdef MPI
 		// NOTE: the -mpi checks must come last here because they allow the previous argument 
 		// to be -mpi as well. If it game before something else like -game, then if the previous
 		// argument was -mpi and the current argument was something valid like -game, it would skip it.
@@ -980,6 +1048,7 @@ int ParseCommandLine( int argc, char **argv )
 			if ( i == argc - 1 )
 				break;
 		}
+#endif
 		else if (argv[i][0] == '-')
 		{
 			Warning("VBSP: Unknown option \"%s\"\n\n", argv[i]);
@@ -1016,7 +1085,10 @@ void PrintUsage( int argc, char **argv )
 		"\n"
 		"  -v (or -verbose): Turn on verbose output (also shows more command\n"
 		"  -fast           : Only do first quick pass on vis calculations.\n"
+#ifdef MPI
 		"  -mpi            : Use VMPI to distribute computations.\n"
+#endif
+		"  -distribute <n> : Run the portal flow on <n> worker processes on this machine.\n"
 		"  -low            : Run as an idle-priority process.\n"
 		"                    env_fog_controller specifies one.\n"
 		"\n"
@@ -1026,10 +1098,21 @@ void PrintUsage( int argc, char **argv )
 		"Other options:\n"
 		"  -novconfig      : Don't bring up graphical UI on vproject errors.\n"
 		"  -radius_override: Force a vis radius, regardless of whether an\n"
+#ifdef MPI
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
+#endif
+		"  -distributeport <port>      : Loopback port for -distribute (default: any free port).\n"
+		"  -distributetimeout <seconds>: Hand a work unit to another worker after this long (default: 300).\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -nosimdclip     : Clip portals with the original scalar code and no seperator\n"
+		"                    cache. The output should be identical;\n"
+		"                    devtools\\bin\\comparecompile.pl checks that it is.\n"
+		"  -incremental    : Reuse the portal flow from the last compile (<mapname>.viscache)\n"
+		"                    for every portal whose surroundings didn't change.\n"
+		"  -incremental_limit <fraction> : Do a full vis when more than this fraction of\n"
+		"                    the portals has to be flowed again (default 0.5).\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1109,8 +1192,13 @@ int RunVVis( int argc, char **argv )
 
 	start = Plat_FloatTime();
 
+	if ( fastvis || g_bUseMPI || g_TraceClusterStart >= 0 )
+	{
+		Distribute_Disable( "with -fast, -mpi and -trace" );
+	}
+	Distribute_Init( argc, argv );
 
-	if (!g_bUseMPI)
+	if ( !g_bUseMPI && !Distribute_IsWorker() )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -1162,10 +1250,27 @@ int RunVVis( int argc, char **argv )
 	Msg ("reading %s\n", portalfile);
 	LoadPortals (portalfile);
 
+	if ( g_bIncrementalVis && ( fastvis || g_bUseMPI || g_bDistribute || g_TraceClusterStart >= 0 ) )
+	{
+		Warning( "-incremental is ignored with -fast, -mpi, -distribute and -trace\n" );
+		g_bIncrementalVis = false;
+	}
+
+	if ( g_bIncrementalVis )
+	{
+		LoadVisCache( source );
+	}
+
 	// don't write out results when simply doing a trace
 	if ( g_TraceClusterStart < 0 )
 	{
 		CalcVis ();
+
+		if ( g_bIncrementalVis )
+		{
+			SaveVisCache( source );
+		}
+
 		CalcPAS ();
 
 		// We need a mapping from cluster to leaves, since the PVS
@@ -1221,12 +1326,14 @@ int main (int argc, char **argv)
 	InstallAllocationFunctions();
 	InstallSpewFunction();
 
+#ifdef MPI
 	VVIS_SetupMPI( argc, argv );
 
 	// Install an exception handler.
 	if ( g_bUseMPI && !g_bMPIMaster )
 		SetupToolsMinidumpHandler( VMPI_ExceptionFilter );
 	else
+#endif
 		SetupDefaultToolsMinidumpHandler();
 
 	return RunVVis( argc, argv );